@@ -0,0 +1,23 @@
+#include "audio_capture.h"
+
+static inline int16_t audio_capture_sample(const void *in, size_t i, int in_bytes)
+{
+    if (in_bytes == 2) {
+        return ((const int16_t *)in)[i];
+    }
+    return (int16_t)(((const int32_t *)in)[i] >> 16);
+}
+
+size_t audio_capture_convert(const void *in, size_t frames, int in_bytes, int in_channels,
+                             int16_t *out, int out_channels)
+{
+    for (size_t f = 0; f < frames; f++) {
+        int16_t left = audio_capture_sample(in, f * in_channels, in_bytes);
+        int16_t right = in_channels > 1 ? audio_capture_sample(in, f * in_channels + 1, in_bytes) : left;
+        out[f * out_channels] = left;
+        if (out_channels > 1) {
+            out[f * out_channels + 1] = right;
+        }
+    }
+    return frames * out_channels * sizeof(int16_t);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Capture-side format conversion: I2S RX frames to the 16-bit USB microphone format.
+//
+// RX runs in the same slot layout as TX (full duplex shares the clock), so its frames are
+// 16-bit or MSB-justified 32-bit, mono or stereo, whatever the playback path drives.
+// Stereo to mono keeps the left slot, where a single I2S microphone sits; mono to stereo
+// duplicates it. 32-bit samples are truncated to their top 16 bits, so a sample's value
+// survives the trip unchanged when it fits.
+// tools/loopback_sim.c runs it behind a simulated codec loopback.
+
+// Converts `frames` frames of `in` (`in_bytes` per sample, `in_channels` per frame) to
+// `out_channels` interleaved int16 channels. Returns the number of bytes written to `out`.
+size_t audio_capture_convert(const void *in, size_t frames, int in_bytes, int in_channels,
+                             int16_t *out, int out_channels);
+
+#ifdef __cplusplus
+}
+#endif
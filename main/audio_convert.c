@@ -0,0 +1,109 @@
+#include <string.h>
+#include "audio_convert.h"
+
+#define CONVERT_WIDTHS   (3)    // 2, 3 and 4 bytes
+#define CONVERT_CHANNELS (2)
+
+// One sample, MSB-justified in 32 bits. Packed 24-bit samples go byte by byte, the
+// others are single aligned accesses.
+static inline __attribute__((always_inline)) int32_t convert_load(const uint8_t *p, int bytes)
+{
+    switch (bytes) {
+    case 2:
+        return (int32_t)((uint32_t)*(const uint16_t *)p << 16);
+    case 3:
+        return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+    default:
+        return *(const int32_t *)p;
+    }
+}
+
+static inline __attribute__((always_inline)) void convert_store(uint8_t *p, int bytes, int32_t v)
+{
+    uint32_t u = (uint32_t)v;
+    switch (bytes) {
+    case 2:
+        *(int16_t *)p = (int16_t)(u >> 16);
+        break;
+    case 3:
+        p[0] = (uint8_t)(u >> 8);
+        p[1] = (uint8_t)(u >> 16);
+        p[2] = (uint8_t)(u >> 24);
+        break;
+    default:
+        *(int32_t *)p = v;
+        break;
+    }
+}
+
+// Instantiated once per layout pair with constant arguments, so the switches and channel
+// tests fold away.
+static inline __attribute__((always_inline)) void convert_frames(uint8_t *restrict out, const uint8_t *restrict in,
+                                                                 size_t frames, int in_bytes, int in_ch,
+                                                                 int out_bytes, int out_ch)
+{
+    for (size_t i = 0; i < frames; i++) {
+        int32_t l = convert_load(in, in_bytes);
+        int32_t r = in_ch == 2 ? convert_load(in + in_bytes, in_bytes) : l;
+        in += in_bytes * in_ch;
+        if (out_ch == 1) {
+            convert_store(out, out_bytes, in_ch == 2 ? (l >> 1) + (r >> 1) : l);
+        } else {
+            convert_store(out, out_bytes, l);
+            convert_store(out + out_bytes, out_bytes, r);
+        }
+        out += out_bytes * out_ch;
+    }
+}
+
+#define CONVERT_KERNEL(ib, ic, ob, oc)                                                          \
+    static void convert_##ib##x##ic##_##ob##x##oc(void *out, const void *in, size_t frames)     \
+    {                                                                                           \
+        convert_frames(out, in, frames, ib, ic, ob, oc);                                        \
+    }
+
+#define CONVERT_COPY(b, c)                                                                      \
+    static void convert_##b##x##c##_##b##x##c(void *out, const void *in, size_t frames)         \
+    {                                                                                           \
+        memcpy(out, in, frames * (b) * (c));                                                    \
+    }
+
+CONVERT_COPY(2, 1) CONVERT_COPY(2, 2) CONVERT_COPY(3, 1) CONVERT_COPY(3, 2) CONVERT_COPY(4, 1) CONVERT_COPY(4, 2)
+
+CONVERT_KERNEL(2, 1, 3, 1) CONVERT_KERNEL(2, 1, 3, 2) CONVERT_KERNEL(2, 1, 4, 1) CONVERT_KERNEL(2, 1, 4, 2)
+CONVERT_KERNEL(2, 2, 2, 1) CONVERT_KERNEL(2, 2, 3, 1) CONVERT_KERNEL(2, 2, 3, 2) CONVERT_KERNEL(2, 2, 4, 1) CONVERT_KERNEL(2, 2, 4, 2)
+CONVERT_KERNEL(3, 1, 2, 1) CONVERT_KERNEL(3, 1, 2, 2) CONVERT_KERNEL(3, 1, 3, 2) CONVERT_KERNEL(3, 1, 4, 1) CONVERT_KERNEL(3, 1, 4, 2)
+CONVERT_KERNEL(3, 2, 2, 1) CONVERT_KERNEL(3, 2, 2, 2) CONVERT_KERNEL(3, 2, 3, 1) CONVERT_KERNEL(3, 2, 4, 1) CONVERT_KERNEL(3, 2, 4, 2)
+CONVERT_KERNEL(4, 1, 2, 1) CONVERT_KERNEL(4, 1, 2, 2) CONVERT_KERNEL(4, 1, 3, 1) CONVERT_KERNEL(4, 1, 3, 2) CONVERT_KERNEL(4, 1, 4, 2)
+CONVERT_KERNEL(4, 2, 2, 1) CONVERT_KERNEL(4, 2, 2, 2) CONVERT_KERNEL(4, 2, 3, 1) CONVERT_KERNEL(4, 2, 3, 2) CONVERT_KERNEL(4, 2, 4, 1)
+
+// 16-bit mono to stereo is the most common conversion on the I2S path (mono speaker into
+// stereo slots): one 32-bit store per frame.
+static void convert_2x1_2x2(void *out, const void *in, size_t frames)
+{
+    const uint16_t *src = in;
+    uint32_t *dst = out;
+    for (size_t i = 0; i < frames; i++) {
+        dst[i] = (uint32_t)src[i] * 0x00010001u;
+    }
+}
+
+#define CONVERT_ROW(ib, ic)                                                                     \
+    { convert_##ib##x##ic##_2x1, convert_##ib##x##ic##_2x2 },                                   \
+    { convert_##ib##x##ic##_3x1, convert_##ib##x##ic##_3x2 },                                   \
+    { convert_##ib##x##ic##_4x1, convert_##ib##x##ic##_4x2 }
+
+static const audio_convert_fn_t s_kernels[CONVERT_WIDTHS][CONVERT_CHANNELS][CONVERT_WIDTHS][CONVERT_CHANNELS] = {
+    { { CONVERT_ROW(2, 1) }, { CONVERT_ROW(2, 2) } },
+    { { CONVERT_ROW(3, 1) }, { CONVERT_ROW(3, 2) } },
+    { { CONVERT_ROW(4, 1) }, { CONVERT_ROW(4, 2) } },
+};
+
+audio_convert_fn_t audio_convert_select(int in_bytes, int in_channels, int out_bytes, int out_channels)
+{
+    if (in_bytes < 2 || in_bytes > 4 || out_bytes < 2 || out_bytes > 4 ||
+            in_channels < 1 || in_channels > 2 || out_channels < 1 || out_channels > 2) {
+        return NULL;
+    }
+    return s_kernels[in_bytes - 2][in_channels - 1][out_bytes - 2][out_channels - 1];
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Block conversion between PCM sample layouts and channel counts.
+//
+// Samples are 2 (int16), 3 (packed 24-bit) or 4 bytes (MSB-justified in 32 bits, the
+// way USB and the I2S 32-bit slot carry 24-bit audio), little endian, 1 or 2 channels
+// interleaved. Widening pads with zeros, narrowing truncates. Mono is duplicated to
+// both channels, stereo is averaged down to mono.
+//
+// Every combination has its own kernel with the layout folded in at compile time, so
+// the inner loop is straight loads, shifts and stores; audio_convert_select() picks one
+// when a stream is set up. Matching layouts get a plain copy.
+// tools/convert_bench.c checks every kernel bit for bit and times it.
+
+// Converts `frames` frames from `in` to `out`. The buffers must not overlap, and 16- and
+// 32-bit buffers must be aligned to their sample size.
+typedef void (*audio_convert_fn_t)(void *out, const void *in, size_t frames);
+
+// The kernel for one conversion, NULL if either layout is unsupported.
+audio_convert_fn_t audio_convert_select(int in_bytes, int in_channels, int out_bytes, int out_channels);
+
+#ifdef __cplusplus
+}
+#endif
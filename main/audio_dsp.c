@@ -0,0 +1,349 @@
+#include <math.h>
+#include <string.h>
+#include "audio_dsp.h"
+
+#define DSP_COEF_SHIFT   (28)
+#define DSP_GAIN_SHIFT   (28)
+#define DSP_LIM_SHIFT    (30)
+#define DSP_FULL_SCALE   (1 << 27)    // Internal full scale, 4 bits of headroom
+#define DSP_S16_SHIFT    (27 - 15)
+#define DSP_S32_SHIFT    (31 - 27)
+#define DSP_RELEASE_SHIFT (10)        // Limiter release, roughly 20 ms at 48 kHz
+#define DSP_VOLUME_MAX_DB (12.0f)
+
+static inline int32_t dsp_sat32(int64_t v)
+{
+    return v > INT32_MAX ? INT32_MAX : (v < INT32_MIN ? INT32_MIN : (int32_t)v);
+}
+
+static inline int32_t dsp_to_q28(double v)
+{
+    return (int32_t)lrint(v * (1 << DSP_COEF_SHIFT));
+}
+
+void audio_dsp_default_params(audio_dsp_params_t *params)
+{
+    memset(params, 0, sizeof(*params));
+    params->volume_db = 0.0f;
+    params->mute = false;
+    params->limiter = true;
+    params->limit_dbfs = -0.3f;
+}
+
+void audio_dsp_init(audio_dsp_t *dsp, uint32_t sample_rate, int channels)
+{
+    memset(dsp, 0, sizeof(*dsp));
+    dsp->sample_rate = sample_rate;
+    dsp->channels = channels > AUDIO_DSP_MAX_CH ? AUDIO_DSP_MAX_CH : channels;
+    dsp->gain = 0; // Streams start silent and ramp up to the configured gain
+    dsp->gain_max_step = (int32_t)((1 << DSP_GAIN_SHIFT) / (sample_rate * AUDIO_DSP_RAMP_MS / 1000));
+    if (dsp->gain_max_step == 0) {
+        dsp->gain_max_step = 1;
+    }
+    dsp->lookahead = (int)(sample_rate * AUDIO_DSP_LOOKAHEAD_MS / 1000);
+    if (dsp->lookahead > AUDIO_DSP_LOOKAHEAD_MAX) {
+        dsp->lookahead = AUDIO_DSP_LOOKAHEAD_MAX;
+    }
+    dsp->lim_gain = 1 << DSP_LIM_SHIFT;
+    dsp->lim_target = 1 << DSP_LIM_SHIFT;
+    dsp->fade = 1 << DSP_GAIN_SHIFT;
+    dsp->fade_target = 1 << DSP_GAIN_SHIFT;
+}
+
+void audio_dsp_fade(audio_dsp_t *dsp, bool in, uint32_t ms)
+{
+    if (in) {
+        dsp->fade = 0;
+    }
+    dsp->fade_target = in ? 1 << DSP_GAIN_SHIFT : 0;
+    uint32_t frames = dsp->sample_rate * ms / 1000;
+    if (frames == 0) {
+        dsp->fade = dsp->fade_target;
+        return;
+    }
+    dsp->fade_step = (int32_t)((1 << DSP_GAIN_SHIFT) / frames);
+    if (dsp->fade_step == 0) {
+        dsp->fade_step = 1;
+    }
+}
+
+bool audio_dsp_faded_out(const audio_dsp_t *dsp)
+{
+    return dsp->fade == 0 && dsp->fade_target == 0;
+}
+
+static void audio_dsp_design_biquad(const audio_dsp_eq_t *eq, uint32_t sample_rate, audio_dsp_biquad_t *bq)
+{
+    // RBJ audio EQ cookbook
+    double a = pow(10.0, eq->gain_db / 40.0);
+    double w0 = 2.0 * M_PI * eq->freq_hz / sample_rate;
+    double cw = cos(w0);
+    double alpha = sin(w0) / (2.0 * (eq->q > 0.05f ? eq->q : 0.05f));
+    double sa = 2.0 * sqrt(a) * alpha;
+    double b0, b1, b2, a0, a1, a2;
+
+    switch (eq->type) {
+    case AUDIO_DSP_EQ_PEAK:
+        b0 = 1 + alpha * a;  b1 = -2 * cw;  b2 = 1 - alpha * a;
+        a0 = 1 + alpha / a;  a1 = -2 * cw;  a2 = 1 - alpha / a;
+        break;
+    case AUDIO_DSP_EQ_LOWSHELF:
+        b0 = a * ((a + 1) - (a - 1) * cw + sa);
+        b1 = 2 * a * ((a - 1) - (a + 1) * cw);
+        b2 = a * ((a + 1) - (a - 1) * cw - sa);
+        a0 = (a + 1) + (a - 1) * cw + sa;
+        a1 = -2 * ((a - 1) + (a + 1) * cw);
+        a2 = (a + 1) + (a - 1) * cw - sa;
+        break;
+    case AUDIO_DSP_EQ_HIGHSHELF:
+        b0 = a * ((a + 1) + (a - 1) * cw + sa);
+        b1 = -2 * a * ((a - 1) + (a + 1) * cw);
+        b2 = a * ((a + 1) + (a - 1) * cw - sa);
+        a0 = (a + 1) - (a - 1) * cw + sa;
+        a1 = 2 * ((a - 1) - (a + 1) * cw);
+        a2 = (a + 1) - (a - 1) * cw - sa;
+        break;
+    case AUDIO_DSP_EQ_LOWPASS:
+        b0 = (1 - cw) / 2;  b1 = 1 - cw;  b2 = (1 - cw) / 2;
+        a0 = 1 + alpha;     a1 = -2 * cw; a2 = 1 - alpha;
+        break;
+    case AUDIO_DSP_EQ_HIGHPASS:
+        b0 = (1 + cw) / 2;  b1 = -(1 + cw); b2 = (1 + cw) / 2;
+        a0 = 1 + alpha;     a1 = -2 * cw;   a2 = 1 - alpha;
+        break;
+    default:
+        b0 = 1; b1 = b2 = 0; a0 = 1; a1 = a2 = 0;
+        break;
+    }
+
+    bq->b0 = dsp_to_q28(b0 / a0);
+    bq->b1 = dsp_to_q28(b1 / a0);
+    bq->b2 = dsp_to_q28(b2 / a0);
+    bq->a1 = dsp_to_q28(a1 / a0);
+    bq->a2 = dsp_to_q28(a2 / a0);
+}
+
+void audio_dsp_configure(audio_dsp_t *dsp, const audio_dsp_params_t *params)
+{
+    float volume_db = params->volume_db > DSP_VOLUME_MAX_DB ? DSP_VOLUME_MAX_DB : params->volume_db;
+    dsp->gain_target = params->mute ? 0 : dsp_to_q28(pow(10.0, volume_db / 20.0));
+
+    // Active bands are packed to the front; a band that moves keeps its slot's state,
+    // which at worst causes one block of transient rather than a click-free reset.
+    int n = 0;
+    for (int i = 0; i < AUDIO_DSP_MAX_BIQUADS; i++) {
+        const audio_dsp_eq_t *eq = &params->eq[i];
+        if (eq->type == AUDIO_DSP_EQ_OFF || eq->freq_hz <= 0 || eq->freq_hz >= dsp->sample_rate / 2) {
+            continue;
+        }
+        audio_dsp_design_biquad(eq, dsp->sample_rate, &dsp->biquad[n]);
+        n++;
+    }
+    for (int i = n; i < AUDIO_DSP_MAX_BIQUADS; i++) {
+        memset(dsp->biquad_state[i], 0, sizeof(dsp->biquad_state[i]));
+    }
+    dsp->n_biquads = n;
+
+    dsp->limiter = params->limiter;
+    float limit_dbfs = params->limit_dbfs > 0 ? 0 : params->limit_dbfs;
+    dsp->limit = (int32_t)(DSP_FULL_SCALE * pow(10.0, limit_dbfs / 20.0));
+}
+
+void audio_dsp_gain_block(audio_dsp_t *dsp, int32_t *x, size_t frames)
+{
+    const int ch = dsp->channels;
+    int32_t g = dsp->gain;
+
+    if (g == dsp->gain_target) {
+        if (g == 1 << DSP_GAIN_SHIFT) {
+            return;
+        }
+        for (size_t i = 0; i < frames * ch; i++) {
+            x[i] = dsp_sat32(((int64_t)x[i] * g) >> DSP_GAIN_SHIFT);
+        }
+        return;
+    }
+
+    // Linear ramp towards the target, never faster than gain_max_step per frame
+    int32_t step = (int32_t)(((int64_t)dsp->gain_target - g) / (int64_t)frames);
+    if (step > dsp->gain_max_step) {
+        step = dsp->gain_max_step;
+    } else if (step < -dsp->gain_max_step) {
+        step = -dsp->gain_max_step;
+    } else if (step == 0) {
+        step = dsp->gain_target > g ? 1 : -1;
+    }
+    for (size_t f = 0; f < frames; f++) {
+        if ((step > 0 && g + step >= dsp->gain_target) || (step < 0 && g + step <= dsp->gain_target)) {
+            g = dsp->gain_target;
+            step = 0;
+        } else {
+            g += step;
+        }
+        for (int c = 0; c < ch; c++) {
+            x[f * ch + c] = dsp_sat32(((int64_t)x[f * ch + c] * g) >> DSP_GAIN_SHIFT);
+        }
+    }
+    dsp->gain = g;
+}
+
+void audio_dsp_fade_block(audio_dsp_t *dsp, int32_t *x, size_t frames)
+{
+    const int ch = dsp->channels;
+    int32_t f = dsp->fade;
+
+    if (f == dsp->fade_target) {
+        if (f == 0) {
+            memset(x, 0, frames * ch * sizeof(*x));
+        }
+        return;                 // Unity
+    }
+    const int32_t step = f < dsp->fade_target ? dsp->fade_step : -dsp->fade_step;
+    for (size_t i = 0; i < frames; i++) {
+        f += step;
+        if ((step > 0 && f >= dsp->fade_target) || (step < 0 && f <= dsp->fade_target)) {
+            f = dsp->fade_target;
+        }
+        for (int c = 0; c < ch; c++) {
+            x[i * ch + c] = (int32_t)(((int64_t)x[i * ch + c] * f) >> DSP_GAIN_SHIFT);
+        }
+    }
+    dsp->fade = f;
+}
+
+void audio_dsp_biquad_block(audio_dsp_t *dsp, int32_t *x, size_t frames)
+{
+    const int ch = dsp->channels;
+
+    for (int s = 0; s < dsp->n_biquads; s++) {
+        const audio_dsp_biquad_t bq = dsp->biquad[s];
+        for (int c = 0; c < ch; c++) {
+            audio_dsp_biquad_state_t st = dsp->biquad_state[s][c];
+            int32_t *p = x + c;
+            // Direct form I: the state is the previous inputs and outputs, so a
+            // coefficient change never produces an internal-state discontinuity. The
+            // output is rounded: truncation is a constant bias that the recursion amplifies
+            // by 1 / (1 + a1 + a2), several LSBs of DC offset for a 40 Hz high pass.
+            for (size_t f = 0; f < frames; f++, p += ch) {
+                int64_t acc = (int64_t)bq.b0 * *p + (int64_t)bq.b1 * st.x1 + (int64_t)bq.b2 * st.x2
+                              - (int64_t)bq.a1 * st.y1 - (int64_t)bq.a2 * st.y2;
+                int32_t y = dsp_sat32((acc + (1 << (DSP_COEF_SHIFT - 1))) >> DSP_COEF_SHIFT);
+                st.x2 = st.x1;
+                st.x1 = *p;
+                st.y2 = st.y1;
+                st.y1 = y;
+                *p = y;
+            }
+            dsp->biquad_state[s][c] = st;
+        }
+    }
+}
+
+void audio_dsp_limiter_block(audio_dsp_t *dsp, int32_t *x, size_t frames)
+{
+    const int ch = dsp->channels;
+    const int32_t unity = 1 << DSP_LIM_SHIFT;
+
+    if (!dsp->limiter) {
+        return;
+    }
+
+    for (size_t f = 0; f < frames; f++) {
+        int32_t *frame = x + f * ch;
+        int32_t peak = 0;
+        for (int c = 0; c < ch; c++) {
+            int32_t a = frame[c] < 0 ? (frame[c] == INT32_MIN ? INT32_MAX : -frame[c]) : frame[c];
+            peak = a > peak ? a : peak;
+        }
+
+        // Gain the incoming frame will need when it leaves the delay line. Release is
+        // held while any frame in the delay line needs less than the target could reach
+        // by the time that frame is output.
+        int32_t required = peak > dsp->limit ? (int32_t)(((int64_t)dsp->limit << DSP_LIM_SHIFT) / peak) : unity;
+        int64_t release_margin = (int64_t)dsp->lookahead * (((unity - dsp->lim_target) >> DSP_RELEASE_SHIFT) + 1);
+        if (required < dsp->lim_target) {
+            // Never slow down an attack already in progress: its own deadline still holds.
+            int32_t step = (dsp->lim_gain - required) / dsp->lookahead + 1;
+            if (dsp->lim_gain <= dsp->lim_target || step > dsp->lim_step) {
+                dsp->lim_step = step;
+            }
+            dsp->lim_target = required;
+            dsp->hold = dsp->lookahead;
+        } else if (required < dsp->lim_target + release_margin) {
+            dsp->hold = dsp->lookahead;
+        } else if (dsp->hold > 0) {
+            dsp->hold--;
+        } else if (dsp->lim_target < unity) {
+            dsp->lim_target += ((unity - dsp->lim_target) >> DSP_RELEASE_SHIFT) + 1;
+            if (dsp->lim_target > unity) {
+                dsp->lim_target = unity;
+            }
+        }
+
+        // Attack ramps so the target is met exactly when the peak comes out; release
+        // follows the target directly since it already moves slowly.
+        if (dsp->lim_gain > dsp->lim_target) {
+            dsp->lim_gain -= dsp->lim_step;
+            if (dsp->lim_gain < dsp->lim_target) {
+                dsp->lim_gain = dsp->lim_target;
+            }
+        } else {
+            dsp->lim_gain = dsp->lim_target;
+        }
+
+        int32_t *delayed = dsp->delay[dsp->delay_pos];
+        for (int c = 0; c < ch; c++) {
+            int32_t out = (int32_t)(((int64_t)delayed[c] * dsp->lim_gain) >> DSP_LIM_SHIFT);
+            delayed[c] = frame[c];
+            frame[c] = out;
+        }
+        if (++dsp->delay_pos >= dsp->lookahead) {
+            dsp->delay_pos = 0;
+        }
+    }
+}
+
+static void audio_dsp_run(audio_dsp_t *dsp, int32_t *x, size_t frames)
+{
+    audio_dsp_gain_block(dsp, x, frames);
+    audio_dsp_fade_block(dsp, x, frames);
+    audio_dsp_biquad_block(dsp, x, frames);
+    audio_dsp_limiter_block(dsp, x, frames);
+}
+
+void audio_dsp_process_s16(audio_dsp_t *dsp, int16_t *buf, size_t frames)
+{
+    const int ch = dsp->channels;
+
+    while (frames > 0) {
+        size_t n = frames > AUDIO_DSP_BLOCK_FRAMES ? AUDIO_DSP_BLOCK_FRAMES : frames;
+        for (size_t i = 0; i < n * ch; i++) {
+            dsp->scratch[i] = (int32_t)buf[i] << DSP_S16_SHIFT;
+        }
+        audio_dsp_run(dsp, dsp->scratch, n);
+        for (size_t i = 0; i < n * ch; i++) {
+            int32_t v = (dsp->scratch[i] + (1 << (DSP_S16_SHIFT - 1))) >> DSP_S16_SHIFT;
+            buf[i] = v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : (int16_t)v);
+        }
+        buf += n * ch;
+        frames -= n;
+    }
+}
+
+void audio_dsp_process_s32(audio_dsp_t *dsp, int32_t *buf, size_t frames)
+{
+    const int ch = dsp->channels;
+
+    while (frames > 0) {
+        size_t n = frames > AUDIO_DSP_BLOCK_FRAMES ? AUDIO_DSP_BLOCK_FRAMES : frames;
+        for (size_t i = 0; i < n * ch; i++) {
+            dsp->scratch[i] = buf[i] >> DSP_S32_SHIFT;
+        }
+        audio_dsp_run(dsp, dsp->scratch, n);
+        for (size_t i = 0; i < n * ch; i++) {
+            buf[i] = dsp_sat32((int64_t)dsp->scratch[i] << DSP_S32_SHIFT);
+        }
+        buf += n * ch;
+        frames -= n;
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fixed-point playback DSP chain: smoothed gain/mute ramp, stream start/stop fade,
+// cascaded biquads and a look-ahead peak limiter, applied in place to interleaved PCM
+// blocks.
+//
+// Samples are processed as int32 with 4 bits of headroom (full scale is 1 << 27) so EQ
+// boosts don't clip before the limiter. Coefficients are Q28 and are only recomputed in
+// audio_dsp_configure(); the block kernels do nothing but integer multiply-accumulate.
+// tools/dsp_bench.c checks each stage against a reference and measures its cost.
+
+#define AUDIO_DSP_MAX_BIQUADS   (4)
+#define AUDIO_DSP_MAX_CH        (2)
+#define AUDIO_DSP_BLOCK_FRAMES  (192)   // Internal block size; longer buffers are split
+#define AUDIO_DSP_LOOKAHEAD_MS  (1)
+#define AUDIO_DSP_LOOKAHEAD_MAX (96)    // Frames, 1 ms at the highest supported rate
+#define AUDIO_DSP_RAMP_MS       (10)    // Time for a full-scale gain change
+
+typedef enum {
+    AUDIO_DSP_EQ_OFF = 0,
+    AUDIO_DSP_EQ_PEAK,
+    AUDIO_DSP_EQ_LOWSHELF,
+    AUDIO_DSP_EQ_HIGHSHELF,
+    AUDIO_DSP_EQ_LOWPASS,
+    AUDIO_DSP_EQ_HIGHPASS,
+} audio_dsp_eq_type_t;
+
+typedef struct {
+    audio_dsp_eq_type_t type;
+    float freq_hz;
+    float q;
+    float gain_db;       // Peak and shelf types only
+} audio_dsp_eq_t;
+
+// User-facing parameters, converted to coefficients by audio_dsp_configure().
+typedef struct {
+    float volume_db;     // 0 is unity, at most +12
+    bool mute;
+    audio_dsp_eq_t eq[AUDIO_DSP_MAX_BIQUADS];
+    bool limiter;
+    float limit_dbfs;    // Limiter ceiling, <= 0
+} audio_dsp_params_t;
+
+typedef struct {
+    int32_t b0, b1, b2, a1, a2; // Q28, a0 normalized to 1
+} audio_dsp_biquad_t;
+
+typedef struct {
+    int32_t x1, x2, y1, y2;
+} audio_dsp_biquad_state_t;
+
+typedef struct {
+    uint32_t sample_rate;
+    int channels;
+
+    // Gain ramp, Q28
+    int32_t gain;
+    int32_t gain_target;
+    int32_t gain_max_step;
+
+    // Start/stop fade, Q28, on top of the gain
+    int32_t fade;
+    int32_t fade_target;
+    int32_t fade_step;
+
+    // Biquads
+    int n_biquads;
+    audio_dsp_biquad_t biquad[AUDIO_DSP_MAX_BIQUADS];
+    audio_dsp_biquad_state_t biquad_state[AUDIO_DSP_MAX_BIQUADS][AUDIO_DSP_MAX_CH];
+
+    // Limiter
+    bool limiter;
+    int32_t limit;              // Ceiling in internal units
+    int lookahead;              // Frames
+    int delay_pos;
+    int hold;
+    int32_t lim_gain;           // Q30
+    int32_t lim_target;         // Q30
+    int32_t lim_step;           // Q30 per frame while attacking
+    int32_t delay[AUDIO_DSP_LOOKAHEAD_MAX][AUDIO_DSP_MAX_CH];
+
+    int32_t scratch[AUDIO_DSP_BLOCK_FRAMES * AUDIO_DSP_MAX_CH];
+} audio_dsp_t;
+
+// Default parameters: unity gain, no EQ, limiter at -0.3 dBFS.
+void audio_dsp_default_params(audio_dsp_params_t *params);
+
+// Resets all state for a new stream format. Follow with audio_dsp_configure().
+void audio_dsp_init(audio_dsp_t *dsp, uint32_t sample_rate, int channels);
+
+// Recomputes coefficients from `params`. Filter state is kept so this can be called
+// while playing; gain changes are ramped, never stepped.
+void audio_dsp_configure(audio_dsp_t *dsp, const audio_dsp_params_t *params);
+
+// Ramps linearly from silence to unity (`in`) or from the current level to silence over
+// `ms`; 0 switches at once. Independent of the volume ramp, so a fade never disturbs it.
+void audio_dsp_fade(audio_dsp_t *dsp, bool in, uint32_t ms);
+
+// True while the output is held at silence by a finished fade out.
+bool audio_dsp_faded_out(const audio_dsp_t *dsp);
+
+// In-place processing of interleaved frames. s32 expects MSB-justified samples.
+void audio_dsp_process_s16(audio_dsp_t *dsp, int16_t *buf, size_t frames);
+void audio_dsp_process_s32(audio_dsp_t *dsp, int32_t *buf, size_t frames);
+
+// Individual stages on internal-format blocks, exposed for benchmarking.
+void audio_dsp_gain_block(audio_dsp_t *dsp, int32_t *x, size_t frames);
+void audio_dsp_fade_block(audio_dsp_t *dsp, int32_t *x, size_t frames);
+void audio_dsp_biquad_block(audio_dsp_t *dsp, int32_t *x, size_t frames);
+void audio_dsp_limiter_block(audio_dsp_t *dsp, int32_t *x, size_t frames);
+
+#ifdef __cplusplus
+}
+#endif
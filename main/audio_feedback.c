@@ -0,0 +1,114 @@
+#include "audio_feedback.h"
+
+// PI gains, tuned for a critically damped loop with a ~4 s time constant:
+// P is in 16.16 samples-per-frame per frame of fill error, I integrates fill error
+// over time in frame*milliseconds.
+#define AUDIO_FB_KP_Q16   (16)
+#define AUDIO_FB_KI_SHIFT (10)
+#define AUDIO_FB_RATE_IIR_SHIFT (3)
+
+void audio_fb_init(audio_fb_t *fb, uint32_t sample_rate, uint32_t usb_frames_per_sec,
+                   uint32_t target_fill_frames, uint32_t period_us)
+{
+    atomic_init(&fb->seq, 0);
+    atomic_init(&fb->frames, 0);
+    atomic_init(&fb->stamp_us, 0);
+    fb->usb_frames_per_sec = usb_frames_per_sec;
+    fb->nominal_q16 = audio_fb_nominal_q16(sample_rate, usb_frames_per_sec);
+    fb->target_fill = target_fill_frames;
+    fb->period_us = period_us;
+    audio_fb_reset(fb);
+}
+
+void audio_fb_reset(audio_fb_t *fb)
+{
+    fb->running = false;
+    fb->window_valid = false;
+    fb->rate_q16 = (int32_t)fb->nominal_q16;
+    fb->integral = 0;
+    fb->fill_sum = 0;
+    fb->fill_count = 0;
+    fb->feedback_q16 = fb->nominal_q16;
+}
+
+static void audio_fb_snapshot(audio_fb_t *fb, uint32_t *frames, uint32_t *stamp_us)
+{
+    uint32_t s1, s2;
+    do {
+        s1 = atomic_load_explicit(&fb->seq, memory_order_acquire);
+        *frames = atomic_load_explicit(&fb->frames, memory_order_relaxed);
+        *stamp_us = atomic_load_explicit(&fb->stamp_us, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        s2 = atomic_load_explicit(&fb->seq, memory_order_relaxed);
+    } while (s1 != s2 || (s1 & 1));
+}
+
+static void audio_fb_measure(audio_fb_t *fb)
+{
+    uint32_t frames, stamp_us;
+    audio_fb_snapshot(fb, &frames, &stamp_us);
+
+    if (!fb->window_valid) {
+        fb->window_frames = frames;
+        fb->window_start_us = stamp_us;
+        fb->window_valid = true;
+        return;
+    }
+
+    // Both ends of the window sit on DMA-done events, so the span is an exact number
+    // of DMA buffers and the only error is interrupt latency.
+    uint32_t span_us = stamp_us - fb->window_start_us;
+    if (span_us < AUDIO_FB_MEASURE_WINDOW_US) {
+        return;
+    }
+    uint32_t span_frames = frames - fb->window_frames;
+    int32_t measured = (int32_t)(((uint64_t)span_frames * 1000000ULL << 16) / ((uint64_t)span_us * fb->usb_frames_per_sec));
+
+    // Ignore windows that are obviously broken (stream paused, DMA stalled).
+    int32_t limit = (int32_t)((uint64_t)fb->nominal_q16 * AUDIO_FB_MAX_DEVIATION_PPM / 1000000);
+    if (measured > (int32_t)fb->nominal_q16 - limit && measured < (int32_t)fb->nominal_q16 + limit) {
+        fb->rate_q16 += (measured - fb->rate_q16) >> AUDIO_FB_RATE_IIR_SHIFT;
+    }
+    fb->window_frames = frames;
+    fb->window_start_us = stamp_us;
+}
+
+bool audio_fb_update(audio_fb_t *fb, uint32_t now_us, uint32_t fill_frames, uint32_t *feedback_q16)
+{
+    fb->fill_sum += fill_frames;
+    fb->fill_count++;
+    uint32_t dt_us = now_us - fb->last_update_us;
+    if (fb->running && dt_us < fb->period_us) {
+        return false;
+    }
+    bool first = !fb->running;
+    fb->running = true;
+    fb->last_update_us = now_us;
+
+    audio_fb_measure(fb);
+
+    int32_t fill = (int32_t)(fb->fill_sum / fb->fill_count);
+    fb->fill_sum = 0;
+    fb->fill_count = 0;
+    int32_t err = fill - (int32_t)fb->target_fill;
+    int64_t integral = first ? fb->integral : fb->integral + (int64_t)err * (dt_us / 1000);
+    int64_t correction = (int64_t)err * AUDIO_FB_KP_Q16 + (integral >> AUDIO_FB_KI_SHIFT);
+
+    int64_t limit = (int64_t)fb->nominal_q16 * AUDIO_FB_MAX_DEVIATION_PPM / 1000000;
+    int64_t value = (int64_t)fb->rate_q16 - correction;
+    if (value > (int64_t)fb->nominal_q16 + limit) {
+        value = (int64_t)fb->nominal_q16 + limit;
+    } else if (value < (int64_t)fb->nominal_q16 - limit) {
+        value = (int64_t)fb->nominal_q16 - limit;
+    } else {
+        // Only integrate while unsaturated, otherwise the integrator winds up.
+        fb->integral = integral;
+    }
+
+    if ((uint32_t)value == fb->feedback_q16 && !first) {
+        return false;
+    }
+    fb->feedback_q16 = (uint32_t)value;
+    *feedback_q16 = fb->feedback_q16;
+    return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Asynchronous-sink feedback engine for the UAC speaker stream.
+//
+// The value reported to the host is the I2S consumption rate in samples per USB frame,
+// 16.16 fixed point. It is the sum of two parts:
+//  - the consumption rate measured from DMA-done events against the local timer, which
+//    tracks the codec clock, and
+//  - a PI correction on the jitter-buffer fill level, which absorbs the offset between
+//    the local timer and the host's SOF clock and keeps the fill centred on its target.
+// tools/audio_sim.c runs the loop against a simulated host and DMA.
+
+#define AUDIO_FB_MEASURE_WINDOW_US (500000) // Minimum span of one rate measurement
+#define AUDIO_FB_MAX_DEVIATION_PPM (10000)  // Clamp around nominal, well within host limits
+
+typedef struct {
+    // Written from the I2S DMA ISR, read with a sequence lock.
+    _Atomic uint32_t seq;
+    _Atomic uint32_t frames;     // Total frames consumed by the DMA
+    _Atomic uint32_t stamp_us;   // Local time of the last DMA-done event (wraps)
+
+    // Control state, task context only.
+    uint32_t nominal_q16;        // Nominal samples per USB frame, 16.16
+    uint32_t usb_frames_per_sec; // 1000 for full speed, 8000 for high speed
+    uint32_t target_fill;        // Frames
+    uint32_t period_us;          // Minimum interval between loop updates
+    bool running;                // At least one update since reset
+    uint32_t last_update_us;
+    uint32_t window_frames;
+    uint32_t window_start_us;
+    bool window_valid;
+    int32_t rate_q16;            // Filtered measured rate, samples per USB frame
+    int64_t integral;            // Fill error integrated over time, frames * ms
+    uint64_t fill_sum;           // Fill samples since the last loop step
+    uint32_t fill_count;
+    uint32_t feedback_q16;       // Last reported value
+} audio_fb_t;
+
+// Nominal samples per USB frame at `sample_rate`, 16.16: what a sink running exactly
+// at the host's rate reports.
+static inline uint32_t audio_fb_nominal_q16(uint32_t sample_rate, uint32_t usb_frames_per_sec)
+{
+    return (uint32_t)(((uint64_t)sample_rate << 16) / usb_frames_per_sec);
+}
+
+// `usb_frames_per_sec` is 1000 for full speed and 8000 for high speed.
+void audio_fb_init(audio_fb_t *fb, uint32_t sample_rate, uint32_t usb_frames_per_sec,
+                   uint32_t target_fill_frames, uint32_t period_us);
+
+// Forgets the integrator and measurement window, e.g. when the stream restarts.
+void audio_fb_reset(audio_fb_t *fb);
+
+// Records `frames` more frames consumed by the DMA at local time `now_us`.
+// Called from the I2S on_sent ISR; kept inline so it lands in IRAM with the caller.
+static inline void audio_fb_dma_done(audio_fb_t *fb, uint32_t frames, uint32_t now_us)
+{
+    atomic_fetch_add_explicit(&fb->seq, 1, memory_order_acq_rel);
+    atomic_store_explicit(&fb->frames, atomic_load_explicit(&fb->frames, memory_order_relaxed) + frames, memory_order_relaxed);
+    atomic_store_explicit(&fb->stamp_us, now_us, memory_order_relaxed);
+    atomic_fetch_add_explicit(&fb->seq, 1, memory_order_release);
+}
+
+// Runs one control-loop step if at least `period_us` passed since the previous one.
+// `fill_frames` is the current jitter-buffer fill. The writer drains the buffer a whole
+// DMA buffer at a time, so a single reading lands anywhere on that swing; the step uses
+// the mean of every reading since the previous one. Returns true when `*feedback_q16`
+// holds a new value to send to the host.
+bool audio_fb_update(audio_fb_t *fb, uint32_t now_us, uint32_t fill_frames, uint32_t *feedback_q16);
+
+#ifdef __cplusplus
+}
+#endif
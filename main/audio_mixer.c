@@ -0,0 +1,115 @@
+#include <string.h>
+#include "audio_mixer.h"
+
+#define MIXER_ALL ((uint32_t)((1ull << AUDIO_MIXER_VOICES) - 1))
+
+_Static_assert(AUDIO_MIXER_VOICES <= 32, "Voices are tracked in a 32-bit mask");
+
+static inline size_t mixer_min(size_t a, size_t b)
+{
+    return a < b ? a : b;
+}
+
+void audio_mixer_init(audio_mixer_t *mixer)
+{
+    memset(mixer, 0, sizeof(*mixer));
+}
+
+int audio_mixer_play(audio_mixer_t *mixer, const int16_t *pcm, uint32_t frames, int channels, int32_t gain)
+{
+    uint32_t free_mask = ~mixer->active & MIXER_ALL;
+    int v = 0;
+    if (free_mask) {
+        v = __builtin_ctz(free_mask);
+    } else {
+        for (int i = 1; i < AUDIO_MIXER_VOICES; i++) {
+            if ((int32_t)(mixer->voice[i].started - mixer->voice[v].started) < 0) {
+                v = i;
+            }
+        }
+        mixer->stolen++;
+    }
+    mixer->voice[v] = (audio_mixer_voice_t) {
+        .pcm = pcm,
+        .frames = frames,
+        .pos = 0,
+        .gain = gain < 0 ? 0 : (gain > AUDIO_MIXER_GAIN_MAX ? AUDIO_MIXER_GAIN_MAX : gain),
+        .started = mixer->started++,
+        .channels = (uint8_t)channels,
+    };
+    if (frames > 0) {
+        mixer->active |= 1u << v;
+    }
+    return v;
+}
+
+void audio_mixer_stop_all(audio_mixer_t *mixer)
+{
+    mixer->active = 0;
+}
+
+// Sums up to AUDIO_MIXER_BLOCK frames of every active voice into mixer->acc, releasing
+// the voices that end.
+static void mixer_accumulate(audio_mixer_t *mixer, size_t frames, int channels)
+{
+    int32_t *acc = mixer->acc;
+    memset(acc, 0, frames * channels * sizeof(int32_t));
+    uint32_t active = mixer->active;
+    while (active) {
+        int v = __builtin_ctz(active);
+        active &= active - 1;
+        audio_mixer_voice_t *voice = &mixer->voice[v];
+        const size_t n = mixer_min(frames, voice->frames - voice->pos);
+        const int16_t *src = voice->pcm + (size_t)voice->pos * voice->channels;
+        const int32_t g = voice->gain;
+        if (voice->channels == channels) {
+            for (size_t i = 0; i < n * channels; i++) {
+                acc[i] += (src[i] * g) >> 15;
+            }
+        } else if (voice->channels == 1) {
+            for (size_t i = 0; i < n; i++) {
+                int32_t s = (src[i] * g) >> 15;
+                acc[2 * i] += s;
+                acc[2 * i + 1] += s;
+            }
+        } else {
+            for (size_t i = 0; i < n; i++) {
+                acc[i] += (((src[2 * i] + src[2 * i + 1]) >> 1) * g) >> 15;
+            }
+        }
+        voice->pos += n;
+        if (voice->pos == voice->frames) {
+            mixer->active &= ~(1u << v);
+        }
+    }
+}
+
+void audio_mixer_mix_s16(audio_mixer_t *mixer, int16_t *out, size_t frames, int channels)
+{
+    while (frames > 0 && mixer->active) {
+        const size_t n = mixer_min(frames, AUDIO_MIXER_BLOCK);
+        mixer_accumulate(mixer, n, channels);
+        const int32_t *acc = mixer->acc;
+        for (size_t i = 0; i < n * channels; i++) {
+            int32_t v = out[i] + acc[i];
+            out[i] = (int16_t)(v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v));
+        }
+        out += n * channels;
+        frames -= n;
+    }
+}
+
+void audio_mixer_mix_s32(audio_mixer_t *mixer, int32_t *out, size_t frames, int channels)
+{
+    while (frames > 0 && mixer->active) {
+        const size_t n = mixer_min(frames, AUDIO_MIXER_BLOCK);
+        mixer_accumulate(mixer, n, channels);
+        const int32_t *acc = mixer->acc;
+        for (size_t i = 0; i < n * channels; i++) {
+            int64_t v = (int64_t)out[i] + ((int64_t)acc[i] << 16);
+            out[i] = (int32_t)(v > INT32_MAX ? INT32_MAX : (v < INT32_MIN ? INT32_MIN : v));
+        }
+        out += n * channels;
+        frames -= n;
+    }
+}
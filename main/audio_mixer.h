@@ -0,0 +1,67 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fixed-voice mixer for short effects on top of the playback stream.
+//
+// A voice plays a 16-bit mono or stereo sample straight from memory (the sample cache)
+// with its own gain. Starting one takes constant time and never allocates: it takes the
+// lowest free slot from a bitmask, or replaces the oldest of the AUDIO_MIXER_VOICES when
+// all are busy. Mixing sums the active voices into an int32 accumulator block and then
+// adds that to the stream block in one saturating pass, so the cost is one multiply-add
+// per voice and sample plus a single clamp per output sample.
+// Samples must be at the stream's rate; mono voices go to both channels, stereo voices
+// are averaged into a mono stream.
+// Single-threaded: the audio writer owns it. tools/mixer_bench.c checks it against a
+// per-sample reference.
+
+#define AUDIO_MIXER_VOICES    (8)   // At most 32
+#define AUDIO_MIXER_BLOCK     (128) // Frames accumulated per pass
+#define AUDIO_MIXER_UNITY     (1 << 15)
+#define AUDIO_MIXER_GAIN_MAX  (2 * AUDIO_MIXER_UNITY) // +6 dB, keeps the products in 32 bits
+
+typedef struct {
+    const int16_t *pcm;
+    uint32_t frames;
+    uint32_t pos;
+    int32_t gain;               // Q15, AUDIO_MIXER_UNITY is 0 dB
+    uint32_t started;           // Start order, to pick the oldest voice to replace
+    uint8_t channels;
+} audio_mixer_voice_t;
+
+typedef struct {
+    audio_mixer_voice_t voice[AUDIO_MIXER_VOICES];
+    uint32_t active;            // Bit per busy voice
+    uint32_t started;           // Voices started so far
+    uint32_t stolen;            // Started by replacing a playing voice
+    int32_t acc[AUDIO_MIXER_BLOCK * 2]; // One block of the voices' sum, in 16-bit units
+} audio_mixer_t;
+
+void audio_mixer_init(audio_mixer_t *mixer);
+
+// Starts `frames` frames of `pcm` (`channels` interleaved) at `gain` (Q15, clamped to
+// AUDIO_MIXER_GAIN_MAX). Returns the voice index.
+int audio_mixer_play(audio_mixer_t *mixer, const int16_t *pcm, uint32_t frames, int channels, int32_t gain);
+
+void audio_mixer_stop_all(audio_mixer_t *mixer);
+
+static inline bool audio_mixer_active(const audio_mixer_t *mixer)
+{
+    return mixer->active != 0;
+}
+
+// Adds the active voices to `frames` frames of `out` (`channels` interleaved), clamping
+// at full scale. Voices that run out are released.
+void audio_mixer_mix_s16(audio_mixer_t *mixer, int16_t *out, size_t frames, int channels);
+
+// Same for MSB-justified 32-bit samples.
+void audio_mixer_mix_s32(audio_mixer_t *mixer, int32_t *out, size_t frames, int channels);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,177 @@
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "audio_power.h"
+
+static const char *TAG = "audio_power";
+
+static audio_power_config_t s_config;
+static bool s_awake;
+static int64_t s_wake_requested_us = -1;    // Waiting for the first sample when >= 0
+static int64_t s_sleep_start_us;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static audio_power_stats_t s_stats;
+
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t s_cpu_lock;     // Held while awake
+static esp_pm_lock_handle_t s_sleep_lock;   // Held while awake
+static esp_pm_lock_handle_t s_vbus_lock;    // Held while VBUS is present
+static bool s_vbus_held;
+#endif
+
+static void audio_power_amp(bool on)
+{
+    if (s_config.amp_gpio != GPIO_NUM_NC) {
+        gpio_set_level(s_config.amp_gpio, on);
+    }
+}
+
+static void audio_power_locks(bool acquire)
+{
+#if CONFIG_PM_ENABLE
+    if (acquire) {
+        esp_pm_lock_acquire(s_cpu_lock);
+        esp_pm_lock_acquire(s_sleep_lock);
+    } else {
+        esp_pm_lock_release(s_sleep_lock);
+        esp_pm_lock_release(s_cpu_lock);
+    }
+#endif
+}
+
+esp_err_t audio_power_init(const audio_power_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config && config->output_cb, ESP_ERR_INVALID_ARG, TAG, "Output callback required");
+    s_config = *config;
+
+    if (s_config.amp_gpio != GPIO_NUM_NC) {
+        const gpio_config_t amp_mode_config = {
+            .pin_bit_mask = BIT64(s_config.amp_gpio),
+            .mode = GPIO_MODE_OUTPUT,
+            .pull_up_en = GPIO_PULLUP_ENABLE,
+            .pull_down_en = GPIO_PULLDOWN_DISABLE,
+            .intr_type = GPIO_INTR_DISABLE,
+        };
+        ESP_RETURN_ON_ERROR(gpio_config(&amp_mode_config), TAG, "Amp GPIO");
+    }
+
+#if CONFIG_PM_ENABLE
+    const esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_AUDIO_POWER_MIN_CPU_MHZ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true,
+#endif
+    };
+    ESP_RETURN_ON_ERROR(esp_pm_configure(&pm_config), TAG, "PM configuration");
+    ESP_RETURN_ON_ERROR(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "audio", &s_cpu_lock), TAG, "PM lock");
+    ESP_RETURN_ON_ERROR(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "audio", &s_sleep_lock), TAG, "PM lock");
+    ESP_RETURN_ON_ERROR(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "vbus", &s_vbus_lock), TAG, "PM lock");
+    if (s_config.vbus_gpio == GPIO_NUM_NC) {
+        esp_pm_lock_acquire(s_vbus_lock);
+        s_vbus_held = true;
+    } else {
+        // Plugging in wakes the chip; the lock is taken on the next poll
+        ESP_RETURN_ON_ERROR(gpio_wakeup_enable(s_config.vbus_gpio, GPIO_INTR_HIGH_LEVEL), TAG, "VBUS wakeup");
+        ESP_RETURN_ON_ERROR(esp_sleep_enable_gpio_wakeup(), TAG, "GPIO wakeup");
+        audio_power_poll();
+    }
+#endif
+
+    // The caller's output is already running
+    audio_power_locks(true);
+    audio_power_amp(true);
+    s_awake = true;
+    s_stats.awake = true;
+    return ESP_OK;
+}
+
+bool audio_power_awake(void)
+{
+    return s_awake;
+}
+
+void audio_power_sleep(void)
+{
+    if (!s_awake) {
+        return;
+    }
+    audio_power_amp(false);
+    s_config.output_cb(false, s_config.cb_ctx);
+    audio_power_locks(false);
+    s_awake = false;
+    s_wake_requested_us = -1;
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_sleep_start_us = now;
+    s_stats.awake = false;
+    taskEXIT_CRITICAL(&s_stats_lock);
+    audio_power_poll();
+}
+
+void audio_power_wake(int64_t requested_us)
+{
+    if (s_awake) {
+        return;
+    }
+    int64_t start = esp_timer_get_time();
+    audio_power_locks(true);
+    s_config.output_cb(true, s_config.cb_ctx);
+    audio_power_amp(true);
+    s_awake = true;
+    s_wake_requested_us = requested_us;
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.awake = true;
+    s_stats.wakes++;
+    s_stats.last_wake_us = (uint32_t)(now - start);
+    s_stats.asleep_ms += (start - s_sleep_start_us) / 1000;
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+void audio_power_first_sample(void)
+{
+    if (s_wake_requested_us < 0) {
+        return;
+    }
+    uint32_t us = (uint32_t)(esp_timer_get_time() - s_wake_requested_us);
+    s_wake_requested_us = -1;
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.last_first_sample_us = us;
+    if (us > s_stats.max_first_sample_us) {
+        s_stats.max_first_sample_us = us;
+    }
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+void audio_power_poll(void)
+{
+#if CONFIG_PM_ENABLE
+    if (s_config.vbus_gpio == GPIO_NUM_NC) {
+        return;
+    }
+    bool vbus = gpio_get_level(s_config.vbus_gpio);
+    if (vbus && !s_vbus_held) {
+        esp_pm_lock_acquire(s_vbus_lock);
+    } else if (!vbus && s_vbus_held) {
+        esp_pm_lock_release(s_vbus_lock);
+    }
+    s_vbus_held = vbus;
+#endif
+}
+
+void audio_power_get_stats(audio_power_stats_t *stats)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    int64_t sleep_start = s_sleep_start_us;
+    taskEXIT_CRITICAL(&s_stats_lock);
+    if (!stats->awake) {
+        stats->asleep_ms += (esp_timer_get_time() - sleep_start) / 1000;
+    }
+}
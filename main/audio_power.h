@@ -0,0 +1,67 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Idle power-down of the playback path.
+//
+// While awake the output holds PM locks that keep the CPU at full speed and out of light
+// sleep, the amplifier is on and the I2S channel runs. Asleep, the amplifier is shut
+// down first, then the channel is stopped (which also drops the I2S driver's own APB
+// lock), then the locks are released. Waking runs the same steps in reverse, so the amp
+// only ever sees a running clock and silence.
+//
+// With CONFIG_PM_ENABLE the CPU scales down to CONFIG_AUDIO_POWER_MIN_CPU_MHZ while
+// asleep, and with tickless idle also enters light sleep, but only while VBUS is absent:
+// light sleep stops the USB PHY. Without CONFIG_PM_ENABLE only the output is gated.
+//
+// Everything but audio_power_get_stats() belongs to the audio writer task.
+
+// Starts or stops the audio output (the I2S channel). Runs in the writer task.
+typedef void (*audio_power_output_cb_t)(bool on, void *cb_ctx);
+
+typedef struct {
+    gpio_num_t amp_gpio;        // Amplifier enable, active high; GPIO_NUM_NC if none
+    gpio_num_t vbus_gpio;       // Light sleep only while this reads low; GPIO_NUM_NC: never
+    audio_power_output_cb_t output_cb;
+    void *cb_ctx;
+} audio_power_config_t;
+
+typedef struct {
+    bool awake;
+    uint32_t wakes;
+    uint32_t last_wake_us;      // Locks, output and amp back on
+    uint32_t last_first_sample_us; // Wake request to the first sample handed to the DMA
+    uint32_t max_first_sample_us;
+    uint64_t asleep_ms;         // Total, including the current sleep
+} audio_power_stats_t;
+
+// Configures the amp GPIO and PM, and starts awake with the output running.
+esp_err_t audio_power_init(const audio_power_config_t *config);
+
+bool audio_power_awake(void);
+
+// Powers the output down. The DMA should have played out by now: whatever it still
+// holds is replayed on wake.
+void audio_power_sleep(void);
+
+// Powers the output up, if asleep. `requested_us` (esp_timer time) is when the audio
+// that caused the wake arrived; the first-sample latency is measured from there.
+void audio_power_wake(int64_t requested_us);
+
+// Call after every write of real audio to the output; closes the latency measurement.
+void audio_power_first_sample(void);
+
+// Call periodically while asleep: follows VBUS for the light-sleep lock.
+void audio_power_poll(void);
+
+void audio_power_get_stats(audio_power_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
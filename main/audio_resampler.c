@@ -0,0 +1,193 @@
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include "audio_resampler.h"
+
+#define AUDIO_RS_CUTOFF      (0.92)  // Of Nyquist; the ratio is ~1, so no anti-aliasing is needed
+#define AUDIO_RS_KAISER_BETA (7.0)
+// PI gains on the low-passed fill. A ppm of ratio moves the fill by 0.048 frames/s at
+// 48 kHz, which makes this a slow loop (zeta ~0.9, settling in about a minute): every
+// step of the ratio is frequency modulation of the output, so the ratio must drift,
+// not jump. The means still wobble by tens of frames with the DMA bursts; the IIR
+// (~0.7 s at one step per DMA buffer) keeps the proportional term to a few ppm.
+#define AUDIO_RS_KP_PPM         (1)     // ppm per frame of fill error
+#define AUDIO_RS_KI_SHIFT       (16)    // Integral gain, per frame*ms of fill error
+#define AUDIO_RS_FILL_IIR_SHIFT (5)     // Low-pass of the step means, 1/32 per step
+
+// One extra row so phase p and p + 1 can always be interpolated.
+static int16_t s_coef[AUDIO_RS_PHASES + 1][AUDIO_RS_TAPS];
+static bool s_coef_ready;
+
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static void audio_rs_build_coef(void)
+{
+    const double half = AUDIO_RS_TAPS / 2.0;
+    const double center = AUDIO_RS_TAPS / 2 - 1;
+    const double i0_beta = bessel_i0(AUDIO_RS_KAISER_BETA);
+
+    for (int p = 0; p <= AUDIO_RS_PHASES; p++) {
+        double d = (double)p / AUDIO_RS_PHASES;
+        double h[AUDIO_RS_TAPS];
+        double sum = 0;
+        for (int k = 0; k < AUDIO_RS_TAPS; k++) {
+            double x = k - center - d;
+            double s = x == 0 ? 1.0 : sin(M_PI * AUDIO_RS_CUTOFF * x) / (M_PI * AUDIO_RS_CUTOFF * x);
+            double r = x / half;
+            double w = r * r < 1.0 ? bessel_i0(AUDIO_RS_KAISER_BETA * sqrt(1.0 - r * r)) / i0_beta : 0.0;
+            h[k] = s * w;
+            sum += h[k];
+        }
+        // Unity DC gain per phase, rounding error folded into the centre tap.
+        int32_t total = 0;
+        for (int k = 0; k < AUDIO_RS_TAPS; k++) {
+            s_coef[p][k] = (int16_t)lrint(h[k] / sum * 32767.0);
+            total += s_coef[p][k];
+        }
+        s_coef[p][(int)center + (d >= 0.5)] += (int16_t)(32767 - total);
+    }
+    s_coef_ready = true;
+}
+
+void audio_rs_init(audio_rs_t *rs, int channels)
+{
+    if (!s_coef_ready) {
+        audio_rs_build_coef();
+    }
+    rs->channels = channels > AUDIO_RS_MAX_CH ? AUDIO_RS_MAX_CH : channels;
+    audio_rs_reset(rs);
+}
+
+void audio_rs_reset(audio_rs_t *rs)
+{
+    rs->frac = 0;
+    rs->pos = 0;
+    rs->integral = 0;
+    rs->fill_sum = 0;
+    rs->fill_count = 0;
+    rs->fill_q8 = -1;
+    rs->tracking = false;
+    // Start with a zeroed window so the first output frame is available immediately.
+    rs->hist_len = AUDIO_RS_TAPS - 1;
+    memset(rs->hist, 0, sizeof(rs->hist));
+    audio_rs_set_ppm(rs, 0);
+}
+
+void audio_rs_set_ppm(audio_rs_t *rs, int32_t ppm)
+{
+    if (ppm > AUDIO_RS_MAX_PPM) {
+        ppm = AUDIO_RS_MAX_PPM;
+    } else if (ppm < -AUDIO_RS_MAX_PPM) {
+        ppm = -AUDIO_RS_MAX_PPM;
+    }
+    rs->ppm = ppm;
+    rs->step = (1ULL << 32) + (uint64_t)(((int64_t)ppm << 32) / 1000000);
+}
+
+int32_t audio_rs_track_fill(audio_rs_t *rs, uint32_t now_us, uint32_t fill_frames, uint32_t target_frames)
+{
+    rs->fill_sum += fill_frames;
+    rs->fill_count++;
+    if (!rs->tracking) {
+        // The first step waits for a whole period; early readings all sit at the top
+        rs->tracking = true;
+        rs->track_us = now_us;
+        return rs->ppm;
+    }
+    uint32_t dt_us = now_us - rs->track_us;
+    if (dt_us < AUDIO_RS_TRACK_PERIOD_US) {
+        return rs->ppm;
+    }
+    rs->track_us = now_us;
+
+    int32_t mean_q8 = (int32_t)((rs->fill_sum << 8) / rs->fill_count);
+    rs->fill_sum = 0;
+    rs->fill_count = 0;
+    rs->fill_q8 = rs->fill_q8 < 0 ? mean_q8 : rs->fill_q8 + ((mean_q8 - rs->fill_q8) >> AUDIO_RS_FILL_IIR_SHIFT);
+    int32_t err = (rs->fill_q8 >> 8) - (int32_t)target_frames;
+    int64_t integral = rs->integral + (int64_t)err * (dt_us / 1000);
+    int64_t ppm = (int64_t)err * AUDIO_RS_KP_PPM + (integral >> AUDIO_RS_KI_SHIFT);
+
+    if (ppm > -AUDIO_RS_MAX_PPM && ppm < AUDIO_RS_MAX_PPM) {
+        rs->integral = integral; // No windup while clamped
+    }
+    audio_rs_set_ppm(rs, (int32_t)ppm);
+    return rs->ppm;
+}
+
+static inline int32_t audio_rs_dot(const int16_t *x, const int16_t *h)
+{
+    int32_t acc = 0;
+    for (int k = 0; k < AUDIO_RS_TAPS; k++) {
+        acc += (int32_t)x[k] * h[k];
+    }
+    return acc;
+}
+
+static inline int16_t audio_rs_sat16(int32_t v)
+{
+    return v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : (int16_t)v);
+}
+
+static size_t audio_rs_run(audio_rs_t *rs, int16_t *out, size_t out_cap)
+{
+    size_t produced = 0;
+    while (rs->pos + AUDIO_RS_TAPS <= rs->hist_len && produced < out_cap) {
+        uint32_t phase = rs->frac >> (32 - AUDIO_RS_PHASE_BITS);
+        int32_t mu = (int32_t)((rs->frac >> (32 - AUDIO_RS_PHASE_BITS - 15)) & 0x7FFF);
+        const int16_t *c0 = s_coef[phase];
+        const int16_t *c1 = s_coef[phase + 1];
+
+        for (int ch = 0; ch < rs->channels; ch++) {
+            const int16_t *x = &rs->hist[ch][rs->pos];
+            int32_t a0 = audio_rs_dot(x, c0);
+            int32_t a1 = audio_rs_dot(x, c1);
+            int32_t y = a0 + (int32_t)(((int64_t)a1 - a0) * mu >> 15);
+            out[produced * rs->channels + ch] = audio_rs_sat16((y + (1 << 14)) >> 15);
+        }
+        produced++;
+
+        uint64_t next = (uint64_t)rs->frac + rs->step;
+        rs->pos += (size_t)(next >> 32);
+        rs->frac = (uint32_t)next;
+    }
+    return produced;
+}
+
+size_t audio_rs_process(audio_rs_t *rs, const int16_t *in, size_t in_frames, int16_t *out, size_t out_cap)
+{
+    size_t produced = 0;
+    while (in_frames > 0) {
+        // Keep the unconsumed tail (at most TAPS frames plus a step) at the front.
+        size_t keep = rs->hist_len - rs->pos;
+        for (int ch = 0; ch < rs->channels; ch++) {
+            memmove(rs->hist[ch], &rs->hist[ch][rs->pos], keep * sizeof(int16_t));
+        }
+        rs->pos = 0;
+        rs->hist_len = keep;
+
+        size_t n = AUDIO_RS_TAPS + AUDIO_RS_MAX_BLOCK - rs->hist_len;
+        if (n > in_frames) {
+            n = in_frames;
+        }
+        for (size_t i = 0; i < n; i++) {
+            for (int ch = 0; ch < rs->channels; ch++) {
+                rs->hist[ch][rs->hist_len + i] = in[i * rs->channels + ch];
+            }
+        }
+        rs->hist_len += n;
+        in += n * rs->channels;
+        in_frames -= n;
+
+        produced += audio_rs_run(rs, out + produced * rs->channels, out_cap - produced);
+    }
+    return produced;
+}
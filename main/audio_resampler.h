@@ -0,0 +1,64 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Adaptive fractional resampler for hosts that ignore the feedback endpoint.
+//
+// A 16-tap windowed-sinc polyphase filter with linear interpolation between 128 phases,
+// all in Q15. The ratio stays within a few hundred ppm of 1:1 and is steered by the
+// jitter-buffer fill, so the device clock never has to match the host's.
+// The per-sample kernel is two contiguous 16 x int16 dot products per channel, kept in
+// planar history buffers so the compiler can unroll and pipeline it.
+// Cost and THD+N are measured by tools/resampler_bench.c.
+
+#define AUDIO_RS_TAPS        (16)
+#define AUDIO_RS_PHASE_BITS  (7)
+#define AUDIO_RS_PHASES      (1 << AUDIO_RS_PHASE_BITS)
+#define AUDIO_RS_MAX_CH      (2)
+#define AUDIO_RS_MAX_BLOCK   (256)  // Frames accepted per internal pass
+#define AUDIO_RS_MAX_PPM     (1000) // Clamp for the fill-tracking loop
+#define AUDIO_RS_TRACK_PERIOD_US (20000) // Minimum interval between fill-tracking steps
+
+typedef struct {
+    int channels;
+    uint64_t step;              // Input frames advanced per output frame, 32.32
+    uint32_t frac;              // Fractional read position, 0.32
+    size_t pos;                 // Integer read position in `hist`
+    size_t hist_len;            // Valid frames in `hist`
+    int32_t ppm;                // Current ratio offset
+    int64_t integral;           // Fill error integrated over time, frames * ms
+    uint64_t fill_sum;          // Fill samples since the last tracking step
+    uint32_t fill_count;
+    int32_t fill_q8;            // Low-passed step means, frames 24.8; negative before the first
+    uint32_t track_us;          // Time of the last tracking step
+    bool tracking;              // At least one step since reset
+    int16_t hist[AUDIO_RS_MAX_CH][AUDIO_RS_TAPS + AUDIO_RS_MAX_BLOCK];
+} audio_rs_t;
+
+// Builds the shared coefficient table on first use and resets `rs` to 1:1.
+void audio_rs_init(audio_rs_t *rs, int channels);
+
+// Drops history and returns to 1:1, e.g. when the stream restarts.
+void audio_rs_reset(audio_rs_t *rs);
+
+// Sets the ratio directly; positive ppm consumes input faster than it produces output.
+void audio_rs_set_ppm(audio_rs_t *rs, int32_t ppm);
+
+// Feeds the fill-tracking PI loop one reading of the jitter-buffer fill at local time
+// `now_us`, fill and target in frames. The fill swings by a DMA buffer as the writer
+// drains it, so the loop steps at most every AUDIO_RS_TRACK_PERIOD_US, on the mean of
+// the readings since the previous step. Returns the ppm now in effect.
+int32_t audio_rs_track_fill(audio_rs_t *rs, uint32_t now_us, uint32_t fill_frames, uint32_t target_frames);
+
+// Consumes all `in_frames` interleaved frames and writes the resampled result to `out`.
+// `out_cap` must be at least in_frames + 2. Returns the number of frames produced.
+size_t audio_rs_process(audio_rs_t *rs, const int16_t *in, size_t in_frames, int16_t *out, size_t out_cap);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,156 @@
+#include <string.h>
+#include "audio_ring.h"
+
+bool audio_ring_init(audio_ring_t *ring, uint8_t *storage, size_t size, size_t frame_bytes, size_t target)
+{
+    if (ring == NULL || storage == NULL || size == 0 || (size & (size - 1)) != 0) {
+        return false;
+    }
+    // Whole frames never straddle the wrap, so in-place readers always make progress
+    if (frame_bytes == 0 || size % frame_bytes != 0 || target >= size) {
+        return false;
+    }
+
+    ring->buf = storage;
+    ring->size = size;
+    ring->frame_bytes = frame_bytes;
+    ring->target = target - (target % frame_bytes);
+    ring->primed = false;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->overruns, 0);
+    atomic_init(&ring->underruns, 0);
+    atomic_init(&ring->high_water, 0);
+    return true;
+}
+
+void audio_ring_reset(audio_ring_t *ring)
+{
+    // Consumer-owned: skipping the tail forward to head discards the backlog without
+    // racing the producer.
+    atomic_store_explicit(&ring->tail, atomic_load_explicit(&ring->head, memory_order_acquire), memory_order_release);
+    ring->primed = false;
+}
+
+size_t audio_ring_fill(const audio_ring_t *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return head - tail;
+}
+
+size_t audio_ring_write(audio_ring_t *ring, const uint8_t *data, size_t len)
+{
+    if (!audio_ring_reserve(ring, len)) {
+        return 0;
+    }
+
+    size_t off = atomic_load_explicit(&ring->head, memory_order_relaxed) & (ring->size - 1);
+    size_t first = ring->size - off;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(ring->buf + off, data, first);
+    memcpy(ring->buf, data + first, len - first);
+
+    audio_ring_commit(ring, len);
+    return len;
+}
+
+bool audio_ring_reserve(audio_ring_t *ring, size_t len)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (len > ring->size - (head - tail)) {
+        atomic_fetch_add_explicit(&ring->overruns, 1, memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+uint8_t *audio_ring_write_ptr(audio_ring_t *ring, size_t offset, size_t *contig)
+{
+    size_t off = (atomic_load_explicit(&ring->head, memory_order_relaxed) + offset) & (ring->size - 1);
+    *contig = ring->size - off;
+    return ring->buf + off;
+}
+
+void audio_ring_commit(audio_ring_t *ring, size_t len)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed) + len;
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+
+    size_t fill = head - atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (fill > atomic_load_explicit(&ring->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&ring->high_water, fill, memory_order_relaxed);
+    }
+}
+
+// Bytes the consumer may take now, applying the priming and underrun rules.
+static size_t audio_ring_readable(audio_ring_t *ring, size_t tail)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t avail = head - tail;
+
+    if (!ring->primed) {
+        if (avail < ring->target || avail == 0) {
+            return 0;
+        }
+        ring->primed = true;
+    }
+
+    if (avail == 0) {
+        atomic_fetch_add_explicit(&ring->underruns, 1, memory_order_relaxed);
+        ring->primed = false;
+    }
+    return avail;
+}
+
+size_t audio_ring_read(audio_ring_t *ring, uint8_t *out, size_t len)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t avail = audio_ring_readable(ring, tail);
+
+    if (len > avail) {
+        len = avail;
+    }
+    len -= len % ring->frame_bytes;
+    if (len == 0) {
+        return 0;
+    }
+
+    size_t off = tail & (ring->size - 1);
+    size_t first = ring->size - off;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(out, ring->buf + off, first);
+    memcpy(out + first, ring->buf, len - first);
+
+    atomic_store_explicit(&ring->tail, tail + len, memory_order_release);
+    return len;
+}
+
+size_t audio_ring_peek(audio_ring_t *ring, uint8_t **data, size_t len)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t avail = audio_ring_readable(ring, tail);
+    size_t off = tail & (ring->size - 1);
+
+    if (len > avail) {
+        len = avail;
+    }
+    if (len > ring->size - off) {
+        len = ring->size - off;
+    }
+    len -= len % ring->frame_bytes;
+    *data = ring->buf + off;
+    return len;
+}
+
+void audio_ring_consume(audio_ring_t *ring, size_t len)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + len, memory_order_release);
+}
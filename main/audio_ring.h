@@ -0,0 +1,79 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Single-producer/single-consumer byte ring used as the playback jitter buffer.
+// The producer (USB audio callback) only ever touches `head`, the consumer (audio
+// writer task) only ever touches `tail`, so no lock is needed between them.
+//
+// Besides the copying write/read calls, both sides can work on the storage in place:
+// the producer reserves space, fills it and commits; the consumer peeks a contiguous
+// region, hands it to the DMA driver and consumes it once that returns. Bytes between
+// tail and head belong to the consumer until consumed, so this is an ownership
+// transfer with no intermediate copy.
+// Deliberately free of ESP-IDF dependencies so it can be built and exercised on a host.
+typedef struct {
+    uint8_t *buf;
+    size_t size;               // Capacity in bytes, power of two
+    size_t frame_bytes;        // Producer/consumer always move whole frames
+    size_t target;             // Fill level (bytes) the consumer waits for before starting
+    _Atomic size_t head;       // Free-running write index, owned by the producer
+    _Atomic size_t tail;       // Free-running read index, owned by the consumer
+    bool primed;               // Consumer side: target reached, draining
+    _Atomic uint32_t overruns;  // Packets dropped because the ring was full
+    _Atomic uint32_t underruns; // Times the consumer ran dry after being primed
+    _Atomic size_t high_water; // Highest fill seen by the producer, bytes
+} audio_ring_t;
+
+// Bytes needed to hold `ms` milliseconds of audio in the given format.
+static inline size_t audio_ring_bytes_for_ms(uint32_t ms, uint32_t sample_rate, size_t frame_bytes)
+{
+    return (size_t)(((uint64_t)sample_rate * ms / 1000) * frame_bytes);
+}
+
+// Initializes `ring` on top of caller-owned `storage`. `size` must be a power of two and
+// `target` (in bytes) must leave room for at least one more packet.
+bool audio_ring_init(audio_ring_t *ring, uint8_t *storage, size_t size, size_t frame_bytes, size_t target);
+
+// Drops everything buffered and waits for `target` again. Consumer side only.
+void audio_ring_reset(audio_ring_t *ring);
+
+// Number of bytes currently buffered. Safe from either side.
+size_t audio_ring_fill(const audio_ring_t *ring);
+
+// Producer side. Copies the whole packet or nothing; a packet that doesn't fit is
+// counted as an overrun and dropped. Returns the number of bytes accepted.
+size_t audio_ring_write(audio_ring_t *ring, const uint8_t *data, size_t len);
+
+// Producer side, in place. Returns true if `len` more bytes fit; otherwise the packet
+// is counted as an overrun and must be dropped.
+bool audio_ring_reserve(audio_ring_t *ring, size_t len);
+
+// Producer side, in place. Address `offset` bytes past the head and the number of
+// contiguous bytes available there before the storage wraps.
+uint8_t *audio_ring_write_ptr(audio_ring_t *ring, size_t offset, size_t *contig);
+
+// Producer side, in place. Publishes `len` bytes written through audio_ring_write_ptr().
+void audio_ring_commit(audio_ring_t *ring, size_t len);
+
+// Consumer side. Returns 0 while the ring is (re)priming; once primed copies up to
+// `len` bytes (whole frames only) and falls back to priming on underrun.
+size_t audio_ring_read(audio_ring_t *ring, uint8_t *out, size_t len);
+
+// Consumer side, in place. Same priming rules as audio_ring_read(), but instead of
+// copying points `*data` at up to `len` contiguous bytes in the ring. The region stays
+// valid, and may be modified, until audio_ring_consume().
+size_t audio_ring_peek(audio_ring_t *ring, uint8_t **data, size_t len);
+
+// Consumer side, in place. Releases `len` bytes returned by audio_ring_peek().
+void audio_ring_consume(audio_ring_t *ring, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
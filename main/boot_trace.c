@@ -0,0 +1,73 @@
+#include <stdatomic.h>
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "boot_trace.h"
+
+static _Atomic uint32_t s_start[BOOT_PHASE_COUNT];
+static _Atomic uint32_t s_end[BOOT_PHASE_COUNT];
+static _Atomic uint32_t s_mark[BOOT_MARK_COUNT];
+
+static const char *const s_phase_names[BOOT_PHASE_COUNT] = {
+    [BOOT_PHASE_AUDIO] = "audio",
+    [BOOT_PHASE_I2S] = "i2s",
+    [BOOT_PHASE_UAC] = "uac",
+    [BOOT_PHASE_CONSOLE] = "console",
+    [BOOT_PHASE_PROFILE] = "profile",
+    [BOOT_PHASE_PHY] = "phy",
+    [BOOT_PHASE_TINYUSB] = "tinyusb",
+    [BOOT_PHASE_STORAGE] = "storage",
+    [BOOT_PHASE_INDEX] = "index",
+};
+
+static const char *const s_mark_names[BOOT_MARK_COUNT] = {
+    [BOOT_MARK_APP_MAIN] = "app_main",
+    [BOOT_MARK_ENUMERATED] = "enumerated",
+    [BOOT_MARK_FIRST_SOUND] = "first sound",
+};
+
+// 0 means "not recorded", so a stamp never reads 0
+static inline uint32_t boot_trace_stamp(int64_t us)
+{
+    return us > 0 ? (uint32_t)us : 1;
+}
+
+void boot_trace_begin(boot_phase_t phase)
+{
+    atomic_store_explicit(&s_start[phase], boot_trace_stamp(esp_timer_get_time()), memory_order_relaxed);
+}
+
+void boot_trace_end(boot_phase_t phase)
+{
+    atomic_store_explicit(&s_end[phase], boot_trace_stamp(esp_timer_get_time()), memory_order_relaxed);
+}
+
+IRAM_ATTR void boot_trace_mark(boot_mark_t mark, int64_t now_us)
+{
+    if (now_us > UINT32_MAX || atomic_load_explicit(&s_mark[mark], memory_order_relaxed) != 0) {
+        return;
+    }
+    uint32_t unset = 0;
+    atomic_compare_exchange_strong_explicit(&s_mark[mark], &unset, boot_trace_stamp(now_us),
+                                            memory_order_relaxed, memory_order_relaxed);
+}
+
+void boot_trace_get(boot_trace_t *trace)
+{
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        trace->phase_start_us[i] = atomic_load_explicit(&s_start[i], memory_order_relaxed);
+        trace->phase_end_us[i] = atomic_load_explicit(&s_end[i], memory_order_relaxed);
+    }
+    for (int i = 0; i < BOOT_MARK_COUNT; i++) {
+        trace->mark_us[i] = atomic_load_explicit(&s_mark[i], memory_order_relaxed);
+    }
+}
+
+const char *boot_trace_phase_name(boot_phase_t phase)
+{
+    return phase < BOOT_PHASE_COUNT ? s_phase_names[phase] : "?";
+}
+
+const char *boot_trace_mark_name(boot_mark_t mark)
+{
+    return mark < BOOT_MARK_COUNT ? s_mark_names[mark] : "?";
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Timestamps of the startup phases and of the milestones the boot time budget is
+// measured against.
+//
+// Times are microseconds of esp_timer_get_time(), which starts counting shortly before
+// app_main(), so the ROM and bootloader time before that is not included. A phase
+// records when it began and ended; a milestone records only the first time it is
+// reached and can be marked from an ISR. Everything is kept in 32 bits: a milestone
+// first reached more than 71 minutes after boot is not recorded.
+
+typedef enum {
+    BOOT_PHASE_AUDIO,       // Jitter buffer, writer task and WAV player
+    BOOT_PHASE_I2S,
+    BOOT_PHASE_UAC,
+    BOOT_PHASE_CONSOLE,     // CDC ACM and the console
+    BOOT_PHASE_PROFILE,     // NVS and the USB composition profile
+    BOOT_PHASE_PHY,
+    BOOT_PHASE_TINYUSB,     // tusb_init() and the device task
+    BOOT_PHASE_STORAGE,     // Wear levelling, MSC engine and FAT mount, off the boot path
+    BOOT_PHASE_INDEX,       // Directory scan and sample cache
+    BOOT_PHASE_COUNT
+} boot_phase_t;
+
+typedef enum {
+    BOOT_MARK_APP_MAIN,
+    BOOT_MARK_ENUMERATED,   // Configured by the host
+    BOOT_MARK_FIRST_SOUND,  // First non-silent sample out of the DMA
+    BOOT_MARK_COUNT
+} boot_mark_t;
+
+typedef struct {
+    uint32_t phase_start_us[BOOT_PHASE_COUNT];  // 0: not started
+    uint32_t phase_end_us[BOOT_PHASE_COUNT];    // 0: not finished
+    uint32_t mark_us[BOOT_MARK_COUNT];          // 0: not reached
+} boot_trace_t;
+
+void boot_trace_begin(boot_phase_t phase);
+void boot_trace_end(boot_phase_t phase);
+
+// Records `mark` at `now_us` (esp_timer_get_time()) unless it has been reached before.
+// IRAM-safe.
+void boot_trace_mark(boot_mark_t mark, int64_t now_us);
+
+void boot_trace_get(boot_trace_t *trace);
+
+const char *boot_trace_phase_name(boot_phase_t phase);
+const char *boot_trace_mark_name(boot_mark_t mark);
+
+#ifdef __cplusplus
+}
+#endif
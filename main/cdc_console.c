@@ -0,0 +1,205 @@
+#define _GNU_SOURCE // fopencookie
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/stream_buffer.h"
+#include "freertos/task.h"
+#include "esp_check.h"
+#include "esp_console.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "tusb.h"
+#include "tusb_cdc_acm.h"
+#include "line_assembler.h"
+#include "cdc_console.h"
+
+static const char *TAG = "cdc_console";
+
+#define CDC_CONSOLE_TASK_STACK    (CONFIG_TASK_CONSOLE_STACK)
+#define CDC_CONSOLE_TASK_PRIO     (CONFIG_TASK_CONSOLE_PRIO)  // Below TinyUSB, audio and storage
+#define CDC_CONSOLE_TASK_CORE     (CONFIG_TASK_CONSOLE_CORE)
+#define CDC_CONSOLE_TX_TIMEOUT_MS (100)
+
+static tinyusb_cdcacm_itf_t s_itf;
+static StreamBufferHandle_t s_rx;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static cdc_console_stats_t s_stats;
+
+// Worker task only
+static char s_queue[CDC_CONSOLE_QUEUE_LEN][CDC_CONSOLE_LINE_MAX];
+static int s_queue_head;
+static int s_queue_count;
+static cdc_console_raw_handler_t s_raw_handler;
+static void *s_raw_ctx;
+
+static inline void cdc_stats_add(uint32_t *counter, uint32_t n)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    *counter += n;
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+void cdc_console_feed(const uint8_t *data, size_t len)
+{
+    if (s_rx == NULL) {
+        return;
+    }
+    size_t sent = xStreamBufferSend(s_rx, data, len, 0);
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.rx_bytes += sent;
+    s_stats.rx_dropped += len - sent;
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+// Queues `len` bytes on the CDC endpoint and waits for them to go out. Gives up when
+// nobody is listening, so a closed port can't wedge the console.
+static size_t cdc_console_send(const uint8_t *data, size_t len)
+{
+    size_t done = 0;
+    while (done < len && tud_cdc_n_connected(s_itf)) {
+        size_t n = tinyusb_cdcacm_write_queue(s_itf, data + done, len - done);
+        done += n;
+        if (tinyusb_cdcacm_write_flush(s_itf, pdMS_TO_TICKS(CDC_CONSOLE_TX_TIMEOUT_MS)) != ESP_OK && n == 0) {
+            break;
+        }
+    }
+    return done;
+}
+
+// stdout of the worker. stdio hands over up to CDC_CONSOLE_TX_BATCH bytes at a time;
+// LF becomes CRLF for terminals.
+static ssize_t cdc_console_write(void *cookie, const char *buf, size_t size)
+{
+    size_t sent = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= size; i++) {
+        if (i == size || buf[i] == '\n') {
+            sent += cdc_console_send((const uint8_t *)buf + start, i - start);
+            if (i < size && cdc_console_send((const uint8_t *)"\r\n", 2) == 2) {
+                sent++;
+            }
+            start = i + 1;
+        }
+    }
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.tx_bytes += sent;
+    s_stats.tx_batches++;
+    s_stats.tx_dropped += size - sent;
+    taskEXIT_CRITICAL(&s_stats_lock);
+    return size;
+}
+
+void cdc_console_set_raw_handler(cdc_console_raw_handler_t handler, void *ctx)
+{
+    s_raw_ctx = ctx;
+    s_raw_handler = handler;
+}
+
+void cdc_console_write_raw(const void *data, size_t len)
+{
+    fflush(stdout);
+    size_t sent = cdc_console_send(data, len);
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.tx_bytes += sent;
+    s_stats.tx_batches++;
+    s_stats.tx_dropped += len - sent;
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void cdc_console_exec(const char *line)
+{
+    int64_t start = esp_timer_get_time();
+    int ret = 0;
+    esp_err_t err = esp_console_run(line, &ret);
+    if (err == ESP_ERR_NOT_FOUND) {
+        printf("Unknown command: %s\n", line);
+    } else if (err != ESP_OK && err != ESP_ERR_INVALID_ARG) {
+        printf("%s: %s\n", line, esp_err_to_name(err));
+    }
+    fflush(stdout);
+    ESP_LOGD(TAG, "Ran \"%s\" (%d)", line, ret);
+
+    uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.commands++;
+    s_stats.max_exec_us = MAX(s_stats.max_exec_us, us);
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+// Input is only taken from the stream buffer while the command queue has room, so a
+// burst of commands waits there instead of being dropped.
+static void cdc_console_task(void *arg)
+{
+    // stdout is per task in ESP-IDF
+    FILE *out = fopencookie(NULL, "w", (cookie_io_functions_t) { .write = cdc_console_write });
+    assert(out);
+    setvbuf(out, NULL, _IOFBF, CDC_CONSOLE_TX_BATCH);
+    stdout = out;
+
+    static char line_buf[CDC_CONSOLE_LINE_MAX];
+    static uint8_t rx[256];
+    size_t rx_len = 0;
+    size_t rx_off = 0;
+    line_asm_t la;
+    line_asm_init(&la, line_buf, sizeof(line_buf));
+
+    while (1) {
+        if (s_raw_handler) {
+            if (rx_off == rx_len) {
+                rx_off = 0;
+                rx_len = xStreamBufferReceive(s_rx, rx, sizeof(rx), pdMS_TO_TICKS(CDC_CONSOLE_RAW_POLL_MS));
+            }
+            rx_off += s_raw_handler(rx + rx_off, rx_len - rx_off, s_raw_ctx);
+            continue;
+        }
+
+        while (s_queue_count < CDC_CONSOLE_QUEUE_LEN && !s_raw_handler) {
+            if (rx_off == rx_len) {
+                rx_off = 0;
+                rx_len = xStreamBufferReceive(s_rx, rx, sizeof(rx), s_queue_count ? 0 : portMAX_DELAY);
+                if (rx_len == 0) {
+                    break;
+                }
+            }
+            const char *line;
+            uint32_t overflows = la.overflows;
+            rx_off += line_asm_feed(&la, rx + rx_off, rx_len - rx_off, &line);
+            if (la.overflows != overflows) {
+                cdc_stats_add(&s_stats.lines_too_long, 1);
+                printf("Line too long, max %d characters\n", CDC_CONSOLE_LINE_MAX - 1);
+                fflush(stdout);
+            }
+            if (line) {
+                strlcpy(s_queue[(s_queue_head + s_queue_count) % CDC_CONSOLE_QUEUE_LEN], line, CDC_CONSOLE_LINE_MAX);
+                s_queue_count++;
+                cdc_stats_add(&s_stats.lines, 1);
+            }
+        }
+
+        if (s_queue_count > 0 && !s_raw_handler) {
+            cdc_console_exec(s_queue[s_queue_head]);
+            s_queue_head = (s_queue_head + 1) % CDC_CONSOLE_QUEUE_LEN;
+            s_queue_count--;
+        }
+    }
+}
+
+void cdc_console_get_stats(cdc_console_stats_t *stats)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+esp_err_t cdc_console_init(int itf)
+{
+    s_itf = (tinyusb_cdcacm_itf_t)itf;
+    s_rx = xStreamBufferCreate(CDC_CONSOLE_RX_BYTES, 1);
+    ESP_RETURN_ON_FALSE(s_rx, ESP_ERR_NO_MEM, TAG, "No memory for receive buffer");
+    BaseType_t task_created = xTaskCreatePinnedToCore(cdc_console_task, "cdc_console", CDC_CONSOLE_TASK_STACK, NULL,
+                                                      CDC_CONSOLE_TASK_PRIO, NULL, CDC_CONSOLE_TASK_CORE);
+    ESP_RETURN_ON_FALSE(task_created == pdPASS, ESP_ERR_NO_MEM, TAG, "Failed to create console task");
+    return ESP_OK;
+}
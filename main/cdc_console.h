@@ -0,0 +1,61 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Console over the CDC-ACM port, executed off the USB stack.
+//
+// The CDC receive callback only copies the packet into a stream buffer. A low-priority
+// worker assembles lines from it (line_assembler.h), keeps up to
+// CDC_CONSOLE_QUEUE_LEN complete commands queued and runs them with esp_console_run()
+// one at a time, so a slow command never holds up tud_task() or audio. The worker's
+// stdout goes to the CDC port through a block-buffered stream: command output leaves in
+// CDC_CONSOLE_TX_BATCH chunks and is flushed once the command returns.
+// A command can switch the port to raw mode with cdc_console_set_raw_handler(): input
+// then bypasses the line assembler until the handler removes itself (see cdc_xfer.h).
+// esp_console must be initialized and the commands registered before input arrives.
+
+#define CDC_CONSOLE_RX_BYTES  (4096)  // Raw input parked while a command runs; holds a cdc_xfer window
+#define CDC_CONSOLE_LINE_MAX  (256)
+#define CDC_CONSOLE_QUEUE_LEN (4)
+#define CDC_CONSOLE_TX_BATCH  (512)
+
+typedef struct {
+    uint32_t rx_bytes;
+    uint32_t rx_dropped;        // Stream buffer full, input lost
+    uint32_t lines;
+    uint32_t lines_too_long;
+    uint32_t commands;
+    uint32_t tx_bytes;
+    uint32_t tx_batches;        // Writes handed to the CDC driver
+    uint32_t tx_dropped;        // Port closed or host not reading
+    uint32_t max_exec_us;       // Slowest command so far
+} cdc_console_stats_t;
+
+// Raw-mode input handler. Returns how many of `len` bytes it consumed; it is also called
+// with `len` 0 every CDC_CONSOLE_RAW_POLL_MS while no input arrives.
+typedef size_t (*cdc_console_raw_handler_t)(const uint8_t *data, size_t len, void *ctx);
+
+#define CDC_CONSOLE_RAW_POLL_MS (100)
+
+esp_err_t cdc_console_init(int itf);
+
+// Installs (or, with NULL, removes) the raw handler. Console worker only, i.e. from a
+// command or from the handler itself.
+void cdc_console_set_raw_handler(cdc_console_raw_handler_t handler, void *ctx);
+
+// Sends bytes to the port as they are, after whatever stdout holds. Console worker only.
+void cdc_console_write_raw(const void *data, size_t len);
+
+// Receive side: call from the CDC rx callback with the bytes just read. Never blocks.
+void cdc_console_feed(const uint8_t *data, size_t len);
+
+void cdc_console_get_stats(cdc_console_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
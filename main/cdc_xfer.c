@@ -0,0 +1,223 @@
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <unistd.h>
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "cdc_console.h"
+#include "cdc_xfer.h"
+
+static const char *TAG = "cdc_xfer";
+
+#define CDC_XFER_WRITE_BYTES (4096) // FAT cluster multiple, as in wav_player.c
+#define CDC_XFER_DRAIN_QUIET_MS (2000) // Twice the resend timeout of tools/cdc_xfer.py
+
+_Static_assert(CDC_XFER_WINDOW * CDC_XFER_FRAME_MAX <= CDC_CONSOLE_RX_BYTES,
+               "The console receive buffer must hold a full window");
+
+typedef enum {
+    XFER_IDLE,
+    XFER_ACTIVE,
+    XFER_FAILED,                // Draining starts after the frame being handled
+    XFER_DRAIN,
+} xfer_state_t;
+
+// Console worker only
+static xfer_state_t s_state;
+static int s_fd = -1;
+static bool s_discard;
+static char s_path[64];
+static uint32_t s_crc;
+static int64_t s_start_us;
+static int64_t s_last_rx_us;
+static cdc_xfer_rx_t s_rx;
+static uint8_t *s_wbuf;
+static size_t s_wfill;
+static cdc_xfer_stats_t s_stats;
+
+static uint32_t xfer_crc32(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    return esp_rom_crc32_le(crc, data, len);
+}
+
+static void xfer_send(cdc_xfer_type_t type, uint16_t seq, const uint8_t *payload, uint16_t len)
+{
+    uint8_t f[CDC_XFER_HDR_BYTES + 8 + 4];
+    assert(len <= 8);
+    cdc_console_write_raw(f, cdc_xfer_frame_build(f, type, seq, payload, len, xfer_crc32));
+}
+
+static bool xfer_flush(void)
+{
+    if (s_wfill == 0 || s_discard) {
+        s_wfill = 0;
+        return true;
+    }
+    bool ok = write(s_fd, s_wbuf, s_wfill) == (ssize_t)s_wfill;
+    s_wfill = 0;
+    return ok;
+}
+
+// Closes the file and reports the outcome. The DONE frame goes out after the file is
+// closed, so a host that saw DONE(OK) can rely on the data being on flash.
+static void xfer_finish(cdc_xfer_status_t status, uint32_t host_size, uint32_t host_crc)
+{
+    if (status == CDC_XFER_OK && !xfer_flush()) {
+        status = CDC_XFER_ERR_IO;
+    }
+    if (status == CDC_XFER_OK && host_size != s_stats.bytes) {
+        status = CDC_XFER_ERR_SIZE;
+    }
+    if (status == CDC_XFER_OK && host_crc != s_crc) {
+        status = CDC_XFER_ERR_CRC;
+    }
+    if (s_fd >= 0) {
+        if (status == CDC_XFER_OK && fsync(s_fd) != 0) {
+            status = CDC_XFER_ERR_IO;
+        }
+        close(s_fd);
+        s_fd = -1;
+        if (status != CDC_XFER_OK) {
+            unlink(s_path);
+        }
+    }
+    s_stats.status = status;
+    s_stats.duration_us = (uint32_t)(esp_timer_get_time() - s_start_us);
+
+    uint8_t done[8];
+    cdc_xfer_put_le32(done, status);
+    cdc_xfer_put_le32(done + 4, s_stats.bytes);
+    xfer_send(CDC_XFER_DONE, s_rx.expected, done, sizeof(done));
+    ESP_LOGI(TAG, "%s: %" PRIu32 " bytes in %" PRIu32 " ms, status %d, %" PRIu32 " resends",
+             s_path, s_stats.bytes, s_stats.duration_us / 1000, status, s_rx.naks);
+}
+
+static void xfer_leave(void)
+{
+    s_state = XFER_IDLE;
+    cdc_console_set_raw_handler(NULL, NULL);
+}
+
+// A transfer that stopped before END still has up to a window of DATA frames on the
+// way, and their payload must not reach the command line. Everything is discarded
+// until the host sends ABORT or goes quiet. Rejecting END drains as well, which
+// swallows the ABORT the host answers with.
+static void xfer_drain(void)
+{
+    s_state = XFER_DRAIN;
+    s_last_rx_us = esp_timer_get_time();
+    cdc_xfer_rx_drain(&s_rx);
+}
+
+static void xfer_reply(void *ctx, cdc_xfer_type_t type, uint16_t seq)
+{
+    xfer_send(type, seq, NULL, 0);
+}
+
+static bool xfer_data(void *ctx, const uint8_t *data, size_t len)
+{
+    s_crc = esp_rom_crc32_le(s_crc, data, len);
+    s_stats.bytes += len;
+    while (len > 0) {
+        size_t n = MIN(len, CDC_XFER_WRITE_BYTES - s_wfill);
+        memcpy(s_wbuf + s_wfill, data, n);
+        s_wfill += n;
+        data += n;
+        len -= n;
+        if (s_wfill == CDC_XFER_WRITE_BYTES && !xfer_flush()) {
+            xfer_finish(CDC_XFER_ERR_IO, 0, 0);
+            s_state = XFER_FAILED;
+            return false;
+        }
+    }
+    return true;
+}
+
+static void xfer_end(void *ctx, cdc_xfer_type_t type, const uint8_t *payload, size_t len)
+{
+    if (type == CDC_XFER_END) {
+        xfer_finish(CDC_XFER_OK, cdc_xfer_le32(payload), cdc_xfer_le32(payload + 4));
+    } else {
+        xfer_finish(CDC_XFER_ERR_ABORTED, 0, 0);
+    }
+    if (s_stats.status == CDC_XFER_OK || s_stats.status == CDC_XFER_ERR_ABORTED) {
+        xfer_leave();
+    } else {
+        s_state = XFER_FAILED;
+    }
+}
+
+static const cdc_xfer_frame_ops_t s_frame_ops = {
+    .crc32 = xfer_crc32,
+    .reply = xfer_reply,
+    .data = xfer_data,
+    .end = xfer_end,
+};
+
+// Raw-mode handler: collects frames from the byte stream.
+static size_t xfer_feed(const uint8_t *data, size_t len, void *ctx)
+{
+    int64_t now = esp_timer_get_time();
+    if (len == 0) {
+        if (s_state == XFER_ACTIVE && now - s_last_rx_us > CDC_XFER_IDLE_TIMEOUT_MS * 1000LL) {
+            xfer_finish(CDC_XFER_ERR_TIMEOUT, 0, 0);
+            xfer_drain();
+        } else if (s_state == XFER_DRAIN && now - s_last_rx_us > CDC_XFER_DRAIN_QUIET_MS * 1000LL) {
+            ESP_LOGI(TAG, "Link quiet, %" PRIu32 " bytes discarded", s_rx.drained_bytes);
+            xfer_leave();
+        }
+        return 0;
+    }
+    s_last_rx_us = now;
+    size_t n = cdc_xfer_rx_feed(&s_rx, data, len);
+    if (s_state == XFER_FAILED) {
+        xfer_drain();
+    } else if (s_state == XFER_DRAIN && s_rx.done) {
+        ESP_LOGI(TAG, "ABORT received, %" PRIu32 " bytes discarded", s_rx.drained_bytes);
+        xfer_leave();
+    }
+    return n;
+}
+
+esp_err_t cdc_xfer_start(const char *path)
+{
+    ESP_RETURN_ON_FALSE(s_state == XFER_IDLE, ESP_ERR_INVALID_STATE, TAG, "Transfer in progress");
+    if (s_wbuf == NULL) {
+        s_wbuf = malloc(CDC_XFER_WRITE_BYTES);
+        ESP_RETURN_ON_FALSE(s_wbuf, ESP_ERR_NO_MEM, TAG, "No memory for write buffer");
+    }
+
+    strlcpy(s_path, path, sizeof(s_path));
+    s_discard = strcmp(path, "-") == 0;
+    if (!s_discard) {
+        s_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ESP_RETURN_ON_FALSE(s_fd >= 0, ESP_FAIL, TAG, "Cannot create %s", path);
+    }
+
+    memset(&s_stats, 0, sizeof(s_stats));
+    cdc_xfer_rx_init(&s_rx, &s_frame_ops);
+    s_crc = 0;
+    s_wfill = 0;
+    s_start_us = s_last_rx_us = esp_timer_get_time();
+    s_state = XFER_ACTIVE;
+    cdc_console_set_raw_handler(xfer_feed, NULL);
+
+    // Flushed with the rest of the command output, before any frame can arrive
+    printf("XFER READY %d %d\n", CDC_XFER_WINDOW, CDC_XFER_MAX_PAYLOAD);
+    return ESP_OK;
+}
+
+void cdc_xfer_get_stats(cdc_xfer_stats_t *stats)
+{
+    *stats = s_stats;
+    stats->frames = s_rx.frames;
+    stats->naks = s_rx.naks;
+    stats->crc_errors = s_rx.crc_errors;
+    stats->resync_bytes = s_rx.resync_bytes;
+    stats->drained_bytes = s_rx.drained_bytes;
+}
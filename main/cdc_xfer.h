@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+#include "cdc_xfer_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary file upload over the console's CDC port, into the FAT volume while the
+// application keeps it mounted.
+//
+// The console command replies "XFER READY <window> <max_payload>" and switches the port
+// to raw mode. Both directions then carry frames:
+//
+//   0xA5 | type u8 | seq u16 | len u16 | payload[len] | crc32 u32 (over type..payload)
+//
+// all little-endian, CRC-32 as in zlib. The host streams DATA frames with consecutive
+// sequence numbers, keeping up to <window> of them unacknowledged. The device answers
+// every DATA frame it has consumed with ACK(next expected seq); a CRC error or a gap
+// gets NAK(next expected seq) and the host resends from there (go-back-N). END carries
+// the total size and the CRC-32 of the file; the device answers DONE(status, size) and
+// returns to line mode, as it does after ABORT. On any other error (a rejected END, a
+// write error mid-stream, or CDC_XFER_IDLE_TIMEOUT_MS of silence) the device sends DONE
+// with the error and then discards everything until the host sends ABORT or stays
+// quiet for two seconds, so frames still in flight are not run as commands. Hosts send
+// ABORT after any error.
+// Data is written in 4 KB blocks at block-aligned file offsets. A failed upload leaves
+// no file behind. Writing to "-" discards the data, which measures the link alone.
+// tools/cdc_xfer.py is the host side; the framing lives in cdc_xfer_frame.c, which
+// tools/cdc_xfer_test.c runs against a go-back-N sender over a lossy link.
+
+#define CDC_XFER_WINDOW       (7)
+#define CDC_XFER_IDLE_TIMEOUT_MS (5000)
+
+typedef enum {
+    CDC_XFER_OK = 0,
+    CDC_XFER_ERR_SIZE = 1,
+    CDC_XFER_ERR_CRC = 2,
+    CDC_XFER_ERR_IO = 3,
+    CDC_XFER_ERR_ABORTED = 4,
+    CDC_XFER_ERR_TIMEOUT = 5,
+} cdc_xfer_status_t;
+
+typedef struct {
+    uint32_t bytes;
+    uint32_t frames;
+    uint32_t naks;              // Resends requested
+    uint32_t crc_errors;
+    uint32_t resync_bytes;      // Skipped while hunting for a frame start
+    uint32_t drained_bytes;     // Discarded after a failure, until the host resynced
+    uint32_t duration_us;
+    cdc_xfer_status_t status;
+} cdc_xfer_stats_t;
+
+// Opens `path` for writing and switches the console port to raw mode. Run from a
+// console command.
+esp_err_t cdc_xfer_start(const char *path);
+
+// Counters of the current or last transfer.
+void cdc_xfer_get_stats(cdc_xfer_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
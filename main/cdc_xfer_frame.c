@@ -0,0 +1,128 @@
+#include <string.h>
+#include "cdc_xfer_frame.h"
+
+void cdc_xfer_rx_init(cdc_xfer_rx_t *rx, const cdc_xfer_frame_ops_t *ops)
+{
+    memset(rx, 0, sizeof(*rx));
+    rx->ops = *ops;
+}
+
+size_t cdc_xfer_frame_build(uint8_t *out, cdc_xfer_type_t type, uint16_t seq, const uint8_t *payload, uint16_t len,
+                            cdc_xfer_crc32_fn_t crc32)
+{
+    out[0] = CDC_XFER_MAGIC;
+    out[1] = type;
+    out[2] = seq;
+    out[3] = seq >> 8;
+    out[4] = len;
+    out[5] = len >> 8;
+    if (len) {
+        memcpy(out + CDC_XFER_HDR_BYTES, payload, len);
+    }
+    cdc_xfer_put_le32(out + CDC_XFER_HDR_BYTES + len, crc32(0, out + 1, CDC_XFER_HDR_BYTES - 1 + len));
+    return CDC_XFER_HDR_BYTES + len + 4;
+}
+
+void cdc_xfer_rx_drain(cdc_xfer_rx_t *rx)
+{
+    rx->draining = true;
+    rx->done = false;
+    rx->nak_sent = true;        // Keeps rx_nak() quiet
+    rx->fill = 0;
+}
+
+static void rx_nak(cdc_xfer_rx_t *rx)
+{
+    // One NAK per error burst; everything in flight behind the bad frame is resent anyway
+    if (!rx->nak_sent) {
+        rx->ops.reply(rx->ops.ctx, CDC_XFER_NAK, rx->expected);
+        rx->nak_sent = true;
+        rx->naks++;
+    }
+}
+
+static void rx_frame(cdc_xfer_rx_t *rx)
+{
+    const uint8_t type = rx->frame[1];
+    const uint16_t seq = cdc_xfer_le16(rx->frame + 2);
+    const uint16_t len = cdc_xfer_le16(rx->frame + 4);
+    const uint8_t *payload = rx->frame + CDC_XFER_HDR_BYTES;
+
+    if (rx->ops.crc32(0, rx->frame + 1, CDC_XFER_HDR_BYTES - 1 + len) != cdc_xfer_le32(payload + len)) {
+        rx->crc_errors += !rx->draining;
+        rx_nak(rx);
+        return;
+    }
+    if (rx->draining) {
+        if (type == CDC_XFER_ABORT) {
+            rx->draining = false;
+            rx->done = true;
+        }
+        return;
+    }
+    if (type == CDC_XFER_ABORT) {
+        rx->done = true;
+        rx->ops.end(rx->ops.ctx, CDC_XFER_ABORT, payload, len);
+        return;
+    }
+    if (seq != rx->expected) {
+        // A resend of something already consumed, or a frame after a lost one
+        rx_nak(rx);
+        return;
+    }
+    rx->nak_sent = false;
+
+    if (type == CDC_XFER_DATA) {
+        rx->frames++;
+        rx->expected++;
+        if (!rx->ops.data(rx->ops.ctx, payload, len)) {
+            rx->done = true;
+            return;
+        }
+        rx->ops.reply(rx->ops.ctx, CDC_XFER_ACK, rx->expected);
+    } else if (type == CDC_XFER_END && len == 8) {
+        rx->done = true;
+        rx->ops.end(rx->ops.ctx, CDC_XFER_END, payload, len);
+    }
+}
+
+size_t cdc_xfer_rx_feed(cdc_xfer_rx_t *rx, const uint8_t *data, size_t len)
+{
+    const bool draining = rx->draining;
+    size_t i = 0;
+    while (i < len && !rx->done) {
+        if (rx->fill == 0) {
+            if (data[i++] == CDC_XFER_MAGIC) {
+                rx->frame[rx->fill++] = CDC_XFER_MAGIC;
+            } else {
+                rx->resync_bytes += !draining;
+            }
+            continue;
+        }
+
+        size_t need = CDC_XFER_HDR_BYTES;
+        if (rx->fill >= CDC_XFER_HDR_BYTES) {
+            uint16_t payload_len = cdc_xfer_le16(rx->frame + 4);
+            if (payload_len > CDC_XFER_MAX_PAYLOAD) {
+                // Not a frame after all: hunt for the next magic byte
+                rx->fill = 0;
+                rx->crc_errors += !draining;
+                rx_nak(rx);
+                continue;
+            }
+            need = CDC_XFER_HDR_BYTES + payload_len + 4;
+        }
+        size_t n = need - rx->fill < len - i ? need - rx->fill : len - i;
+        memcpy(rx->frame + rx->fill, data + i, n);
+        rx->fill += n;
+        i += n;
+        if (rx->fill == need && need > CDC_XFER_HDR_BYTES) {
+            rx_frame(rx);
+            rx->fill = 0;
+        }
+    }
+    if (draining) {
+        rx->drained_bytes += i;
+    }
+    return i;
+}
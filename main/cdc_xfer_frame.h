@@ -0,0 +1,99 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Frame layer of the CDC file transfer (cdc_xfer.h): builds frames, and receives them
+// from the raw byte stream with the go-back-N sequencing the device side runs.
+//
+// The receiver hunts for the magic byte, checks each frame's CRC and sequence number,
+// hands DATA frames that arrive in order to `data` and answers them with ACK; a CRC
+// error or a gap gets one NAK per error burst. END and ABORT go to `end`. Bytes are
+// consumed up to the frame that ended the transfer, so what follows it stays with the
+// caller. After a transfer that failed, cdc_xfer_rx_drain() makes the receiver swallow
+// the frames the host still had in flight, and anything else, up to an intact ABORT.
+// The CRC is supplied by the caller (the ROM's on the device).
+
+#define CDC_XFER_MAGIC        (0xA5)
+#define CDC_XFER_MAX_PAYLOAD  (512)
+#define CDC_XFER_HDR_BYTES    (6)     // magic, type, seq, len
+#define CDC_XFER_FRAME_MAX    (CDC_XFER_HDR_BYTES + CDC_XFER_MAX_PAYLOAD + 4)
+
+typedef enum {
+    CDC_XFER_DATA = 0x01,
+    CDC_XFER_END = 0x02,        // u32 size, u32 crc32
+    CDC_XFER_ABORT = 0x03,
+    CDC_XFER_ACK = 0x81,
+    CDC_XFER_NAK = 0x82,
+    CDC_XFER_DONE = 0x83,       // u32 status, u32 size
+} cdc_xfer_type_t;
+
+// CRC-32 as in zlib, continued from `crc`; esp_rom_crc32_le() on the device.
+typedef uint32_t (*cdc_xfer_crc32_fn_t)(uint32_t crc, const uint8_t *data, uint32_t len);
+
+typedef struct {
+    cdc_xfer_crc32_fn_t crc32;
+    // ACK or NAK with the next expected sequence number
+    void (*reply)(void *ctx, cdc_xfer_type_t type, uint16_t seq);
+    // The payload of the next DATA frame in sequence. Returning false ends the transfer.
+    bool (*data)(void *ctx, const uint8_t *payload, size_t len);
+    // END or ABORT; ends the transfer
+    void (*end)(void *ctx, cdc_xfer_type_t type, const uint8_t *payload, size_t len);
+    void *ctx;
+} cdc_xfer_frame_ops_t;
+
+typedef struct {
+    cdc_xfer_frame_ops_t ops;
+    uint16_t expected;          // Sequence number of the next DATA frame
+    bool nak_sent;              // Within an error burst
+    bool done;                  // END, ABORT or a refused DATA frame was seen
+    bool draining;              // Discarding up to an ABORT
+    size_t fill;
+    uint32_t frames;
+    uint32_t naks;
+    uint32_t crc_errors;
+    uint32_t resync_bytes;      // Skipped while hunting for a frame start
+    uint32_t drained_bytes;     // Discarded after a failed transfer
+    uint8_t frame[CDC_XFER_FRAME_MAX];
+} cdc_xfer_rx_t;
+
+void cdc_xfer_rx_init(cdc_xfer_rx_t *rx, const cdc_xfer_frame_ops_t *ops);
+
+// Consumes bytes from the stream until they run out or the transfer is done. Returns
+// the number of bytes consumed.
+size_t cdc_xfer_rx_feed(cdc_xfer_rx_t *rx, const uint8_t *data, size_t len);
+
+// Discards all input up to and including an intact ABORT frame, which sets `done` and
+// clears `draining`. Nothing is answered meanwhile.
+void cdc_xfer_rx_drain(cdc_xfer_rx_t *rx);
+
+// Writes one frame to `out`, which must hold CDC_XFER_HDR_BYTES + len + 4 bytes. Returns
+// the frame's length.
+size_t cdc_xfer_frame_build(uint8_t *out, cdc_xfer_type_t type, uint16_t seq, const uint8_t *payload, uint16_t len,
+                            cdc_xfer_crc32_fn_t crc32);
+
+static inline uint16_t cdc_xfer_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static inline uint32_t cdc_xfer_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void cdc_xfer_put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,220 @@
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_check.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "dlog.h"
+
+static const char *TAG = "dlog";
+
+#define DLOG_TASK_STACK (CONFIG_TASK_LOG_STACK)
+#define DLOG_TASK_PRIO  (CONFIG_TASK_LOG_PRIO)  // Below everything but idle
+#define DLOG_TASK_CORE  (CONFIG_TASK_LOG_CORE)
+#define DLOG_DRAIN_MS   (50)
+#define DLOG_LINE_MAX   (160)
+#define DLOG_PATH_MAX   (64)
+#define DLOG_RAW_TAG    "tusb"  // For esp_log_write() filtering of dlog_printf() output
+
+_Static_assert((DLOG_RING_RECORDS & (DLOG_RING_RECORDS - 1)) == 0, "DLOG_RING_RECORDS must be a power of two");
+
+typedef struct {
+    uint32_t ts_us;             // Low 32 bits of esp_timer_get_time()
+    const char *tag;            // NULL: dlog_printf() output
+    const char *fmt;
+    uint8_t level;
+    uint8_t nargs;
+    uint32_t args[DLOG_MAX_ARGS];
+} dlog_record_t;
+
+// A slot is published by storing its claim position + 1 in `seq`, so a zeroed ring
+// starts out empty and needs no init.
+typedef struct {
+    _Atomic uint32_t seq;
+    dlog_record_t rec;
+} dlog_slot_t;
+
+// Any number of producers on one core (tasks preempting each other, ISRs), one
+// consumer: the drain task.
+typedef struct {
+    _Atomic uint32_t head;      // Next position to claim
+    _Atomic uint32_t tail;      // Next position to drain, owned by the drain task
+    _Atomic uint32_t written;
+    _Atomic uint32_t dropped;
+    dlog_slot_t slots[DLOG_RING_RECORDS];
+} dlog_ring_t;
+
+static dlog_ring_t s_ring[portNUM_PROCESSORS];
+static portMUX_TYPE s_path_lock = portMUX_INITIALIZER_UNLOCKED;
+static char s_path[DLOG_PATH_MAX];
+
+// Drain task only
+static uint32_t s_lines;
+static uint32_t s_file_errors;
+
+void dlog_write(esp_log_level_t level, const char *tag, const char *fmt,
+                uint32_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    dlog_ring_t *r = &s_ring[esp_cpu_get_core_id()];
+    uint32_t pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+    do {
+        // Acquire: the drain task is done with the slot before it is reused
+        if (pos - atomic_load_explicit(&r->tail, memory_order_acquire) >= DLOG_RING_RECORDS) {
+            atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+            return;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&r->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed));
+
+    dlog_slot_t *slot = &r->slots[pos & (DLOG_RING_RECORDS - 1)];
+    slot->rec = (dlog_record_t) {
+        .ts_us = (uint32_t)esp_timer_get_time(),
+        .tag = tag,
+        .fmt = fmt,
+        .level = level,
+        .nargs = nargs,
+        .args = { a0, a1, a2, a3 },
+    };
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    atomic_fetch_add_explicit(&r->written, 1, memory_order_relaxed);
+}
+
+int dlog_printf(const char *fmt, ...)
+{
+    uint32_t a[DLOG_MAX_ARGS] = { 0 };
+    uint32_t n = 0;
+    va_list ap;
+    va_start(ap, fmt);
+    for (const char *p = fmt; *p && n < DLOG_MAX_ARGS; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        if (p[1] == '%') {
+            p++;
+            continue;
+        }
+        a[n++] = va_arg(ap, uint32_t);
+    }
+    va_end(ap);
+    dlog_write(ESP_LOG_INFO, NULL, fmt, n, a[0], a[1], a[2], a[3]);
+    return 0;
+}
+
+// The published record at the tail of `r`, if any. A producer preempted between claim
+// and publish holds up the records behind it until the next pass.
+static dlog_slot_t *dlog_peek(dlog_ring_t *r)
+{
+    uint32_t pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    dlog_slot_t *slot = &r->slots[pos & (DLOG_RING_RECORDS - 1)];
+    return atomic_load_explicit(&slot->seq, memory_order_acquire) == pos + 1 ? slot : NULL;
+}
+
+// Takes the oldest published record across the cores.
+static bool dlog_next(dlog_record_t *rec)
+{
+    dlog_ring_t *best = NULL;
+    dlog_slot_t *best_slot = NULL;
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        dlog_slot_t *slot = dlog_peek(&s_ring[c]);
+        if (slot && (!best_slot || (int32_t)(slot->rec.ts_us - best_slot->rec.ts_us) < 0)) {
+            best = &s_ring[c];
+            best_slot = slot;
+        }
+    }
+    if (!best) {
+        return false;
+    }
+    *rec = best_slot->rec;
+    atomic_fetch_add_explicit(&best->tail, 1, memory_order_release);
+    return true;
+}
+
+static void dlog_format(const dlog_record_t *rec, char *line, size_t size)
+{
+    const uint32_t *a = rec->args;
+    if (rec->tag == NULL) {
+        snprintf(line, size, rec->fmt, a[0], a[1], a[2], a[3]);
+        return;
+    }
+    static const char letters[] = { 'N', 'E', 'W', 'I', 'D', 'V' };
+    int64_t now = esp_timer_get_time();
+    uint32_t age_us = (uint32_t)now - rec->ts_us;
+    uint32_t ms = (uint32_t)((now - age_us) / 1000);
+    int n = snprintf(line, size, "%c (%" PRIu32 ") %s: ", letters[rec->level % sizeof(letters)], ms, rec->tag);
+    if (n >= 0 && (size_t)n < size) {
+        n += snprintf(line + n, size - n, rec->fmt, a[0], a[1], a[2], a[3]);
+    }
+    // Truncated lines still end in a newline
+    n = n < 0 ? 0 : MIN((size_t)n, size - 2);
+    line[n] = '\n';
+    line[n + 1] = '\0';
+}
+
+static void dlog_task(void *arg)
+{
+    static char line[DLOG_LINE_MAX];
+    char path[DLOG_PATH_MAX];
+    dlog_record_t rec;
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(DLOG_DRAIN_MS));
+
+        taskENTER_CRITICAL(&s_path_lock);
+        memcpy(path, s_path, sizeof(path));
+        taskEXIT_CRITICAL(&s_path_lock);
+
+        // The file is only open while there is something to write, so the volume can be
+        // handed to the USB host between passes.
+        FILE *f = NULL;
+        bool opened = false;
+        while (dlog_next(&rec)) {
+            dlog_format(&rec, line, sizeof(line));
+            if (path[0] && !opened) {
+                opened = true;
+                f = fopen(path, "a");
+                if (f == NULL) {
+                    s_file_errors++;
+                }
+            }
+            if (f) {
+                fputs(line, f);
+            } else {
+                esp_log_write(rec.level, rec.tag ? rec.tag : DLOG_RAW_TAG, "%s", line);
+            }
+            s_lines++;
+        }
+        if (f) {
+            fclose(f);
+        }
+    }
+}
+
+void dlog_set_file(const char *path)
+{
+    taskENTER_CRITICAL(&s_path_lock);
+    strlcpy(s_path, path ? path : "", sizeof(s_path));
+    taskEXIT_CRITICAL(&s_path_lock);
+}
+
+void dlog_get_stats(dlog_stats_t *stats)
+{
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        stats->written[c] = atomic_load_explicit(&s_ring[c].written, memory_order_relaxed);
+        stats->dropped[c] = atomic_load_explicit(&s_ring[c].dropped, memory_order_relaxed);
+    }
+    stats->lines = s_lines;
+    stats->file_errors = s_file_errors;
+}
+
+esp_err_t dlog_init(void)
+{
+    BaseType_t task_created = xTaskCreatePinnedToCore(dlog_task, "dlog", DLOG_TASK_STACK, NULL,
+                                                      DLOG_TASK_PRIO, NULL, DLOG_TASK_CORE);
+    ESP_RETURN_ON_FALSE(task_created == pdPASS, ESP_ERR_NO_MEM, TAG, "Failed to create drain task");
+    return ESP_OK;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "esp_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Deferred logging for the audio and USB paths.
+//
+// DLOGx() stores a binary record of the format string pointer, the tag, up to
+// DLOG_MAX_ARGS 32-bit arguments and a timestamp in a lock-free ring for the
+// current core. It never blocks, formats or takes a lock, and it is safe from any task
+// or ISR (not from IRAM ISRs: the code lives in flash). A low-priority task formats
+// the records in timestamp order and writes them through esp_log_write(), i.e. to
+// UART or the CDC console, or appends them to a file. A full ring drops the record and
+// counts it.
+//
+// Formatting happens later on another task, so arguments must be integers, or pointers
+// to strings that never change (literals, constant tables). No floats, no 64-bit values.
+// TinyUSB's debug output goes through dlog_printf() the same way.
+
+#define DLOG_MAX_ARGS     (4)
+#define DLOG_RING_RECORDS (128) // Per core, power of two
+
+#define DLOGE(tag, fmt, ...) DLOG(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define DLOGW(tag, fmt, ...) DLOG(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define DLOGI(tag, fmt, ...) DLOG(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define DLOGD(tag, fmt, ...) DLOG(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+
+#define DLOG(level, tag, fmt, ...) do {                                     \
+        if (LOG_LOCAL_LEVEL >= (level)) {                                   \
+            dlog_write((level), (tag), (fmt), DLOG_ARGS_(__VA_ARGS__));     \
+        }                                                                   \
+    } while (0)
+
+// Expands to the argument count followed by DLOG_MAX_ARGS zero-padded arguments
+#define DLOG_A_(x)              ((uint32_t)(uintptr_t)(x))
+#define DLOG_0_()               0, 0, 0, 0, 0
+#define DLOG_1_(a)              1, DLOG_A_(a), 0, 0, 0
+#define DLOG_2_(a, b)           2, DLOG_A_(a), DLOG_A_(b), 0, 0
+#define DLOG_3_(a, b, c)        3, DLOG_A_(a), DLOG_A_(b), DLOG_A_(c), 0
+#define DLOG_4_(a, b, c, d)     4, DLOG_A_(a), DLOG_A_(b), DLOG_A_(c), DLOG_A_(d)
+#define DLOG_PICK_(_0, _1, _2, _3, _4, n, ...) n
+#define DLOG_ARGS_(...)         DLOG_PICK_(0, ##__VA_ARGS__, DLOG_4_, DLOG_3_, DLOG_2_, DLOG_1_, DLOG_0_)(__VA_ARGS__)
+
+typedef struct {
+    uint32_t written[portNUM_PROCESSORS];
+    uint32_t dropped[portNUM_PROCESSORS];   // Ring full
+    uint32_t lines;             // Formatted and written out
+    uint32_t file_errors;       // Batches that went to the log instead of the file
+} dlog_stats_t;
+
+// Starts the drain task. Records written before this are kept.
+esp_err_t dlog_init(void);
+
+void dlog_write(esp_log_level_t level, const char *tag, const char *fmt,
+                uint32_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+// printf-compatible entry for CFG_TUSB_DEBUG_PRINTF. Output is written as is, without
+// a log prefix, since TinyUSB builds lines from several calls.
+int dlog_printf(const char *fmt, ...);
+
+// Appends the output to `path` instead of the log; NULL goes back to the log. While the
+// file can't be opened (volume owned by the USB host) output goes to the log.
+void dlog_set_file(const char *path);
+
+void dlog_get_stats(dlog_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
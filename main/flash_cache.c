@@ -0,0 +1,187 @@
+#include <string.h>
+#include "flash_cache.h"
+
+#define UNIT_MASK ((size_t)FLASH_CACHE_UNIT_BYTES - 1)
+
+void flash_cache_init(flash_cache_t *cache, const flash_cache_ops_t *ops, uint8_t *storage)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->ops = *ops;
+    for (int i = 0; i < FLASH_CACHE_UNITS; i++) {
+        cache->entry[i].data = storage + (size_t)i * FLASH_CACHE_UNIT_BYTES;
+    }
+}
+
+static flash_cache_entry_t *flash_cache_find(flash_cache_t *cache, size_t unit)
+{
+    for (int i = 0; i < FLASH_CACHE_UNITS; i++) {
+        if (cache->entry[i].valid && cache->entry[i].addr == unit) {
+            return &cache->entry[i];
+        }
+    }
+    return NULL;
+}
+
+static int flash_cache_program(flash_cache_t *cache, size_t addr, const void *src, size_t len)
+{
+    int err = cache->ops.erase(cache->ops.ctx, addr, len);
+    if (err == 0) {
+        err = cache->ops.write(cache->ops.ctx, addr, src, len);
+    }
+    if (err == 0) {
+        cache->flash_bytes += len;
+    }
+    return err;
+}
+
+static int flash_cache_writeback(flash_cache_t *cache, flash_cache_entry_t *e)
+{
+    if (!e->dirty) {
+        return 0;
+    }
+    int err = flash_cache_program(cache, e->addr, e->data, FLASH_CACHE_UNIT_BYTES);
+    if (err == 0) {
+        e->dirty = false;
+        cache->unit_flushes++;
+    }
+    return err;
+}
+
+// Returns the cached copy of `unit`, loading it into the least recently used slot on a miss.
+static int flash_cache_load(flash_cache_t *cache, size_t unit, flash_cache_entry_t **out)
+{
+    flash_cache_entry_t *e = flash_cache_find(cache, unit);
+    if (e == NULL) {
+        e = &cache->entry[0];
+        for (int i = 1; i < FLASH_CACHE_UNITS && e->valid; i++) {
+            flash_cache_entry_t *c = &cache->entry[i];
+            if (!c->valid || c->last_use < e->last_use) {
+                e = c;
+            }
+        }
+        if (e->valid) {
+            int err = flash_cache_writeback(cache, e);
+            if (err != 0) {
+                return err;
+            }
+        }
+        e->valid = false;
+        int err = cache->ops.read(cache->ops.ctx, unit, e->data, FLASH_CACHE_UNIT_BYTES);
+        if (err != 0) {
+            return err;
+        }
+        e->addr = unit;
+        e->valid = true;
+        e->dirty = false;
+    }
+    e->last_use = ++cache->tick;
+    *out = e;
+    return 0;
+}
+
+int flash_cache_read(flash_cache_t *cache, size_t addr, void *dst, size_t len)
+{
+    int err = cache->ops.read(cache->ops.ctx, addr, dst, len);
+    if (err != 0) {
+        return err;
+    }
+
+    // Overlay cached units, which may be newer than flash
+    for (int i = 0; i < FLASH_CACHE_UNITS; i++) {
+        const flash_cache_entry_t *e = &cache->entry[i];
+        if (!e->valid || e->addr + FLASH_CACHE_UNIT_BYTES <= addr || e->addr >= addr + len) {
+            continue;
+        }
+        size_t start = e->addr > addr ? e->addr : addr;
+        size_t end = e->addr + FLASH_CACHE_UNIT_BYTES < addr + len ? e->addr + FLASH_CACHE_UNIT_BYTES : addr + len;
+        memcpy((uint8_t *)dst + (start - addr), e->data + (start - e->addr), end - start);
+    }
+    return 0;
+}
+
+int flash_cache_write(flash_cache_t *cache, size_t addr, const void *src, size_t len)
+{
+    const uint8_t *p = src;
+    cache->host_bytes += len;
+
+    while (len > 0) {
+        size_t unit = addr & ~UNIT_MASK;
+        size_t off = addr - unit;
+
+        if (off == 0 && len >= FLASH_CACHE_UNIT_BYTES) {
+            // Whole units: one erase and program for the run, cached copies are superseded
+            size_t run = len & ~UNIT_MASK;
+            for (int i = 0; i < FLASH_CACHE_UNITS; i++) {
+                flash_cache_entry_t *e = &cache->entry[i];
+                if (e->valid && e->addr >= addr && e->addr < addr + run) {
+                    e->valid = false;
+                }
+            }
+            int err = flash_cache_program(cache, addr, p, run);
+            if (err != 0) {
+                return err;
+            }
+            addr += run;
+            p += run;
+            len -= run;
+            continue;
+        }
+
+        size_t n = FLASH_CACHE_UNIT_BYTES - off < len ? FLASH_CACHE_UNIT_BYTES - off : len;
+        flash_cache_entry_t *e;
+        int err = flash_cache_load(cache, unit, &e);
+        if (err != 0) {
+            return err;
+        }
+        memcpy(e->data + off, p, n);
+        e->dirty = true;
+        addr += n;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int flash_cache_flush(flash_cache_t *cache)
+{
+    int ret = 0;
+    for (int i = 0; i < FLASH_CACHE_UNITS; i++) {
+        if (cache->entry[i].valid) {
+            int err = flash_cache_writeback(cache, &cache->entry[i]);
+            if (err != 0 && ret == 0) {
+                ret = err;
+            }
+        }
+    }
+    return ret;
+}
+
+int flash_cache_flush_unit(flash_cache_t *cache)
+{
+    flash_cache_entry_t *oldest = NULL;
+    for (int i = 0; i < FLASH_CACHE_UNITS; i++) {
+        flash_cache_entry_t *e = &cache->entry[i];
+        if (e->valid && e->dirty && (oldest == NULL || e->last_use < oldest->last_use)) {
+            oldest = e;
+        }
+    }
+    return oldest ? flash_cache_writeback(cache, oldest) : 0;
+}
+
+void flash_cache_invalidate(flash_cache_t *cache)
+{
+    for (int i = 0; i < FLASH_CACHE_UNITS; i++) {
+        cache->entry[i].valid = false;
+        cache->entry[i].dirty = false;
+    }
+}
+
+bool flash_cache_dirty(const flash_cache_t *cache)
+{
+    for (int i = 0; i < FLASH_CACHE_UNITS; i++) {
+        if (cache->entry[i].valid && cache->entry[i].dirty) {
+            return true;
+        }
+    }
+    return false;
+}
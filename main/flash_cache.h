@@ -0,0 +1,75 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Write-back cache of flash erase units between the MSC engine and wear levelling.
+//
+// With 512-byte WL sectors every partial write makes wear levelling read, erase and
+// rewrite the whole 4 KB flash sector around it. Here partial writes are merged into a
+// cached copy of their erase unit instead, and a unit is erased and programmed once,
+// when it is evicted or flushed. Writes that cover whole units go straight through.
+// Flash access goes through `flash_cache_ops_t`, so the cache can run against an
+// emulated partition on a host.
+
+#define FLASH_CACHE_UNIT_BYTES (4096)   // SPI flash erase sector
+#define FLASH_CACHE_UNITS      (4)
+
+// Each returns 0 on success; any other value is passed back to the caller.
+typedef struct {
+    int (*read)(void *ctx, size_t addr, void *dst, size_t len);
+    int (*erase)(void *ctx, size_t addr, size_t len);
+    int (*write)(void *ctx, size_t addr, const void *src, size_t len);
+    void *ctx;
+} flash_cache_ops_t;
+
+typedef struct {
+    size_t addr;                // Base address of the unit
+    bool valid;
+    bool dirty;
+    uint32_t last_use;
+    uint8_t *data;
+} flash_cache_entry_t;
+
+typedef struct {
+    flash_cache_ops_t ops;
+    flash_cache_entry_t entry[FLASH_CACHE_UNITS];
+    uint32_t tick;
+    uint64_t host_bytes;        // Bytes passed to flash_cache_write()
+    uint64_t flash_bytes;       // Bytes erased and programmed, always whole units
+    uint32_t unit_flushes;      // Cached units written back
+} flash_cache_t;
+
+// `storage` must hold FLASH_CACHE_UNITS * FLASH_CACHE_UNIT_BYTES bytes.
+void flash_cache_init(flash_cache_t *cache, const flash_cache_ops_t *ops, uint8_t *storage);
+
+// Reads through the cache, so data written but not yet flushed is returned.
+int flash_cache_read(flash_cache_t *cache, size_t addr, void *dst, size_t len);
+
+int flash_cache_write(flash_cache_t *cache, size_t addr, const void *src, size_t len);
+
+// Writes back every dirty unit. Cached data stays valid.
+int flash_cache_flush(flash_cache_t *cache);
+
+// Writes back the least recently used dirty unit, if any: at most one erase per call, so
+// the caller can serve other requests between units. Cached data stays valid.
+int flash_cache_flush_unit(flash_cache_t *cache);
+
+// Forgets all cached data, e.g. before flash is written by someone else. Flush first.
+void flash_cache_invalidate(flash_cache_t *cache);
+
+bool flash_cache_dirty(const flash_cache_t *cache);
+
+// Flash bytes programmed per byte written by the host, in percent (100 is ideal).
+static inline uint32_t flash_cache_write_amplification_pct(const flash_cache_t *cache)
+{
+    return cache->host_bytes ? (uint32_t)(cache->flash_bytes * 100 / cache->host_bytes) : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
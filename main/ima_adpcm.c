@@ -0,0 +1,140 @@
+#include "ima_adpcm.h"
+
+static const int8_t ima_index_table[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static const int16_t ima_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+// Applies one nibble to the channel state; shared by both directions so the encoder
+// tracks exactly what the decoder will reconstruct.
+static inline int16_t ima_adpcm_apply(ima_adpcm_channel_t *c, uint8_t nibble)
+{
+    int step = ima_step_table[c->index];
+    int diff = step >> 3;
+    if (nibble & 4) {
+        diff += step;
+    }
+    if (nibble & 2) {
+        diff += step >> 1;
+    }
+    if (nibble & 1) {
+        diff += step >> 2;
+    }
+    int32_t p = c->predictor + ((nibble & 8) ? -diff : diff);
+    c->predictor = p > INT16_MAX ? INT16_MAX : (p < INT16_MIN ? INT16_MIN : p);
+
+    int index = c->index + ima_index_table[nibble & 7];
+    c->index = index < 0 ? 0 : (index > 88 ? 88 : index);
+    return (int16_t)c->predictor;
+}
+
+bool ima_adpcm_decoder_start(ima_adpcm_decoder_t *dec, const uint8_t *block, size_t block_bytes, int channels)
+{
+    if (!ima_adpcm_block_valid(block_bytes, channels)) {
+        return false;
+    }
+    for (int c = 0; c < channels; c++) {
+        const uint8_t *h = block + 4 * c;
+        dec->ch[c].predictor = (int16_t)(h[0] | h[1] << 8);
+        dec->ch[c].index = h[2] > 88 ? 88 : h[2];
+    }
+    dec->data = block + 4 * channels;
+    dec->channels = channels;
+    dec->frames = ima_adpcm_frames_per_block(block_bytes, channels);
+    dec->pos = 0;
+    return true;
+}
+
+size_t ima_adpcm_decode(ima_adpcm_decoder_t *dec, int16_t *out, size_t max_frames)
+{
+    const int channels = dec->channels;
+    size_t n = 0;
+
+    if (dec->pos == 0 && max_frames > 0 && dec->frames > 0) {
+        // Frame 0 is the header sample itself
+        for (int c = 0; c < channels; c++) {
+            *out++ = (int16_t)dec->ch[c].predictor;
+        }
+        dec->pos = 1;
+        n = 1;
+    }
+
+    for (; n < max_frames && dec->pos < dec->frames; n++, dec->pos++) {
+        uint32_t j = dec->pos - 1;
+        // Group of eight nibbles per channel, low nibble first
+        const uint8_t *group = dec->data + (j >> 3) * 4 * channels + ((j & 7) >> 1);
+        int shift = (j & 1) * 4;
+        for (int c = 0; c < channels; c++) {
+            *out++ = ima_adpcm_apply(&dec->ch[c], (group[4 * c] >> shift) & 0x0F);
+        }
+    }
+    return n;
+}
+
+void ima_adpcm_encoder_init(ima_adpcm_encoder_t *enc, int channels)
+{
+    enc->channels = channels;
+    for (int c = 0; c < IMA_ADPCM_MAX_CH; c++) {
+        enc->ch[c].predictor = 0;
+        enc->ch[c].index = 0;
+    }
+}
+
+static uint8_t ima_adpcm_encode_sample(ima_adpcm_channel_t *c, int16_t sample)
+{
+    int diff = sample - c->predictor;
+    uint8_t nibble = 0;
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+    int step = ima_step_table[c->index];
+    for (uint8_t bit = 4; bit; bit >>= 1) {
+        if (diff >= step) {
+            nibble |= bit;
+            diff -= step;
+        }
+        step >>= 1;
+    }
+    ima_adpcm_apply(c, nibble);
+    return nibble;
+}
+
+void ima_adpcm_encode_block(ima_adpcm_encoder_t *enc, const int16_t *in, size_t frames,
+                            uint8_t *block, size_t block_bytes)
+{
+    const int channels = enc->channels;
+    const uint32_t block_frames = ima_adpcm_frames_per_block(block_bytes, channels);
+
+    for (int c = 0; c < channels; c++) {
+        int16_t first = frames > 0 ? in[c] : 0;
+        enc->ch[c].predictor = first;
+        uint8_t *h = block + 4 * c;
+        h[0] = (uint8_t)first;
+        h[1] = (uint8_t)((uint16_t)first >> 8);
+        h[2] = (uint8_t)enc->ch[c].index;
+        h[3] = 0;
+    }
+
+    uint8_t *data = block + 4 * channels;
+    for (uint32_t f = 1; f < block_frames; f++) {
+        uint32_t j = f - 1;
+        uint8_t *group = data + (j >> 3) * 4 * channels + ((j & 7) >> 1);
+        int shift = (j & 1) * 4;
+        const int16_t *frame = in + (f < frames ? f : (frames ? frames - 1 : 0)) * channels;
+        for (int c = 0; c < channels; c++) {
+            int16_t sample = frames > 0 ? frame[c] : 0;
+            uint8_t nibble = ima_adpcm_encode_sample(&enc->ch[c], sample);
+            if (shift == 0) {
+                group[4 * c] = nibble;
+            } else {
+                group[4 * c] |= nibble << 4;
+            }
+        }
+    }
+}
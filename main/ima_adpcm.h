@@ -0,0 +1,73 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// IMA-ADPCM (WAVE_FORMAT_IMA_ADPCM, 4 bits per sample) block codec.
+//
+// A block starts with a 4-byte header per channel (first sample, step index) followed
+// by 4-byte groups of eight nibbles, channels interleaved group by group. The decoder
+// works in place on the caller's block and produces any number of frames per call, so
+// playback needs one block of storage and no allocation. The encoder is used by the
+// host tool in tools/wav2adpcm.c.
+
+#define IMA_ADPCM_FORMAT_TAG   (0x0011)
+#define IMA_ADPCM_MAX_CH       (2)
+
+typedef struct {
+    int32_t predictor;
+    int index;
+} ima_adpcm_channel_t;
+
+typedef struct {
+    const uint8_t *data;        // Nibbles after the channel headers
+    int channels;
+    uint32_t frames;            // In the current block
+    uint32_t pos;               // Next frame to decode
+    ima_adpcm_channel_t ch[IMA_ADPCM_MAX_CH];
+} ima_adpcm_decoder_t;
+
+typedef struct {
+    int channels;
+    ima_adpcm_channel_t ch[IMA_ADPCM_MAX_CH];
+} ima_adpcm_encoder_t;
+
+// Frames held by a block of `block_bytes` (the WAV block_align).
+static inline uint32_t ima_adpcm_frames_per_block(size_t block_bytes, int channels)
+{
+    return (uint32_t)((block_bytes - 4 * channels) * 2 / channels + 1);
+}
+
+// A block must hold the headers plus whole 4-byte groups for every channel.
+static inline bool ima_adpcm_block_valid(size_t block_bytes, int channels)
+{
+    return channels >= 1 && channels <= IMA_ADPCM_MAX_CH &&
+           block_bytes > 4 * (size_t)channels && block_bytes % (4 * channels) == 0;
+}
+
+// Starts decoding `block`, which must stay valid until the block is done.
+bool ima_adpcm_decoder_start(ima_adpcm_decoder_t *dec, const uint8_t *block, size_t block_bytes, int channels);
+
+// Decodes up to `max_frames` interleaved frames of the current block. Returns the
+// number produced; 0 once the block is done.
+size_t ima_adpcm_decode(ima_adpcm_decoder_t *dec, int16_t *out, size_t max_frames);
+
+static inline bool ima_adpcm_block_done(const ima_adpcm_decoder_t *dec)
+{
+    return dec->pos >= dec->frames;
+}
+
+void ima_adpcm_encoder_init(ima_adpcm_encoder_t *enc, int channels);
+
+// Encodes one block from `frames` interleaved frames. A short final block is padded by
+// holding the last sample.
+void ima_adpcm_encode_block(ima_adpcm_encoder_t *enc, const int16_t *in, size_t frames,
+                            uint8_t *block, size_t block_bytes);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,53 @@
+#include "line_assembler.h"
+
+void line_asm_init(line_asm_t *la, char *buf, size_t cap)
+{
+    la->buf = buf;
+    la->cap = cap;
+    la->len = 0;
+    la->overflow = false;
+    la->last_cr = false;
+    la->lines = 0;
+    la->overflows = 0;
+}
+
+size_t line_asm_feed(line_asm_t *la, const uint8_t *data, size_t len, const char **line)
+{
+    *line = NULL;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = data[i];
+        bool was_cr = la->last_cr;
+        la->last_cr = c == '\r';
+
+        if (c == '\r' || c == '\n') {
+            if (c == '\n' && was_cr) {
+                continue;
+            }
+            bool complete = !la->overflow && la->len > 0;
+            la->buf[la->len] = '\0';
+            la->len = 0;
+            la->overflow = false;
+            if (complete) {
+                la->lines++;
+                *line = la->buf;
+                return i + 1;
+            }
+            continue;
+        }
+
+        if (la->overflow) {
+            continue;
+        }
+        if (c == '\b' || c == 0x7F) {
+            if (la->len > 0) {
+                la->len--;
+            }
+        } else if (la->len + 1 < la->cap) {
+            la->buf[la->len++] = (char)c;
+        } else {
+            la->overflow = true;
+            la->overflows++;
+        }
+    }
+    return len;
+}
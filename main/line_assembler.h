@@ -0,0 +1,37 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Incremental line assembler for the console byte stream.
+//
+// Bytes arrive in arbitrary pieces (64-byte USB packets, or one key at a time from a
+// terminal) and are collected until CR, LF or CRLF. Backspace/DEL edit the pending
+// line. A line longer than the buffer is dropped as a whole, up to its terminator, so a
+// truncated command is never run.
+// tools/line_assembler_test.c replays every packet split through it.
+
+typedef struct {
+    char *buf;
+    size_t cap;                 // Including the terminating NUL
+    size_t len;
+    bool overflow;              // Current line is too long and is being skipped
+    bool last_cr;               // Swallow the LF of a CRLF pair
+    uint32_t lines;
+    uint32_t overflows;
+} line_asm_t;
+
+void line_asm_init(line_asm_t *la, char *buf, size_t cap);
+
+// Consumes bytes up to and including the first line terminator in `data`. Returns the
+// number of bytes consumed; when a line completed, `*line` points to it (NUL-terminated,
+// valid until the next call), otherwise it is NULL. Empty lines are not reported.
+size_t line_asm_feed(line_asm_t *la, const uint8_t *data, size_t len, const char **line);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,19 +1,47 @@
 #include <errno.h>
+#include <math.h>
 #include <dirent.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
 #include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "esp_console.h"
 #include "esp_check.h"
 #include "esp_partition.h"
+#include "nvs.h"
+#include "nvs_flash.h"
 #include "driver/gpio.h"
 #include "tinyusb.h"
-#include "tusb_msc_storage.h" // Note: This seems unused if only UAC is the goal.
+#include "msc_storage.h"
 #include "tusb_cdc_acm.h"
 #include "tusb_console.h"
 #include "esp_private/usb_phy.h"
-#include "usb_device_uac.h"
+#include "usb_audio.h"
 #include "usb_descriptors.h"
 #include "driver/i2s_std.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_idf_version.h"
+#include "audio_ring.h"
+#include "audio_feedback.h"
+#include "audio_resampler.h"
+#include "audio_dsp.h"
+#include "wav_player.h"
+#include "cdc_console.h"
+#include "cdc_xfer.h"
+#include "telemetry.h"
+#include "dlog.h"
+#include "task_stats.h"
+#include "audio_power.h"
+#include "audio_capture.h"
+#include "audio_convert.h"
+#include "audio_mixer.h"
+#include "sample_cache.h"
+#include "boot_trace.h"
+#include "usb_desc_check.h"
+#include "freertos/semphr.h"
 // #include "driver/i2c_master.h" // Note: This seems unused in the provided snippet.
 #include "esp_log.h"
 #include <inttypes.h> // For PRIu32
@@ -27,21 +55,195 @@ static const char *TAG = "example_main";
 #define EXAMPLE_I2S_BCK_IO      (GPIO_NUM_9)
 #define EXAMPLE_I2S_WS_IO       (GPIO_NUM_45)
 #define EXAMPLE_I2S_DO_IO       (GPIO_NUM_10)
+#if UAC_MIC_CHANNELS > 0
+#define EXAMPLE_I2S_DI_IO       (GPIO_NUM_11)     // Codec ADC / I2S microphone data
+#else
 #define EXAMPLE_I2S_DI_IO       (I2S_GPIO_UNUSED) // Not used for output only
+#endif
+#define EXAMPLE_AMP_EN_IO       (GPIO_NUM_8)      // Amplifier enable, active high
+#define EXAMPLE_VBUS_IO         (GPIO_NUM_6)      // VBUS sense for the self-powered PHY
 
-#define EXAMPLE_AUDIO_SAMPLE_RATE (48000)
-#define EXAMPLE_AUDIO_BIT_WIDTH   (I2S_DATA_BIT_WIDTH_16BIT) // Must match USB descriptor
+// The host selects the actual rate and alt setting; these are used until it does.
+#define EXAMPLE_AUDIO_SAMPLE_RATE (UAC_SAMPLE_RATE_DEFAULT)
 #define EXAMPLE_I2S_DMA_DESC_NUM  (6)
-#define EXAMPLE_I2S_DMA_FRAME_NUM (1248) // ~2ms buffer, stereo, 16-bit (adjust as needed)
+#if UAC_MIC_CHANNELS > 0
+// RX shares the DMA layout, and its buffer length is the capture latency: 5 ms
+#define EXAMPLE_I2S_DMA_FRAME_NUM (240)
+#else
+#define EXAMPLE_I2S_DMA_FRAME_NUM (1248) // Frames per DMA buffer at EXAMPLE_AUDIO_SAMPLE_RATE, scaled with the rate
+#endif
+#define EXAMPLE_I2S_DMA_BUF_MAX   (4092) // Hardware limit for one DMA buffer, bytes
+// Slot layout the DAC is driven with. 0 follows the stream; anything else and the writer
+// converts each chunk on its way to the DMA.
+#if CONFIG_AUDIO_I2S_SLOT_WIDTH_16
+#define EXAMPLE_I2S_SLOT_BYTES    (2)
+#elif CONFIG_AUDIO_I2S_SLOT_WIDTH_32
+#define EXAMPLE_I2S_SLOT_BYTES    (4)
+#else
+#define EXAMPLE_I2S_SLOT_BYTES    (0)
+#endif
+#if CONFIG_AUDIO_I2S_SLOT_STEREO
+#define EXAMPLE_I2S_SLOT_CHANNELS (2)
+#else
+#define EXAMPLE_I2S_SLOT_CHANNELS (0)
+#endif
+#define EXAMPLE_I2S_SLOT_BUF_BYTES (2048) // Converted frames handed to i2s_channel_write at a time
+
+// --- Jitter buffer between the USB callback and the I2S writer ---
+#define EXAMPLE_AUDIO_FRAME_BYTES_MAX (CONFIG_UAC_SPEAKER_CHANNEL_NUM * UAC_FORMAT_2_N_BYTES)
+// The writer drains the ring one DMA buffer at a time, so the fill swings by a whole buffer
+// between two on_sent events. Playback (re)starts once the ring holds one DMA buffer plus
+// this margin, and the drift loops keep the mean fill there.
+#define EXAMPLE_AUDIO_RING_MARGIN_MS (5)
+#define EXAMPLE_AUDIO_POOL_BLOCK_BYTES (4096) // One I2S DMA buffer (EXAMPLE_I2S_DMA_BUF_MAX) rounded up to a power of two
+#define EXAMPLE_AUDIO_POOL_BLOCKS    (4)
+#define EXAMPLE_AUDIO_POOL_ALIGN     (64) // Cache line, so DMA never shares a line with other data
+#define EXAMPLE_AUDIO_RING_SIZE      (EXAMPLE_AUDIO_POOL_BLOCKS * EXAMPLE_AUDIO_POOL_BLOCK_BYTES) // Must exceed the target plus a few packets at the largest format
+
+#define EXAMPLE_AUDIO_WRITE_CHUNK_MS (2)  // Amount handed to i2s_channel_write per iteration
+#define EXAMPLE_AUDIO_WRITER_CORE    (CONFIG_TASK_AUDIO_CORE)  // Away from TinyUSB
+#define EXAMPLE_AUDIO_WRITER_PRIO    (CONFIG_TASK_AUDIO_PRIO)
+#define EXAMPLE_AUDIO_WRITER_STACK   (CONFIG_TASK_AUDIO_STACK)
+#define EXAMPLE_USB_TASK_CORE        (CONFIG_TASK_USB_CORE)
+#define EXAMPLE_USB_TASK_PRIO        (CONFIG_TASK_USB_PRIO)
+#define EXAMPLE_USB_TASK_STACK       (CONFIG_TASK_USB_STACK)
+#define EXAMPLE_CAPTURE_CORE         (CONFIG_TASK_CAPTURE_CORE)
+#define EXAMPLE_CAPTURE_PRIO         (CONFIG_TASK_CAPTURE_PRIO)
+#define EXAMPLE_CAPTURE_STACK        (CONFIG_TASK_CAPTURE_STACK)
+#define EXAMPLE_CAPTURE_TIMEOUT_MS   (20) // Longest RX read, bounds how long the writer waits for the RX lock
+#define EXAMPLE_AUDIO_FB_PERIOD_MS   (10) // Feedback control loop update interval
+#define EXAMPLE_AUDIO_IDLE_MS        (CONFIG_AUDIO_POWER_IDLE_MS) // Without audio before the output powers down
+#define EXAMPLE_AUDIO_SLEEP_POLL_MS  (100) // Writer wake-up period while powered down
+#define EXAMPLE_AUDIO_PREROLL_MS     (CONFIG_AUDIO_START_PREROLL_MS) // Clocked silence between output start and the first sample
+#define EXAMPLE_AUDIO_FADE_MS        (CONFIG_AUDIO_START_FADE_MS)
+#define EXAMPLE_AUDIO_SILENCE_BYTES  (512)
+
+// --- Sound effects mixed over the output ---
+#define EXAMPLE_SAMPLE_CACHE_BYTES   (CONFIG_SAMPLE_CACHE_KB * 1024)
+#define EXAMPLE_SAMPLE_FILE_MAX      (CONFIG_SAMPLE_CACHE_FILE_MAX_KB * 1024)
+#define EXAMPLE_MSC_VIEW_BYTES       (CONFIG_MSC_APP_VIEW_KB * 1024) // Keeps /data readable while the host owns it
+#define EXAMPLE_SFX_QUEUE_LEN        (8)
+
+// --- Startup ---
+// USB and audio come up in app_main; the storage volume is mounted and indexed by a
+// task of its own afterwards, so enumeration never waits for wear levelling or FAT.
+#define EXAMPLE_STORAGE_TASK_CORE    (CONFIG_TASK_STORAGE_CORE)
+#define EXAMPLE_STORAGE_TASK_PRIO    (CONFIG_TASK_STORAGE_PRIO)
+#define EXAMPLE_STORAGE_TASK_STACK   (CONFIG_TASK_STORAGE_STACK)
+#define EXAMPLE_BOOT_BUDGET_MS       (CONFIG_BOOT_TIME_BUDGET_MS) // Power-on to enumerated and to first sound
+
+// --- USB composition ---
+#if CONFIG_USB_PROFILE_DEFAULT_AUDIO
+#define EXAMPLE_USB_PROFILE_DEFAULT  USB_PROFILE_AUDIO
+#elif CONFIG_USB_PROFILE_DEFAULT_AUDIO_CDC
+#define EXAMPLE_USB_PROFILE_DEFAULT  USB_PROFILE_AUDIO_CDC
+#elif CONFIG_USB_PROFILE_DEFAULT_MAINTENANCE
+#define EXAMPLE_USB_PROFILE_DEFAULT  USB_PROFILE_MAINTENANCE
+#else
+#define EXAMPLE_USB_PROFILE_DEFAULT  USB_PROFILE_FULL
+#endif
+#define EXAMPLE_USB_RESCUE_IO        (GPIO_NUM_0)  // BOOT button: held at reset, starts the maintenance profile
+#define EXAMPLE_USB_DETACH_MS        (200) // Long enough for any host to notice the device left
+#define EXAMPLE_USB_NVS_NAMESPACE    "usb"
+#define EXAMPLE_USB_NVS_PROFILE_KEY  "profile"
+#define EXAMPLE_USB_EP_NUM_MAX       (6)   // OTG endpoints besides EP0
+#define EXAMPLE_USB_IN_EP_MAX        (4)   // IN endpoints the OTG FIFOs can run at once, besides EP0 IN
+
+// --- Clock-drift correction ---
+// FEEDBACK lets the host adapt its rate through the feedback endpoint. RESAMPLER is for
+// hosts that ignore it: the stream is resampled locally, steered by the ring fill.
+#define EXAMPLE_AUDIO_DRIFT_FEEDBACK  (0)
+#define EXAMPLE_AUDIO_DRIFT_RESAMPLER (1)
+#if CONFIG_AUDIO_DRIFT_RESAMPLER
+#define EXAMPLE_AUDIO_DRIFT_MODE      EXAMPLE_AUDIO_DRIFT_RESAMPLER
+#else
+#define EXAMPLE_AUDIO_DRIFT_MODE      EXAMPLE_AUDIO_DRIFT_FEEDBACK
+#endif
+
 
 // --- I2S Handles ---
 static i2s_chan_handle_t i2s_tx_handle = NULL;
-static i2s_chan_handle_t i2s_rx_handle = NULL; // Keep if you plan to use RX, otherwise can remove its setup
+static i2s_chan_handle_t i2s_rx_handle = NULL; // Microphone capture, full duplex with TX
+
+#if UAC_MIC_CHANNELS > 0
+// --- Capture ---
+// The capture task reads RX under the lock; the writer takes it to stop, rebuild or
+// power down the channels, and holds it while the output is powered down.
+static SemaphoreHandle_t i2s_rx_lock;
+static _Atomic bool mic_streaming;
+static _Atomic uint32_t mic_frames;      // Delivered to the USB FIFO
+static _Atomic uint32_t mic_dropped;     // Frames the FIFO had no room for
+// Frames clocked out and in by the DMA. Both run off one clock, so their difference
+// only moves when a channel restarts.
+static _Atomic uint32_t i2s_tx_frames;
+static _Atomic uint32_t i2s_rx_frames;
+#endif
+
+// --- Playback jitter buffer ---
+// The writer task owns the applied format; the TinyUSB task only queues requests for it.
+static usb_audio_format_t spk_format;
+static usb_audio_format_t spk_format_host;
+static QueueHandle_t spk_format_queue = NULL;
+static _Atomic uint32_t spk_format_requested;
+static _Atomic uint32_t spk_format_applied;
+static size_t spk_frame_bytes;
+static size_t spk_chunk_bytes;
+static uint32_t i2s_dma_frames;
+static uint8_t i2s_slot_bytes;
+static uint8_t i2s_slot_channels;
+static size_t i2s_frame_bytes;
+static audio_convert_fn_t spk_to_slots; // NULL: chunks go to the DMA as they are
+static uint8_t *spk_ring_storage;  // DMA-capable: USB writes and I2S reads it in place
+static audio_ring_t spk_ring;
+static _Atomic uint64_t spk_copy_bytes_avoided; // memcpy traffic saved by in-place ring access
+static TaskHandle_t audio_writer_handle = NULL;
+static _Atomic bool spk_host_streaming;  // Host has a non-zero alt setting selected
+static int64_t spk_output_start_us;      // When the I2S channel last started clocking
+
+// Effects are requested through sfx_queue and mixed by the writer after the DSP, so host
+// volume, mute and fades don't apply to them.
+typedef struct {
+    const sample_cache_entry_t *sample;     // NULL: stop all
+    int32_t gain;                           // Q15
+} sfx_request_t;
+static QueueHandle_t sfx_queue;
+static audio_mixer_t spk_mixer;             // Writer task only
+static _Atomic uint32_t sfx_skipped;        // Not at the stream's rate
+
+// --- Stream start latency ---
+// From the SET_INTERFACE that opens a stream to its first I2S write and to the first
+// non-silent sample leaving the DMA. The on_sent ISR only scans played buffers while a
+// measurement is armed.
+typedef struct {
+    uint32_t starts;
+    uint32_t first_write_us;
+    uint32_t first_sound_us;
+    uint32_t max_first_sound_us;
+} spk_start_stats_t;
+
+static _Atomic uint32_t spk_set_itf_us;  // Low 32 bits of esp_timer_get_time()
+static _Atomic bool spk_start_pending;   // Stream opened, nothing written yet
+static _Atomic bool spk_sound_armed;     // Written, waiting for sound in a played buffer
+static portMUX_TYPE spk_start_lock = portMUX_INITIALIZER_UNLOCKED;
+static spk_start_stats_t spk_start_stats;
+static audio_fb_t spk_fb;
+#if EXAMPLE_AUDIO_DRIFT_MODE == EXAMPLE_AUDIO_DRIFT_RESAMPLER
+static audio_rs_t spk_rs;
+#endif
+
+// --- Playback DSP ---
+// Parameters are written by the USB and console contexts under the lock; the writer
+// task picks up a copy whenever the generation changes and owns everything else.
+static portMUX_TYPE dsp_params_lock = portMUX_INITIALIZER_UNLOCKED;
+static audio_dsp_params_t dsp_params;
+static _Atomic uint32_t dsp_params_gen;
+static uint32_t dsp_params_applied;
+static audio_dsp_t spk_dsp;
 
 static void usb_phy_init(void)
 {
     const gpio_config_t vbus_gpio_config = {
-        .pin_bit_mask = BIT64(GPIO_NUM_6),
+        .pin_bit_mask = BIT64(EXAMPLE_VBUS_IO),
         .mode = GPIO_MODE_INPUT,
         .pull_up_en = GPIO_PULLUP_DISABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
@@ -52,7 +254,7 @@ static void usb_phy_init(void)
     static usb_phy_handle_t phy_hdl; // Make static to ensure it remains valid
     // The otg_io_conf struct must also be static or global if phy_conf is static/global
     // and its address is stored. For local usage like this, it's fine.
-    usb_phy_otg_io_conf_t otg_io_conf = USB_PHY_SELF_POWERED_DEVICE(GPIO_NUM_6); // Use the defined GPIO_NUM_6
+    usb_phy_otg_io_conf_t otg_io_conf = USB_PHY_SELF_POWERED_DEVICE(EXAMPLE_VBUS_IO);
 
     usb_phy_config_t phy_conf = {
         .controller = USB_PHY_CTRL_OTG,
@@ -63,46 +265,92 @@ static void usb_phy_init(void)
     ESP_ERROR_CHECK(usb_new_phy(&phy_conf, &phy_hdl));
 }
 
+static usb_profile_t usb_profile_saved(void)
+{
+    nvs_handle_t nvs;
+    uint8_t profile = EXAMPLE_USB_PROFILE_DEFAULT;
+    if (nvs_open(EXAMPLE_USB_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        nvs_get_u8(nvs, EXAMPLE_USB_NVS_PROFILE_KEY, &profile);
+        nvs_close(nvs);
+    }
+    return profile < USB_PROFILE_COUNT ? (usb_profile_t)profile : EXAMPLE_USB_PROFILE_DEFAULT;
+}
+
+static esp_err_t usb_profile_save(usb_profile_t profile)
+{
+    nvs_handle_t nvs;
+    ESP_RETURN_ON_ERROR(nvs_open(EXAMPLE_USB_NVS_NAMESPACE, NVS_READWRITE, &nvs), TAG, "Cannot open NVS");
+    esp_err_t err = nvs_set_u8(nvs, EXAMPLE_USB_NVS_PROFILE_KEY, (uint8_t)profile);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+// The saved profile, or maintenance while the rescue button is held: the audio-only
+// profile has no console to switch back from.
+static usb_profile_t usb_profile_boot(void)
+{
+    const gpio_config_t rescue_gpio_config = {
+        .pin_bit_mask = BIT64(EXAMPLE_USB_RESCUE_IO),
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    ESP_ERROR_CHECK(gpio_config(&rescue_gpio_config));
+    if (gpio_get_level(EXAMPLE_USB_RESCUE_IO) == 0) {
+        ESP_LOGW(TAG, "Rescue button held, starting the maintenance profile");
+        return USB_PROFILE_MAINTENANCE;
+    }
+    return usb_profile_saved();
+}
+
+static void usb_check_log(void *ctx, const char *problem)
+{
+    ESP_LOGE(TAG, "USB profile %s: %s", (const char *)ctx, problem);
+}
+
+static void usb_check_print(void *ctx, const char *problem)
+{
+    printf("  %s\n", problem);
+}
+
+// Checks the descriptors of `profile` against this controller, as a host would find
+// them on enumeration. Returns the number of problems, each passed to `report`.
+static int usb_profile_check(usb_profile_t profile, usb_desc_report_fn_t report, usb_desc_layout_t *layout)
+{
+    const usb_desc_limits_t limits = {
+        .ep_num_max = EXAMPLE_USB_EP_NUM_MAX,
+        .in_ep_max = EXAMPLE_USB_IN_EP_MAX,
+        .string_count = usb_descriptors_string_count(),
+    };
+    void *ctx = (void *)usb_descriptors_profile_name(profile);
+    const uint8_t *config = usb_descriptors_config(profile);
+    int problems = usb_desc_check_device(usb_descriptors_device(), &limits, report, ctx);
+    problems += usb_desc_check_config(config, (size_t)(config[2] | (config[3] << 8)), &limits, layout, report, ctx);
+    return problems;
+}
+
 #define BASE_PATH "/data" // base path to mount the partition
 static uint8_t buf[CONFIG_TINYUSB_CDC_RX_BUFSIZE + 1];
  
  
  
-// mount the partition and show all the files in BASE_PATH
-static void _mount(void)
+// mount the partition in the application
+static esp_err_t _mount(void)
 {
     ESP_LOGI(TAG, "Mount storage...");
-    ESP_ERROR_CHECK(tinyusb_msc_storage_mount(BASE_PATH));
-
-    // List all the files in this directory
-    ESP_LOGI(TAG, "\nls command output:");
-    struct dirent *d;
-    DIR *dh = opendir(BASE_PATH);
-    if (!dh) {
-        if (errno == ENOENT) {
-            //If the directory is not found
-            ESP_LOGE(TAG, "Directory doesn't exist %s", BASE_PATH);
-        } else {
-            //If the directory is not readable then throw error and exit
-            ESP_LOGE(TAG, "Unable to read directory %s", BASE_PATH);
-        }
-        return;
-    }
-    //While the next entry is not readable we will print directory files
-    while ((d = readdir(dh)) != NULL) {
-        printf("%s\n", d->d_name);
-    }
-    return;
+    return msc_storage_mount(BASE_PATH);
 }
 
-
-
 // callback that is delivered when storage is mounted/unmounted by application.
-static void storage_mount_changed_cb(tinyusb_msc_event_t *event)
+static void storage_mount_changed_cb(bool mounted_to_app)
 {
     static bool inited = false;
-    ESP_LOGI("USB", "Storage mounted to application: %s", event->mount_changed_data.is_mounted ? "Yes" : "No");
-    if(event->mount_changed_data.is_mounted){
+    ESP_LOGI("USB", "Storage mounted to application: %s", mounted_to_app ? "Yes" : "No");
+    if(mounted_to_app){
         if(!inited){
             return;
         }
@@ -130,64 +378,325 @@ static esp_err_t storage_init_spiflash(wl_handle_t *wl_handle)
     return wl_mount(data_partition, wl_handle);
 }
 
+static _Atomic bool storage_ready;          // Mounted and indexed, or handed to the host
+static _Atomic bool storage_release_pending; // The CDC port closed before that
+
+// Hands the volume to the host if the CDC port closed while the storage task was still
+// busy. Called by both sides; whichever sees the other's flag does it, exactly once.
+static void storage_release_if_pending(void)
+{
+    if (atomic_load(&storage_ready) && atomic_exchange(&storage_release_pending, false)) {
+        // With a view the track plays on from the snapshot
+        if (!msc_storage_view_enabled()) {
+            wav_player_stop();
+        }
+        msc_storage_unmount();
+    }
+}
+
+// Brings up wear levelling and the MSC engine, mounts the volume in the application and
+// loads the sound effects from it, then exits. Runs once USB and audio are up; until it
+// is done the host sees the unit becoming ready.
+static void storage_task(void *arg)
+{
+    boot_trace_begin(BOOT_PHASE_STORAGE);
+    static wl_handle_t wl_handle = WL_INVALID_HANDLE;
+    esp_err_t err = storage_init_spiflash(&wl_handle);
+    if (err == ESP_OK) {
+        const msc_storage_config_t config_spi = {
+            .wl_handle = wl_handle,
+            .mount_changed_cb = storage_mount_changed_cb,
+            .mount_config.max_files = 5,
+            .view_bytes = EXAMPLE_MSC_VIEW_BYTES,
+        };
+        err = msc_storage_init(&config_spi);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Storage unavailable: %s", esp_err_to_name(err));
+        vTaskDelete(NULL);
+    }
+
+    //mounted in the app by default
+    bool mounted = _mount() == ESP_OK;
+    if (!mounted) {
+        ESP_LOGE(TAG, "Mount failed, leaving the volume to the host");
+        msc_storage_unmount();
+    }
+    boot_trace_end(BOOT_PHASE_STORAGE);
+
+    // Effects are read once, before the host can take the volume
+    boot_trace_begin(BOOT_PHASE_INDEX);
+    if (mounted && EXAMPLE_SAMPLE_CACHE_BYTES > 0 && sample_cache_init(EXAMPLE_SAMPLE_CACHE_BYTES) == ESP_OK) {
+        sample_cache_load(BASE_PATH, EXAMPLE_SAMPLE_FILE_MAX);
+    }
+    boot_trace_end(BOOT_PHASE_INDEX);
+
+    atomic_store(&storage_ready, true);
+    storage_release_if_pending();
+    ESP_LOGI(TAG, "Storage ready at %" PRIu32 " ms.", (uint32_t)(esp_timer_get_time() / 1000));
+    vTaskDelete(NULL);
+}
+
 static void tusb_device_task(void *arg)
 {
+    int64_t last = esp_timer_get_time();
+    bool enumerated = false;
     while (1) {
-        tud_task();
-        // Add a small delay to yield to other tasks if tud_task() is non-blocking
-        // vTaskDelay(pdMS_TO_TICKS(1)); // Example, adjust as needed
+        // Sleeps on the TinyUSB event queue until the ISR or a class driver posts an
+        // event, so the task only runs when there is USB work to do.
+        tud_task_ext(UINT32_MAX, false);
+        int64_t now = esp_timer_get_time();
+        telemetry_record(TELEM_TUD_PERIOD_US, (uint32_t)(now - last));
+        last = now;
+        if (!enumerated && tud_mounted()) {
+            enumerated = true;
+            boot_trace_mark(BOOT_MARK_ENUMERATED, now);
+            DLOGI(TAG, "Enumerated at %" PRIu32 " ms.", (uint32_t)(now / 1000));
+        }
     }
 }
 
-// This is the UAC callback where USB audio data is received
-static esp_err_t uac_device_output_cb(uint8_t *buf, size_t len, void *arg)
+// This is the UAC callback where USB audio data is received.
+// The packet is read from the endpoint FIFO straight into the jitter ring; the audio
+// writer task owns the (blocking) I2S write.
+static void uac_device_rx_cb(size_t len, void *arg)
 {
-    esp_err_t ret = ESP_OK;
-    size_t bytes_written = 0;
+    if (audio_writer_handle == NULL) {
+        return;
+    }
 
-    if (i2s_tx_handle == NULL) {
-        ESP_LOGE(TAG, "I2S TX Handle not initialized!");
-        return ESP_ERR_INVALID_STATE;
+    // Gaps of a second or more are the stream stopping, not jitter
+    static int64_t last_rx_us;
+    int64_t now = esp_timer_get_time();
+    if (now - last_rx_us < 1000000) {
+        telemetry_record(TELEM_USB_RX_INTERVAL_US, (uint32_t)(now - last_rx_us));
     }
+    last_rx_us = now;
 
-    // Write the received audio data to I2S
-    // The timeout portMAX_DELAY means it will block indefinitely until space is available.
-    // You might want to use a smaller timeout depending on your application's needs.
-    ret = i2s_channel_write(i2s_tx_handle, buf, len, &bytes_written, portMAX_DELAY);
+    // Local playback owns the output; the ring is discarded when it hands back
+    if (wav_player_active()) {
+        return;
+    }
 
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "I2S write failed: %s", esp_err_to_name(ret));
-    } else if (bytes_written < len) {
-        ESP_LOGW(TAG, "I2S write underrun: wrote %d of %d bytes", bytes_written, len);
-        // This might happen if the I2S bus is slower than the USB audio stream
-        // or if the I2S DMA buffer is too small.
+    // Until the writer has switched formats the ring is about to be re-initialized, and
+    // the packet would be played at the wrong rate anyway.
+    if (atomic_load_explicit(&spk_format_requested, memory_order_relaxed) !=
+            atomic_load_explicit(&spk_format_applied, memory_order_acquire)) {
+        return;
     }
-    return ret;
+
+    if (!audio_ring_reserve(&spk_ring, len)) {
+        // Ring full: the writer fell behind. The packet is dropped and counted, logging
+        // here would only make things worse.
+        telemetry_count(TELEM_USB_OVERRUNS, 1);
+        return;
+    }
+    size_t done = 0;
+    while (done < len) {
+        size_t contig;
+        uint8_t *dst = audio_ring_write_ptr(&spk_ring, done, &contig);
+        size_t n = usb_audio_read(dst, MIN(contig, len - done));
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    // Never publish a partial frame
+    done -= done % spk_frame_bytes;
+    audio_ring_commit(&spk_ring, done);
+    atomic_fetch_add_explicit(&spk_copy_bytes_avoided, done, memory_order_relaxed);
+    telemetry_count(TELEM_USB_PACKETS, 1);
+    telemetry_count(TELEM_USB_BYTES, done);
+    telemetry_record(TELEM_RING_FILL_PCT, audio_ring_fill(&spk_ring) * 100 / spk_ring.target);
+    xTaskNotifyGive(audio_writer_handle);
 }
 
-static void i2s_driver_init(void)
+// Whether the local resampler absorbs the drift of `format`. The kernel is 16-bit only,
+// so 24-bit streams run the feedback loop in either mode.
+static inline bool audio_drift_resampled(const usb_audio_format_t *format)
+{
+    return EXAMPLE_AUDIO_DRIFT_MODE == EXAMPLE_AUDIO_DRIFT_RESAMPLER && format->bytes_per_sample == 2;
+}
+
+// Host changed alt setting or sample rate. Runs in the TinyUSB task, so the actual I2S
+// reconfiguration is handed to the writer task.
+static void uac_device_format_cb(const usb_audio_format_t *format, bool streaming, void *arg)
+{
+#if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
+    if (streaming && audio_drift_resampled(format)) {
+        // Nothing updates the endpoint while resampling; a host that reads it anyway
+        // must see the nominal rate, not whatever the last stream left there
+        tud_audio_fb_set(audio_fb_nominal_q16(format->sample_rate, CONFIG_USB_HS ? 8000 : 1000));
+    }
+#endif
+    if (streaming && !atomic_exchange_explicit(&spk_host_streaming, true, memory_order_relaxed)) {
+        atomic_store_explicit(&spk_set_itf_us, (uint32_t)esp_timer_get_time(), memory_order_relaxed);
+        atomic_store_explicit(&spk_sound_armed, false, memory_order_relaxed);
+        atomic_store_explicit(&spk_start_pending, true, memory_order_release);
+    } else if (!streaming) {
+        atomic_store_explicit(&spk_host_streaming, false, memory_order_relaxed);
+        atomic_store_explicit(&spk_start_pending, false, memory_order_relaxed);
+        atomic_store_explicit(&spk_sound_armed, false, memory_order_relaxed);  // Closed before any sound
+    }
+    if (usb_audio_format_equal(format, &spk_format_host)) {
+        // Only the alt setting changed; the writer decides whether to power down
+        xTaskNotifyGive(audio_writer_handle);
+        return;
+    }
+    spk_format_host = *format;
+    xQueueOverwrite(spk_format_queue, format);
+    atomic_fetch_add_explicit(&spk_format_requested, 1, memory_order_release);
+    xTaskNotifyGive(audio_writer_handle);
+}
+
+// Hands the current dsp_params to the writer task. Call after editing them under the lock.
+static void audio_dsp_params_publish(void)
+{
+    atomic_fetch_add_explicit(&dsp_params_gen, 1, memory_order_release);
+}
+
+static void uac_device_set_mute_cb(bool mute, void *arg)
+{
+    taskENTER_CRITICAL(&dsp_params_lock);
+    dsp_params.mute = mute;
+    taskEXIT_CRITICAL(&dsp_params_lock);
+    audio_dsp_params_publish();
+}
+
+static void uac_device_set_volume_cb(int16_t volume_db256, void *arg)
+{
+    taskENTER_CRITICAL(&dsp_params_lock);
+    dsp_params.volume_db = volume_db256 / 256.0f;
+    taskEXIT_CRITICAL(&dsp_params_lock);
+    audio_dsp_params_publish();
+}
+
+// Looks for the first non-zero sample in a buffer that finished playing at `sent_us`
+// and, if there is one, closes the start latency measurement at the time it went out.
+static IRAM_ATTR void i2s_tx_find_sound(const i2s_event_data_t *event, uint32_t sent_us)
+{
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+    const uint32_t *buf = event->dma_buf;
+#else
+    const uint32_t *buf = *(uint32_t *const *)event->data;
+#endif
+    const size_t words = event->size / sizeof(uint32_t);
+    size_t i = 0;
+    while (i < words && buf[i] == 0) {
+        i++;
+    }
+    if (i == words) {
+        return;
+    }
+    // At most a few thousand frames, so this stays within 32 bits
+    uint32_t frames_after = (words - i) * sizeof(uint32_t) / i2s_frame_bytes;
+    uint32_t sound_us = sent_us - frames_after * 1000000u / spk_format.sample_rate;
+    uint32_t latency = sound_us - atomic_load_explicit(&spk_set_itf_us, memory_order_relaxed);
+    atomic_store_explicit(&spk_sound_armed, false, memory_order_relaxed);
+    boot_trace_mark(BOOT_MARK_FIRST_SOUND, esp_timer_get_time() - (sent_us - sound_us));
+    taskENTER_CRITICAL_ISR(&spk_start_lock);
+    spk_start_stats.first_sound_us = latency;
+    if (latency > spk_start_stats.max_first_sound_us) {
+        spk_start_stats.max_first_sound_us = latency;
+    }
+    taskEXIT_CRITICAL_ISR(&spk_start_lock);
+}
+
+// Counts frames actually clocked out by the DMA; this is what the feedback engine
+// measures the codec rate from.
+static IRAM_ATTR bool i2s_tx_sent_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    uint32_t now = (uint32_t)esp_timer_get_time();
+    audio_fb_dma_done(&spk_fb, i2s_dma_frames, now);
+#if UAC_MIC_CHANNELS > 0
+    atomic_fetch_add_explicit(&i2s_tx_frames, i2s_dma_frames, memory_order_relaxed);
+#endif
+    if (atomic_load_explicit(&spk_sound_armed, memory_order_acquire)) {
+        i2s_tx_find_sound(event, now);
+    }
+    return false;
+}
+
+// Runs the feedback loop against the current jitter-buffer fill and publishes the
+// result on the UAC feedback endpoint. The loop restarts whenever the stream does.
+// `in_flight` bytes the writer has peeked still sit in the ring but don't count as fill.
+static void audio_feedback_update(bool streaming, size_t in_flight)
+{
+    if (!streaming) {
+        audio_fb_reset(&spk_fb);
+        return;
+    }
+
+    uint32_t feedback;
+    uint32_t fill_frames = (audio_ring_fill(&spk_ring) - in_flight) / spk_frame_bytes;
+    if (audio_fb_update(&spk_fb, (uint32_t)esp_timer_get_time(), fill_frames, &feedback)) {
+#if CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP
+        // 16.16 samples per (micro)frame; TinyUSB converts to 10.14 on full speed.
+        tud_audio_fb_set(feedback);
+#endif
+    }
+}
+
+#if EXAMPLE_AUDIO_DRIFT_MODE == EXAMPLE_AUDIO_DRIFT_RESAMPLER
+// Resamples one chunk peeked from the ring, nudging the ratio so the ring fill converges
+// on its target. Returns the number of bytes placed in `out`.
+static size_t audio_resample_chunk(bool streaming, const uint8_t *in, size_t len, uint8_t *out, size_t out_cap)
+{
+    if (!streaming) {
+        audio_rs_reset(&spk_rs);
+    }
+    uint32_t fill_frames = (audio_ring_fill(&spk_ring) - len) / spk_frame_bytes;
+    audio_rs_track_fill(&spk_rs, (uint32_t)esp_timer_get_time(), fill_frames, spk_ring.target / spk_frame_bytes);
+
+    size_t frames = audio_rs_process(&spk_rs, (const int16_t *)in, len / spk_frame_bytes,
+                                     (int16_t *)out, out_cap / spk_frame_bytes);
+    return frames * spk_frame_bytes;
+}
+#endif
+
+#if UAC_MIC_CHANNELS > 0
+static IRAM_ATTR bool i2s_rx_recv_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    atomic_fetch_add_explicit(&i2s_rx_frames, i2s_dma_frames, memory_order_relaxed);
+    return false;
+}
+#endif
+
+// Frames per DMA buffer for `format`: the same duration as at the default rate, capped
+// by the hardware buffer size. Call after audio_stream_setup().
+static uint32_t i2s_dma_frames_for(const usb_audio_format_t *format)
+{
+    uint32_t frames = (uint32_t)((uint64_t)EXAMPLE_I2S_DMA_FRAME_NUM * format->sample_rate / EXAMPLE_AUDIO_SAMPLE_RATE);
+    uint32_t max_frames = EXAMPLE_I2S_DMA_BUF_MAX / i2s_frame_bytes;
+    return frames < max_frames ? frames : max_frames;
+}
+
+static void i2s_tx_open(const usb_audio_format_t *format)
 {
     // I2S channel configuration
     i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
     chan_cfg.auto_clear = true; // Auto clear the legacy data in the DMA buffer
     chan_cfg.dma_desc_num = EXAMPLE_I2S_DMA_DESC_NUM;
-    chan_cfg.dma_frame_num = EXAMPLE_I2S_DMA_FRAME_NUM; // Must be <= dma_desc_num
-                                                       // Frame num represents samples PER CHANNEL.
-                                                       // e.g., if 16-bit stereo, frame_num=240 means 240*2(ch)*2(bytes)=960 bytes
-    // ESP_LOGI(TAG, "I2S DMA Buffer size: %d frames, %d descriptors. Total bytes: %u",
-    //          chan_cfg.dma_frame_num, chan_cfg.dma_desc_num,
-    //          chan_cfg.dma_frame_num * (EXAMPLE_AUDIO_BIT_WIDTH / 8) * 2 * chan_cfg.dma_desc_num); // Assuming stereo
-
-    // Allocate TX and RX channels. If only TX is needed, you can skip RX.
+    chan_cfg.dma_frame_num = i2s_dma_frames_for(format); // Frame num represents samples PER CHANNEL.
+    i2s_dma_frames = chan_cfg.dma_frame_num;
+
+#if UAC_MIC_CHANNELS > 0
+    // Both directions on one controller: RX runs off TX's BCLK/WS, so playback and capture
+    // share a clock and keep a fixed offset.
+    ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, &i2s_tx_handle, &i2s_rx_handle));
+#else
     ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, &i2s_tx_handle, NULL)); // Only TX for output
-    // If you also need RX:
-    // ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, &i2s_tx_handle, &i2s_rx_handle));
+#endif
 
+    // 24-bit USB samples are MSB-justified in 32-bit subslots, which is exactly what a
+    // 32-bit I2S data width expects.
+    i2s_data_bit_width_t bit_width = i2s_slot_bytes == 2 ? I2S_DATA_BIT_WIDTH_16BIT : I2S_DATA_BIT_WIDTH_32BIT;
+    i2s_slot_mode_t slot_mode = i2s_slot_channels == 1 ? I2S_SLOT_MODE_MONO : I2S_SLOT_MODE_STEREO;
 
     // I2S standard mode configuration
     i2s_std_config_t std_cfg = {
-        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(EXAMPLE_AUDIO_SAMPLE_RATE),
-        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(EXAMPLE_AUDIO_BIT_WIDTH, I2S_SLOT_MODE_MONO), // Assuming stereo output
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(format->sample_rate),
+        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(bit_width, slot_mode),
         .gpio_cfg = {
             .mclk = EXAMPLE_I2S_MCK_IO,
             .bclk = EXAMPLE_I2S_BCK_IO,
@@ -202,52 +711,1178 @@ static void i2s_driver_init(void)
         },
     };
 
-
     // Initialize TX channel
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(i2s_tx_handle, &std_cfg));
-    ESP_LOGI(TAG, "I2S TX channel initialized.");
 
-    // Initialize RX channel if allocated
-    // if (i2s_rx_handle) {
-    //     ESP_ERROR_CHECK(i2s_channel_init_std_mode(i2s_rx_handle, &std_cfg));
-    //     ESP_LOGI(TAG, "I2S RX channel initialized.");
-    // }
+    const i2s_event_callbacks_t tx_cbs = {
+        .on_sent = i2s_tx_sent_cb,
+    };
+    ESP_ERROR_CHECK(i2s_channel_register_event_callback(i2s_tx_handle, &tx_cbs, NULL));
+
+#if UAC_MIC_CHANNELS > 0
+    // Same slot format as TX, which the shared clock requires; audio_capture_convert()
+    // maps it to the microphone format.
+    ESP_ERROR_CHECK(i2s_channel_init_std_mode(i2s_rx_handle, &std_cfg));
+    const i2s_event_callbacks_t rx_cbs = {
+        .on_recv = i2s_rx_recv_cb,
+    };
+    ESP_ERROR_CHECK(i2s_channel_register_event_callback(i2s_rx_handle, &rx_cbs, NULL));
+#endif
 
     // Enable TX channel
     ESP_ERROR_CHECK(i2s_channel_enable(i2s_tx_handle));
-    ESP_LOGI(TAG, "I2S TX channel enabled.");
-
-    // Enable RX channel if allocated and initialized
-    // if (i2s_rx_handle) {
-    //     ESP_ERROR_CHECK(i2s_channel_enable(i2s_rx_handle));
-    //     ESP_LOGI(TAG, "I2S RX channel enabled.");
-    // }
-
-    /* Get the initial MCLK */
-    // This part is mostly for debugging or if you need to know the exact MCLK.
-    // i2s_std_clk_config_t clk_cfg_tmp; // Temporary to get current clock config
-    // ESP_ERROR_CHECK(i2s_channel_get_std_clk_config(i2s_tx_handle, &clk_cfg_tmp));
-    // init_mclk_freq_hz = clk_cfg_tmp.mclk_hz;
-    // ESP_LOGI(TAG, "Initial MCLK: %" PRIu32 " Hz", init_mclk_freq_hz);
-    // ESP_LOGI(TAG, "Configured Sample Rate: %d Hz, Bit Width: %d bits",
-    //          EXAMPLE_AUDIO_SAMPLE_RATE, EXAMPLE_AUDIO_BIT_WIDTH);
-
-    // You might want to pre-fill the DMA buffer with silence if there's a delay before USB audio starts
-    // This helps avoid initial glitches on some DACs.
-    // size_t written_silence;
-    // uint8_t silence_buf[1024] = {0}; // Adjust size as needed
-    // i2s_channel_write(i2s_tx_handle, silence_buf, sizeof(silence_buf), &written_silence, portMAX_DELAY);
-
-    const gpio_config_t amp_mode_config = {
-        .pin_bit_mask = BIT64(GPIO_NUM_8),
-        .mode = GPIO_MODE_OUTPUT,
-        .pull_up_en = GPIO_PULLUP_ENABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE,
+#if UAC_MIC_CHANNELS > 0
+    ESP_ERROR_CHECK(i2s_channel_enable(i2s_rx_handle));
+#endif
+    spk_output_start_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "I2S TX enabled: %" PRIu32 " Hz, %d-bit, %d ch, %" PRIu32 " frames x %d DMA buffers.",
+             format->sample_rate, bit_width, format->channels, i2s_dma_frames, EXAMPLE_I2S_DMA_DESC_NUM);
+}
+
+// audio_power output callback. Stopping the channel keeps its DMA buffers; auto_clear
+// has zeroed every buffer that was played, so restarting it begins with silence.
+static void i2s_tx_power(bool on, void *arg)
+{
+#if UAC_MIC_CHANNELS > 0
+    if (!on) {
+        // Held until the output is back on, so the capture task doesn't spin on a
+        // stopped channel
+        xSemaphoreTake(i2s_rx_lock, portMAX_DELAY);
+        ESP_ERROR_CHECK(i2s_channel_disable(i2s_rx_handle));
+    }
+#endif
+    ESP_ERROR_CHECK(on ? i2s_channel_enable(i2s_tx_handle) : i2s_channel_disable(i2s_tx_handle));
+    spk_output_start_us = esp_timer_get_time();
+#if UAC_MIC_CHANNELS > 0
+    if (on) {
+        ESP_ERROR_CHECK(i2s_channel_enable(i2s_rx_handle));
+        xSemaphoreGive(i2s_rx_lock);
+    }
+#endif
+}
+
+// How long the DMA takes to play out everything queued in it
+static uint32_t i2s_dma_depth_us(void)
+{
+    return (uint32_t)((uint64_t)EXAMPLE_I2S_DMA_DESC_NUM * i2s_dma_frames * 1000000 / spk_format.sample_rate);
+}
+
+static void i2s_tx_close(void)
+{
+    if (i2s_tx_handle == NULL) {
+        return;
+    }
+#if UAC_MIC_CHANNELS > 0
+    ESP_ERROR_CHECK(i2s_channel_disable(i2s_rx_handle));
+    ESP_ERROR_CHECK(i2s_del_channel(i2s_rx_handle));
+    i2s_rx_handle = NULL;
+#endif
+    ESP_ERROR_CHECK(i2s_channel_disable(i2s_tx_handle));
+    ESP_ERROR_CHECK(i2s_del_channel(i2s_tx_handle));
+    i2s_tx_handle = NULL;
+}
+
+// (Re)initializes everything that depends on the stream format. Writer task only, or
+// before the writer starts.
+static void audio_stream_setup(const usb_audio_format_t *format)
+{
+    spk_format = *format;
+    spk_frame_bytes = format->channels * format->bytes_per_sample;
+    spk_chunk_bytes = audio_ring_bytes_for_ms(EXAMPLE_AUDIO_WRITE_CHUNK_MS, format->sample_rate, spk_frame_bytes);
+
+    i2s_slot_bytes = EXAMPLE_I2S_SLOT_BYTES ? EXAMPLE_I2S_SLOT_BYTES : format->bytes_per_sample;
+    i2s_slot_channels = MAX(format->channels, EXAMPLE_I2S_SLOT_CHANNELS);
+    i2s_frame_bytes = i2s_slot_bytes * i2s_slot_channels;
+    spk_to_slots = NULL;
+    if (i2s_slot_bytes != format->bytes_per_sample || i2s_slot_channels != format->channels) {
+        spk_to_slots = audio_convert_select(format->bytes_per_sample, format->channels, i2s_slot_bytes, i2s_slot_channels);
+    }
+
+    // Half the ring leaves room for the swing above the target; only narrow slots under a
+    // 24-bit 96 kHz stream need more, and they get fewer frames of margin.
+    const size_t target = MIN(i2s_dma_frames_for(format) * spk_frame_bytes +
+                              audio_ring_bytes_for_ms(EXAMPLE_AUDIO_RING_MARGIN_MS, format->sample_rate, spk_frame_bytes),
+                              EXAMPLE_AUDIO_RING_SIZE / 2);
+    if (!audio_ring_init(&spk_ring, spk_ring_storage, EXAMPLE_AUDIO_RING_SIZE, spk_frame_bytes, target)) {
+        ESP_LOGE(TAG, "Invalid audio ring configuration (size %d, target %d)", EXAMPLE_AUDIO_RING_SIZE, target);
+        abort();
+    }
+
+    audio_fb_init(&spk_fb, format->sample_rate, CONFIG_USB_HS ? 8000 : 1000,
+                  target / spk_frame_bytes, EXAMPLE_AUDIO_FB_PERIOD_MS * 1000);
+#if EXAMPLE_AUDIO_DRIFT_MODE == EXAMPLE_AUDIO_DRIFT_RESAMPLER
+    audio_rs_init(&spk_rs, format->channels);
+#endif
+    audio_dsp_init(&spk_dsp, format->sample_rate, format->channels);
+    audio_mixer_stop_all(&spk_mixer);
+    wav_player_set_output_rate(format->sample_rate);
+    dsp_params_applied = atomic_load_explicit(&dsp_params_gen, memory_order_acquire) - 1; // Force a configure
+}
+
+// Recomputes DSP coefficients if the parameters changed. Writer task only.
+static void audio_dsp_sync(void)
+{
+    uint32_t gen = atomic_load_explicit(&dsp_params_gen, memory_order_acquire);
+    if (gen == dsp_params_applied) {
+        return;
+    }
+    audio_dsp_params_t params;
+    taskENTER_CRITICAL(&dsp_params_lock);
+    params = dsp_params;
+    taskEXIT_CRITICAL(&dsp_params_lock);
+    audio_dsp_configure(&spk_dsp, &params);
+    dsp_params_applied = gen;
+}
+
+// Runs the DSP chain in place on `len` bytes in the current stream format.
+static void audio_dsp_chunk(uint8_t *data, size_t len)
+{
+    size_t frames = len / spk_frame_bytes;
+    if (spk_format.bytes_per_sample == 2) {
+        audio_dsp_process_s16(&spk_dsp, (int16_t *)data, frames);
+    } else {
+        audio_dsp_process_s32(&spk_dsp, (int32_t *)data, frames);
+    }
+}
+
+// Starts the effects requested since the last chunk. Writer task only.
+static void audio_sfx_poll(void)
+{
+    sfx_request_t req;
+    while (xQueueReceive(sfx_queue, &req, 0) == pdTRUE) {
+        if (req.sample == NULL) {
+            audio_mixer_stop_all(&spk_mixer);
+        } else if (req.sample->sample_rate != spk_format.sample_rate) {
+            atomic_fetch_add_explicit(&sfx_skipped, 1, memory_order_relaxed);
+        } else {
+            audio_mixer_play(&spk_mixer, req.sample->pcm, req.sample->frames, req.sample->channels, req.gain);
+        }
+    }
+}
+
+// Adds the playing effects to `len` bytes that have been through the DSP.
+static void audio_sfx_mix(uint8_t *data, size_t len)
+{
+    size_t frames = len / spk_frame_bytes;
+    if (spk_format.bytes_per_sample == 2) {
+        audio_mixer_mix_s16(&spk_mixer, (int16_t *)data, frames, spk_format.channels);
+    } else {
+        audio_mixer_mix_s32(&spk_mixer, (int32_t *)data, frames, spk_format.channels);
+    }
+}
+
+// Applies the latest format requested by the host: the ring is discarded so nothing
+// stale is played at the new rate, then the channel is disabled, rebuilt with DMA
+// buffers sized for the new rate and re-enabled.
+static void audio_writer_apply_format(void)
+{
+    uint32_t requested = atomic_load_explicit(&spk_format_requested, memory_order_acquire);
+    usb_audio_format_t format;
+
+    if (xQueueReceive(spk_format_queue, &format, 0) == pdTRUE && !usb_audio_format_equal(&format, &spk_format)) {
+        int64_t start = esp_timer_get_time();
+#if UAC_MIC_CHANNELS > 0
+        xSemaphoreTake(i2s_rx_lock, portMAX_DELAY);
+#endif
+        i2s_tx_close();
+        audio_stream_setup(&format);
+        i2s_tx_open(&format);
+#if UAC_MIC_CHANNELS > 0
+        xSemaphoreGive(i2s_rx_lock);
+#endif
+        DLOGI(TAG, "Stream format switched in %" PRIu32 " us.", (uint32_t)(esp_timer_get_time() - start));
+    }
+    atomic_store_explicit(&spk_format_applied, requested, memory_order_release);
+}
+
+static void audio_i2s_write_slots(const uint8_t *data, size_t len)
+{
+    size_t bytes_written = 0;
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = i2s_channel_write(i2s_tx_handle, data, len, &bytes_written, portMAX_DELAY);
+    telemetry_record(TELEM_I2S_WRITE_US, (uint32_t)(esp_timer_get_time() - start));
+    if (ret != ESP_OK) {
+        DLOGE(TAG, "I2S write failed: %s", esp_err_to_name(ret));
+    } else if (bytes_written < len) {
+        telemetry_count(TELEM_I2S_SHORT_WRITES, 1);
+        DLOGW(TAG, "I2S write underrun: wrote %d of %d bytes", bytes_written, len);
+    }
+    audio_power_first_sample();
+}
+
+// Writes `len` bytes in the stream format, converted to the slot layout if they differ.
+static void audio_i2s_write(const uint8_t *data, size_t len)
+{
+    if (spk_to_slots == NULL) {
+        audio_i2s_write_slots(data, len);
+        return;
+    }
+    static uint8_t slots[EXAMPLE_I2S_SLOT_BUF_BYTES] __attribute__((aligned(4)));
+    const size_t max_frames = sizeof(slots) / i2s_frame_bytes;
+    size_t frames = len / spk_frame_bytes;
+    while (frames > 0) {
+        size_t n = MIN(frames, max_frames);
+        spk_to_slots(slots, data, n);
+        audio_i2s_write_slots(slots, n * i2s_frame_bytes);
+        data += n * spk_frame_bytes;
+        frames -= n;
+    }
+}
+
+// Writes `us` of silence in the current slot layout.
+static void audio_i2s_silence(int64_t us)
+{
+    static const uint8_t zeros[EXAMPLE_AUDIO_SILENCE_BYTES];
+    size_t len = (size_t)(us * spk_format.sample_rate / 1000000) * i2s_frame_bytes;
+    while (len > 0) {
+        size_t n = MIN(len, sizeof(zeros) - sizeof(zeros) % i2s_frame_bytes);
+        size_t bytes_written = 0;
+        i2s_channel_write(i2s_tx_handle, zeros, n, &bytes_written, portMAX_DELAY);
+        len -= n;
+    }
+}
+
+// Starts a stream on a running output: pads the time since the channel started with
+// silence up to EXAMPLE_AUDIO_PREROLL_MS, so the DAC and amplifier have settled before
+// the first sample, then fades in. A channel that has been running longer adds no delay.
+static void audio_writer_stream_start(void)
+{
+    int64_t preroll_us = EXAMPLE_AUDIO_PREROLL_MS * 1000LL - (esp_timer_get_time() - spk_output_start_us);
+    if (preroll_us > 0) {
+        audio_i2s_silence(preroll_us);
+    }
+    audio_dsp_fade(&spk_dsp, true, EXAMPLE_AUDIO_FADE_MS);
+}
+
+// Call after each USB write; the first one after SET_INTERFACE arms the sound search.
+static void audio_writer_stream_written(void)
+{
+    if (!atomic_exchange_explicit(&spk_start_pending, false, memory_order_acquire)) {
+        return;
+    }
+    uint32_t us = (uint32_t)esp_timer_get_time() - atomic_load_explicit(&spk_set_itf_us, memory_order_relaxed);
+    taskENTER_CRITICAL(&spk_start_lock);
+    spk_start_stats.starts++;
+    spk_start_stats.first_write_us = us;
+    taskEXIT_CRITICAL(&spk_start_lock);
+    atomic_store_explicit(&spk_sound_armed, true, memory_order_release);
+}
+
+// Powers the output down once nothing has been played for EXAMPLE_AUDIO_IDLE_MS, or as
+// soon as the DMA has played out when the host closed the stream. `idle_since` is when
+// the writer last ran out of audio. Returns the time to wait for the producers.
+static TickType_t audio_writer_idle(int64_t idle_since)
+{
+    if (!audio_power_awake()) {
+        audio_power_poll();
+        return pdMS_TO_TICKS(EXAMPLE_AUDIO_SLEEP_POLL_MS);
+    }
+#if UAC_MIC_CHANNELS > 0
+    if (atomic_load_explicit(&mic_streaming, memory_order_relaxed)) {
+        // The microphone runs off the output's clock
+        return pdMS_TO_TICKS(EXAMPLE_AUDIO_WRITE_CHUNK_MS);
+    }
+#endif
+    int64_t idle_us = esp_timer_get_time() - idle_since;
+    bool host_closed = !atomic_load_explicit(&spk_host_streaming, memory_order_relaxed);
+    if (idle_us >= EXAMPLE_AUDIO_IDLE_MS * 1000LL || (host_closed && idle_us >= i2s_dma_depth_us())) {
+        // Half a priming's worth of a stream that stopped would otherwise wake it again
+        audio_ring_reset(&spk_ring);
+        audio_power_sleep();
+        DLOGI(TAG, "Output powered down after %" PRIu32 " ms idle", (uint32_t)(idle_us / 1000));
+        return pdMS_TO_TICKS(EXAMPLE_AUDIO_SLEEP_POLL_MS);
+    }
+    return pdMS_TO_TICKS(EXAMPLE_AUDIO_WRITE_CHUNK_MS);
+}
+
+// Drains the jitter buffer into the I2S DMA. Runs on the other core than TinyUSB so a
+// full DMA queue only ever blocks this task. Chunks are processed and handed to the
+// driver in place; the ring space is released only once i2s_channel_write returns.
+// While the WAV player has a track, chunks come from it instead; the switch happens
+// between two writes, so the I2S channel keeps running across the handoff.
+static void audio_writer_task(void *arg)
+{
+    const size_t chunk_cap = audio_ring_bytes_for_ms(EXAMPLE_AUDIO_WRITE_CHUNK_MS, UAC_SAMPLE_RATE_MAX, EXAMPLE_AUDIO_FRAME_BYTES_MAX);
+    uint8_t *local = heap_caps_malloc(chunk_cap, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    assert(local);
+    bool local_active = false;
+#if EXAMPLE_AUDIO_DRIFT_MODE == EXAMPLE_AUDIO_DRIFT_RESAMPLER
+    const size_t resampled_bytes = chunk_cap + 2 * EXAMPLE_AUDIO_FRAME_BYTES_MAX;
+    uint8_t *resampled = heap_caps_malloc(resampled_bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    assert(resampled);
+#endif
+    uint32_t underruns_seen = 0;
+    bool streaming = false;
+    bool fading_out = false;
+    int64_t idle_since = esp_timer_get_time();
+    int64_t stream_written_us = 0;  // Last write of stream audio to the DMA
+
+    while (1) {
+        if (atomic_load_explicit(&spk_format_requested, memory_order_acquire) !=
+                atomic_load_explicit(&spk_format_applied, memory_order_relaxed)) {
+            // The host is about to stream; the channel must be running to be rebuilt
+            audio_power_wake(esp_timer_get_time());
+            audio_writer_apply_format();
+            underruns_seen = 0;
+            streaming = false;
+            continue;
+        }
+        audio_dsp_sync();
+        audio_sfx_poll();
+        if (audio_mixer_active(&spk_mixer)) {
+            audio_power_wake(esp_timer_get_time());
+        }
+
+        if (wav_player_active()) {
+            audio_power_wake(esp_timer_get_time());
+            idle_since = esp_timer_get_time();
+            if (!local_active) {
+                DLOGI(TAG, "Local playback takes over from USB");
+                local_active = true;
+                streaming = false;
+                audio_feedback_update(false, 0);
+                audio_writer_stream_start();
+            }
+            size_t len = wav_player_read(local, spk_chunk_bytes, &spk_format);
+            if (len == 0) {
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(EXAMPLE_AUDIO_WRITE_CHUNK_MS));
+                continue;
+            }
+            audio_dsp_chunk(local, len);
+            audio_sfx_mix(local, len);
+            audio_i2s_write(local, len);
+            continue;
+        }
+        if (local_active) {
+            // Whatever the host sent before the takeover is stale by now
+            DLOGI(TAG, "USB playback resumes");
+            audio_ring_reset(&spk_ring);
+            local_active = false;
+            idle_since = esp_timer_get_time();
+        }
+        if (!audio_power_awake() && audio_ring_fill(&spk_ring) != 0) {
+            // Woken by the first packet; the output comes up while the ring primes
+            audio_power_wake(esp_timer_get_time());
+            idle_since = esp_timer_get_time();
+        }
+#if UAC_MIC_CHANNELS > 0
+        if (!audio_power_awake() && atomic_load_explicit(&mic_streaming, memory_order_relaxed)) {
+            audio_power_wake(esp_timer_get_time());
+            idle_since = esp_timer_get_time();
+        }
+#endif
+
+        uint8_t *chunk;
+        const size_t chunk_len = audio_ring_peek(&spk_ring, &chunk, spk_chunk_bytes);
+        size_t len = chunk_len;
+        if (!audio_drift_resampled(&spk_format)) {
+            audio_feedback_update(streaming, len);
+        }
+        if (len == 0) {
+            // Priming or ran dry; the DMA plays out what it has queued, then silence
+            // (auto_clear), until the producer has refilled the ring up to its target.
+            uint32_t underruns = atomic_load(&spk_ring.underruns);
+            if (underruns != underruns_seen) {
+                telemetry_count(TELEM_AUDIO_UNDERRUNS, underruns - underruns_seen);
+                DLOGW(TAG, "Audio ring underrun (%" PRIu32 " total)", underruns);
+                underruns_seen = underruns;
+            }
+            // An empty ring is only a re-prime while the DMA still has audio queued: the
+            // stream resumes where it left off, with the drift loop state and no fade in.
+            // It has ended once the host closed it or the DMA has played out.
+            if (!atomic_load_explicit(&spk_host_streaming, memory_order_relaxed) ||
+                    esp_timer_get_time() - stream_written_us >= i2s_dma_depth_us()) {
+                streaming = false;
+            }
+            if (audio_mixer_active(&spk_mixer)) {
+                // Effects play on their own while the stream is idle or priming
+                memset(local, 0, spk_chunk_bytes);
+                audio_sfx_mix(local, spk_chunk_bytes);
+                audio_i2s_write(local, spk_chunk_bytes);
+                idle_since = esp_timer_get_time();
+                continue;
+            }
+            ulTaskNotifyTake(pdTRUE, audio_writer_idle(idle_since));
+            continue;
+        }
+
+        const bool host_streaming = atomic_load_explicit(&spk_host_streaming, memory_order_relaxed);
+        if (!streaming || (fading_out && host_streaming)) {
+            audio_writer_stream_start();
+            fading_out = false;
+        } else if (!fading_out && !host_streaming) {
+            // The host closed the stream: fade out over whatever it left in the ring
+            uint32_t left_ms = audio_ring_fill(&spk_ring) / spk_frame_bytes * 1000 / spk_format.sample_rate;
+            audio_dsp_fade(&spk_dsp, false, MIN(left_ms, EXAMPLE_AUDIO_FADE_MS));
+            fading_out = true;
+        }
+
+        uint8_t *out = chunk;
+#if EXAMPLE_AUDIO_DRIFT_MODE == EXAMPLE_AUDIO_DRIFT_RESAMPLER
+        if (audio_drift_resampled(&spk_format)) {
+            len = audio_resample_chunk(streaming, chunk, len, resampled, resampled_bytes);
+            out = resampled;
+        }
+#endif
+        audio_dsp_chunk(out, len);
+        audio_sfx_mix(out, len);
+        streaming = true;
+
+        audio_i2s_write(out, len);
+        audio_writer_stream_written();
+        audio_ring_consume(&spk_ring, chunk_len);
+        idle_since = esp_timer_get_time();
+        stream_written_us = idle_since;
+        if (out == chunk) {
+            atomic_fetch_add_explicit(&spk_copy_bytes_avoided, chunk_len, memory_order_relaxed);
+        }
+    }
+}
+
+static void audio_writer_init(void)
+{
+    spk_ring_storage = heap_caps_aligned_alloc(EXAMPLE_AUDIO_POOL_ALIGN, EXAMPLE_AUDIO_RING_SIZE,
+                                               MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    assert(spk_ring_storage);
+    spk_format_queue = xQueueCreate(1, sizeof(usb_audio_format_t));
+    assert(spk_format_queue);
+    sfx_queue = xQueueCreate(EXAMPLE_SFX_QUEUE_LEN, sizeof(sfx_request_t));
+    assert(sfx_queue);
+    audio_mixer_init(&spk_mixer);
+#if UAC_MIC_CHANNELS > 0
+    i2s_rx_lock = xSemaphoreCreateMutex();
+    assert(i2s_rx_lock);
+#endif
+
+    audio_dsp_default_params(&dsp_params);
+    usb_audio_get_format(&spk_format_host);
+    audio_stream_setup(&spk_format_host);
+
+    BaseType_t task_created = xTaskCreatePinnedToCore(audio_writer_task, "audio_writer", EXAMPLE_AUDIO_WRITER_STACK, NULL,
+                                                      EXAMPLE_AUDIO_WRITER_PRIO, &audio_writer_handle, EXAMPLE_AUDIO_WRITER_CORE);
+    if (task_created != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create audio writer task.");
+        abort();
+    }
+    ESP_LOGI(TAG, "Audio writer started on core %d, ring %d bytes, target %d frames.",
+             EXAMPLE_AUDIO_WRITER_CORE, EXAMPLE_AUDIO_RING_SIZE, spk_ring.target / spk_frame_bytes);
+}
+
+#if UAC_MIC_CHANNELS > 0
+// Host opened or closed the microphone. Runs in the TinyUSB task.
+static void uac_device_mic_cb(bool streaming, void *arg)
+{
+    atomic_store_explicit(&mic_streaming, streaming, memory_order_relaxed);
+    // The capture task only runs while the output is up
+    xTaskNotifyGive(audio_writer_handle);
+}
+
+// Reads RX one DMA buffer at a time and queues it for the microphone endpoint. RX runs
+// whenever TX does, so with the host not listening the buffers are just drained.
+static void audio_capture_task(void *arg)
+{
+    uint8_t *in = heap_caps_malloc(EXAMPLE_I2S_DMA_BUF_MAX, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    int16_t *out = heap_caps_malloc(EXAMPLE_I2S_DMA_BUF_MAX, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    assert(in && out);
+
+    while (1) {
+        xSemaphoreTake(i2s_rx_lock, portMAX_DELAY);
+        // Stable while the lock is held: the writer only changes it with the lock taken
+        const int in_bytes = i2s_slot_bytes;
+        const int in_channels = i2s_slot_channels;
+        const size_t frame_bytes = in_bytes * in_channels;
+        size_t len = 0;
+        esp_err_t ret = i2s_channel_read(i2s_rx_handle, in, i2s_dma_frames * frame_bytes, &len,
+                                         pdMS_TO_TICKS(EXAMPLE_CAPTURE_TIMEOUT_MS));
+        xSemaphoreGive(i2s_rx_lock);
+        if (ret != ESP_OK && ret != ESP_ERR_TIMEOUT) {
+            DLOGE(TAG, "I2S read failed: %s", esp_err_to_name(ret));
+            vTaskDelay(pdMS_TO_TICKS(EXAMPLE_CAPTURE_TIMEOUT_MS));
+            continue;
+        }
+        if (len == 0 || !atomic_load_explicit(&mic_streaming, memory_order_relaxed)) {
+            continue;
+        }
+
+        // Mono to stereo doubles a 16-bit buffer, which only fits while DMA buffers are short
+        size_t frames = MIN(len / frame_bytes, EXAMPLE_I2S_DMA_BUF_MAX / (UAC_MIC_N_BYTES * UAC_MIC_CHANNELS));
+        size_t out_len = audio_capture_convert(in, frames, in_bytes, in_channels, out, UAC_MIC_CHANNELS);
+        size_t queued = usb_audio_write(out, out_len);
+        size_t queued_frames = queued / (UAC_MIC_N_BYTES * UAC_MIC_CHANNELS);
+        atomic_fetch_add_explicit(&mic_frames, queued_frames, memory_order_relaxed);
+        if (queued_frames < frames) {
+            atomic_fetch_add_explicit(&mic_dropped, frames - queued_frames, memory_order_relaxed);
+        }
+    }
+}
+
+static void audio_capture_init(void)
+{
+    BaseType_t task_created = xTaskCreatePinnedToCore(audio_capture_task, "audio_capture", EXAMPLE_CAPTURE_STACK, NULL,
+                                                      EXAMPLE_CAPTURE_PRIO, NULL, EXAMPLE_CAPTURE_CORE);
+    if (task_created != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create audio capture task.");
+        abort();
+    }
+    ESP_LOGI(TAG, "Audio capture started on core %d, %d ch.", EXAMPLE_CAPTURE_CORE, UAC_MIC_CHANNELS);
+}
+#endif
+
+static void i2s_driver_init(void)
+{
+    // Every stream starts with silence and a fade-in (audio_writer_stream_start), so no
+    // prefill is needed here.
+    i2s_tx_open(&spk_format);
+
+    const audio_power_config_t power_config = {
+        .amp_gpio = EXAMPLE_AMP_EN_IO,
+        .vbus_gpio = EXAMPLE_VBUS_IO,
+        .output_cb = i2s_tx_power,
     };
-    ESP_ERROR_CHECK(gpio_config(&amp_mode_config));
-    gpio_set_level(GPIO_NUM_8, 1);
+    ESP_ERROR_CHECK(audio_power_init(&power_config));
+#if UAC_MIC_CHANNELS > 0
+    audio_capture_init();
+#endif
+}
+
+// --- Console commands ---
+static const char *const dsp_eq_type_names[] = {
+    [AUDIO_DSP_EQ_OFF] = "off",
+    [AUDIO_DSP_EQ_PEAK] = "peak",
+    [AUDIO_DSP_EQ_LOWSHELF] = "lowshelf",
+    [AUDIO_DSP_EQ_HIGHSHELF] = "highshelf",
+    [AUDIO_DSP_EQ_LOWPASS] = "lowpass",
+    [AUDIO_DSP_EQ_HIGHPASS] = "highpass",
+};
+
+static void dsp_print_params(const audio_dsp_params_t *params)
+{
+    printf("volume %.1f dB%s, limiter ", params->volume_db, params->mute ? " (muted)" : "");
+    if (params->limiter) {
+        printf("%.1f dBFS\n", params->limit_dbfs);
+    } else {
+        printf("off\n");
+    }
+    for (int i = 0; i < AUDIO_DSP_MAX_BIQUADS; i++) {
+        const audio_dsp_eq_t *eq = &params->eq[i];
+        if (eq->type == AUDIO_DSP_EQ_OFF) {
+            printf("eq %d: off\n", i);
+        } else {
+            printf("eq %d: %s %.0f Hz q %.2f %.1f dB\n", i, dsp_eq_type_names[eq->type], eq->freq_hz, eq->q, eq->gain_db);
+        }
+    }
+}
+
+// dsp                                   show the current settings
+// dsp vol <dB>                          master volume, ramped
+// dsp mute on|off
+// dsp eq <band> off
+// dsp eq <band> <type> <Hz> <q> [dB]    type: peak, lowshelf, highshelf, lowpass, highpass
+// dsp limit off|<dBFS>
+static int console_cmd_dsp(int argc, char **argv)
+{
+    audio_dsp_params_t params;
+    taskENTER_CRITICAL(&dsp_params_lock);
+    params = dsp_params;
+    taskEXIT_CRITICAL(&dsp_params_lock);
+
+    if (argc < 2) {
+        dsp_print_params(&params);
+        return 0;
+    }
+
+    if (strcmp(argv[1], "vol") == 0 && argc == 3) {
+        params.volume_db = strtof(argv[2], NULL);
+    } else if (strcmp(argv[1], "mute") == 0 && argc == 3) {
+        params.mute = strcmp(argv[2], "on") == 0;
+    } else if (strcmp(argv[1], "limit") == 0 && argc == 3) {
+        params.limiter = strcmp(argv[2], "off") != 0;
+        if (params.limiter) {
+            params.limit_dbfs = strtof(argv[2], NULL);
+        }
+    } else if (strcmp(argv[1], "eq") == 0 && argc >= 4) {
+        int band = atoi(argv[2]);
+        if (band < 0 || band >= AUDIO_DSP_MAX_BIQUADS) {
+            printf("band must be 0..%d\n", AUDIO_DSP_MAX_BIQUADS - 1);
+            return 1;
+        }
+        audio_dsp_eq_t eq = { .type = AUDIO_DSP_EQ_OFF };
+        if (strcmp(argv[3], "off") != 0) {
+            for (int t = AUDIO_DSP_EQ_PEAK; t <= AUDIO_DSP_EQ_HIGHPASS; t++) {
+                if (strcmp(argv[3], dsp_eq_type_names[t]) == 0) {
+                    eq.type = t;
+                }
+            }
+            if (eq.type == AUDIO_DSP_EQ_OFF || argc < 6) {
+                printf("usage: dsp eq <band> <peak|lowshelf|highshelf|lowpass|highpass> <Hz> <q> [dB]\n");
+                return 1;
+            }
+            eq.freq_hz = strtof(argv[4], NULL);
+            eq.q = strtof(argv[5], NULL);
+            eq.gain_db = argc > 6 ? strtof(argv[6], NULL) : 0.0f;
+        }
+        params.eq[band] = eq;
+    } else {
+        printf("usage: dsp [vol <dB> | mute on|off | eq <band> ... | limit off|<dBFS>]\n");
+        return 1;
+    }
+
+    taskENTER_CRITICAL(&dsp_params_lock);
+    dsp_params = params;
+    taskEXIT_CRITICAL(&dsp_params_lock);
+    audio_dsp_params_publish();
+    dsp_print_params(&params);
+    return 0;
+}
+
+// audio                                 stream format and jitter-pool counters
+static int console_cmd_audio(int argc, char **argv)
+{
+    printf("format %" PRIu32 " Hz, %d-bit, %d ch\n", spk_format.sample_rate, spk_format.bits_per_sample, spk_format.channels);
+    printf("i2s slots %d-bit x %d%s\n", i2s_slot_bytes * 8, i2s_slot_channels, spk_to_slots ? ", converted" : "");
+    printf("pool %d x %d bytes, fill %d, high-water %d\n", EXAMPLE_AUDIO_POOL_BLOCKS, EXAMPLE_AUDIO_POOL_BLOCK_BYTES,
+           audio_ring_fill(&spk_ring), atomic_load(&spk_ring.high_water));
+    printf("overruns %" PRIu32 ", underruns %" PRIu32 "\n", atomic_load(&spk_ring.overruns), atomic_load(&spk_ring.underruns));
+    printf("copy bytes avoided %" PRIu64 "\n", atomic_load(&spk_copy_bytes_avoided));
+
+    spk_start_stats_t start;
+    taskENTER_CRITICAL(&spk_start_lock);
+    start = spk_start_stats;
+    taskEXIT_CRITICAL(&spk_start_lock);
+    printf("starts %" PRIu32 ", SET_INTERFACE to first write %" PRIu32 " us, to first sound %" PRIu32 " us (max %" PRIu32 " us)\n",
+           start.starts, start.first_write_us, start.first_sound_us, start.max_first_sound_us);
+#if UAC_MIC_CHANNELS > 0
+    // Both counters advance one DMA buffer at a time off the shared clock, so the offset
+    // stays put between channel restarts
+    int32_t offset = (int32_t)(atomic_load(&i2s_tx_frames) - atomic_load(&i2s_rx_frames));
+    printf("mic %s, %" PRIu32 " frames captured, %" PRIu32 " dropped, tx-rx offset %" PRId32 " frames\n",
+           atomic_load(&mic_streaming) ? "streaming" : "idle", atomic_load(&mic_frames), atomic_load(&mic_dropped), offset);
+#endif
+
+    wav_player_status_t player;
+    wav_player_get_status(&player);
+    if (player.active) {
+        printf("local %s, %" PRIu32 " Hz, %d-bit, %d ch, %" PRIu32 ".%03" PRIu32 " s\n", player.path, player.sample_rate,
+               player.bits_per_sample, player.channels, player.played_ms / 1000, player.played_ms % 1000);
+    } else {
+        printf("local idle\n");
+    }
+    printf("local queued %" PRIu32 ", underruns %" PRIu32 "\n", player.queued, player.underruns);
+    return 0;
+}
+
+// Paths without a leading '/' are relative to BASE_PATH.
+static void wav_resolve_path(const char *arg, char *path, size_t size)
+{
+    if (arg[0] == '/') {
+        strlcpy(path, arg, size);
+    } else {
+        snprintf(path, size, BASE_PATH "/%s", arg);
+    }
+}
+
+// play <file>                           stop, clear the queue and play <file>
+// queue <file>                          play <file> after the queued tracks
+static int console_cmd_play(int argc, char **argv)
+{
+    if (argc != 2) {
+        printf("usage: %s <file>\n", argv[0]);
+        return 1;
+    }
+    char path[WAV_PLAYER_PATH_MAX];
+    wav_resolve_path(argv[1], path, sizeof(path));
+    if (msc_storage_in_use_by_host() && !wav_player_active()) {
+        // Files the host copied in since the handover are only on a new view. Nothing is
+        // open on the old one; if the host is mid-write this one is kept.
+        msc_storage_view_refresh();
+    }
+    esp_err_t ret = strcmp(argv[0], "queue") == 0 ? wav_player_enqueue(path) : wav_player_play(path);
+    if (ret != ESP_OK) {
+        printf("%s\n", esp_err_to_name(ret));
+        return 1;
+    }
+    // A powered-down writer only polls now and then
+    xTaskNotifyGive(audio_writer_handle);
+    return 0;
+}
+
+// stop                                  stop local playback, hand back to USB
+static int console_cmd_stop(int argc, char **argv)
+{
+    return wav_player_stop() == ESP_OK ? 0 : 1;
+}
+
+// xfer put <file>                       receive <file> over this port (tools/cdc_xfer.py); "-" discards
+// xfer                                  result of the last transfer
+static int console_cmd_xfer(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "put") == 0) {
+        char path[WAV_PLAYER_PATH_MAX];
+        if (strcmp(argv[2], "-") == 0) {
+            strlcpy(path, argv[2], sizeof(path));
+        } else {
+            wav_resolve_path(argv[2], path, sizeof(path));
+        }
+        esp_err_t ret = cdc_xfer_start(path);
+        if (ret != ESP_OK) {
+            printf("XFER ERROR %s\n", esp_err_to_name(ret));
+            return 1;
+        }
+        return 0;
+    }
+    if (argc != 1) {
+        printf("usage: xfer [put <file>|-]\n");
+        return 1;
+    }
+
+    cdc_xfer_stats_t stats;
+    cdc_xfer_get_stats(&stats);
+    printf("status %d, %" PRIu32 " bytes in %" PRIu32 " frames, %" PRIu32 " ms\n",
+           stats.status, stats.bytes, stats.frames, stats.duration_us / 1000);
+    printf("resends %" PRIu32 ", crc errors %" PRIu32 ", resync bytes %" PRIu32 ", drained bytes %" PRIu32 "\n",
+           stats.naks, stats.crc_errors, stats.resync_bytes, stats.drained_bytes);
+    if (stats.duration_us > 0) {
+        printf("rate %.1f KB/s\n", stats.bytes * 1000.0 / stats.duration_us);
+    }
+    return 0;
+}
+
+// msc                                   mass-storage engine counters
+static int console_cmd_msc(int argc, char **argv)
+{
+    msc_storage_stats_t stats;
+    msc_storage_get_stats(&stats);
+
+    printf("owner %s\n", msc_storage_in_use_by_host() ? "host" : "app");
+    printf("read %" PRIu64 " bytes in %" PRIu32 " ops, %" PRIu32 " read-ahead hits\n", stats.bytes_read, stats.read_ops, stats.read_ahead_hits);
+    printf("written %" PRIu64 " bytes in %" PRIu32 " ops\n", stats.bytes_written, stats.write_ops);
+    printf("flash programmed %" PRIu64 " bytes, write amplification %" PRIu32 ".%02" PRIu32 ", %" PRIu32 " cache flushes\n",
+           stats.flash_bytes_written, stats.write_amplification_pct / 100, stats.write_amplification_pct % 100, stats.cache_flushes);
+    printf("busy retries %" PRIu32 ", errors %" PRIu32 "\n", stats.busy_retries, stats.errors);
+    if (msc_storage_view_enabled()) {
+        printf("app view: %" PRIu32 " reads, %" PRIu32 " sectors kept from host writes, lost %" PRIu32 " times\n",
+               stats.view_reads, stats.view_sectors, stats.view_lost);
+    }
+    if (stats.io_time_us > 0) {
+        printf("flash throughput %.2f MB/s\n", (double)(stats.bytes_read + stats.bytes_written) / stats.io_time_us);
+    }
+    return 0;
+}
 
+// console                               CDC command pipeline counters
+static int console_cmd_console(int argc, char **argv)
+{
+    cdc_console_stats_t stats;
+    cdc_console_get_stats(&stats);
+
+    printf("rx %" PRIu32 " bytes, %" PRIu32 " dropped\n", stats.rx_bytes, stats.rx_dropped);
+    printf("lines %" PRIu32 ", too long %" PRIu32 ", commands %" PRIu32 ", slowest %" PRIu32 " us\n",
+           stats.lines, stats.lines_too_long, stats.commands, stats.max_exec_us);
+    printf("tx %" PRIu32 " bytes in %" PRIu32 " batches, %" PRIu32 " dropped\n", stats.tx_bytes, stats.tx_batches, stats.tx_dropped);
+    return 0;
+}
+
+// stats                                 telemetry since boot or the last reset
+// stats hist                            also the non-empty histogram buckets
+// stats reset
+static int console_cmd_stats(int argc, char **argv)
+{
+    bool buckets = argc == 2 && strcmp(argv[1], "hist") == 0;
+    if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+        telemetry_reset();
+        return 0;
+    }
+    if (argc > 2 || (argc == 2 && !buckets)) {
+        printf("usage: stats [hist|reset]\n");
+        return 1;
+    }
+
+    // Too big for the console worker's stack
+    static telemetry_snapshot_t snap;
+    telemetry_snapshot(&snap);
+    const double secs = snap.elapsed_us / 1e6;
+
+    printf("window %.3f s\n", secs);
+    for (int i = 0; i < TELEM_COUNTER_COUNT; i++) {
+        printf("%-20s %" PRIu32 "\n", telemetry_counter_name(i), snap.counters[i]);
+    }
+    if (secs > 0) {
+        printf("msc %.1f KB/s read, %.1f KB/s written\n", snap.counters[TELEM_MSC_READ_BYTES] / secs / 1000,
+               snap.counters[TELEM_MSC_WRITE_BYTES] / secs / 1000);
+    }
+    for (int i = 0; i < TELEM_HIST_COUNT; i++) {
+        const telemetry_hist_snapshot_t *h = &snap.hist[i];
+        printf("%-20s n %" PRIu32 ", p50 %" PRIu32 ", p99 %" PRIu32 ", p99.9 %" PRIu32 ", max %" PRIu32 "\n",
+               telemetry_hist_name(i), h->count, telemetry_hist_percentile(i, h, 500),
+               telemetry_hist_percentile(i, h, 990), telemetry_hist_percentile(i, h, 999), h->max);
+        for (int b = 0; buckets && b < TELEMETRY_BUCKETS; b++) {
+            if (h->buckets[b] == 0) {
+                continue;
+            }
+            if (b == TELEMETRY_BUCKETS - 1) {
+                printf("  >= %-10" PRIu32 " %" PRIu32 "\n", telemetry_bucket_floor(i, b), h->buckets[b]);
+            } else {
+                printf("  %5" PRIu32 "..%-6" PRIu32 " %" PRIu32 "\n", telemetry_bucket_floor(i, b),
+                       telemetry_bucket_floor(i, b + 1) - 1, h->buckets[b]);
+            }
+        }
+    }
+    return 0;
+}
+
+// log                                   deferred log counters
+// log file <file>                       append deferred log output to <file>
+// log console                           back to the console
+static int console_cmd_log(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "file") == 0) {
+        char path[WAV_PLAYER_PATH_MAX];
+        wav_resolve_path(argv[2], path, sizeof(path));
+        dlog_set_file(path);
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "console") == 0) {
+        dlog_set_file(NULL);
+        return 0;
+    }
+    if (argc != 1) {
+        printf("usage: log [file <file> | console]\n");
+        return 1;
+    }
+
+    dlog_stats_t stats;
+    dlog_get_stats(&stats);
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        printf("core %d: %" PRIu32 " records, %" PRIu32 " dropped\n", c, stats.written[c], stats.dropped[c]);
+    }
+    printf("%" PRIu32 " lines out, %" PRIu32 " file errors\n", stats.lines, stats.file_errors);
+    return 0;
+}
+
+// Milliseconds with one decimal
+#define BOOT_MS(us) ((us) / 1000), ((us) / 100 % 10)
+
+static int console_cmd_boot(int argc, char **argv)
+{
+    boot_trace_t trace;
+    boot_trace_get(&trace);
+
+    printf("%-12s %9s %9s %9s\n", "phase", "start ms", "end ms", "took ms");
+    for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+        uint32_t start = trace.phase_start_us[i];
+        uint32_t end = trace.phase_end_us[i];
+        if (start == 0) {
+            printf("%-12s %9s\n", boot_trace_phase_name(i), "-");
+        } else if (end == 0) {
+            printf("%-12s %5" PRIu32 ".%" PRIu32 " %9s\n", boot_trace_phase_name(i), BOOT_MS(start), "running");
+        } else {
+            printf("%-12s %5" PRIu32 ".%" PRIu32 " %5" PRIu32 ".%" PRIu32 " %5" PRIu32 ".%" PRIu32 "\n",
+                   boot_trace_phase_name(i), BOOT_MS(start), BOOT_MS(end), BOOT_MS(end - start));
+        }
+    }
+    for (int i = 0; i < BOOT_MARK_COUNT; i++) {
+        uint32_t at = trace.mark_us[i];
+        if (at == 0) {
+            printf("%-12s not yet\n", boot_trace_mark_name(i));
+            continue;
+        }
+        bool budgeted = i != BOOT_MARK_APP_MAIN;
+        printf("%-12s %5" PRIu32 ".%" PRIu32 "%s\n", boot_trace_mark_name(i), BOOT_MS(at),
+               !budgeted ? "" : (at <= EXAMPLE_BOOT_BUDGET_MS * 1000u ? "  within budget" : "  OVER BUDGET"));
+    }
+    printf("budget %d ms from esp_timer start, bootloader not included\n", EXAMPLE_BOOT_BUDGET_MS);
+    return 0;
+}
+
+static int console_cmd_tasks(int argc, char **argv)
+{
+    static task_stats_t stats;  // Too big for the console worker's stack
+    if (task_stats_sample(&stats) != ESP_OK) {
+        return 1;
+    }
+    printf("%-16s %4s %4s %6s %7s\n", "task", "core", "prio", "stack", "load");
+    for (int i = 0; i < stats.count; i++) {
+        task_stats_entry_t *t = &stats.tasks[i];
+        char core[4] = "-";
+        if (t->core >= 0) {
+            snprintf(core, sizeof(core), "%d", t->core);
+        }
+        printf("%-16s %4s %4" PRIu32 " %6" PRIu32 " %3" PRIu32 ".%" PRIu32 "%%\n", t->name, core, t->prio,
+               t->stack_free, t->load_permille / 10, t->load_permille % 10);
+    }
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        printf("core %d: %" PRIu32 ".%" PRIu32 "%% busy\n", c,
+               stats.core_load_permille[c] / 10, stats.core_load_permille[c] % 10);
+    }
+    printf("over %" PRIu32 " ms\n", stats.window_us / 1000);
+    return 0;
+}
+
+// power                                 output power state and wake latency
+static int console_cmd_power(int argc, char **argv)
+{
+    audio_power_stats_t stats;
+    audio_power_get_stats(&stats);
+    printf("output %s, %" PRIu64 " ms asleep in total, %" PRIu32 " wakes\n", stats.awake ? "on" : "off",
+           stats.asleep_ms, stats.wakes);
+    printf("wake %" PRIu32 " us, to first sample %" PRIu32 " us (max %" PRIu32 " us)\n",
+           stats.last_wake_us, stats.last_first_sample_us, stats.max_first_sample_us);
+    return 0;
+}
+
+// sfx                                   cached samples and mixer state
+// sfx <name> [dB]                       play a cached sample over the output
+// sfx stop                              silence all effects
+static int console_cmd_sfx(int argc, char **argv)
+{
+    if (!atomic_load(&storage_ready)) {
+        printf("storage not ready\n");
+        return 1;
+    }
+    if (argc == 1) {
+        sample_cache_stats_t stats;
+        sample_cache_get_stats(&stats);
+        printf("cache %d of %d bytes in %s, %" PRIu32 " samples, %" PRIu32 " skipped\n", stats.used_bytes, stats.arena_bytes,
+               stats.psram ? "PSRAM" : "internal RAM", stats.entries, stats.skipped);
+        const sample_cache_entry_t *e;
+        for (int i = 0; (e = sample_cache_get(i)) != NULL; i++) {
+            printf("  %-24s %" PRIu32 " Hz, %d ch, %" PRIu32 " ms\n", e->name, e->sample_rate, e->channels,
+                   (uint32_t)((uint64_t)e->frames * 1000 / e->sample_rate));
+        }
+        // Written by the writer task; word-sized, so at worst a chunk old
+        printf("voices %d of %d playing, %" PRIu32 " started, %" PRIu32 " replaced, %" PRIu32 " at the wrong rate\n",
+               __builtin_popcount(spk_mixer.active), AUDIO_MIXER_VOICES, spk_mixer.started, spk_mixer.stolen,
+               atomic_load(&sfx_skipped));
+        return 0;
+    }
+    if (argc > 3) {
+        printf("usage: sfx [<name> [dB]|stop]\n");
+        return 1;
+    }
+
+    sfx_request_t req = { .sample = NULL, .gain = AUDIO_MIXER_UNITY };
+    if (strcmp(argv[1], "stop") != 0) {
+        req.sample = sample_cache_find(argv[1]);
+        if (req.sample == NULL) {
+            printf("%s is not cached\n", argv[1]);
+            return 1;
+        }
+        if (argc == 3) {
+            req.gain = (int32_t)lrintf(AUDIO_MIXER_UNITY * powf(10.0f, strtof(argv[2], NULL) / 20.0f));
+        }
+    }
+    if (xQueueSend(sfx_queue, &req, 0) != pdTRUE) {
+        printf("busy\n");
+        return 1;
+    }
+    xTaskNotifyGive(audio_writer_handle);
+    return 0;
+}
+
+// Detaches from the bus, swaps the descriptors and reattaches, so the host enumerates
+// `profile` as a new device.
+static void usb_profile_switch(usb_profile_t profile)
+{
+    tud_disconnect();
+    vTaskDelay(pdMS_TO_TICKS(EXAMPLE_USB_DETACH_MS));
+    // The host is gone without closing its streams
+    usb_audio_detached();
+    if (!(usb_descriptors_functions(profile) & USB_FUNC_MSC) && atomic_load(&storage_ready) &&
+            msc_storage_in_use_by_host()) {
+        // The volume would be left to a host that can no longer see it. Files open on the
+        // application view don't survive that.
+        wav_player_stop();
+        msc_storage_mount(BASE_PATH);
+    }
+    usb_descriptors_set_profile(profile);
+    tud_connect();
+}
+
+// usb                                   profiles, the one running and the one saved
+// usb <profile>                         save <profile> and re-enumerate with it
+// usb check                             check every profile's descriptors
+// usb dump                              descriptors in hex, for tools/usb_desc_check.c -d
+static int console_cmd_usb(int argc, char **argv)
+{
+    const usb_profile_t running = usb_descriptors_get_profile();
+    if (argc == 2 && strcmp(argv[1], "check") == 0) {
+        int total = 0;
+        for (usb_profile_t i = 0; i < USB_PROFILE_COUNT; i++) {
+            usb_desc_layout_t layout;
+            printf("%-12s\n", usb_descriptors_profile_name(i));
+            int problems = usb_profile_check(i, usb_check_print, &layout);
+            printf("  %u bytes, %u interfaces, %u IN / %u OUT endpoints, %u periodic bytes/frame: %s\n",
+                   layout.total_len, layout.itf_count, layout.in_eps, layout.out_eps, layout.periodic_bytes,
+                   problems ? "FAIL" : "ok");
+            total += problems;
+        }
+        return total ? 1 : 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "dump") == 0) {
+        const uint8_t *device = usb_descriptors_device();
+        printf("strings %u\ndevice", usb_descriptors_string_count());
+        for (int i = 0; i < device[0]; i++) {
+            printf(" %02x", device[i]);
+        }
+        for (usb_profile_t i = 0; i < USB_PROFILE_COUNT; i++) {
+            const uint8_t *config = usb_descriptors_config(i);
+            printf("\nconfig %s", usb_descriptors_profile_name(i));
+            for (int j = 0; j < (config[2] | (config[3] << 8)); j++) {
+                printf(" %02x", config[j]);
+            }
+        }
+        printf("\n");
+        return 0;
+    }
+    if (argc == 1) {
+        const usb_profile_t saved = usb_profile_saved();
+        for (usb_profile_t i = 0; i < USB_PROFILE_COUNT; i++) {
+            uint32_t funcs = usb_descriptors_functions(i);
+            printf("%c%c %-12s pid 0x%04x %s%s%s\n", i == running ? '*' : ' ', i == saved ? 's' : ' ',
+                   usb_descriptors_profile_name(i), usb_descriptors_pid(i), (funcs & USB_FUNC_AUDIO) ? "audio " : "",
+                   (funcs & USB_FUNC_CDC) ? "cdc " : "", (funcs & USB_FUNC_MSC) ? "msc" : "");
+        }
+        printf("* running, s saved; hold the BOOT button at reset for maintenance\n");
+        return 0;
+    }
+
+    usb_profile_t profile = 0;
+    while (profile < USB_PROFILE_COUNT && strcmp(argv[1], usb_descriptors_profile_name(profile)) != 0) {
+        profile++;
+    }
+    if (argc > 2 || profile == USB_PROFILE_COUNT) {
+        printf("usage: usb [full|audio|audio-cdc|maintenance|check|dump]\n");
+        return 1;
+    }
+    esp_err_t err = usb_profile_save(profile);
+    if (err != ESP_OK) {
+        printf("save failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    if (profile == running) {
+        return 0;
+    }
+    printf("re-enumerating as %s%s\n", usb_descriptors_profile_name(profile),
+           (usb_descriptors_functions(profile) & USB_FUNC_CDC) ? "" : ", this console goes away");
+    // Lets the reply reach the host before the port goes
+    vTaskDelay(pdMS_TO_TICKS(50));
+    usb_profile_switch(profile);
+    return 0;
+}
+
+static void console_init(void)
+{
+    esp_console_config_t console_config = ESP_CONSOLE_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_console_init(&console_config));
+    ESP_ERROR_CHECK(esp_console_register_help_command());
+
+    const esp_console_cmd_t dsp_cmd = {
+        .command = "dsp",
+        .help = "Show or set playback DSP: vol <dB>, mute on|off, eq <band> <type> <Hz> <q> [dB], limit off|<dBFS>",
+        .func = console_cmd_dsp,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&dsp_cmd));
+
+    const esp_console_cmd_t audio_cmd = {
+        .command = "audio",
+        .help = "Show stream format and jitter-pool counters",
+        .func = console_cmd_audio,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&audio_cmd));
+
+    const esp_console_cmd_t play_cmd = {
+        .command = "play",
+        .help = "Play a WAV file from " BASE_PATH ", replacing the queue",
+        .func = console_cmd_play,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&play_cmd));
+
+    const esp_console_cmd_t queue_cmd = {
+        .command = "queue",
+        .help = "Queue a WAV file from " BASE_PATH,
+        .func = console_cmd_play,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&queue_cmd));
+
+    const esp_console_cmd_t stop_cmd = {
+        .command = "stop",
+        .help = "Stop local playback and clear the queue",
+        .func = console_cmd_stop,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&stop_cmd));
+
+    const esp_console_cmd_t power_cmd = {
+        .command = "power",
+        .help = "Show output power state and wake-to-first-sample latency",
+        .func = console_cmd_power,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&power_cmd));
+
+    const esp_console_cmd_t sfx_cmd = {
+        .command = "sfx",
+        .help = "Play a cached sample from " BASE_PATH " over the output: <name> [dB], stop; no argument lists the cache",
+        .func = console_cmd_sfx,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&sfx_cmd));
+
+    const esp_console_cmd_t msc_cmd = {
+        .command = "msc",
+        .help = "Show mass-storage engine counters",
+        .func = console_cmd_msc,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&msc_cmd));
+
+    const esp_console_cmd_t xfer_cmd = {
+        .command = "xfer",
+        .help = "Receive a file into " BASE_PATH " over this port: put <file>|-; no argument shows the last result",
+        .func = console_cmd_xfer,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&xfer_cmd));
+
+    const esp_console_cmd_t stats_cmd = {
+        .command = "stats",
+        .help = "Show audio/USB telemetry: hist adds the buckets, reset starts a new window",
+        .func = console_cmd_stats,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&stats_cmd));
+
+    const esp_console_cmd_t log_cmd = {
+        .command = "log",
+        .help = "Show deferred log counters, or send its output to a file in " BASE_PATH " or the console",
+        .func = console_cmd_log,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&log_cmd));
+
+    const esp_console_cmd_t tasks_cmd = {
+        .command = "tasks",
+        .help = "Show per-task core, priority, free stack and CPU load since the last call",
+        .func = console_cmd_tasks,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&tasks_cmd));
+
+    const esp_console_cmd_t boot_cmd = {
+        .command = "boot",
+        .help = "Show when each startup phase ran, and when the device enumerated and first played sound",
+        .func = console_cmd_boot,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&boot_cmd));
+
+    const esp_console_cmd_t usb_cmd = {
+        .command = "usb",
+        .help = "Show the USB composition profiles, save one and re-enumerate (full, audio, audio-cdc, maintenance), "
+                "or check or dump their descriptors",
+        .func = console_cmd_usb,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&usb_cmd));
+
+    const esp_console_cmd_t console_cmd = {
+        .command = "console",
+        .help = "Show CDC command pipeline counters",
+        .func = console_cmd_console,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&console_cmd));
+
+    ESP_ERROR_CHECK(cdc_console_init(TINYUSB_CDC_ACM_0));
 }
 
 void tinyusb_cdc_rx_callback(int itf, cdcacm_event_t *event)
@@ -258,17 +1893,10 @@ void tinyusb_cdc_rx_callback(int itf, cdcacm_event_t *event)
     /* read */
     esp_err_t ret = tinyusb_cdcacm_read((tinyusb_cdcacm_itf_t)itf, buf, CONFIG_TINYUSB_CDC_RX_BUFSIZE, &rx_size);
     if (ret == ESP_OK) {
-        // Ensure received data is null-terminated and fits in the buffer
-        static char line[255]; // Console input buffer
-        size_t len = MIN(sizeof(line) - 1, rx_size); // Leave room for null terminator
-        snprintf(line, len + 1, "%.*s", (int)len, buf); // Null-terminate and truncate if necessary
-
-        // Pass the line to the console
-        int console_ret;
-        esp_console_run(line, &console_ret);
-        ESP_LOGI("USB", "Running %s.", line);
+        // Lines are assembled and run by the console worker, never in the USB task
+        cdc_console_feed(buf, rx_size);
     } else {
-        ESP_LOGE("USB", "Read error");
+        DLOGE("USB", "Read error");
     }
 }
 
@@ -280,41 +1908,63 @@ void tinyusb_cdc_line_state_changed_callback(int itf, cdcacm_event_t *event)
 
     // als hostpoort nét opengezet is → onthoud dat we in “open” zijn
     if (dtr && !cdc_port_open) {
-        ESP_LOGI("USB", "CDC DTR gone up → host-poort open");
+        DLOGI("USB", "CDC DTR gone up → host-poort open");
         cdc_port_open = true;
     }
     // als hostpoort wél eerder open was en nu dichtgaat → unmount
     else if (!dtr && cdc_port_open) {
-        ESP_LOGI("USB", "CDC DTR gone down → unmount MSC");
-        tinyusb_msc_storage_unmount();
         cdc_port_open = false;
+        // Only when the host can see the volume; done here, or by the storage task once it is up
+        if (usb_descriptors_functions(usb_descriptors_get_profile()) & USB_FUNC_MSC) {
+            DLOGI("USB", "CDC DTR gone down → unmount MSC");
+            atomic_store(&storage_release_pending, true);
+            storage_release_if_pending();
+        }
         // (optioneel) na korte vertraging weer remounten:
         // vTaskDelay(pdMS_TO_TICKS(100));
-        // tinyusb_msc_storage_mount(BASE_PATH);
+        // msc_storage_mount(BASE_PATH);
     }
 }
 
 void app_main(void)
 {
-    ESP_LOGI(TAG, "Initializing storage...");
- 
-     static wl_handle_t wl_handle = WL_INVALID_HANDLE;
-     ESP_ERROR_CHECK(storage_init_spiflash(&wl_handle));
- 
-     const tinyusb_msc_spiflash_config_t config_spi = {
-         .wl_handle = wl_handle,
-         .callback_mount_changed = storage_mount_changed_cb,  /* First way to register the callback. This is while initializing the storage. */
-         .mount_config.max_files = 5,
-     };
-     ESP_ERROR_CHECK(tinyusb_msc_storage_init_spiflash(&config_spi));
-     ESP_ERROR_CHECK(tinyusb_msc_register_callback(TINYUSB_MSC_EVENT_MOUNT_CHANGED, storage_mount_changed_cb)); /* Other way to register the callback i.e. registering using separate API. If the callback had been already registered, it will be overwritten. */
- 
-     //mounted in the app by default
-     _mount();
- 
-     ESP_LOGI(TAG, "USB MSC initialization");
+    boot_trace_mark(BOOT_MARK_APP_MAIN, esp_timer_get_time());
+    // Before anything that can log from a callback
+    ESP_ERROR_CHECK(dlog_init());
+
+    ESP_LOGI(TAG, "App main started");
+
+    // 1. Initialize the jitter buffer and feedback engine, the local WAV player, then the
+    //    I2S driver that feeds DMA-done events into it. The writer only touches I2S once
+    //    USB audio arrives or a file is played.
+    boot_trace_begin(BOOT_PHASE_AUDIO);
+    audio_writer_init();
+    ESP_ERROR_CHECK(wav_player_init());
+    boot_trace_end(BOOT_PHASE_AUDIO);
+    boot_trace_begin(BOOT_PHASE_I2S);
+    i2s_driver_init();
+    boot_trace_end(BOOT_PHASE_I2S);
+    ESP_LOGI(TAG, "I2S driver initialized.");
 
-     tinyusb_config_cdcacm_t acm_cfg = {
+    // 2. Configure UAC device
+    boot_trace_begin(BOOT_PHASE_UAC);
+    usb_audio_config_t uac_config = {
+        .rx_cb = uac_device_rx_cb,
+        .format_cb = uac_device_format_cb,
+        .set_mute_cb = uac_device_set_mute_cb,
+        .set_volume_cb = uac_device_set_volume_cb,
+#if UAC_MIC_CHANNELS > 0
+        .mic_cb = uac_device_mic_cb,
+#endif
+        .cb_ctx = NULL,
+    };
+    ESP_ERROR_CHECK(usb_audio_init(&uac_config));
+    boot_trace_end(BOOT_PHASE_UAC);
+    ESP_LOGI(TAG, "UAC device initialized.");
+
+    // 3. CDC ACM and the console on it
+    boot_trace_begin(BOOT_PHASE_CONSOLE);
+    tinyusb_config_cdcacm_t acm_cfg = {
         .usb_dev = TINYUSB_USBDEV_0,
         .cdc_port = TINYUSB_CDC_ACM_0,
         .rx_unread_buf_sz = 64,
@@ -325,45 +1975,60 @@ void app_main(void)
     };
 
     ESP_ERROR_CHECK(tusb_cdc_acm_init(&acm_cfg));
+    console_init();
+    boot_trace_end(BOOT_PHASE_CONSOLE);
 
-    ESP_LOGI(TAG, "App main started");
-
-    // 1. Initialize I2S driver first
-    i2s_driver_init();
-    ESP_LOGI(TAG, "I2S driver initialized.");
-
-    // 2. Configure UAC device
-    uac_device_config_t uac_config = {
-        .skip_tinyusb_init = true,     // We will init TinyUSB manually
-        .output_cb = uac_device_output_cb,
-        .cb_ctx = NULL,
-        .spk_itf_num = ITF_NUM_AUDIO_STREAMING_SPK, // Ensure this matches your USB descriptor
-        // Add .mic_itf_num if you also have microphone input
-    };
-    // Initialize UAC. This sets up descriptor parts related to UAC.
-    uac_device_init(&uac_config);
-    ESP_LOGI(TAG, "UAC device initialized.");
+    // 4. Pick the USB composition profile
+    boot_trace_begin(BOOT_PHASE_PROFILE);
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(err);
+    usb_descriptors_set_profile(usb_profile_boot());
+    // A profile the host would reject is reported now rather than as a failed enumeration
+    for (usb_profile_t i = 0; i < USB_PROFILE_COUNT; i++) {
+        usb_desc_layout_t layout;
+        usb_profile_check(i, usb_check_log, &layout);
+    }
+    boot_trace_end(BOOT_PHASE_PROFILE);
+    ESP_LOGI(TAG, "USB profile %s, PID 0x%04x.", usb_descriptors_profile_name(usb_descriptors_get_profile()),
+             usb_descriptors_pid(usb_descriptors_get_profile()));
 
-    // 3. Initialize USB PHY
+    // 5. Initialize USB PHY
+    boot_trace_begin(BOOT_PHASE_PHY);
     usb_phy_init();
+    boot_trace_end(BOOT_PHASE_PHY);
     ESP_LOGI(TAG, "USB PHY initialized.");
 
-    // 4. Initialize TinyUSB stack
+    // 6. Initialize TinyUSB stack
+    boot_trace_begin(BOOT_PHASE_TINYUSB);
     bool usb_init_stat = tusb_init();
     if (usb_init_stat == false) {
         ESP_LOGE(TAG, "Failed to initialize TinyUSB stack.");
         return; // Or handle error appropriately
     }
-    ESP_LOGI(TAG, "TinyUSB stack initialized.");
 
-    // 5. Create TinyUSB device task
+    // 7. Create TinyUSB device task
     // It's good practice to check the return value of xTaskCreatePinnedToCore
-    BaseType_t task_created = xTaskCreatePinnedToCore(tusb_device_task, "TinyUSB", 4096, NULL, 5, NULL, 0);
+    BaseType_t task_created = xTaskCreatePinnedToCore(tusb_device_task, "TinyUSB", EXAMPLE_USB_TASK_STACK, NULL,
+                                                      EXAMPLE_USB_TASK_PRIO, NULL, EXAMPLE_USB_TASK_CORE);
     if (task_created != pdPASS) {
         ESP_LOGE(TAG, "Failed to create TinyUSB task.");
         return; // Or handle error appropriately
     }
-    ESP_LOGI(TAG, "TinyUSB task created and pinned to core 0.");
+    boot_trace_end(BOOT_PHASE_TINYUSB);
+    ESP_LOGI(TAG, "TinyUSB task created and pinned to core %d.", EXAMPLE_USB_TASK_CORE);
 
-    ESP_LOGI(TAG, "Setup complete. Waiting for USB connection and audio data...");
-}
\ No newline at end of file
+    // 8. Mount and index the storage volume in the background; the host sees the unit
+    //    becoming ready until then
+    task_created = xTaskCreatePinnedToCore(storage_task, "storage", EXAMPLE_STORAGE_TASK_STACK, NULL,
+                                           EXAMPLE_STORAGE_TASK_PRIO, NULL, EXAMPLE_STORAGE_TASK_CORE);
+    if (task_created != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create storage task.");
+    }
+
+    ESP_LOGI(TAG, "Setup complete at %" PRIu32 " ms. Waiting for USB connection and audio data...",
+             (uint32_t)(esp_timer_get_time() / 1000));
+}
@@ -0,0 +1,203 @@
+#include <string.h>
+#include <sys/param.h>
+#include "msc_engine.h"
+
+void msc_engine_init(msc_engine_t *e, const msc_engine_ops_t *ops, size_t disk_bytes, uint8_t *const bufs[MSC_ENGINE_BUFS])
+{
+    memset(e, 0, sizeof(*e));
+    e->ops = *ops;
+    e->disk_bytes = disk_bytes;
+    msc_io_buf_t *b[MSC_ENGINE_BUFS] = { &e->wbuf[0], &e->wbuf[1], &e->rbuf[0], &e->rbuf[1] };
+    for (int i = 0; i < MSC_ENGINE_BUFS; i++) {
+        b[i]->data = bufs[i];
+        b[i]->op = i < 2 ? MSC_IO_WRITE : MSC_IO_READ;
+        atomic_init(&b[i]->state, MSC_BUF_IDLE);
+    }
+    e->flush_req.op = MSC_IO_FLUSH;
+    atomic_init(&e->flush_req.state, MSC_BUF_IDLE);
+    atomic_init(&e->write_gen, 0);
+    atomic_init(&e->write_failed, false);
+}
+
+static void msc_submit(msc_engine_t *e, msc_io_buf_t *b)
+{
+    atomic_store_explicit(&b->state, MSC_BUF_BUSY, memory_order_release);
+    e->ops.submit(e->ops.ctx, b);
+}
+
+// Sends the write buffer being filled, if any, to the worker. Returns true once no
+// write is pending any more.
+static bool msc_writes_drained(msc_engine_t *e)
+{
+    msc_io_buf_t *w = &e->wbuf[e->wcur];
+    if (msc_buf_state(w) == MSC_BUF_FILLING) {
+        msc_submit(e, w);
+        e->wcur ^= 1;
+    }
+    return msc_buf_state(&e->wbuf[0]) != MSC_BUF_BUSY && msc_buf_state(&e->wbuf[1]) != MSC_BUF_BUSY;
+}
+
+//--------------------------------------------------------------------+
+// Read path
+//--------------------------------------------------------------------+
+static void msc_read_start(msc_engine_t *e, msc_io_buf_t *r, size_t addr, bool prefetch)
+{
+    r->addr = addr;
+    r->bytes = MIN(MSC_ENGINE_BUF_BYTES, e->disk_bytes - addr);
+    r->gen = atomic_load(&e->write_gen);
+    r->prefetch = prefetch;
+    msc_submit(e, r);
+}
+
+static inline bool msc_read_covers(msc_engine_t *e, const msc_io_buf_t *r, size_t addr)
+{
+    return r->gen == atomic_load(&e->write_gen) && addr >= r->addr && addr < r->addr + r->bytes;
+}
+
+// Keeps the window after `cur` loading into the other buffer.
+static void msc_read_ahead(msc_engine_t *e, const msc_io_buf_t *cur)
+{
+    size_t next = cur->addr + cur->bytes;
+    msc_io_buf_t *other = &e->rbuf[cur == &e->rbuf[0] ? 1 : 0];
+    int state = msc_buf_state(other);
+
+    if (next >= e->disk_bytes || state == MSC_BUF_BUSY) {
+        return;
+    }
+    if (state == MSC_BUF_VALID && msc_read_covers(e, other, next)) {
+        return;
+    }
+    msc_read_start(e, other, next, true);
+}
+
+int32_t msc_engine_read(msc_engine_t *e, size_t addr, void *dst, uint32_t len)
+{
+    // Reads must observe every write already acknowledged to the host
+    if (!msc_writes_drained(e)) {
+        e->busy_retries++;
+        return 0;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        msc_io_buf_t *r = &e->rbuf[i];
+        if (!msc_read_covers(e, r, addr)) {
+            continue;
+        }
+        switch (msc_buf_state(r)) {
+        case MSC_BUF_VALID: {
+            uint32_t n = MIN(len, r->addr + r->bytes - addr);
+            memcpy(dst, r->data + (addr - r->addr), n);
+            if (r->prefetch) {
+                r->prefetch = false;
+                e->read_ahead_hits++;
+            }
+            msc_read_ahead(e, r);
+            return n;
+        }
+        case MSC_BUF_BUSY:
+            e->busy_retries++;
+            return 0;
+        case MSC_BUF_FAILED:
+            atomic_store(&r->state, MSC_BUF_IDLE);
+            return -1;
+        default:
+            break;
+        }
+    }
+
+    // Miss: fetch a window starting here into whichever buffer is free
+    for (int i = 0; i < 2; i++) {
+        if (msc_buf_state(&e->rbuf[i]) != MSC_BUF_BUSY) {
+            msc_read_start(e, &e->rbuf[i], addr, false);
+            break;
+        }
+    }
+    e->busy_retries++;
+    return 0;
+}
+
+//--------------------------------------------------------------------+
+// Write path
+//--------------------------------------------------------------------+
+int32_t msc_engine_write(msc_engine_t *e, size_t addr, const void *src, uint32_t len)
+{
+    if (msc_engine_take_write_error(e)) {
+        // A write-back from an earlier command failed; this is the first chance to report it
+        return -1;
+    }
+
+    msc_io_buf_t *w = &e->wbuf[e->wcur];
+    if (msc_buf_state(w) == MSC_BUF_FILLING && (addr != w->addr + w->bytes || w->bytes == MSC_ENGINE_BUF_BYTES)) {
+        msc_submit(e, w);
+        e->wcur ^= 1;
+        w = &e->wbuf[e->wcur];
+    }
+    if (msc_buf_state(w) == MSC_BUF_BUSY) {
+        e->busy_retries++;
+        return 0;
+    }
+    if (msc_buf_state(w) == MSC_BUF_IDLE) {
+        w->addr = addr;
+        w->bytes = 0;
+        atomic_store(&w->state, MSC_BUF_FILLING);
+    }
+
+    // Anything read before this point may now be stale
+    atomic_fetch_add(&e->write_gen, 1);
+
+    uint32_t n = MIN(len, MSC_ENGINE_BUF_BYTES - w->bytes);
+    memcpy(w->data + w->bytes, src, n);
+    w->bytes += n;
+    if (w->bytes == MSC_ENGINE_BUF_BYTES) {
+        msc_submit(e, w);
+        e->wcur ^= 1;
+    }
+    return n;
+}
+
+void msc_engine_write_complete(msc_engine_t *e)
+{
+    // The host usually waits for the status before sending the next command, so keeping
+    // a partial buffer open would only delay its flash write.
+    msc_io_buf_t *w = &e->wbuf[e->wcur];
+    if (msc_buf_state(w) == MSC_BUF_FILLING) {
+        msc_submit(e, w);
+        e->wcur ^= 1;
+    }
+}
+
+bool msc_engine_sync(msc_engine_t *e)
+{
+    if (!msc_writes_drained(e) || msc_buf_state(&e->flush_req) == MSC_BUF_BUSY) {
+        e->busy_retries++;
+        return false;
+    }
+    // A write-back done at the current generation covers every write acknowledged so far
+    uint32_t gen = atomic_load(&e->write_gen);
+    if (e->flush_req.gen == gen) {
+        return true;
+    }
+    e->flush_req.gen = gen;
+    msc_submit(e, &e->flush_req);
+    e->busy_retries++;
+    return false;
+}
+
+bool msc_engine_take_write_error(msc_engine_t *e)
+{
+    return atomic_exchange(&e->write_failed, false);
+}
+
+void msc_engine_invalidate(msc_engine_t *e)
+{
+    atomic_fetch_add(&e->write_gen, 1);
+}
+
+void msc_engine_done(msc_engine_t *e, msc_io_buf_t *b, int err)
+{
+    if (err != 0 && b->op != MSC_IO_READ) {
+        atomic_store(&e->write_failed, true);
+    }
+    int state = b->op != MSC_IO_READ ? MSC_BUF_IDLE : (err == 0 ? MSC_BUF_VALID : MSC_BUF_FAILED);
+    atomic_store_explicit(&b->state, state, memory_order_release);
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Buffer engine of the USB mass-storage backend (msc_storage.h): the TinyUSB side of
+// READ10, WRITE10 and SYNCHRONIZE CACHE over multi-sector buffers that a worker task
+// moves to and from flash.
+//
+// Every call on the TinyUSB side returns at once. When it has to wait for the worker it
+// says so (0 bytes, or false from msc_engine_sync()) and the caller retries later, so
+// tud_task() never sleeps on flash. Requests go to the worker through `submit`, which
+// must not block; the worker executes them and reports back with msc_engine_done().
+// Buffers change hands through their `state`, so the two sides need no lock.
+// tools/msc_engine_test.c drives it against a file-backed partition.
+
+#define MSC_ENGINE_BUF_BYTES (16384)    // Per buffer, 32 sectors of 512 bytes
+#define MSC_ENGINE_BUFS      (4)        // Two for writes, two for reads
+
+typedef enum {
+    MSC_BUF_IDLE = 0,   // Free, or read data that is no longer of interest
+    MSC_BUF_FILLING,    // Write staging, owned by the TinyUSB task
+    MSC_BUF_BUSY,       // Owned by the worker
+    MSC_BUF_VALID,      // Read data ready, owned by the TinyUSB task
+    MSC_BUF_FAILED,     // Read failed, owned by the TinyUSB task
+} msc_buf_state_t;
+
+typedef enum {
+    MSC_IO_READ,
+    MSC_IO_WRITE,
+    MSC_IO_FLUSH,       // Write back and drop the erase-unit cache
+    MSC_IO_VIEW_READ,   // Application read, from the snapshot it keeps while the host owns the volume
+    MSC_IO_VIEW_RESET,  // New snapshot, if the host has synced its writes
+} msc_io_op_t;
+
+typedef struct {
+    uint8_t *data;
+    msc_io_op_t op;
+    size_t addr;        // Byte address in the WL partition
+    size_t bytes;
+    uint32_t gen;       // Reads and flushes: write generation at submission
+    bool prefetch;      // Reads: issued ahead of the host
+    int err;            // View requests: the result
+    _Atomic int state;  // msc_buf_state_t
+} msc_io_buf_t;
+
+typedef struct {
+    void (*submit)(void *ctx, msc_io_buf_t *b);
+    void *ctx;
+} msc_engine_ops_t;
+
+typedef struct {
+    msc_engine_ops_t ops;
+    size_t disk_bytes;
+    // TinyUSB task only
+    msc_io_buf_t wbuf[2];
+    int wcur;
+    msc_io_buf_t rbuf[2];
+    msc_io_buf_t flush_req;
+    uint32_t busy_retries;      // Calls answered with "not yet"
+    uint32_t read_ahead_hits;   // Prefetched windows the host went on to read
+    // Bumped on every write and on msc_engine_invalidate(); read data fetched at an
+    // older generation is stale
+    _Atomic uint32_t write_gen;
+    _Atomic bool write_failed;  // A write-back failed and the host hasn't been told yet
+} msc_engine_t;
+
+// `bufs` are MSC_ENGINE_BUFS buffers of MSC_ENGINE_BUF_BYTES.
+void msc_engine_init(msc_engine_t *e, const msc_engine_ops_t *ops, size_t disk_bytes, uint8_t *const bufs[MSC_ENGINE_BUFS]);
+
+// READ10 data: copies up to `len` bytes at `addr`. Returns the bytes copied, 0 while
+// the data is still being fetched (or writes are still going out), -1 if the flash read
+// failed.
+int32_t msc_engine_read(msc_engine_t *e, size_t addr, void *dst, uint32_t len);
+
+// WRITE10 data: takes up to `len` bytes for `addr`. Returns the bytes taken, 0 while
+// both write buffers are with the worker, -1 if an earlier write-back failed.
+int32_t msc_engine_write(msc_engine_t *e, size_t addr, const void *src, uint32_t len);
+
+// End of a WRITE10: sends the partial buffer on rather than wait for more.
+void msc_engine_write_complete(msc_engine_t *e);
+
+// SYNCHRONIZE CACHE and eject: sends out every buffered write and then writes back the
+// erase-unit cache. Returns true once everything acknowledged to the host is on flash;
+// until then each call moves things along and returns false.
+bool msc_engine_sync(msc_engine_t *e);
+
+// True once per failed write-back, so the failure is reported once.
+bool msc_engine_take_write_error(msc_engine_t *e);
+
+// Marks all read data stale, e.g. after the application wrote to the volume.
+void msc_engine_invalidate(msc_engine_t *e);
+
+// Worker side: `b` has been executed with result `err` (0 for success).
+void msc_engine_done(msc_engine_t *e, msc_io_buf_t *b, int err);
+
+static inline int msc_buf_state(const msc_io_buf_t *b)
+{
+    return atomic_load_explicit(&b->state, memory_order_acquire);
+}
+
+#ifdef __cplusplus
+}
+#endif
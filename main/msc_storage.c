@@ -0,0 +1,695 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "diskio_impl.h"
+#include "tusb.h"
+#include "flash_cache.h"
+#include "msc_engine.h"
+#include "sector_snapshot.h"
+#include "telemetry.h"
+#include "msc_storage.h"
+
+static const char *TAG = "msc_storage";
+
+#define MSC_IO_WORKER_STACK  (CONFIG_TASK_MSC_STACK)
+#define MSC_IO_WORKER_PRIO   (CONFIG_TASK_MSC_PRIO)  // Below the audio writer
+#define MSC_IO_WORKER_CORE   (CONFIG_TASK_MSC_CORE)  // Away from TinyUSB
+#define MSC_FORMAT_WORKBUF   (4096)
+#define MSC_CACHE_IDLE_MS    (200)   // Dirty erase units are written back after this long without I/O
+
+#define MSC_SCSI_CMD_SYNCHRONIZE_CACHE_10 (0x35)
+
+static msc_storage_config_t s_config;
+static size_t s_sector_size;
+static size_t s_disk_bytes;
+static _Atomic bool s_mounted_to_app;
+static _Atomic bool s_inited;           // msc_storage_init() has run
+static _Atomic bool s_ready;            // An owner has been picked; TinyUSB may be up long before
+static char s_base_path[16];
+static BYTE s_pdrv = 0xFF;
+
+static msc_engine_t s_engine;           // TinyUSB task, or whoever owns the volume while the host can't reach it
+static QueueHandle_t s_io_queue;
+static flash_cache_t s_cache;   // Worker task only
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static msc_storage_stats_t s_stats;
+
+// While the host owns the volume, FAT stays mounted in the application on a snapshot of
+// it taken at the handover, and the worker serves its reads
+static sector_snapshot_t s_snapshot;    // Worker task only, once the view is active
+static _Atomic bool s_view_active;      // FAT reads go to the snapshot
+static _Atomic bool s_host_synced;      // No host write since the last SYNCHRONIZE CACHE or eject
+static SemaphoreHandle_t s_disk_lock;   // Held by FAT disk I/O and to switch it between flash and snapshot
+static SemaphoreHandle_t s_view_done;
+static msc_io_buf_t s_view_req;
+static FATFS *s_fs;                     // Registered with the VFS, kept across host ownership with a view
+
+// The host may touch the medium: the engine is up and the application doesn't own it
+static inline bool msc_host_access(void)
+{
+    return atomic_load(&s_ready) && !atomic_load(&s_mounted_to_app);
+}
+
+static inline void msc_stats_add(uint32_t *counter)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    (*counter)++;
+    taskEXIT_CRITICAL(&s_stats_lock);
+}
+
+static int msc_wl_read(void *ctx, size_t addr, void *dst, size_t len)
+{
+    return wl_read(s_config.wl_handle, addr, dst, len);
+}
+
+static int msc_wl_erase(void *ctx, size_t addr, size_t len)
+{
+    return wl_erase_range(s_config.wl_handle, addr, len);
+}
+
+static int msc_wl_write(void *ctx, size_t addr, const void *src, size_t len)
+{
+    return wl_write(s_config.wl_handle, addr, src, len);
+}
+
+// Before the host overwrites sectors, keeps what the application's snapshot has in them
+static void msc_view_preserve(size_t addr, size_t bytes)
+{
+    if (!atomic_load(&s_view_active) || s_snapshot.lost) {
+        return;
+    }
+    for (uint32_t sector = addr / s_sector_size; (size_t)sector * s_sector_size < addr + bytes; sector++) {
+        if (sector_snapshot_find(&s_snapshot, sector)) {
+            continue;
+        }
+        uint8_t *copy = sector_snapshot_add(&s_snapshot, sector);
+        if (!copy || flash_cache_read(&s_cache, (size_t)sector * s_sector_size, copy, s_sector_size) != 0) {
+            s_snapshot.lost = true;
+            msc_stats_add(&s_stats.view_lost);
+            ESP_LOGW(TAG, "Host wrote more than the application view holds, view lost");
+            return;
+        }
+    }
+}
+
+// Sectors the host has overwritten come from the snapshot, the rest from flash through
+// the cache, which may hold host writes to their neighbours. Runs of the latter are read
+// in one go.
+static esp_err_t msc_view_read(size_t addr, uint8_t *dst, size_t bytes)
+{
+    if (s_snapshot.lost) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t run = 0;     // Bytes from flash still to read, ending at `off`
+    for (size_t off = 0; off < bytes; off += s_sector_size) {
+        const uint8_t *copy = sector_snapshot_find(&s_snapshot, (addr + off) / s_sector_size);
+        if (!copy) {
+            run += s_sector_size;
+            continue;
+        }
+        if (run > 0) {
+            ESP_RETURN_ON_ERROR(flash_cache_read(&s_cache, addr + off - run, dst + off - run, run), TAG, "View read failed");
+            run = 0;
+        }
+        memcpy(dst + off, copy, s_sector_size);
+    }
+    if (run > 0) {
+        ESP_RETURN_ON_ERROR(flash_cache_read(&s_cache, addr + bytes - run, dst + bytes - run, run), TAG, "View read failed");
+    }
+    return ESP_OK;
+}
+
+static esp_err_t msc_view_execute(msc_io_buf_t *b)
+{
+    if (b->op == MSC_IO_VIEW_READ) {
+        msc_stats_add(&s_stats.view_reads);
+        return msc_view_read(b->addr, b->data, b->bytes);
+    }
+    // The host's file system is only consistent on the medium right after it synced
+    if (!atomic_load(&s_host_synced)) {
+        return ESP_ERR_NOT_FINISHED;
+    }
+    sector_snapshot_reset(&s_snapshot);
+    return ESP_OK;
+}
+
+static esp_err_t msc_io_execute(msc_io_buf_t *b)
+{
+    if (b->op == MSC_IO_READ) {
+        return flash_cache_read(&s_cache, b->addr, b->data, b->bytes);
+    }
+    msc_view_preserve(b->addr, b->bytes);
+    return flash_cache_write(&s_cache, b->addr, b->data, b->bytes);
+}
+
+// Any request but a flush
+static void msc_io_handle(msc_io_buf_t *b)
+{
+    if (b == &s_view_req) {
+        b->err = msc_view_execute(b);
+        xSemaphoreGive(s_view_done);
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = msc_io_execute(b);
+    int64_t elapsed = esp_timer_get_time() - start;
+    telemetry_record(TELEM_MSC_IO_US, (uint32_t)elapsed);
+
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.io_time_us += elapsed;
+    if (b->op == MSC_IO_WRITE) {
+        s_stats.write_ops++;
+        s_stats.bytes_written += b->bytes;
+    } else {
+        s_stats.read_ops++;
+        s_stats.bytes_read += b->bytes;
+    }
+    if (err != ESP_OK) {
+        s_stats.errors++;
+    }
+    taskEXIT_CRITICAL(&s_stats_lock);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "I/O op %d of %d bytes at 0x%x failed: %s", b->op, b->bytes, b->addr, esp_err_to_name(err));
+    }
+    msc_engine_done(&s_engine, b, err);
+}
+
+// Writes back one dirty erase unit
+static esp_err_t msc_writeback_step(void)
+{
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = flash_cache_flush_unit(&s_cache);
+    int64_t elapsed = esp_timer_get_time() - start;
+    telemetry_record(TELEM_MSC_IO_US, (uint32_t)elapsed);
+
+    taskENTER_CRITICAL(&s_stats_lock);
+    s_stats.io_time_us += elapsed;
+    if (err != ESP_OK) {
+        s_stats.errors++;
+    }
+    taskEXIT_CRITICAL(&s_stats_lock);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Cache write-back failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+static void msc_io_worker(void *arg)
+{
+    msc_io_buf_t *b;
+    msc_io_buf_t *flush = NULL;     // Flush request waiting for the write-back
+    bool writeback = false;         // Dirty units are going out, one per pass
+
+    while (1) {
+        if (writeback) {
+            // One unit per pass, so a read waits for one sector erase at most. Between
+            // units the next request is served, unless it is a write: that waits if a
+            // flush request is waiting too (the engine holds reads back until its writes
+            // are done, so no read queues behind it), and ends an idle write-back, since
+            // it may yet merge into the cached units.
+            if (xQueuePeek(s_io_queue, &b, 0) == pdTRUE) {
+                if (b->op == MSC_IO_WRITE && flush == NULL) {
+                    writeback = false;
+                    continue;
+                }
+                if (b->op != MSC_IO_WRITE) {
+                    xQueueReceive(s_io_queue, &b, 0);
+                    if (b->op == MSC_IO_FLUSH) {
+                        flush = b;
+                    } else {
+                        msc_io_handle(b);
+                    }
+                }
+            }
+            esp_err_t err = msc_writeback_step();
+            if (err != ESP_OK || !flash_cache_dirty(&s_cache)) {
+                writeback = false;
+                if (flush) {
+                    // The application may write flash behind the cache next
+                    flash_cache_invalidate(&s_cache);
+                    msc_engine_done(&s_engine, flush, err);
+                    flush = NULL;
+                } else if (err != ESP_OK) {
+                    atomic_store(&s_engine.write_failed, true);
+                }
+            }
+        } else {
+            TickType_t wait = flash_cache_dirty(&s_cache) ? pdMS_TO_TICKS(MSC_CACHE_IDLE_MS) : portMAX_DELAY;
+            if (xQueueReceive(s_io_queue, &b, wait) != pdTRUE) {
+                // Idle: nothing is coming to merge with the cached units any more
+                writeback = true;
+            } else if (b->op == MSC_IO_FLUSH) {
+                flush = b;
+                writeback = true;
+            } else {
+                msc_io_handle(b);
+            }
+        }
+
+        taskENTER_CRITICAL(&s_stats_lock);
+        s_stats.flash_bytes_written = s_cache.flash_bytes;
+        s_stats.cache_flushes = s_cache.unit_flushes;
+        s_stats.write_amplification_pct = flash_cache_write_amplification_pct(&s_cache);
+        s_stats.view_sectors = s_snapshot.count;
+        taskEXIT_CRITICAL(&s_stats_lock);
+    }
+}
+
+static void msc_io_submit(void *ctx, msc_io_buf_t *b)
+{
+    // The queue holds every request, so this never blocks
+    xQueueSend(s_io_queue, &b, portMAX_DELAY);
+}
+
+//--------------------------------------------------------------------+
+// Read and write path, see msc_engine.h
+//--------------------------------------------------------------------+
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void *buffer, uint32_t bufsize)
+{
+    if (!msc_host_access()) {
+        return -1;
+    }
+    int32_t n = msc_engine_read(&s_engine, (size_t)lba * s_sector_size + offset, buffer, bufsize);
+    if (n < 0) {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x11, 0x00); // Unrecovered read error
+    } else if (n > 0) {
+        telemetry_count(TELEM_MSC_READ_BYTES, n);
+    }
+    return n;
+}
+
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *buffer, uint32_t bufsize)
+{
+    if (!msc_host_access()) {
+        return -1;
+    }
+    int32_t n = msc_engine_write(&s_engine, (size_t)lba * s_sector_size + offset, buffer, bufsize);
+    if (n < 0) {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00); // Write error
+    } else if (n > 0) {
+        atomic_store(&s_host_synced, false);
+        telemetry_count(TELEM_MSC_WRITE_BYTES, n);
+    }
+    return n;
+}
+
+void tud_msc_write10_complete_cb(uint8_t lun)
+{
+    if (msc_host_access()) {
+        msc_engine_write_complete(&s_engine);
+    }
+}
+
+// SYNCHRONIZE CACHE and eject. The write-back can take several erase cycles, far too
+// long to hold up tud_task() and with it the audio and CDC endpoints, so the first call
+// only starts it and the command fails with NOT READY, "operation in progress". Hosts
+// retry that after a short delay, and the retry that finds everything on flash succeeds.
+static bool msc_host_sync(uint8_t lun)
+{
+    if (!msc_engine_sync(&s_engine)) {
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x07);
+        return false;
+    }
+    if (msc_engine_take_write_error(&s_engine)) {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+        return false;
+    }
+    atomic_store(&s_host_synced, true);
+    return true;
+}
+
+//--------------------------------------------------------------------+
+// SCSI housekeeping
+//--------------------------------------------------------------------+
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16], uint8_t product_rev[4])
+{
+    const char vid[] = "TinyUSB";
+    const char pid[] = "Flash Storage";
+    const char rev[] = "0.1";
+
+    memcpy(vendor_id, vid, strlen(vid));
+    memcpy(product_id, pid, strlen(pid));
+    memcpy(product_rev, rev, strlen(rev));
+}
+
+bool tud_msc_test_unit_ready_cb(uint8_t lun)
+{
+    if (!atomic_load(&s_ready)) {
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x04, 0x01); // Becoming ready
+        return false;
+    }
+    if (atomic_load(&s_mounted_to_app)) {
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00); // Medium not present
+        return false;
+    }
+    return true;
+}
+
+void tud_msc_capacity_cb(uint8_t lun, uint32_t *block_count, uint16_t *block_size)
+{
+    if (!atomic_load(&s_ready)) {
+        *block_count = 0;
+        *block_size = 512;
+        return;
+    }
+    *block_count = s_disk_bytes / s_sector_size;
+    *block_size = s_sector_size;
+}
+
+bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, bool load_eject)
+{
+    if (load_eject && !start && msc_host_access()) {
+        return msc_host_sync(lun);
+    }
+    return true;
+}
+
+int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void *buffer, uint16_t bufsize)
+{
+    switch (scsi_cmd[0]) {
+    case MSC_SCSI_CMD_SYNCHRONIZE_CACHE_10:
+        if (!msc_host_access()) {
+            return 0;
+        }
+        return msc_host_sync(lun) ? 0 : -1;
+    default:
+        tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00); // Invalid command
+        return -1;
+    }
+}
+
+//--------------------------------------------------------------------+
+// FAT disk: flash while the application owns the volume, the snapshot after
+//--------------------------------------------------------------------+
+// Caller holds s_disk_lock, so there is one view request at a time
+static esp_err_t msc_view_request(msc_io_op_t op, size_t addr, void *dst, size_t bytes)
+{
+    s_view_req.op = op;
+    s_view_req.addr = addr;
+    s_view_req.data = dst;
+    s_view_req.bytes = bytes;
+    msc_io_submit(NULL, &s_view_req);
+    xSemaphoreTake(s_view_done, portMAX_DELAY);
+    return s_view_req.err;
+}
+
+static DSTATUS msc_disk_status(unsigned char pdrv)
+{
+    return atomic_load(&s_view_active) ? STA_PROTECT : 0;
+}
+
+static DRESULT msc_disk_read(unsigned char pdrv, unsigned char *buff, uint32_t sector, unsigned count)
+{
+    size_t addr = (size_t)sector * s_sector_size;
+    size_t bytes = (size_t)count * s_sector_size;
+    xSemaphoreTake(s_disk_lock, portMAX_DELAY);
+    esp_err_t err = atomic_load(&s_view_active) ? msc_view_request(MSC_IO_VIEW_READ, addr, buff, bytes)
+                                                : wl_read(s_config.wl_handle, addr, buff, bytes);
+    xSemaphoreGive(s_disk_lock);
+    return err == ESP_OK ? RES_OK : RES_ERROR;
+}
+
+static DRESULT msc_disk_write(unsigned char pdrv, const unsigned char *buff, uint32_t sector, unsigned count)
+{
+    size_t addr = (size_t)sector * s_sector_size;
+    size_t bytes = (size_t)count * s_sector_size;
+    xSemaphoreTake(s_disk_lock, portMAX_DELAY);
+    if (atomic_load(&s_view_active)) {
+        xSemaphoreGive(s_disk_lock);
+        return RES_WRPRT;
+    }
+    esp_err_t err = wl_erase_range(s_config.wl_handle, addr, bytes);
+    if (err == ESP_OK) {
+        err = wl_write(s_config.wl_handle, addr, buff, bytes);
+    }
+    xSemaphoreGive(s_disk_lock);
+    return err == ESP_OK ? RES_OK : RES_ERROR;
+}
+
+static DRESULT msc_disk_ioctl(unsigned char pdrv, unsigned char cmd, void *buff)
+{
+    switch (cmd) {
+    case CTRL_SYNC:
+        return RES_OK;          // Writes are done by the time they return
+    case GET_SECTOR_COUNT:
+        *(LBA_t *)buff = s_disk_bytes / s_sector_size;
+        return RES_OK;
+    case GET_SECTOR_SIZE:
+        *(WORD *)buff = s_sector_size;
+        return RES_OK;
+    default:
+        return RES_ERROR;
+    }
+}
+
+static const ff_diskio_impl_t s_disk_impl = {
+    .init = msc_disk_status,
+    .status = msc_disk_status,
+    .read = msc_disk_read,
+    .write = msc_disk_write,
+    .ioctl = msc_disk_ioctl,
+};
+
+//--------------------------------------------------------------------+
+// Ownership
+//--------------------------------------------------------------------+
+static esp_err_t msc_storage_format(const char *drv)
+{
+    void *workbuf = malloc(MSC_FORMAT_WORKBUF);
+    ESP_RETURN_ON_FALSE(workbuf, ESP_ERR_NO_MEM, TAG, "No memory for format");
+
+    size_t alloc_unit_size = esp_vfs_fat_get_allocation_unit_size(s_sector_size, s_config.mount_config.allocation_unit_size);
+    const MKFS_PARM opt = {(BYTE)FM_ANY, 0, 0, 0, alloc_unit_size};
+    FRESULT res = f_mkfs(drv, &opt, workbuf, MSC_FORMAT_WORKBUF);
+    free(workbuf);
+    ESP_RETURN_ON_FALSE(res == FR_OK, ESP_FAIL, TAG, "f_mkfs failed (%d)", res);
+    return ESP_OK;
+}
+
+// Puts FAT on the drive, formatting it if there is none and the configuration allows
+static esp_err_t msc_fat_mount(const char *drv, FATFS *fs)
+{
+    FRESULT res = f_mount(fs, drv, 1);
+    if (res == FR_OK) {
+        return ESP_OK;
+    }
+    ESP_RETURN_ON_FALSE(s_config.mount_config.format_if_mount_failed && (res == FR_NO_FILESYSTEM || res == FR_INT_ERR),
+                        ESP_FAIL, TAG, "f_mount failed (%d)", res);
+    ESP_LOGW(TAG, "No filesystem, formatting");
+    ESP_RETURN_ON_ERROR(msc_storage_format(drv), TAG, "Format failed");
+    ESP_RETURN_ON_FALSE(f_mount(fs, drv, 0) == FR_OK, ESP_FAIL, TAG, "f_mount after format failed");
+    return ESP_OK;
+}
+
+// Unmounts FAT and takes it off the VFS
+static esp_err_t msc_fat_release(void)
+{
+    char drv[3] = {(char)('0' + s_pdrv), ':', 0};
+    f_mount(NULL, drv, 0);
+    ff_diskio_unregister(s_pdrv);
+    s_pdrv = 0xFF;
+    s_fs = NULL;
+    ESP_RETURN_ON_ERROR(esp_vfs_fat_unregister_path(s_base_path), TAG, "Failed to unregister VFS");
+    return ESP_OK;
+}
+
+esp_err_t msc_storage_mount(const char *base_path)
+{
+    esp_err_t ret = ESP_OK;
+    BYTE pdrv = 0xFF;
+
+    ESP_RETURN_ON_FALSE(atomic_load(&s_inited), ESP_ERR_INVALID_STATE, TAG, "Not initialized");
+    if (atomic_load(&s_mounted_to_app)) {
+        return ESP_OK;
+    }
+    atomic_store(&s_mounted_to_app, true);
+    // Everything the host wrote goes to flash, and the cache is dropped even if it is
+    // clean: the application is about to write flash behind it. The host can't reach the
+    // engine any more, so this task may drive it.
+    msc_engine_invalidate(&s_engine);
+    while (!msc_engine_sync(&s_engine)) {
+        vTaskDelay(1);
+    }
+
+    if (s_fs) {
+        // Still mounted on the snapshot: back to flash, and read again what the host left
+        xSemaphoreTake(s_disk_lock, portMAX_DELAY);
+        atomic_store(&s_view_active, false);
+        xSemaphoreGive(s_disk_lock);
+        char drv[3] = {(char)('0' + s_pdrv), ':', 0};
+        f_mount(NULL, drv, 0);
+        ret = msc_fat_mount(drv, s_fs);
+        if (ret != ESP_OK) {
+            msc_fat_release();
+            atomic_store(&s_mounted_to_app, false);
+            return ret;
+        }
+    } else {
+        ESP_GOTO_ON_ERROR(ff_diskio_get_drive(&pdrv), fail, TAG, "No free FAT drive");
+        char drv[3] = {(char)('0' + pdrv), ':', 0};
+        ff_diskio_register(pdrv, &s_disk_impl);
+
+        FATFS *fs = NULL;
+        ret = esp_vfs_fat_register(base_path, drv, s_config.mount_config.max_files, &fs);
+        ESP_GOTO_ON_FALSE(ret == ESP_OK || ret == ESP_ERR_INVALID_STATE, ret, fail_diskio, TAG, "Failed to register VFS");
+        ESP_GOTO_ON_ERROR(msc_fat_mount(drv, fs), fail_vfs, TAG, "Mount failed");
+
+        s_pdrv = pdrv;
+        s_fs = fs;
+        strlcpy(s_base_path, base_path, sizeof(s_base_path));
+    }
+
+    atomic_store(&s_ready, true);
+    if (s_config.mount_changed_cb) {
+        s_config.mount_changed_cb(true);
+    }
+    return ESP_OK;
+
+fail_vfs:
+    esp_vfs_fat_unregister_path(base_path);
+fail_diskio:
+    ff_diskio_unregister(pdrv);
+fail:
+    atomic_store(&s_mounted_to_app, false);
+    return ret;
+}
+
+esp_err_t msc_storage_unmount(void)
+{
+    ESP_RETURN_ON_FALSE(atomic_load(&s_inited), ESP_ERR_INVALID_STATE, TAG, "Not initialized");
+    if (!atomic_load(&s_mounted_to_app)) {
+        atomic_store(&s_ready, true);
+        return ESP_OK;
+    }
+
+    if (msc_storage_view_enabled()) {
+        // FAT stays mounted, on a snapshot of the volume as the host gets it. The host
+        // has no access yet and the view is inactive, so the worker isn't using it.
+        xSemaphoreTake(s_disk_lock, portMAX_DELAY);
+        sector_snapshot_reset(&s_snapshot);
+        atomic_store(&s_host_synced, true);
+        atomic_store(&s_view_active, true);
+        xSemaphoreGive(s_disk_lock);
+    } else {
+        ESP_RETURN_ON_ERROR(msc_fat_release(), TAG, "Unmount failed");
+    }
+
+    // The application may have changed anything that is still buffered
+    msc_engine_invalidate(&s_engine);
+    atomic_store(&s_mounted_to_app, false);
+    if (s_config.mount_changed_cb) {
+        s_config.mount_changed_cb(false);
+    }
+    return ESP_OK;
+}
+
+bool msc_storage_view_enabled(void)
+{
+    return s_snapshot.capacity > 0;
+}
+
+esp_err_t msc_storage_view_refresh(void)
+{
+    ESP_RETURN_ON_FALSE(atomic_load(&s_view_active), ESP_ERR_INVALID_STATE, TAG, "No application view");
+    msc_storage_stats_t stats;
+    msc_storage_get_stats(&stats);
+    if (stats.view_sectors == 0) {
+        return ESP_OK;          // The host hasn't written since the snapshot
+    }
+
+    xSemaphoreTake(s_disk_lock, portMAX_DELAY);
+    esp_err_t err = msc_view_request(MSC_IO_VIEW_RESET, 0, NULL, 0);
+    xSemaphoreGive(s_disk_lock);
+    if (err != ESP_OK) {
+        return err;
+    }
+    char drv[3] = {(char)('0' + s_pdrv), ':', 0};
+    f_mount(NULL, drv, 0);
+    FRESULT res = f_mount(s_fs, drv, 1);
+    ESP_RETURN_ON_FALSE(res == FR_OK, ESP_FAIL, TAG, "Mounting the new view failed (%d)", res);
+    return ESP_OK;
+}
+
+bool msc_storage_in_use_by_host(void)
+{
+    return !atomic_load(&s_mounted_to_app);
+}
+
+void msc_storage_get_stats(msc_storage_stats_t *stats)
+{
+    taskENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    taskEXIT_CRITICAL(&s_stats_lock);
+    // Counted by the TinyUSB task alone
+    stats->read_ahead_hits = s_engine.read_ahead_hits;
+    stats->busy_retries = s_engine.busy_retries;
+}
+
+esp_err_t msc_storage_init(const msc_storage_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config && config->wl_handle != WL_INVALID_HANDLE, ESP_ERR_INVALID_ARG, TAG, "Invalid config");
+    s_config = *config;
+    s_sector_size = wl_sector_size(config->wl_handle);
+    s_disk_bytes = wl_size(config->wl_handle);
+
+    uint8_t *bufs[MSC_ENGINE_BUFS];
+    for (int i = 0; i < MSC_ENGINE_BUFS; i++) {
+        bufs[i] = heap_caps_malloc(MSC_ENGINE_BUF_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        ESP_RETURN_ON_FALSE(bufs[i], ESP_ERR_NO_MEM, TAG, "No memory for I/O buffers");
+    }
+    const msc_engine_ops_t engine_ops = {
+        .submit = msc_io_submit,
+    };
+    msc_engine_init(&s_engine, &engine_ops, s_disk_bytes, bufs);
+
+    uint8_t *cache_storage = heap_caps_malloc(FLASH_CACHE_UNITS * FLASH_CACHE_UNIT_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_RETURN_ON_FALSE(cache_storage, ESP_ERR_NO_MEM, TAG, "No memory for sector cache");
+    const flash_cache_ops_t cache_ops = {
+        .read = msc_wl_read,
+        .erase = msc_wl_erase,
+        .write = msc_wl_write,
+    };
+    flash_cache_init(&s_cache, &cache_ops, cache_storage);
+
+    s_disk_lock = xSemaphoreCreateMutex();
+    s_view_done = xSemaphoreCreateBinary();
+    ESP_RETURN_ON_FALSE(s_disk_lock && s_view_done, ESP_ERR_NO_MEM, TAG, "No memory for locks");
+    uint32_t view_sectors = config->view_bytes / s_sector_size;
+    if (view_sectors > 0) {
+        size_t view_bytes = sector_snapshot_mem_bytes(view_sectors, s_sector_size);
+        void *view_mem = heap_caps_malloc(view_bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (view_mem == NULL) {
+            view_mem = heap_caps_malloc(view_bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+        if (view_mem) {
+            sector_snapshot_init(&s_snapshot, view_mem, view_sectors, s_sector_size);
+        } else {
+            ESP_LOGW(TAG, "No room for a %d byte application view, the host owns the volume alone", view_bytes);
+        }
+    }
+
+    // Every buffer, the flush request and a view request can be queued at once
+    s_io_queue = xQueueCreate(6, sizeof(msc_io_buf_t *));
+    ESP_RETURN_ON_FALSE(s_io_queue, ESP_ERR_NO_MEM, TAG, "No memory for I/O queue");
+    BaseType_t task_created = xTaskCreatePinnedToCore(msc_io_worker, "msc_io", MSC_IO_WORKER_STACK, NULL,
+                                                      MSC_IO_WORKER_PRIO, NULL, MSC_IO_WORKER_CORE);
+    ESP_RETURN_ON_FALSE(task_created == pdPASS, ESP_ERR_NO_MEM, TAG, "Failed to create I/O worker");
+    atomic_store(&s_inited, true);
+
+    ESP_LOGI(TAG, "%d sectors of %d bytes, 2+2 x %d byte I/O buffers, %d x %d byte sector cache, %" PRIu32 " sector view",
+             s_disk_bytes / s_sector_size, s_sector_size, MSC_ENGINE_BUF_BYTES, FLASH_CACHE_UNITS, FLASH_CACHE_UNIT_BYTES,
+             s_snapshot.capacity);
+    return ESP_OK;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_vfs_fat.h"
+#include "wear_levelling.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// USB mass-storage backend for the wear-levelled FAT partition.
+//
+// The volume is owned either by the application (FAT mounted on the VFS, the host sees
+// "medium not present") or by the USB host. While the host owns it, SCSI READ10/WRITE10
+// are served from multi-sector buffers and the wl_read()/wl_write() calls run on a
+// worker task, so flash access overlaps USB transfers instead of stalling tud_task():
+//  - writes are staged into one of two buffers and coalesced while the LBAs stay
+//    sequential; a buffer goes to the worker when full, on a gap, or when the command ends,
+//  - reads are served from one of two buffers, and a sequential reader always has the
+//    next window being prefetched into the other.
+// Below that, partial writes are merged into a small cache of 4 KB flash erase units
+// (flash_cache.h), written back when evicted, after 200 ms idle, or on drain.
+// Reads wait for pending writes; SYNCHRONIZE CACHE, eject and mount drain them.
+// Replaces the esp_tinyusb MSC storage, whose callbacks do one blocking flash access
+// per endpoint-sized chunk.
+// TinyUSB may be started before any of this: until the first msc_storage_mount() or
+// msc_storage_unmount() picks an owner, the host is told the unit is becoming ready.
+//
+// With an application view (`view_bytes`), handing the volume to the host leaves FAT
+// mounted in the application, read-only, on a snapshot of the volume as the host got it:
+// files open for reading stay open and playback goes on. Before the host overwrites a
+// sector its old contents are copied to RAM, and the worker serves application reads
+// from those copies and from flash. If the host writes more than the view holds, the
+// view is lost and application reads fail until the volume comes back. Files open for
+// writing should be closed before the handover; writes to the view fail.
+
+// `mounted_to_app` is true when the application took the volume from the host.
+typedef void (*msc_storage_mount_changed_cb_t)(bool mounted_to_app);
+
+typedef struct {
+    wl_handle_t wl_handle;
+    msc_storage_mount_changed_cb_t mount_changed_cb;
+    esp_vfs_fat_mount_config_t mount_config;
+    size_t view_bytes;          // Sector copies for the application view; 0: none
+} msc_storage_config_t;
+
+typedef struct {
+    uint64_t bytes_read;        // Flash side, including read-ahead
+    uint64_t bytes_written;
+    uint64_t flash_bytes_written; // Erased and programmed, whole 4 KB units
+    uint32_t write_amplification_pct; // flash_bytes_written per bytes_written, 100 is ideal
+    uint32_t cache_flushes;     // Erase units written back from the sector cache
+    uint32_t read_ops;          // Requests handled by the worker
+    uint32_t write_ops;
+    uint32_t read_ahead_hits;   // Prefetched windows the host went on to read
+    uint32_t busy_retries;      // Times TinyUSB was asked to retry while flash was busy
+    uint32_t errors;
+    uint64_t io_time_us;        // Time the worker spent in wl_*
+    uint32_t view_reads;        // Application reads served while the host owned the volume
+    uint32_t view_sectors;      // Sectors the host overwrote that the current view keeps
+    uint32_t view_lost;         // Views dropped because the host wrote more than they hold
+} msc_storage_stats_t;
+
+// Starts the worker. The volume has no owner until mounted or unmounted.
+esp_err_t msc_storage_init(const msc_storage_config_t *config);
+
+// Takes the volume from the host and mounts FAT at `base_path`. Files opened on the
+// application view become invalid.
+// ESP_ERR_INVALID_STATE before msc_storage_init().
+esp_err_t msc_storage_mount(const char *base_path);
+
+// Hands the volume to the host, leaving the application its view if there is one, and
+// unmounting FAT otherwise.
+// ESP_ERR_INVALID_STATE before msc_storage_init().
+esp_err_t msc_storage_unmount(void);
+
+// The application keeps a read-only view of the volume while the host owns it.
+bool msc_storage_view_enabled(void);
+
+// Moves the application view to the volume as the host has left it, so files the host
+// added can be read. Files open on the old view become invalid. Only done right after
+// the host synced (SYNCHRONIZE CACHE or eject): ESP_ERR_NOT_FINISHED while it has writes
+// in flight, ESP_ERR_INVALID_STATE without a view.
+esp_err_t msc_storage_view_refresh(void);
+
+bool msc_storage_in_use_by_host(void);
+
+void msc_storage_get_stats(msc_storage_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,186 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "audio_convert.h"
+#include "sample_cache.h"
+#include "wav_player.h"
+
+static const char *TAG = "sample_cache";
+
+#define SAMPLE_CACHE_SLOTS      (64)    // Hash index, power of two above SAMPLE_CACHE_ENTRIES
+#define SAMPLE_CACHE_READ_BYTES (1536)  // Staging for files that need converting, whole frames of any layout
+
+_Static_assert((SAMPLE_CACHE_SLOTS & (SAMPLE_CACHE_SLOTS - 1)) == 0 && SAMPLE_CACHE_SLOTS > SAMPLE_CACHE_ENTRIES,
+               "SAMPLE_CACHE_SLOTS must be a power of two above SAMPLE_CACHE_ENTRIES");
+
+static uint8_t *s_arena;
+static size_t s_arena_bytes;
+static size_t s_used;
+static bool s_psram;
+static sample_cache_entry_t s_entries[SAMPLE_CACHE_ENTRIES];
+static int s_count;
+static int8_t s_index[SAMPLE_CACHE_SLOTS];  // Entry per slot, -1 if empty
+static uint32_t s_skipped;
+
+// FNV-1a
+static uint32_t sample_cache_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h = (h ^ (uint8_t)*name++) * 16777619u;
+    }
+    return h;
+}
+
+static void sample_cache_index(int entry)
+{
+    uint32_t slot = sample_cache_hash(s_entries[entry].name);
+    while (s_index[slot & (SAMPLE_CACHE_SLOTS - 1)] >= 0) {
+        slot++;
+    }
+    s_index[slot & (SAMPLE_CACHE_SLOTS - 1)] = (int8_t)entry;
+}
+
+const sample_cache_entry_t *sample_cache_find(const char *name)
+{
+    uint32_t slot = sample_cache_hash(name);
+    for (int i = 0; i < SAMPLE_CACHE_SLOTS; i++, slot++) {
+        int entry = s_index[slot & (SAMPLE_CACHE_SLOTS - 1)];
+        if (entry < 0) {
+            return NULL;
+        }
+        if (strcmp(s_entries[entry].name, name) == 0) {
+            return &s_entries[entry];
+        }
+    }
+    return NULL;
+}
+
+const sample_cache_entry_t *sample_cache_get(int index)
+{
+    return index >= 0 && index < s_count ? &s_entries[index] : NULL;
+}
+
+// Reads the data of `fd` into the arena as 16-bit samples. Returns the frames read.
+static uint32_t sample_cache_read(int fd, const wav_player_info_t *info, int16_t *dst, uint32_t frames)
+{
+    const size_t in_frame = info->bytes_per_sample * info->channels;
+    if (info->bytes_per_sample == 2) {
+        ssize_t n = read(fd, dst, frames * in_frame);
+        return n > 0 ? n / in_frame : 0;
+    }
+    static uint8_t staging[SAMPLE_CACHE_READ_BYTES] __attribute__((aligned(4)));
+    audio_convert_fn_t convert = audio_convert_select(info->bytes_per_sample, info->channels, 2, info->channels);
+    uint32_t done = 0;
+    while (done < frames) {
+        size_t want = MIN(frames - done, sizeof(staging) / in_frame);
+        ssize_t n = read(fd, staging, want * in_frame);
+        if (n <= 0) {
+            break;
+        }
+        convert(dst + done * info->channels, staging, n / in_frame);
+        done += n / in_frame;
+    }
+    return done;
+}
+
+static esp_err_t sample_cache_add(const char *dir, const char *name, size_t file_max_bytes)
+{
+    char path[WAV_PLAYER_PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    int fd = open(path, O_RDONLY);
+    ESP_RETURN_ON_FALSE(fd >= 0, ESP_FAIL, TAG, "Cannot open %s", path);
+
+    esp_err_t ret = ESP_OK;
+    struct stat st;
+    wav_player_info_t info;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size > file_max_bytes) {
+        ESP_LOGW(TAG, "Skipping %s: larger than %d bytes", name, file_max_bytes);
+        ret = ESP_ERR_INVALID_SIZE;
+    } else if (wav_player_probe(fd, &info) != ESP_OK || info.adpcm) {
+        ESP_LOGW(TAG, "Skipping %s: not a PCM WAV file", name);
+        ret = ESP_ERR_NOT_SUPPORTED;
+    }
+    if (ret == ESP_OK) {
+        const uint32_t frames = (info.data_end - info.data_pos) / (info.bytes_per_sample * info.channels);
+        const size_t bytes = ((size_t)frames * info.channels * sizeof(int16_t) + 3) & ~(size_t)3;
+        if (s_used + bytes > s_arena_bytes) {
+            ESP_LOGW(TAG, "Skipping %s: %d bytes, %d left", name, bytes, s_arena_bytes - s_used);
+            ret = ESP_ERR_NO_MEM;
+        } else {
+            sample_cache_entry_t *e = &s_entries[s_count];
+            int16_t *pcm = (int16_t *)(s_arena + s_used);
+            strlcpy(e->name, name, sizeof(e->name));
+            e->pcm = pcm;
+            e->frames = sample_cache_read(fd, &info, pcm, frames);
+            e->sample_rate = info.sample_rate;
+            e->channels = info.channels;
+            s_used += bytes;
+            sample_cache_index(s_count++);
+        }
+    }
+    close(fd);
+    return ret;
+}
+
+esp_err_t sample_cache_load(const char *dir, size_t file_max_bytes)
+{
+    ESP_RETURN_ON_FALSE(s_arena, ESP_ERR_INVALID_STATE, TAG, "Not initialized");
+    s_used = 0;
+    s_count = 0;
+    s_skipped = 0;
+    memset(s_index, -1, sizeof(s_index));
+
+    DIR *dh = opendir(dir);
+    ESP_RETURN_ON_FALSE(dh, ESP_ERR_NOT_FOUND, TAG, "Cannot open %s", dir);
+    struct dirent *d;
+    while ((d = readdir(dh)) != NULL) {
+        size_t len = strlen(d->d_name);
+        if (d->d_type == DT_DIR || len < 5 || strcasecmp(d->d_name + len - 4, ".wav") != 0) {
+            continue;
+        }
+        if (len >= SAMPLE_CACHE_NAME_MAX || s_count == SAMPLE_CACHE_ENTRIES) {
+            ESP_LOGW(TAG, "Skipping %s: %s", d->d_name, s_count == SAMPLE_CACHE_ENTRIES ? "cache full" : "name too long");
+            s_skipped++;
+            continue;
+        }
+        if (sample_cache_add(dir, d->d_name, file_max_bytes) != ESP_OK) {
+            s_skipped++;
+        }
+    }
+    closedir(dh);
+    ESP_LOGI(TAG, "%d samples, %d of %d bytes, %" PRIu32 " skipped", s_count, s_used, s_arena_bytes, s_skipped);
+    return ESP_OK;
+}
+
+void sample_cache_get_stats(sample_cache_stats_t *stats)
+{
+    stats->arena_bytes = s_arena_bytes;
+    stats->used_bytes = s_used;
+    stats->entries = s_count;
+    stats->skipped = s_skipped;
+    stats->psram = s_psram;
+}
+
+esp_err_t sample_cache_init(size_t arena_bytes)
+{
+    memset(s_index, -1, sizeof(s_index));
+    s_arena = heap_caps_malloc(arena_bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    s_psram = s_arena != NULL;
+    if (s_arena == NULL) {
+        s_arena = heap_caps_malloc(arena_bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    ESP_RETURN_ON_FALSE(s_arena, ESP_ERR_NO_MEM, TAG, "No room for a %d byte arena", arena_bytes);
+    s_arena_bytes = arena_bytes;
+    ESP_LOGI(TAG, "%d byte arena in %s", arena_bytes, s_psram ? "PSRAM" : "internal RAM");
+    return ESP_OK;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// RAM copies of short effect samples from the storage volume.
+//
+// sample_cache_load() reads every PCM WAV file in a directory up to a size limit into one
+// arena allocated at init, in PSRAM when there is some and internal RAM otherwise.
+// Samples are converted to 16 bits and keep their channel count and rate. Entries are
+// found by file name through a hash index, and stay valid until the next load: stop
+// anything playing them first.
+// Loading belongs to one task; lookups may come from any task once it has returned.
+
+#define SAMPLE_CACHE_ENTRIES  (32)
+#define SAMPLE_CACHE_NAME_MAX (32)
+
+typedef struct {
+    char name[SAMPLE_CACHE_NAME_MAX]; // File name without the directory
+    const int16_t *pcm;
+    uint32_t frames;
+    uint32_t sample_rate;
+    uint8_t channels;
+} sample_cache_entry_t;
+
+typedef struct {
+    size_t arena_bytes;
+    size_t used_bytes;
+    uint32_t entries;
+    uint32_t skipped;           // Too large, not PCM, or no room left
+    bool psram;
+} sample_cache_stats_t;
+
+esp_err_t sample_cache_init(size_t arena_bytes);
+
+// Replaces the cache with the WAV files in `dir` of at most `file_max_bytes` each.
+esp_err_t sample_cache_load(const char *dir, size_t file_max_bytes);
+
+// NULL if `name` isn't cached.
+const sample_cache_entry_t *sample_cache_find(const char *name);
+
+// Entry `index` in load order, NULL past the last one.
+const sample_cache_entry_t *sample_cache_get(int index);
+
+void sample_cache_get_stats(sample_cache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
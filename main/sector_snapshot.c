@@ -0,0 +1,68 @@
+#include <string.h>
+#include "sector_snapshot.h"
+
+static uint32_t table_size(uint32_t capacity)
+{
+    uint32_t size = 4;
+    while (size < 2 * capacity) {
+        size <<= 1;
+    }
+    return size;
+}
+
+static inline uint32_t sector_hash(uint32_t sector)
+{
+    return sector * 2654435761u;    // Knuth's multiplicative hash; FAT writes are clustered
+}
+
+size_t sector_snapshot_mem_bytes(uint32_t capacity, size_t sector_size)
+{
+    return table_size(capacity) * 2 * sizeof(uint32_t) + (size_t)capacity * sector_size;
+}
+
+void sector_snapshot_init(sector_snapshot_t *snap, void *mem, uint32_t capacity, size_t sector_size)
+{
+    uint32_t size = table_size(capacity);
+    snap->sector_size = sector_size;
+    snap->capacity = capacity;
+    snap->table_mask = size - 1;
+    snap->keys = mem;
+    snap->slots = snap->keys + size;
+    snap->data = (uint8_t *)(snap->slots + size);
+    sector_snapshot_reset(snap);
+}
+
+void sector_snapshot_reset(sector_snapshot_t *snap)
+{
+    memset(snap->keys, 0, (snap->table_mask + 1) * sizeof(uint32_t));
+    snap->count = 0;
+    snap->lost = false;
+}
+
+const uint8_t *sector_snapshot_find(const sector_snapshot_t *snap, uint32_t sector)
+{
+    for (uint32_t i = sector_hash(sector) & snap->table_mask;; i = (i + 1) & snap->table_mask) {
+        if (snap->keys[i] == 0) {
+            return NULL;
+        }
+        if (snap->keys[i] == sector + 1) {
+            return snap->data + (size_t)snap->slots[i] * snap->sector_size;
+        }
+    }
+}
+
+uint8_t *sector_snapshot_add(sector_snapshot_t *snap, uint32_t sector)
+{
+    if (snap->count == snap->capacity) {
+        snap->lost = true;
+        return NULL;
+    }
+    // The table is never more than half full, so this ends
+    uint32_t i = sector_hash(sector) & snap->table_mask;
+    while (snap->keys[i] != 0) {
+        i = (i + 1) & snap->table_mask;
+    }
+    snap->keys[i] = sector + 1;
+    snap->slots[i] = snap->count;
+    return snap->data + (size_t)snap->count++ * snap->sector_size;
+}
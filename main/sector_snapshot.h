@@ -0,0 +1,46 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Copy-on-write snapshot of a block device, kept as RAM copies of the sectors written
+// since it was taken. Before a sector is overwritten for the first time, its old
+// contents are copied in with sector_snapshot_add(); a reader of the snapshot takes a
+// sector from here when sector_snapshot_find() has it and from the device otherwise.
+// Once more sectors are written than the store holds the snapshot is lost: `lost` is
+// set, and stays set until sector_snapshot_reset() starts a new one.
+// Not thread-safe: one task writes and reads through it.
+
+typedef struct {
+    size_t sector_size;
+    uint32_t capacity;          // Sectors the store holds
+    uint32_t count;             // Sectors held
+    uint32_t table_mask;        // Hash table size - 1, a power of two above twice the capacity
+    uint32_t *keys;             // Sector number + 1, 0 for a free entry
+    uint32_t *slots;            // Store slot of each key
+    uint8_t *data;
+    bool lost;
+} sector_snapshot_t;
+
+// Bytes of `mem` that sector_snapshot_init() needs for `capacity` sectors.
+size_t sector_snapshot_mem_bytes(uint32_t capacity, size_t sector_size);
+
+void sector_snapshot_init(sector_snapshot_t *snap, void *mem, uint32_t capacity, size_t sector_size);
+
+// Drops every copy and starts a new snapshot of the device as it is now.
+void sector_snapshot_reset(sector_snapshot_t *snap);
+
+// The snapshot's copy of `sector`, or NULL when the device still holds it.
+const uint8_t *sector_snapshot_find(const sector_snapshot_t *snap, uint32_t sector);
+
+// Room for the old contents of `sector`, which must not be held yet. NULL, and the
+// snapshot lost, when the store is full.
+uint8_t *sector_snapshot_add(sector_snapshot_t *snap, uint32_t sector);
+
+#ifdef __cplusplus
+}
+#endif
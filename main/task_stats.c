@@ -0,0 +1,82 @@
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_check.h"
+#include "task_stats.h"
+
+static const char *TAG = "task_stats";
+
+// Run-time counters as of the previous sample
+typedef struct {
+    TaskHandle_t handle;
+    uint32_t runtime;
+} task_stats_prev_t;
+
+static task_stats_prev_t s_prev[TASK_STATS_MAX];
+static int s_prev_count;
+static uint32_t s_prev_total;
+
+static uint32_t task_stats_prev_runtime(TaskHandle_t handle)
+{
+    for (int i = 0; i < s_prev_count; i++) {
+        if (s_prev[i].handle == handle) {
+            return s_prev[i].runtime;
+        }
+    }
+    return 0;                   // Created since the last sample
+}
+
+static uint32_t task_stats_permille(uint32_t part, uint32_t total)
+{
+    uint32_t p = total ? (uint32_t)((uint64_t)part * 1000 / total) : 0;
+    return p > 1000 ? 1000 : p;
+}
+
+esp_err_t task_stats_sample(task_stats_t *stats)
+{
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && CONFIG_FREERTOS_USE_TRACE_FACILITY
+    static TaskStatus_t status[TASK_STATS_MAX];
+    static task_stats_prev_t now[TASK_STATS_MAX];
+    configRUN_TIME_COUNTER_TYPE total;
+    UBaseType_t n = uxTaskGetSystemState(status, TASK_STATS_MAX, &total);
+    ESP_RETURN_ON_FALSE(n > 0, ESP_ERR_NO_MEM, TAG, "More than %d tasks", TASK_STATS_MAX);
+
+    uint32_t window = (uint32_t)total - s_prev_total;
+    memset(stats, 0, sizeof(*stats));
+    stats->window_us = window;
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        stats->core_load_permille[c] = 1000;
+    }
+
+    for (UBaseType_t i = 0; i < n; i++) {
+        TaskStatus_t *t = &status[i];
+        uint32_t busy = (uint32_t)t->ulRunTimeCounter - task_stats_prev_runtime(t->xHandle);
+        task_stats_entry_t *e = &stats->tasks[i];
+        strlcpy(e->name, t->pcTaskName, sizeof(e->name));
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        e->core = t->xCoreID < portNUM_PROCESSORS ? (int)t->xCoreID : -1;
+#else
+        e->core = -1;
+#endif
+        e->prio = t->uxCurrentPriority;
+        e->stack_free = t->usStackHighWaterMark;
+        e->load_permille = task_stats_permille(busy, window);
+        for (int c = 0; c < portNUM_PROCESSORS; c++) {
+            if (t->xHandle == xTaskGetIdleTaskHandleForCPU(c)) {
+                stats->core_load_permille[c] = 1000 - e->load_permille;
+            }
+        }
+        now[i] = (task_stats_prev_t) { t->xHandle, (uint32_t)t->ulRunTimeCounter };
+    }
+    stats->count = n;
+
+    memcpy(s_prev, now, n * sizeof(now[0]));
+    s_prev_count = n;
+    s_prev_total = (uint32_t)total;
+    return ESP_OK;
+#else
+    ESP_LOGE(TAG, "Needs CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS and CONFIG_FREERTOS_USE_TRACE_FACILITY");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
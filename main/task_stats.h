@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Per-task CPU load from the FreeRTOS run-time counters
+// (CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS).
+//
+// Each sample covers the time since the previous one, so the first call after boot
+// reports the load since boot. Loads are in permille of one core: a task that kept a
+// core busy for the whole window reports 1000.
+
+#define TASK_STATS_MAX (24)     // Tasks beyond this are left out of the sample
+
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    int core;                   // -1: not pinned or unknown
+    uint32_t prio;
+    uint32_t stack_free;        // Lowest free stack so far, bytes
+    uint32_t load_permille;
+} task_stats_entry_t;
+
+typedef struct {
+    task_stats_entry_t tasks[TASK_STATS_MAX];
+    int count;
+    uint32_t core_load_permille[portNUM_PROCESSORS];    // 1000 minus the idle task's share
+    uint32_t window_us;
+} task_stats_t;
+
+// Not thread-safe: one caller (the console) at a time.
+esp_err_t task_stats_sample(task_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
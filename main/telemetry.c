@@ -0,0 +1,144 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "telemetry.h"
+
+typedef struct {
+    _Atomic uint32_t buckets[TELEMETRY_BUCKETS];
+    _Atomic uint32_t count;
+    _Atomic uint32_t max;
+} telemetry_bins_t;
+
+typedef struct {
+    _Atomic uint32_t counters[TELEM_COUNTER_COUNT];
+    telemetry_bins_t hist[TELEM_HIST_COUNT];
+} telemetry_core_t;
+
+typedef struct {
+    const char *name;
+    uint32_t step;              // Linear bucket width, 0 for log2 buckets
+} telemetry_hist_desc_t;
+
+static const char *const s_counter_names[TELEM_COUNTER_COUNT] = {
+    [TELEM_USB_PACKETS] = "usb_packets",
+    [TELEM_USB_BYTES] = "usb_bytes",
+    [TELEM_USB_OVERRUNS] = "usb_overruns",
+    [TELEM_AUDIO_UNDERRUNS] = "audio_underruns",
+    [TELEM_I2S_SHORT_WRITES] = "i2s_short_writes",
+    [TELEM_MSC_READ_BYTES] = "msc_read_bytes",
+    [TELEM_MSC_WRITE_BYTES] = "msc_write_bytes",
+};
+
+static const telemetry_hist_desc_t s_hist_desc[TELEM_HIST_COUNT] = {
+    [TELEM_USB_RX_INTERVAL_US] = { "usb_rx_interval_us", 0 },
+    [TELEM_I2S_WRITE_US] = { "i2s_write_us", 0 },
+    [TELEM_RING_FILL_PCT] = { "ring_fill_pct", 25 },
+    [TELEM_TUD_PERIOD_US] = { "tud_period_us", 0 },
+    [TELEM_MSC_IO_US] = { "msc_io_us", 0 },
+};
+
+static telemetry_core_t s_core[portNUM_PROCESSORS];
+static int64_t s_reset_us;
+
+static inline int telemetry_bucket(telemetry_hist_t hist, uint32_t value)
+{
+    uint32_t step = s_hist_desc[hist].step;
+    uint32_t b = step ? value / step : (value ? 32u - __builtin_clz(value) : 0u);
+    return b < TELEMETRY_BUCKETS ? b : TELEMETRY_BUCKETS - 1;
+}
+
+void telemetry_count(telemetry_counter_t counter, uint32_t n)
+{
+    atomic_fetch_add_explicit(&s_core[esp_cpu_get_core_id()].counters[counter], n, memory_order_relaxed);
+}
+
+void telemetry_record(telemetry_hist_t hist, uint32_t value)
+{
+    telemetry_bins_t *h = &s_core[esp_cpu_get_core_id()].hist[hist];
+    atomic_fetch_add_explicit(&h->buckets[telemetry_bucket(hist, value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    // Only tasks preempting each other on this core compete here, so this rarely loops
+    uint32_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak_explicit(&h->max, &max, value,
+                                                                 memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void telemetry_snapshot(telemetry_snapshot_t *snap)
+{
+    memset(snap, 0, sizeof(*snap));
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        telemetry_core_t *core = &s_core[c];
+        for (int i = 0; i < TELEM_COUNTER_COUNT; i++) {
+            snap->counters[i] += atomic_load_explicit(&core->counters[i], memory_order_relaxed);
+        }
+        for (int i = 0; i < TELEM_HIST_COUNT; i++) {
+            telemetry_bins_t *h = &core->hist[i];
+            telemetry_hist_snapshot_t *out = &snap->hist[i];
+            for (int b = 0; b < TELEMETRY_BUCKETS; b++) {
+                out->buckets[b] += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+            }
+            out->count += atomic_load_explicit(&h->count, memory_order_relaxed);
+            uint32_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+            out->max = max > out->max ? max : out->max;
+        }
+    }
+    snap->elapsed_us = esp_timer_get_time() - s_reset_us;
+}
+
+void telemetry_reset(void)
+{
+    for (int c = 0; c < portNUM_PROCESSORS; c++) {
+        telemetry_core_t *core = &s_core[c];
+        for (int i = 0; i < TELEM_COUNTER_COUNT; i++) {
+            atomic_store_explicit(&core->counters[i], 0, memory_order_relaxed);
+        }
+        for (int i = 0; i < TELEM_HIST_COUNT; i++) {
+            telemetry_bins_t *h = &core->hist[i];
+            for (int b = 0; b < TELEMETRY_BUCKETS; b++) {
+                atomic_store_explicit(&h->buckets[b], 0, memory_order_relaxed);
+            }
+            atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+            atomic_store_explicit(&h->max, 0, memory_order_relaxed);
+        }
+    }
+    s_reset_us = esp_timer_get_time();
+}
+
+const char *telemetry_counter_name(telemetry_counter_t counter)
+{
+    return s_counter_names[counter];
+}
+
+const char *telemetry_hist_name(telemetry_hist_t hist)
+{
+    return s_hist_desc[hist].name;
+}
+
+uint32_t telemetry_bucket_floor(telemetry_hist_t hist, int bucket)
+{
+    uint32_t step = s_hist_desc[hist].step;
+    if (step) {
+        return bucket * step;
+    }
+    return bucket ? 1u << (bucket - 1) : 0;
+}
+
+uint32_t telemetry_hist_percentile(telemetry_hist_t hist, const telemetry_hist_snapshot_t *h, uint32_t permille)
+{
+    if (h->count == 0) {
+        return 0;
+    }
+    uint64_t want = ((uint64_t)h->count * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (int b = 0; b < TELEMETRY_BUCKETS - 1; b++) {
+        seen += h->buckets[b];
+        if (seen >= want) {
+            uint32_t upper = telemetry_bucket_floor(hist, b + 1) - 1;
+            return upper < h->max ? upper : h->max;
+        }
+    }
+    return h->max;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Always-on counters and fixed-bucket histograms for the audio and USB paths.
+//
+// Every core updates its own copy with relaxed 32-bit atomic adds, so updates never take
+// a lock, never bounce between cores and are safe from any task or ISR. Readers sum the
+// per-core copies; each value is read whole, but a snapshot is not one instant in time.
+// A record costs a core-id read, a clz and two or three atomic adds.
+//
+// Histograms bucket either log2 (bucket 0 is the value 0, bucket k holds
+// [2^(k-1), 2^k)) or linearly in steps of the histogram's `step`. The last bucket
+// collects everything above.
+
+#define TELEMETRY_BUCKETS (20)
+
+typedef enum {
+    TELEM_USB_PACKETS,          // Audio OUT packets taken into the jitter ring
+    TELEM_USB_BYTES,
+    TELEM_USB_OVERRUNS,         // Packets dropped, ring full
+    TELEM_AUDIO_UNDERRUNS,      // Writer found the ring empty after priming
+    TELEM_I2S_SHORT_WRITES,     // i2s_channel_write returned before taking everything
+    TELEM_MSC_READ_BYTES,       // Handed to the host
+    TELEM_MSC_WRITE_BYTES,      // Taken from the host
+    TELEM_COUNTER_COUNT,
+} telemetry_counter_t;
+
+typedef enum {
+    TELEM_USB_RX_INTERVAL_US,   // Between audio OUT packets
+    TELEM_I2S_WRITE_US,         // Blocked in i2s_channel_write
+    TELEM_RING_FILL_PCT,        // Jitter ring fill after each packet, percent of target
+    TELEM_TUD_PERIOD_US,        // One tud_task() loop
+    TELEM_MSC_IO_US,            // One flash request on the MSC worker
+    TELEM_HIST_COUNT,
+} telemetry_hist_t;
+
+typedef struct {
+    uint32_t buckets[TELEMETRY_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+} telemetry_hist_snapshot_t;
+
+typedef struct {
+    uint32_t counters[TELEM_COUNTER_COUNT];
+    telemetry_hist_snapshot_t hist[TELEM_HIST_COUNT];
+    uint64_t elapsed_us;        // Since boot or the last telemetry_reset()
+} telemetry_snapshot_t;
+
+void telemetry_count(telemetry_counter_t counter, uint32_t n);
+void telemetry_record(telemetry_hist_t hist, uint32_t value);
+
+// Sums the per-core copies.
+void telemetry_snapshot(telemetry_snapshot_t *snap);
+
+// Zeroes everything. Updates racing with the reset may survive it.
+void telemetry_reset(void);
+
+const char *telemetry_counter_name(telemetry_counter_t counter);
+const char *telemetry_hist_name(telemetry_hist_t hist);
+
+// Smallest value that lands in `bucket`.
+uint32_t telemetry_bucket_floor(telemetry_hist_t hist, int bucket);
+
+// Upper bound of the bucket holding the `permille`th value, or the maximum for the top
+// bucket. 0 when the histogram is empty.
+uint32_t telemetry_hist_percentile(telemetry_hist_t hist, const telemetry_hist_snapshot_t *h, uint32_t permille);
+
+#ifdef __cplusplus
+}
+#endif
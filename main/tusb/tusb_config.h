@@ -32,7 +32,6 @@
  
  #include "sdkconfig.h"
  #include "uac_descriptors.h"
- #include "tusb_config_uac.h"
  
  //--------------------------------------------------------------------+
  // Board Specific Configuration
@@ -67,6 +66,12 @@
  #ifndef CFG_TUSB_DEBUG
  #define CFG_TUSB_DEBUG        2
  #endif
+
+ // Debug output is queued as binary records and printed later by a low-priority task
+ // (main/dlog.h), so it never blocks the USB task
+ #ifndef CFG_TUSB_DEBUG_PRINTF
+ #define CFG_TUSB_DEBUG_PRINTF dlog_printf
+ #endif
  
  #if TU_CHECK_MCU(OPT_MCU_ESP32S2, OPT_MCU_ESP32S3, OPT_MCU_ESP32P4)
  #define CFG_TUSB_OS_INC_PATH    freertos/
@@ -101,13 +106,39 @@
  //------------- CLASS -------------//
 // The number of video control interfaces
 #define CFG_TUD_MSC               1
-#define CFG_TUD_MSC_BUFSIZE         64
+// Endpoint-side transfer size per read10/write10 callback; msc_storage.c coalesces
+// these into larger flash operations.
+#define CFG_TUD_MSC_EP_BUFSIZE      4096
 
 #define CFG_TUD_CDC                 1
 #define CFG_TUD_CDC_RX_BUFSIZE    64
-#define CFG_TUD_CDC_TX_BUFSIZE    64
+// Holds a whole CDC_CONSOLE_TX_BATCH, so console output is queued in one go
+#define CFG_TUD_CDC_TX_BUFSIZE    512
 
 #define CFG_TUD_AUDIO            1
+
+//------------- AUDIO (UAC2 speaker, optionally with microphone) -------------//
+#define CFG_TUD_AUDIO_FUNC_1_DESC_LEN         TUD_AUDIO_SPEAKER_DESC_LEN
+#define CFG_TUD_AUDIO_FUNC_1_N_AS_INT         (1 + (UAC_MIC_CHANNELS > 0))
+#define CFG_TUD_AUDIO_FUNC_1_CTRL_BUF_SZ      64
+
+#define CFG_TUD_AUDIO_ENABLE_EP_OUT           1
+// The microphone's IN endpoint takes the feedback endpoint's place (uac_descriptors.h)
+#define CFG_TUD_AUDIO_ENABLE_FEEDBACK_EP      (UAC_MIC_CHANNELS == 0)
+#define CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX    UAC_SPK_EP_SIZE_MAX
+// Software FIFO between the endpoint and tud_audio_read(), a few packets deep
+#define CFG_TUD_AUDIO_FUNC_1_EP_OUT_SW_BUF_SZ (4 * UAC_SPK_EP_SIZE_MAX)
+
+#if UAC_MIC_CHANNELS > 0
+#define CFG_TUD_AUDIO_ENABLE_EP_IN            1
+#define CFG_TUD_AUDIO_FUNC_1_N_BYTES_PER_SAMPLE_TX UAC_MIC_N_BYTES
+#define CFG_TUD_AUDIO_FUNC_1_N_CHANNELS_TX    UAC_MIC_CHANNELS
+#define CFG_TUD_AUDIO_FUNC_1_EP_IN_SZ_MAX     UAC_MIC_EP_SIZE_MAX
+// Between tud_audio_write() and the endpoint; TinyUSB sizes each packet from the sample
+// rate and this FIFO's fill, so packet sizes follow the I2S clock.
+#define CFG_TUD_AUDIO_FUNC_1_EP_IN_SW_BUF_SZ  (8 * UAC_MIC_EP_SIZE_MAX)
+#define CFG_TUD_AUDIO_EP_IN_FLOW_CONTROL      1
+#endif
  
  #ifdef __cplusplus
  }
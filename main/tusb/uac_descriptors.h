@@ -0,0 +1,177 @@
+#pragma once
+
+// UAC2 speaker function: one clock source with a selectable sample rate, a feature unit
+// for mute/volume and one streaming interface with an alt setting per sample format.
+// With UAC_MIC_CHANNELS > 0 it becomes a headset: a second streaming interface carries
+// 16-bit capture, clocked by the same clock source. The ESP32-S2/S3 OTG controller has
+// only four IN endpoints besides EP0, all taken by MSC, CDC and the feedback endpoint,
+// so the microphone's IN endpoint replaces the explicit feedback endpoint. Both streams
+// run off one I2S clock, so the host uses the capture packet rate as implicit feedback.
+// Only macros live here; they are expanded where tusb.h is already included, which lets
+// tusb_config.h pull this header in without a circular include.
+
+#include "sdkconfig.h"
+
+// Sample rates advertised through the clock source RANGE request
+#define UAC_SAMPLE_RATES        { 44100, 48000, 96000 }
+#define UAC_SAMPLE_RATE_COUNT   (3)
+#define UAC_SAMPLE_RATE_MAX     (96000)
+#define UAC_SAMPLE_RATE_DEFAULT (48000)
+
+// Streaming interface alternate settings: 0 is zero-bandwidth, then one per format
+#define UAC_ALT_16BIT               (1)
+#define UAC_ALT_24BIT               (2)
+#define UAC_ALT_COUNT               (3)
+#define UAC_FORMAT_1_N_BYTES        (2)
+#define UAC_FORMAT_1_RESOLUTION     (16)
+#define UAC_FORMAT_2_N_BYTES        (4) // 24 valid bits, MSB-justified in a 32-bit subslot
+#define UAC_FORMAT_2_RESOLUTION     (24)
+
+#define UAC_SPK_CHANNELS            CONFIG_UAC_SPEAKER_CHANNEL_NUM
+#define UAC_MIC_CHANNELS            CONFIG_UAC_MIC_CHANNEL_NUM
+
+// Microphone: one alt setting, 16-bit PCM
+#define UAC_MIC_ALT_16BIT           (1)
+#define UAC_MIC_ALT_COUNT           (2)
+#define UAC_MIC_N_BYTES             (2)
+#define UAC_MIC_RESOLUTION          (16)
+
+// Unit / terminal IDs
+#define UAC_ENTITY_SPK_INPUT_TERMINAL  0x01
+#define UAC_ENTITY_SPK_FEATURE_UNIT    0x02
+#define UAC_ENTITY_SPK_OUTPUT_TERMINAL 0x03
+#define UAC_ENTITY_CLOCK               0x04
+#define UAC_ENTITY_MIC_INPUT_TERMINAL  0x05
+#define UAC_ENTITY_MIC_OUTPUT_TERMINAL 0x06
+
+// Largest isochronous OUT packet over all alt settings and rates
+#define UAC_SPK_EP_SIZE_MAX  TUD_AUDIO_EP_SIZE(UAC_SAMPLE_RATE_MAX, UAC_FORMAT_2_N_BYTES, UAC_SPK_CHANNELS)
+#define UAC_MIC_EP_SIZE_MAX  TUD_AUDIO_EP_SIZE(UAC_SAMPLE_RATE_MAX, UAC_MIC_N_BYTES, UAC_MIC_CHANNELS)
+
+#if UAC_SPK_CHANNELS == 1
+#define UAC_DESC_FEATURE_UNIT_LEN TUD_AUDIO_DESC_FEATURE_UNIT_ONE_CHANNEL_LEN
+#define UAC_DESC_FEATURE_UNIT(_unitid, _srcid) \
+    TUD_AUDIO_DESC_FEATURE_UNIT_ONE_CHANNEL(_unitid, _srcid, \
+        AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_MUTE_POS | AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_VOLUME_POS, \
+        AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_MUTE_POS | AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_VOLUME_POS, 0x00)
+#else
+#define UAC_DESC_FEATURE_UNIT_LEN TUD_AUDIO_DESC_FEATURE_UNIT_TWO_CHANNEL_LEN
+#define UAC_DESC_FEATURE_UNIT(_unitid, _srcid) \
+    TUD_AUDIO_DESC_FEATURE_UNIT_TWO_CHANNEL(_unitid, _srcid, \
+        AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_MUTE_POS | AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_VOLUME_POS, \
+        AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_MUTE_POS | AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_VOLUME_POS, \
+        AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_MUTE_POS | AUDIO_CTRL_RW << AUDIO_FEATURE_UNIT_CTRL_VOLUME_POS, 0x00)
+#endif
+
+// Explicit feedback endpoint, spelled out because the TinyUSB helper's arguments
+// changed between releases.
+#define UAC_DESC_STD_AS_ISO_FB_EP_LEN 7
+#define UAC_DESC_STD_AS_ISO_FB_EP(_ep, _interval) \
+    UAC_DESC_STD_AS_ISO_FB_EP_LEN, TUSB_DESC_ENDPOINT, _ep, \
+    (uint8_t)(TUSB_XFER_ISOCHRONOUS | TUSB_ISO_EP_ATT_EXPLICIT_FB | TUSB_ISO_EP_ATT_NO_SYNC), U16_TO_U8S_LE(4), _interval
+
+#if UAC_MIC_CHANNELS > 0
+#define UAC_SPK_FB_EP_COUNT        0
+#define UAC_SPK_FB_EP_LEN          0
+#define UAC_SPK_FB_EP(_epfb)
+#define UAC_FUNC_CATEGORY          AUDIO_FUNC_HEADSET
+// Capture path: microphone input terminal straight to the USB streaming output terminal
+#define UAC_DESC_MIC_UNITS_LEN     (TUD_AUDIO_DESC_INPUT_TERM_LEN + TUD_AUDIO_DESC_OUTPUT_TERM_LEN)
+#define UAC_DESC_MIC_UNITS \
+    TUD_AUDIO_DESC_INPUT_TERM(UAC_ENTITY_MIC_INPUT_TERMINAL, AUDIO_TERM_TYPE_IN_GENERIC_MIC, 0x00, UAC_ENTITY_CLOCK, \
+                              UAC_MIC_CHANNELS, AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, 0x00, 0x0000, 0x00), \
+    TUD_AUDIO_DESC_OUTPUT_TERM(UAC_ENTITY_MIC_OUTPUT_TERMINAL, AUDIO_TERM_TYPE_USB_STREAMING, 0x00, \
+                               UAC_ENTITY_MIC_INPUT_TERMINAL, UAC_ENTITY_CLOCK, 0x0000, 0x00),
+#define UAC_DESC_MIC_AS_LEN (TUD_AUDIO_DESC_STD_AS_INT_LEN \
+    + TUD_AUDIO_DESC_STD_AS_INT_LEN \
+    + TUD_AUDIO_DESC_CS_AS_INT_LEN \
+    + TUD_AUDIO_DESC_TYPE_I_FORMAT_LEN \
+    + TUD_AUDIO_DESC_STD_AS_ISO_EP_LEN \
+    + TUD_AUDIO_DESC_CS_AS_ISO_EP_LEN)
+// Alt 0 zero bandwidth, alt 1 16-bit PCM on an asynchronous IN endpoint that doubles as
+// the speaker's implicit feedback
+#define UAC_DESC_MIC_AS_TAIL(_itfnum, _epin) \
+    , TUD_AUDIO_DESC_STD_AS_INT(_itfnum, 0x00, 0x00, 0x00), \
+    TUD_AUDIO_DESC_STD_AS_INT(_itfnum, UAC_MIC_ALT_16BIT, 0x01, 0x00), \
+    TUD_AUDIO_DESC_CS_AS_INT(UAC_ENTITY_MIC_OUTPUT_TERMINAL, AUDIO_CTRL_NONE, AUDIO_FORMAT_TYPE_I, AUDIO_DATA_FORMAT_TYPE_I_PCM, \
+                             UAC_MIC_CHANNELS, AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, 0x00), \
+    TUD_AUDIO_DESC_TYPE_I_FORMAT(UAC_MIC_N_BYTES, UAC_MIC_RESOLUTION), \
+    TUD_AUDIO_DESC_STD_AS_ISO_EP(_epin, (uint8_t)(TUSB_XFER_ISOCHRONOUS | TUSB_ISO_EP_ATT_ASYNCHRONOUS | TUSB_ISO_EP_ATT_IMPLICIT_FB), \
+                                 UAC_MIC_EP_SIZE_MAX, 0x01), \
+    TUD_AUDIO_DESC_CS_AS_ISO_EP(AUDIO_CS_AS_ISO_DATA_EP_ATT_NON_MAX_PACKETS_OK, AUDIO_CTRL_NONE, \
+                                AUDIO_CS_AS_ISO_DATA_EP_LOCK_DELAY_UNIT_UNDEFINED, 0x0000)
+#else
+#define UAC_SPK_FB_EP_COUNT        1
+#define UAC_SPK_FB_EP_LEN          UAC_DESC_STD_AS_ISO_FB_EP_LEN
+#define UAC_SPK_FB_EP(_epfb)       , UAC_DESC_STD_AS_ISO_FB_EP(_epfb, 1)
+#define UAC_FUNC_CATEGORY          AUDIO_FUNC_DESKTOP_SPEAKER
+#define UAC_DESC_MIC_UNITS_LEN     0
+#define UAC_DESC_MIC_UNITS
+#define UAC_DESC_MIC_AS_LEN        0
+#define UAC_DESC_MIC_AS_TAIL(_itfnum, _epin)
+#endif
+
+#define UAC_DESC_SPK_ALT_LEN (TUD_AUDIO_DESC_STD_AS_INT_LEN \
+    + TUD_AUDIO_DESC_CS_AS_INT_LEN \
+    + TUD_AUDIO_DESC_TYPE_I_FORMAT_LEN \
+    + TUD_AUDIO_DESC_STD_AS_ISO_EP_LEN \
+    + TUD_AUDIO_DESC_CS_AS_ISO_EP_LEN \
+    + UAC_SPK_FB_EP_LEN)
+
+#define TUD_AUDIO_SPEAKER_DESC_LEN (TUD_AUDIO_DESC_IAD_LEN \
+    + TUD_AUDIO_DESC_STD_AC_LEN \
+    + TUD_AUDIO_DESC_CS_AC_LEN \
+    + TUD_AUDIO_DESC_CLK_SRC_LEN \
+    + TUD_AUDIO_DESC_INPUT_TERM_LEN \
+    + UAC_DESC_FEATURE_UNIT_LEN \
+    + TUD_AUDIO_DESC_OUTPUT_TERM_LEN \
+    + UAC_DESC_MIC_UNITS_LEN \
+    + TUD_AUDIO_DESC_STD_AS_INT_LEN \
+    + 2 * UAC_DESC_SPK_ALT_LEN \
+    + UAC_DESC_MIC_AS_LEN)
+
+#define UAC_DESC_SPK_ALT(_itfnum, _alt, _nbytes, _resolution, _epout, _epfb) \
+    TUD_AUDIO_DESC_STD_AS_INT(_itfnum, _alt, 1 + UAC_SPK_FB_EP_COUNT, 0x00), \
+    TUD_AUDIO_DESC_CS_AS_INT(UAC_ENTITY_SPK_INPUT_TERMINAL, AUDIO_CTRL_NONE, AUDIO_FORMAT_TYPE_I, AUDIO_DATA_FORMAT_TYPE_I_PCM, \
+                             UAC_SPK_CHANNELS, AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, 0x00), \
+    TUD_AUDIO_DESC_TYPE_I_FORMAT(_nbytes, _resolution), \
+    TUD_AUDIO_DESC_STD_AS_ISO_EP(_epout, (uint8_t)(TUSB_XFER_ISOCHRONOUS | TUSB_ISO_EP_ATT_ASYNCHRONOUS | TUSB_ISO_EP_ATT_DATA), \
+                                 TUD_AUDIO_EP_SIZE(UAC_SAMPLE_RATE_MAX, _nbytes, UAC_SPK_CHANNELS), 0x01), \
+    TUD_AUDIO_DESC_CS_AS_ISO_EP(AUDIO_CS_AS_ISO_DATA_EP_ATT_NON_MAX_PACKETS_OK, AUDIO_CTRL_NONE, \
+                                AUDIO_CS_AS_ISO_DATA_EP_LOCK_DELAY_UNIT_MILLISEC, 0x0001) \
+    UAC_SPK_FB_EP(_epfb)
+
+// `_epfb` is the feedback endpoint, or the microphone's IN endpoint on a headset, whose
+// streaming interface follows the speaker's.
+#define TUD_AUDIO_SPEAKER_DESCRIPTOR(_itfnum, _stridx, _epout, _epfb) \
+    /* Standard Interface Association Descriptor (IAD) */ \
+    TUD_AUDIO_DESC_IAD(_itfnum, (uint8_t)(2 + (UAC_MIC_CHANNELS > 0)), 0x00), \
+    /* Standard AC Interface Descriptor */ \
+    TUD_AUDIO_DESC_STD_AC(_itfnum, 0x00, _stridx), \
+    /* Class-Specific AC Interface Header Descriptor */ \
+    TUD_AUDIO_DESC_CS_AC(0x0200, UAC_FUNC_CATEGORY, \
+                         TUD_AUDIO_DESC_CLK_SRC_LEN + TUD_AUDIO_DESC_INPUT_TERM_LEN + UAC_DESC_FEATURE_UNIT_LEN + TUD_AUDIO_DESC_OUTPUT_TERM_LEN \
+                         + UAC_DESC_MIC_UNITS_LEN, \
+                         AUDIO_CS_AS_INTERFACE_CTRL_LATENCY_POS), \
+    /* Clock Source: internal programmable clock, frequency read/write, validity read-only */ \
+    TUD_AUDIO_DESC_CLK_SRC(UAC_ENTITY_CLOCK, AUDIO_CLOCK_SOURCE_ATT_INT_PRO_CLK, \
+                           (AUDIO_CTRL_RW << AUDIO_CLOCK_SOURCE_CTRL_CLK_FRQ_POS) | (AUDIO_CTRL_R << AUDIO_CLOCK_SOURCE_CTRL_CLK_VAL_POS), \
+                           UAC_ENTITY_SPK_INPUT_TERMINAL, 0x00), \
+    /* Input Terminal: USB streaming */ \
+    TUD_AUDIO_DESC_INPUT_TERM(UAC_ENTITY_SPK_INPUT_TERMINAL, AUDIO_TERM_TYPE_USB_STREAMING, 0x00, UAC_ENTITY_CLOCK, \
+                              UAC_SPK_CHANNELS, AUDIO_CHANNEL_CONFIG_NON_PREDEFINED, 0x00, 0x0000, 0x00), \
+    /* Feature Unit: mute and volume on master and every channel */ \
+    UAC_DESC_FEATURE_UNIT(UAC_ENTITY_SPK_FEATURE_UNIT, UAC_ENTITY_SPK_INPUT_TERMINAL), \
+    /* Output Terminal: speaker */ \
+    TUD_AUDIO_DESC_OUTPUT_TERM(UAC_ENTITY_SPK_OUTPUT_TERMINAL, AUDIO_TERM_TYPE_OUT_DESKTOP_SPEAKER, 0x00, \
+                               UAC_ENTITY_SPK_FEATURE_UNIT, UAC_ENTITY_CLOCK, 0x0000, 0x00), \
+    /* Microphone input to USB streaming, headset only */ \
+    UAC_DESC_MIC_UNITS \
+    /* Streaming interface, alt 0: zero bandwidth */ \
+    TUD_AUDIO_DESC_STD_AS_INT((uint8_t)((_itfnum) + 1), 0x00, 0x00, 0x00), \
+    /* Alt 1: 16-bit PCM */ \
+    UAC_DESC_SPK_ALT((uint8_t)((_itfnum) + 1), UAC_ALT_16BIT, UAC_FORMAT_1_N_BYTES, UAC_FORMAT_1_RESOLUTION, _epout, _epfb), \
+    /* Alt 2: 24-bit PCM */ \
+    UAC_DESC_SPK_ALT((uint8_t)((_itfnum) + 1), UAC_ALT_24BIT, UAC_FORMAT_2_N_BYTES, UAC_FORMAT_2_RESOLUTION, _epout, _epfb) \
+    /* Microphone streaming interface, headset only */ \
+    UAC_DESC_MIC_AS_TAIL((uint8_t)((_itfnum) + 2), _epfb)
@@ -26,26 +26,58 @@
 #include "tusb.h"
 #include "tusb_config.h"
 #include "usb_descriptors.h"
-#include "uac_config.h"
 #include "uac_descriptors.h"
 
 /* A combination of interfaces must have a unique product id, since PC will save device driver after the first plug.
 * Same VID/PID with different interface e.g MSC (first), then CDC (later) will possibly cause system error on PC.
 *
 * Auto ProductID layout's Bitmap:
-*   [MSB]  VIDEO | AUDIO | MIDI | HID | MSC | CDC          [LSB]
+*   [MSB]  AUDIO-FIRST | MIC | VENDOR | VIDEO | AUDIO | MIDI | HID | MSC | CDC          [LSB]
+*
+* Each profile sets the bits of the functions it exposes. AUDIO-FIRST marks the interface
+* order the profiles use, so hosts don't reuse a driver binding cached for the old
+* MSC-first composite.
 */
-#define _PID_MAP(itf, n)  ( (CFG_TUD_##itf) << (n) )
-#ifndef USB_PID
-#define USB_PID           (0x4008 | _PID_MAP(CDC, 0) | _PID_MAP(MSC, 1) | _PID_MAP(HID, 2) | \
-    _PID_MAP(MIDI, 3) | _PID_MAP(AUDIO, 4) | _PID_MAP(VIDEO, 5) | _PID_MAP(VENDOR, 6) )
-#endif
+#define USB_PID_BASE      (0x4008 | ((UAC_MIC_CHANNELS > 0) << 7) | (1 << 8))
 #define USB_VID   0x303a
 
+static const uint32_t s_profile_funcs[USB_PROFILE_COUNT] = {
+    [USB_PROFILE_FULL]        = USB_FUNC_AUDIO | USB_FUNC_CDC | USB_FUNC_MSC,
+    [USB_PROFILE_AUDIO]       = USB_FUNC_AUDIO,
+    [USB_PROFILE_AUDIO_CDC]   = USB_FUNC_AUDIO | USB_FUNC_CDC,
+    [USB_PROFILE_MAINTENANCE] = USB_FUNC_CDC | USB_FUNC_MSC,
+};
+
+static const char *const s_profile_names[USB_PROFILE_COUNT] = {
+    [USB_PROFILE_FULL]        = "full",
+    [USB_PROFILE_AUDIO]       = "audio",
+    [USB_PROFILE_AUDIO_CDC]   = "audio-cdc",
+    [USB_PROFILE_MAINTENANCE] = "maintenance",
+};
+
+static usb_profile_t s_profile = USB_PROFILE_FULL;
+
+uint32_t usb_descriptors_functions(usb_profile_t profile)
+{
+    return profile < USB_PROFILE_COUNT ? s_profile_funcs[profile] : 0;
+}
+
+uint16_t usb_descriptors_pid(usb_profile_t profile)
+{
+    uint32_t funcs = usb_descriptors_functions(profile);
+    return (uint16_t)(USB_PID_BASE | (((funcs & USB_FUNC_CDC) != 0) << 0) | (((funcs & USB_FUNC_MSC) != 0) << 1) |
+                      (((funcs & USB_FUNC_AUDIO) != 0) << 4));
+}
+
+const char *usb_descriptors_profile_name(usb_profile_t profile)
+{
+    return profile < USB_PROFILE_COUNT ? s_profile_names[profile] : "?";
+}
+
 //--------------------------------------------------------------------+
 // Device Descriptors
 //--------------------------------------------------------------------+
-tusb_desc_device_t const desc_device = {
+static tusb_desc_device_t desc_device = {
     .bLength            = sizeof(tusb_desc_device_t),
     .bDescriptorType    = TUSB_DESC_DEVICE,
     .bcdUSB             = 0x0200,
@@ -59,7 +91,7 @@ tusb_desc_device_t const desc_device = {
     .bMaxPacketSize0    = CFG_TUD_ENDPOINT0_SIZE,
 
     .idVendor           = USB_VID,
-    .idProduct          = USB_PID,
+    .idProduct          = USB_PID_BASE | 0x13,  // Set with the profile
     .bcdDevice          = 0x0100,
 
     .iManufacturer      = 0x01,
@@ -76,19 +108,93 @@ uint8_t const *tud_descriptor_device_cb(void)
     return (uint8_t const *) &desc_device;
 }
 
+const uint8_t *usb_descriptors_device(void)
+{
+    return (const uint8_t *) &desc_device;
+}
+
 //--------------------------------------------------------------------+
-// Configuration Descriptor
+// Configuration Descriptors
 //--------------------------------------------------------------------+
-#define CONFIG_TOTAL_LEN    (TUD_CONFIG_DESC_LEN + TUD_MSC_DESC_LEN + TUD_CDC_DESC_LEN + CFG_TUD_AUDIO * TUD_AUDIO_DEVICE_DESC_LEN)
+#define AUDIO_DESC_LEN      (CFG_TUD_AUDIO * TUD_AUDIO_SPEAKER_DESC_LEN)
+#define AUDIO_EP_FB_OR_MIC  (UAC_MIC_CHANNELS > 0 ? EPNUM_AUDIO_IN : EPNUM_AUDIO_FB)
+
+// Audio, CDC, MSC
+#define FULL_ITF_CDC        (ITF_NUM_AUDIO_TOTAL)
+#define FULL_ITF_MSC        (ITF_NUM_AUDIO_TOTAL + 2)
+#define FULL_ITF_TOTAL      (ITF_NUM_AUDIO_TOTAL + 3)
+#define FULL_TOTAL_LEN      (TUD_CONFIG_DESC_LEN + AUDIO_DESC_LEN + TUD_CDC_DESC_LEN + TUD_MSC_DESC_LEN)
 
-uint8_t const desc_fs_configuration[] = {
+static uint8_t const desc_fs_configuration_full[] = {
     // Config number, interface count, string index, total length, attribute, power in mA
-    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
-    TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, 5, EPNUM_MSC_OUT, EPNUM_MSC_IN, 64),
-    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 4, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64),
-    TUD_AUDIO_SPEAK_DESCRIPTOR(ITF_NUM_AUDIO_CONTROL, 6, EPNUM_AUDIO_OUT, EPNUM_AUDIO_FB),
+    TUD_CONFIG_DESCRIPTOR(1, FULL_ITF_TOTAL, 0, FULL_TOTAL_LEN, 0, 100),
+    TUD_AUDIO_SPEAKER_DESCRIPTOR(ITF_NUM_AUDIO_CONTROL, 6, EPNUM_AUDIO_OUT, AUDIO_EP_FB_OR_MIC),
+    TUD_CDC_DESCRIPTOR(FULL_ITF_CDC, 4, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64),
+    TUD_MSC_DESCRIPTOR(FULL_ITF_MSC, 5, EPNUM_MSC_OUT, EPNUM_MSC_IN, 64),
+};
+
+// Audio only
+#define AUDIO_TOTAL_LEN     (TUD_CONFIG_DESC_LEN + AUDIO_DESC_LEN)
+
+static uint8_t const desc_fs_configuration_audio[] = {
+    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_AUDIO_TOTAL, 0, AUDIO_TOTAL_LEN, 0, 100),
+    TUD_AUDIO_SPEAKER_DESCRIPTOR(ITF_NUM_AUDIO_CONTROL, 6, EPNUM_AUDIO_OUT, AUDIO_EP_FB_OR_MIC),
 };
 
+// Audio, CDC
+#define AUDIO_CDC_ITF_CDC   (ITF_NUM_AUDIO_TOTAL)
+#define AUDIO_CDC_ITF_TOTAL (ITF_NUM_AUDIO_TOTAL + 2)
+#define AUDIO_CDC_TOTAL_LEN (TUD_CONFIG_DESC_LEN + AUDIO_DESC_LEN + TUD_CDC_DESC_LEN)
+
+static uint8_t const desc_fs_configuration_audio_cdc[] = {
+    TUD_CONFIG_DESCRIPTOR(1, AUDIO_CDC_ITF_TOTAL, 0, AUDIO_CDC_TOTAL_LEN, 0, 100),
+    TUD_AUDIO_SPEAKER_DESCRIPTOR(ITF_NUM_AUDIO_CONTROL, 6, EPNUM_AUDIO_OUT, AUDIO_EP_FB_OR_MIC),
+    TUD_CDC_DESCRIPTOR(AUDIO_CDC_ITF_CDC, 4, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64),
+};
+
+// CDC, MSC
+#define MAINT_ITF_CDC       (0)
+#define MAINT_ITF_MSC       (2)
+#define MAINT_ITF_TOTAL     (3)
+#define MAINT_TOTAL_LEN     (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_MSC_DESC_LEN)
+
+static uint8_t const desc_fs_configuration_maintenance[] = {
+    TUD_CONFIG_DESCRIPTOR(1, MAINT_ITF_TOTAL, 0, MAINT_TOTAL_LEN, 0, 100),
+    TUD_CDC_DESCRIPTOR(MAINT_ITF_CDC, 4, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64),
+    TUD_MSC_DESCRIPTOR(MAINT_ITF_MSC, 5, EPNUM_MSC_OUT, EPNUM_MSC_IN, 64),
+};
+
+_Static_assert(sizeof(desc_fs_configuration_full) == FULL_TOTAL_LEN, "Configuration descriptor length mismatch");
+_Static_assert(sizeof(desc_fs_configuration_audio) == AUDIO_TOTAL_LEN, "Configuration descriptor length mismatch");
+_Static_assert(sizeof(desc_fs_configuration_audio_cdc) == AUDIO_CDC_TOTAL_LEN, "Configuration descriptor length mismatch");
+_Static_assert(sizeof(desc_fs_configuration_maintenance) == MAINT_TOTAL_LEN, "Configuration descriptor length mismatch");
+
+static uint8_t const *const s_profile_config[USB_PROFILE_COUNT] = {
+    [USB_PROFILE_FULL]        = desc_fs_configuration_full,
+    [USB_PROFILE_AUDIO]       = desc_fs_configuration_audio,
+    [USB_PROFILE_AUDIO_CDC]   = desc_fs_configuration_audio_cdc,
+    [USB_PROFILE_MAINTENANCE] = desc_fs_configuration_maintenance,
+};
+
+void usb_descriptors_set_profile(usb_profile_t profile)
+{
+    if (profile >= USB_PROFILE_COUNT) {
+        return;
+    }
+    s_profile = profile;
+    desc_device.idProduct = usb_descriptors_pid(profile);
+}
+
+usb_profile_t usb_descriptors_get_profile(void)
+{
+    return s_profile;
+}
+
+const uint8_t *usb_descriptors_config(usb_profile_t profile)
+{
+    return profile < USB_PROFILE_COUNT ? s_profile_config[profile] : NULL;
+}
+
 // Invoked when received GET CONFIGURATION DESCRIPTOR
 // Application return pointer to descriptor
 // Descriptor contents must exist long enough for transfer to complete
@@ -96,7 +202,7 @@ uint8_t const *tud_descriptor_configuration_cb(uint8_t index)
 {
     (void) index; // for multiple configurations
 
-    return desc_fs_configuration;
+    return s_profile_config[s_profile];
 }
 
 //--------------------------------------------------------------------+
@@ -111,13 +217,18 @@ char const *string_desc_arr [] = {
     "123456",                      // 3: Serials, should use chip ID
     "cdc",                         // 4: cdc Interface
     "msc",                         // 5: msc Interface	
-    "uac"       // 6: speaker Interface
-    "speaker",                     
-    "mic"
+    "uac",                         // 6: audio function
+    "speaker",                     // 7: speaker streaming
+    "mic",                         // 8: microphone streaming
 };
 
 static uint16_t _desc_str[32];
 
+uint8_t usb_descriptors_string_count(void)
+{
+    return (uint8_t)(sizeof(string_desc_arr) / sizeof(string_desc_arr[0]));
+}
+
 // Invoked when received GET STRING DESCRIPTOR request
 // Application return pointer to descriptor, whose contents must exist long enough for transfer to complete
 uint16_t const *tud_descriptor_string_cb(uint8_t index, uint16_t langid){
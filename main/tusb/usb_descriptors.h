@@ -1,24 +1,51 @@
 
 #pragma once
 #include "tusb.h"
-#include "tusb_config_uac.h"
 #include "class/audio/audio.h"
-#include "uac_config.h"
 #include "uac_descriptors.h"
 
 // #define ALT_COUNT 1
 
+// Composition profiles, each with its own configuration descriptor and product ID.
+// The audio function comes first in every profile that has one, so its interface
+// numbers below are the same in all of them; CDC and MSC follow it.
+typedef enum {
+  USB_PROFILE_FULL = 0,     // Audio, CDC console and mass storage
+  USB_PROFILE_AUDIO,        // Audio only, the whole bus for the isochronous endpoints
+  USB_PROFILE_AUDIO_CDC,    // Audio and the console
+  USB_PROFILE_MAINTENANCE,  // Console and mass storage, no audio
+  USB_PROFILE_COUNT,
+} usb_profile_t;
+
+#define USB_FUNC_AUDIO (1u << 0)
+#define USB_FUNC_CDC   (1u << 1)
+#define USB_FUNC_MSC   (1u << 2)
+
 enum {
- ITF_NUM_MSC = 0,
- ITF_NUM_CDC,
- ITF_NUM_CDC_DATA,
-//  ITF_NUM_DFU_MODE,
-//  ITF_NUM_HID,
-  ITF_NUM_AUDIO_CONTROL,
+  ITF_NUM_AUDIO_CONTROL = 0,
   ITF_NUM_AUDIO_STREAMING_SPK,
-  ITF_NUM_TOTAL,
+#if UAC_MIC_CHANNELS > 0
+  ITF_NUM_AUDIO_STREAMING_MIC,
+#endif
+  ITF_NUM_AUDIO_TOTAL,
 };
 
+// Selects what the descriptor callbacks return. Only while the device is detached:
+// before tusb_init(), or between tud_disconnect() and tud_connect().
+void usb_descriptors_set_profile(usb_profile_t profile);
+usb_profile_t usb_descriptors_get_profile(void);
+
+// USB_FUNC_* bits of `profile`
+uint32_t usb_descriptors_functions(usb_profile_t profile);
+uint16_t usb_descriptors_pid(usb_profile_t profile);
+const char *usb_descriptors_profile_name(usb_profile_t profile);
+
+// Descriptors for checking them (usb_desc_check.h): the device descriptor of the running
+// profile, the configuration descriptor of any profile, and how many string indices the
+// string callback serves.
+const uint8_t *usb_descriptors_device(void);
+const uint8_t *usb_descriptors_config(usb_profile_t profile);
+uint8_t usb_descriptors_string_count(void);
 
 enum {
   EPNUM_CTRL_OUT = 0x00,
@@ -30,4 +57,5 @@ enum {
   EPNUM_CDC_NOTIF = 0x83,
   EPNUM_AUDIO_OUT = 0x04,
   EPNUM_AUDIO_FB = 0x84,
+  EPNUM_AUDIO_IN = 0x84,  // Microphone, in place of the feedback endpoint
 };
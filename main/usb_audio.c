@@ -0,0 +1,317 @@
+#include <inttypes.h>
+#include <string.h>
+#include "esp_log.h"
+#include "dlog.h"
+#include "tusb.h"
+#include "usb_descriptors.h"
+#include "usb_audio.h"
+
+static const char *TAG = "usb_audio";
+
+#define USB_AUDIO_VOLUME_MIN  (-50 * 256) // 1/256 dB
+#define USB_AUDIO_VOLUME_MAX  (0)
+#define USB_AUDIO_VOLUME_RES  (256)
+
+static const uint32_t s_sample_rates[UAC_SAMPLE_RATE_COUNT] = UAC_SAMPLE_RATES;
+
+static usb_audio_config_t s_config;
+static usb_audio_format_t s_format = {
+    .sample_rate = UAC_SAMPLE_RATE_DEFAULT,
+    .bytes_per_sample = UAC_FORMAT_1_N_BYTES,
+    .bits_per_sample = UAC_FORMAT_1_RESOLUTION,
+    .channels = UAC_SPK_CHANNELS,
+};
+static uint8_t s_alt;
+#if UAC_MIC_CHANNELS > 0
+static uint8_t s_mic_alt;
+#endif
+static bool s_mute[UAC_SPK_CHANNELS + 1];       // Index 0 is the master channel
+static int16_t s_volume[UAC_SPK_CHANNELS + 1];
+
+// Packets are handed to the application straight from this buffer
+static uint8_t s_rx_buf[CFG_TUD_AUDIO_FUNC_1_EP_OUT_SZ_MAX] __attribute__((aligned(4)));
+
+esp_err_t usb_audio_init(const usb_audio_config_t *config)
+{
+    if (config == NULL || (config->output_cb == NULL && config->rx_cb == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_config = *config;
+    ESP_LOGI(TAG, "UAC2 speaker: %d ch, %" PRIu32 " Hz default", UAC_SPK_CHANNELS, s_format.sample_rate);
+#if UAC_MIC_CHANNELS > 0
+    ESP_LOGI(TAG, "UAC2 microphone: %d ch, 16-bit, implicit feedback", UAC_MIC_CHANNELS);
+#endif
+    return ESP_OK;
+}
+
+void usb_audio_get_format(usb_audio_format_t *format)
+{
+    *format = s_format;
+}
+
+size_t usb_audio_read(void *dst, size_t len)
+{
+    return tud_audio_read(dst, (uint16_t) TU_MIN(len, UINT16_MAX));
+}
+
+size_t usb_audio_write(const void *src, size_t len)
+{
+#if UAC_MIC_CHANNELS > 0
+    return tud_audio_write(src, (uint16_t) TU_MIN(len, UINT16_MAX));
+#else
+    (void) src;
+    (void) len;
+    return 0;
+#endif
+}
+
+static bool usb_audio_rate_supported(uint32_t rate)
+{
+    for (int i = 0; i < UAC_SAMPLE_RATE_COUNT; i++) {
+        if (s_sample_rates[i] == rate) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void usb_audio_notify_format(void)
+{
+    if (s_config.format_cb) {
+        s_config.format_cb(&s_format, s_alt != 0, s_config.cb_ctx);
+    }
+}
+
+//--------------------------------------------------------------------+
+// Clock source requests
+//--------------------------------------------------------------------+
+static bool usb_audio_clock_get_request(uint8_t rhport, audio_control_request_t const *request)
+{
+    if (request->bControlSelector == AUDIO_CS_CTRL_SAM_FREQ) {
+        if (request->bRequest == AUDIO_CS_REQ_CUR) {
+            audio_control_cur_4_t curf = { (int32_t) tu_htole32(s_format.sample_rate) };
+            return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *) request, &curf, sizeof(curf));
+        } else if (request->bRequest == AUDIO_CS_REQ_RANGE) {
+            audio_control_range_4_n_t(UAC_SAMPLE_RATE_COUNT) rangef = {
+                .wNumSubRanges = tu_htole16(UAC_SAMPLE_RATE_COUNT),
+            };
+            for (int i = 0; i < UAC_SAMPLE_RATE_COUNT; i++) {
+                rangef.subrange[i].bMin = (int32_t) tu_htole32(s_sample_rates[i]);
+                rangef.subrange[i].bMax = (int32_t) tu_htole32(s_sample_rates[i]);
+                rangef.subrange[i].bRes = 0;
+            }
+            return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *) request, &rangef, sizeof(rangef));
+        }
+    } else if (request->bControlSelector == AUDIO_CS_CTRL_CLK_VALID && request->bRequest == AUDIO_CS_REQ_CUR) {
+        audio_control_cur_1_t cur_valid = { .bCur = 1 };
+        return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *) request, &cur_valid, sizeof(cur_valid));
+    }
+    DLOGD(TAG, "Unsupported clock get request: selector %d, request %d", request->bControlSelector, request->bRequest);
+    return false;
+}
+
+static bool usb_audio_clock_set_request(uint8_t rhport, audio_control_request_t const *request, uint8_t const *buf)
+{
+    (void) rhport;
+    TU_VERIFY(request->bRequest == AUDIO_CS_REQ_CUR);
+
+    if (request->bControlSelector == AUDIO_CS_CTRL_SAM_FREQ) {
+        TU_VERIFY(request->wLength == sizeof(audio_control_cur_4_t));
+        uint32_t rate = (uint32_t) tu_le32toh(((audio_control_cur_4_t const *) buf)->bCur);
+        TU_VERIFY(usb_audio_rate_supported(rate));
+        if (rate != s_format.sample_rate) {
+            DLOGI(TAG, "Sample rate %" PRIu32 " -> %" PRIu32 " Hz", s_format.sample_rate, rate);
+            s_format.sample_rate = rate;
+            usb_audio_notify_format();
+        }
+        return true;
+    }
+    return false;
+}
+
+//--------------------------------------------------------------------+
+// Feature unit requests
+//--------------------------------------------------------------------+
+static bool usb_audio_feature_unit_get_request(uint8_t rhport, audio_control_request_t const *request)
+{
+    TU_VERIFY(request->bChannelNumber <= UAC_SPK_CHANNELS);
+
+    if (request->bControlSelector == AUDIO_FU_CTRL_MUTE && request->bRequest == AUDIO_CS_REQ_CUR) {
+        audio_control_cur_1_t mute = { .bCur = s_mute[request->bChannelNumber] };
+        return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *) request, &mute, sizeof(mute));
+    } else if (request->bControlSelector == AUDIO_FU_CTRL_VOLUME) {
+        if (request->bRequest == AUDIO_CS_REQ_RANGE) {
+            audio_control_range_2_n_t(1) range_vol = {
+                .wNumSubRanges = tu_htole16(1),
+                .subrange[0] = { .bMin = tu_htole16(USB_AUDIO_VOLUME_MIN), .bMax = tu_htole16(USB_AUDIO_VOLUME_MAX), .bRes = tu_htole16(USB_AUDIO_VOLUME_RES) },
+            };
+            return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *) request, &range_vol, sizeof(range_vol));
+        } else if (request->bRequest == AUDIO_CS_REQ_CUR) {
+            audio_control_cur_2_t cur_vol = { .bCur = tu_htole16(s_volume[request->bChannelNumber]) };
+            return tud_audio_buffer_and_schedule_control_xfer(rhport, (tusb_control_request_t const *) request, &cur_vol, sizeof(cur_vol));
+        }
+    }
+    DLOGD(TAG, "Unsupported feature unit get request: selector %d, request %d", request->bControlSelector, request->bRequest);
+    return false;
+}
+
+static bool usb_audio_feature_unit_set_request(uint8_t rhport, audio_control_request_t const *request, uint8_t const *buf)
+{
+    (void) rhport;
+    TU_VERIFY(request->bRequest == AUDIO_CS_REQ_CUR);
+    TU_VERIFY(request->bChannelNumber <= UAC_SPK_CHANNELS);
+
+    if (request->bControlSelector == AUDIO_FU_CTRL_MUTE) {
+        TU_VERIFY(request->wLength == sizeof(audio_control_cur_1_t));
+        s_mute[request->bChannelNumber] = ((audio_control_cur_1_t const *) buf)->bCur;
+        // Only the master channel is applied; per-channel controls are accepted and echoed.
+        if (request->bChannelNumber == 0 && s_config.set_mute_cb) {
+            s_config.set_mute_cb(s_mute[0], s_config.cb_ctx);
+        }
+        return true;
+    } else if (request->bControlSelector == AUDIO_FU_CTRL_VOLUME) {
+        TU_VERIFY(request->wLength == sizeof(audio_control_cur_2_t));
+        int16_t volume = (int16_t) tu_le16toh(((audio_control_cur_2_t const *) buf)->bCur);
+        if (volume < USB_AUDIO_VOLUME_MIN) {
+            volume = USB_AUDIO_VOLUME_MIN;
+        } else if (volume > USB_AUDIO_VOLUME_MAX) {
+            volume = USB_AUDIO_VOLUME_MAX;
+        }
+        s_volume[request->bChannelNumber] = volume;
+        if (request->bChannelNumber == 0 && s_config.set_volume_cb) {
+            s_config.set_volume_cb(volume, s_config.cb_ctx);
+        }
+        return true;
+    }
+    return false;
+}
+
+//--------------------------------------------------------------------+
+// TinyUSB audio class callbacks
+//--------------------------------------------------------------------+
+bool tud_audio_get_req_entity_cb(uint8_t rhport, tusb_control_request_t const *p_request)
+{
+    audio_control_request_t const *request = (audio_control_request_t const *) p_request;
+
+    if (request->bEntityID == UAC_ENTITY_CLOCK) {
+        return usb_audio_clock_get_request(rhport, request);
+    }
+    if (request->bEntityID == UAC_ENTITY_SPK_FEATURE_UNIT) {
+        return usb_audio_feature_unit_get_request(rhport, request);
+    }
+    DLOGD(TAG, "Get request for unknown entity %d", request->bEntityID);
+    return false;
+}
+
+bool tud_audio_set_req_entity_cb(uint8_t rhport, tusb_control_request_t const *p_request, uint8_t *buf)
+{
+    audio_control_request_t const *request = (audio_control_request_t const *) p_request;
+
+    if (request->bEntityID == UAC_ENTITY_CLOCK) {
+        return usb_audio_clock_set_request(rhport, request, buf);
+    }
+    if (request->bEntityID == UAC_ENTITY_SPK_FEATURE_UNIT) {
+        return usb_audio_feature_unit_set_request(rhport, request, buf);
+    }
+    DLOGD(TAG, "Set request for unknown entity %d", request->bEntityID);
+    return false;
+}
+
+bool tud_audio_set_itf_cb(uint8_t rhport, tusb_control_request_t const *p_request)
+{
+    (void) rhport;
+    uint8_t const itf = tu_u16_low(tu_le16toh(p_request->wIndex));
+    uint8_t const alt = tu_u16_low(tu_le16toh(p_request->wValue));
+
+#if UAC_MIC_CHANNELS > 0
+    if (itf == ITF_NUM_AUDIO_STREAMING_MIC) {
+        TU_VERIFY(alt < UAC_MIC_ALT_COUNT);
+        s_mic_alt = alt;
+        // Whatever was captured while the host wasn't listening is stale
+        tud_audio_clear_ep_in_ff();
+        DLOGI(TAG, "Microphone alt %d", alt);
+        if (s_config.mic_cb) {
+            s_config.mic_cb(alt != 0, s_config.cb_ctx);
+        }
+        return true;
+    }
+#endif
+    if (itf != ITF_NUM_AUDIO_STREAMING_SPK) {
+        return true;
+    }
+    TU_VERIFY(alt < UAC_ALT_COUNT);
+
+    s_alt = alt;
+    if (alt == UAC_ALT_16BIT) {
+        s_format.bytes_per_sample = UAC_FORMAT_1_N_BYTES;
+        s_format.bits_per_sample = UAC_FORMAT_1_RESOLUTION;
+    } else if (alt == UAC_ALT_24BIT) {
+        s_format.bytes_per_sample = UAC_FORMAT_2_N_BYTES;
+        s_format.bits_per_sample = UAC_FORMAT_2_RESOLUTION;
+    }
+    DLOGI(TAG, "Speaker alt %d: %d-bit, %" PRIu32 " Hz", alt, s_format.bits_per_sample, s_format.sample_rate);
+    usb_audio_notify_format();
+    return true;
+}
+
+bool tud_audio_set_itf_close_EP_cb(uint8_t rhport, tusb_control_request_t const *p_request)
+{
+    (void) rhport;
+    uint8_t const itf = tu_u16_low(tu_le16toh(p_request->wIndex));
+    uint8_t const alt = tu_u16_low(tu_le16toh(p_request->wValue));
+
+    if (itf == ITF_NUM_AUDIO_STREAMING_SPK && alt == 0 && s_alt != 0) {
+        s_alt = 0;
+        usb_audio_notify_format();
+    }
+#if UAC_MIC_CHANNELS > 0
+    if (itf == ITF_NUM_AUDIO_STREAMING_MIC && alt == 0 && s_mic_alt != 0) {
+        s_mic_alt = 0;
+        if (s_config.mic_cb) {
+            s_config.mic_cb(false, s_config.cb_ctx);
+        }
+    }
+#endif
+    return true;
+}
+
+void usb_audio_detached(void)
+{
+    if (s_alt != 0) {
+        s_alt = 0;
+        usb_audio_notify_format();
+    }
+#if UAC_MIC_CHANNELS > 0
+    if (s_mic_alt != 0) {
+        s_mic_alt = 0;
+        if (s_config.mic_cb) {
+            s_config.mic_cb(false, s_config.cb_ctx);
+        }
+    }
+#endif
+}
+
+bool tud_audio_rx_done_pre_read_cb(uint8_t rhport, uint16_t n_bytes_received, uint8_t func_id, uint8_t ep_out, uint8_t cur_alt_setting)
+{
+    (void) rhport;
+    (void) func_id;
+    (void) ep_out;
+    (void) cur_alt_setting;
+
+    if (s_config.rx_cb) {
+        s_config.rx_cb(n_bytes_received, s_config.cb_ctx);
+        // Leftovers would otherwise be prepended to the next packet
+        tud_audio_clear_ep_out_ff();
+        return true;
+    }
+
+    while (n_bytes_received > 0) {
+        uint16_t len = tud_audio_read(s_rx_buf, TU_MIN(n_bytes_received, sizeof(s_rx_buf)));
+        if (len == 0) {
+            break;
+        }
+        s_config.output_cb(s_rx_buf, len, s_config.cb_ctx);
+        n_bytes_received -= len;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// UAC2 speaker class handling: clock source, feature unit and streaming interface
+// requests, plus delivery of received isochronous packets. With UAC_MIC_CHANNELS > 0 it
+// also runs the microphone streaming interface: 16-bit capture at the speaker's rate,
+// queued with usb_audio_write().
+// Replaces the usb_device_uac component, whose fixed descriptor can't advertise more
+// than one rate or format.
+
+typedef struct {
+    uint32_t sample_rate;      // Hz
+    uint8_t bytes_per_sample;  // Subslot size on the bus
+    uint8_t bits_per_sample;   // Valid bits, MSB-justified in the subslot
+    uint8_t channels;
+} usb_audio_format_t;
+
+static inline bool usb_audio_format_equal(const usb_audio_format_t *a, const usb_audio_format_t *b)
+{
+    return a->sample_rate == b->sample_rate && a->bytes_per_sample == b->bytes_per_sample &&
+           a->bits_per_sample == b->bits_per_sample && a->channels == b->channels;
+}
+
+// Called from the TinyUSB task for every received packet; must not block.
+typedef esp_err_t (*usb_audio_output_cb_t)(uint8_t *buf, size_t len, void *cb_ctx);
+// Zero-copy alternative to output_cb: `len` bytes are waiting in the endpoint FIFO and
+// are fetched with usb_audio_read() from within the callback, straight into the
+// application's buffer. Whatever is left unread is discarded. Must not block.
+typedef void (*usb_audio_rx_cb_t)(size_t len, void *cb_ctx);
+// Called from the TinyUSB task when the host changes alt setting or sample rate.
+// `streaming` is false while the zero-bandwidth alt setting is selected.
+typedef void (*usb_audio_format_cb_t)(const usb_audio_format_t *format, bool streaming, void *cb_ctx);
+typedef void (*usb_audio_set_mute_cb_t)(bool mute, void *cb_ctx);
+// Volume in 1/256 dB, as carried by UAC2 (0 is unity, negative attenuates).
+typedef void (*usb_audio_set_volume_cb_t)(int16_t volume_db256, void *cb_ctx);
+// Called from the TinyUSB task when the host opens (alt 1) or closes the microphone.
+typedef void (*usb_audio_mic_cb_t)(bool streaming, void *cb_ctx);
+
+typedef struct {
+    usb_audio_output_cb_t output_cb;  // One of output_cb and rx_cb is required
+    usb_audio_rx_cb_t rx_cb;
+    usb_audio_format_cb_t format_cb;
+    usb_audio_set_mute_cb_t set_mute_cb;
+    usb_audio_set_volume_cb_t set_volume_cb;
+    usb_audio_mic_cb_t mic_cb;
+    void *cb_ctx;
+} usb_audio_config_t;
+
+esp_err_t usb_audio_init(const usb_audio_config_t *config);
+
+// Format currently selected by the host (or the default before the first request).
+void usb_audio_get_format(usb_audio_format_t *format);
+
+// Copies up to `len` received bytes from the endpoint FIFO to `dst`. Only valid inside
+// the rx_cb. Returns the number of bytes copied.
+size_t usb_audio_read(void *dst, size_t len);
+
+// Queues interleaved 16-bit capture frames for the microphone endpoint. Safe from any
+// task. Returns the number of bytes taken; the FIFO holds a few packets, so a short
+// count means the host isn't reading.
+size_t usb_audio_write(const void *src, size_t len);
+
+// Closes whatever streams the host had open, as it would with alt setting 0. For a device
+// that detached without the host closing them (soft re-enumeration); call only while
+// disconnected, so it can't race the TinyUSB task.
+void usb_audio_detached(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,324 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "usb_desc_check.h"
+
+#define DESC_DEVICE         (0x01)
+#define DESC_CONFIGURATION  (0x02)
+#define DESC_INTERFACE      (0x04)
+#define DESC_ENDPOINT       (0x05)
+#define DESC_IAD            (0x0B)
+
+#define EP_XFER_ISO         (1)
+#define EP_XFER_BULK        (2)
+#define EP_XFER_INT         (3)
+
+// Per-transaction protocol overhead in bytes, USB 2.0 table 5-4
+#define FS_ISO_OVERHEAD     (9)
+#define FS_INT_OVERHEAD     (13)
+
+static int problem(usb_desc_report_fn_t report, void *ctx, const char *fmt, ...)
+{
+    if (report) {
+        char msg[96];
+        va_list ap;
+        va_start(ap, fmt);
+        vsnprintf(msg, sizeof(msg), fmt, ap);
+        va_end(ap);
+        report(ctx, msg);
+    }
+    return 1;
+}
+
+static inline uint16_t rd16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static int check_string(uint8_t index, const char *what, int where, const usb_desc_limits_t *limits,
+                        usb_desc_report_fn_t report, void *ctx)
+{
+    if (index != 0 && index >= limits->string_count) {
+        return problem(report, ctx, "%s %d: string %u of %u", what, where, index, limits->string_count);
+    }
+    return 0;
+}
+
+// Bytes one endpoint moves in the worst frame, or 0 for bulk. Full-speed isochronous
+// endpoints are serviced every frame; interrupt endpoints every bInterval frames, which
+// still means some frames carry them.
+static uint16_t ep_periodic_bytes(const usb_desc_ep_t *ep)
+{
+    switch (ep->attributes & 0x03) {
+    case EP_XFER_ISO:
+        return ep->max_packet + FS_ISO_OVERHEAD;
+    case EP_XFER_INT:
+        return ep->max_packet + FS_INT_OVERHEAD;
+    default:
+        return 0;
+    }
+}
+
+static int check_endpoint(const usb_desc_ep_t *ep, int itf, const usb_desc_limits_t *limits,
+                          usb_desc_report_fn_t report, void *ctx)
+{
+    int n = 0;
+    uint8_t num = ep->addr & 0x0F;
+    if (num == 0 || num > limits->ep_num_max || (ep->addr & 0x70)) {
+        n += problem(report, ctx, "interface %d: endpoint 0x%02x not available", itf, ep->addr);
+    }
+    switch (ep->attributes & 0x03) {
+    case EP_XFER_ISO:
+        if (ep->max_packet > 1023) {
+            n += problem(report, ctx, "endpoint 0x%02x: iso packet %u > 1023", ep->addr, ep->max_packet);
+        }
+        if (ep->interval < 1 || ep->interval > 16) {
+            n += problem(report, ctx, "endpoint 0x%02x: iso bInterval %u", ep->addr, ep->interval);
+        }
+        break;
+    case EP_XFER_BULK:
+        if (ep->max_packet != 8 && ep->max_packet != 16 && ep->max_packet != 32 && ep->max_packet != 64) {
+            n += problem(report, ctx, "endpoint 0x%02x: bulk packet %u", ep->addr, ep->max_packet);
+        }
+        break;
+    case EP_XFER_INT:
+        if (ep->max_packet > 64) {
+            n += problem(report, ctx, "endpoint 0x%02x: interrupt packet %u > 64", ep->addr, ep->max_packet);
+        }
+        if (ep->interval == 0) {
+            n += problem(report, ctx, "endpoint 0x%02x: interrupt bInterval 0", ep->addr);
+        }
+        break;
+    default:
+        n += problem(report, ctx, "endpoint 0x%02x: control endpoint in a configuration", ep->addr);
+        break;
+    }
+    return n;
+}
+
+int usb_desc_check_device(const uint8_t *desc, const usb_desc_limits_t *limits, usb_desc_report_fn_t report, void *ctx)
+{
+    int n = 0;
+    if (desc[0] != 18 || desc[1] != DESC_DEVICE) {
+        return problem(report, ctx, "device: bLength %u type %u", desc[0], desc[1]);
+    }
+    uint8_t mps0 = desc[7];
+    if (mps0 != 8 && mps0 != 16 && mps0 != 32 && mps0 != 64) {
+        n += problem(report, ctx, "device: bMaxPacketSize0 %u", mps0);
+    }
+    n += check_string(desc[14], "device", 0, limits, report, ctx);
+    n += check_string(desc[15], "device", 1, limits, report, ctx);
+    n += check_string(desc[16], "device", 2, limits, report, ctx);
+    if (desc[17] != 1) {
+        n += problem(report, ctx, "device: %u configurations", desc[17]);
+    }
+    return n;
+}
+
+int usb_desc_check_config(const uint8_t *desc, size_t len, const usb_desc_limits_t *limits, usb_desc_layout_t *layout,
+                          usb_desc_report_fn_t report, void *ctx)
+{
+    memset(layout, 0, sizeof(*layout));
+    if (len < 9 || desc[0] != 9 || desc[1] != DESC_CONFIGURATION) {
+        return problem(report, ctx, "config: bad header");
+    }
+    int n = 0;
+    uint16_t total = rd16(desc + 2);
+    uint8_t itf_declared = desc[4];
+    layout->total_len = total;
+    if (total > len) {
+        n += problem(report, ctx, "config: wTotalLength %u > %u bytes", total, (unsigned)len);
+        total = (uint16_t)len;
+    }
+    if (itf_declared > USB_DESC_CHECK_ITF_MAX) {
+        return n + problem(report, ctx, "config: %u interfaces", itf_declared);
+    }
+    n += check_string(desc[6], "config", 0, limits, report, ctx);
+
+    usb_desc_alt_t *alt = NULL;     // Alt setting the following endpoints belong to
+    int itf = -1;
+    int ep_expected = 0;
+    uint8_t iad_end = 0;            // Interfaces below this are covered by an IAD already
+    size_t off = desc[0];
+    while (off < total) {
+        const uint8_t *d = desc + off;
+        if (d[0] < 2 || off + d[0] > total) {
+            n += problem(report, ctx, "offset %u: descriptor overruns wTotalLength", (unsigned)off);
+            break;
+        }
+        switch (d[1]) {
+        case DESC_IAD:
+            if (d[0] < 8) {
+                n += problem(report, ctx, "offset %u: short IAD", (unsigned)off);
+                break;
+            }
+            if (d[3] == 0 || d[2] + d[3] > itf_declared) {
+                n += problem(report, ctx, "IAD: interfaces %u+%u of %u", d[2], d[3], itf_declared);
+            }
+            if (d[2] < iad_end) {
+                n += problem(report, ctx, "IAD: interface %u already associated", d[2]);
+            }
+            if (d[2] != layout->itf_count) {
+                n += problem(report, ctx, "IAD: does not precede interface %u", d[2]);
+            }
+            iad_end = d[2] + d[3];
+            n += check_string(d[7], "IAD", d[2], limits, report, ctx);
+            break;
+        case DESC_INTERFACE: {
+            if (d[0] < 9) {
+                n += problem(report, ctx, "offset %u: short interface", (unsigned)off);
+                break;
+            }
+            if (alt && ep_expected) {
+                n += problem(report, ctx, "interface %d: %d endpoints missing", itf, ep_expected);
+            }
+            alt = NULL;
+            uint8_t num = d[2];
+            uint8_t alt_num = d[3];
+            if (num == layout->itf_count && alt_num == 0 && num < itf_declared) {
+                layout->itf_count++;        // A new interface, in order
+            } else if (num + 1 != layout->itf_count) {
+                n += problem(report, ctx, "interface %u out of order or undeclared", num);
+                ep_expected = 0;
+                break;
+            }
+            usb_desc_itf_t *it = &layout->itf[num];
+            if (alt_num != it->alt_count) {
+                n += problem(report, ctx, "interface %u: alt %u out of order", num, alt_num);
+                ep_expected = 0;
+                break;
+            }
+            if (it->alt_count == USB_DESC_CHECK_ALT_MAX) {
+                n += problem(report, ctx, "interface %u: more than %d alts", num, USB_DESC_CHECK_ALT_MAX);
+                ep_expected = 0;
+                break;
+            }
+            itf = num;
+            alt = &it->alt[it->alt_count++];
+            alt->cls = d[5];
+            alt->subclass = d[6];
+            ep_expected = d[4];
+            if (ep_expected > USB_DESC_CHECK_EP_MAX) {
+                n += problem(report, ctx, "interface %u: %d endpoints", num, ep_expected);
+            }
+            n += check_string(d[8], "interface", num, limits, report, ctx);
+            break;
+        }
+        case DESC_ENDPOINT:
+            if (d[0] < 7) {
+                n += problem(report, ctx, "offset %u: short endpoint", (unsigned)off);
+                break;
+            }
+            if (!alt || ep_expected == 0) {
+                n += problem(report, ctx, "endpoint 0x%02x: not declared by its interface", d[2]);
+                break;
+            }
+            ep_expected--;
+            if (alt->ep_count < USB_DESC_CHECK_EP_MAX) {
+                usb_desc_ep_t *ep = &alt->ep[alt->ep_count++];
+                ep->addr = d[2];
+                ep->attributes = d[3];
+                ep->max_packet = rd16(d + 4) & 0x07FF;
+                ep->interval = d[6];
+                n += check_endpoint(ep, itf, limits, report, ctx);
+            }
+            break;
+        case DESC_DEVICE:
+        case DESC_CONFIGURATION:
+            n += problem(report, ctx, "offset %u: descriptor type %u inside the configuration", (unsigned)off, d[1]);
+            break;
+        default:
+            break;                  // Class-specific, left to the class driver
+        }
+        off += d[0];
+    }
+    if (alt && ep_expected) {
+        n += problem(report, ctx, "interface %d: %d endpoints missing", itf, ep_expected);
+    }
+    if (off != total) {
+        n += problem(report, ctx, "config: descriptors end at %u, wTotalLength %u", (unsigned)off, total);
+    }
+    if (layout->itf_count != itf_declared) {
+        n += problem(report, ctx, "config: %u interfaces declared, %u present", itf_declared, layout->itf_count);
+    }
+
+    // An endpoint address belongs to one interface; its alt settings may reuse it
+    uint8_t owner[2][16];
+    memset(owner, 0xFF, sizeof(owner));
+    for (int i = 0; i < layout->itf_count; i++) {
+        const usb_desc_itf_t *it = &layout->itf[i];
+        for (int a = 0; a < it->alt_count; a++) {
+            for (int e = 0; e < it->alt[a].ep_count; e++) {
+                uint8_t addr = it->alt[a].ep[e].addr;
+                uint8_t *o = &owner[addr >> 7][addr & 0x0F];
+                if (*o == 0xFF) {
+                    *o = (uint8_t)i;
+                    if (addr & 0x80) {
+                        layout->in_eps++;
+                    } else {
+                        layout->out_eps++;
+                    }
+                } else if (*o != i) {
+                    n += problem(report, ctx, "endpoint 0x%02x: in interfaces %u and %d", addr, *o, i);
+                }
+            }
+        }
+    }
+
+    // The host may run every interface at its most demanding alt at once
+    uint8_t worst[USB_DESC_CHECK_ITF_MAX] = {0};
+    for (int i = 0; i < layout->itf_count; i++) {
+        const usb_desc_itf_t *it = &layout->itf[i];
+        uint32_t most = 0;
+        for (int a = 0; a < it->alt_count; a++) {
+            uint32_t bytes = 0;
+            for (int e = 0; e < it->alt[a].ep_count; e++) {
+                bytes += ep_periodic_bytes(&it->alt[a].ep[e]);
+            }
+            if (bytes > most) {
+                most = bytes;
+                worst[i] = (uint8_t)a;
+            }
+        }
+    }
+    n += usb_desc_check_alts(layout, worst, limits, &layout->periodic_bytes, report, ctx);
+    return n;
+}
+
+int usb_desc_check_alts(const usb_desc_layout_t *layout, const uint8_t *alts, const usb_desc_limits_t *limits,
+                        uint16_t *periodic_bytes, usb_desc_report_fn_t report, void *ctx)
+{
+    int n = 0;
+    uint32_t bytes = 0;
+    uint16_t in_used = 0;
+    uint16_t out_used = 0;
+    for (int i = 0; i < layout->itf_count; i++) {
+        const usb_desc_itf_t *it = &layout->itf[i];
+        if (alts[i] >= it->alt_count) {
+            n += problem(report, ctx, "interface %d: no alt %u", i, alts[i]);
+            continue;
+        }
+        const usb_desc_alt_t *alt = &it->alt[alts[i]];
+        for (int e = 0; e < alt->ep_count; e++) {
+            const usb_desc_ep_t *ep = &alt->ep[e];
+            uint16_t bit = (uint16_t)(1u << (ep->addr & 0x0F));
+            uint16_t *used = (ep->addr & 0x80) ? &in_used : &out_used;
+            if (*used & bit) {
+                n += problem(report, ctx, "endpoint 0x%02x: opened twice", ep->addr);
+            }
+            *used |= bit;
+            bytes += ep_periodic_bytes(ep);
+        }
+    }
+    int in_count = __builtin_popcount(in_used);
+    if (in_count > limits->in_ep_max) {
+        n += problem(report, ctx, "%d IN endpoints active, controller runs %u", in_count, limits->in_ep_max);
+    }
+    if (bytes > USB_DESC_FS_PERIODIC_BYTES) {
+        n += problem(report, ctx, "periodic %u bytes/frame > %d", (unsigned)bytes, USB_DESC_FS_PERIODIC_BYTES);
+    }
+    if (periodic_bytes) {
+        *periodic_bytes = (uint16_t)(bytes > UINT16_MAX ? UINT16_MAX : bytes);
+    }
+    return n;
+}
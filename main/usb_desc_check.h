@@ -0,0 +1,82 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Structural checks on USB device and configuration descriptors, for the mistakes that
+// otherwise only show up as a failed SET_CONFIGURATION on a real host:
+//  - wTotalLength against the bytes actually there, and every descriptor inside them,
+//  - bNumInterfaces against the interfaces present, numbered from 0 without gaps, with
+//    alternate settings numbered from 0 and bNumEndpoints matching what follows,
+//  - interface associations that stay within the configuration,
+//  - endpoint numbers within what the controller has, no endpoint shared by two
+//    interfaces, packet sizes legal for full speed, and no more IN endpoints than the
+//    controller can run at once,
+//  - string indices that the string descriptor callback can serve.
+// usb_desc_check_alts() checks one choice of alternate settings the way the host would
+// select them, including the periodic (isochronous and interrupt) bandwidth that choice
+// needs in a full-speed frame.
+// The same checks run on the host in tools/usb_desc_check.c.
+
+#define USB_DESC_CHECK_ITF_MAX  (8)
+#define USB_DESC_CHECK_ALT_MAX  (4)
+#define USB_DESC_CHECK_EP_MAX   (4)     // Per alternate setting
+#define USB_DESC_FS_PERIODIC_BYTES (1350) // 90% of a 1 ms full-speed frame, USB 2.0 5.6.4
+
+typedef struct {
+    uint8_t ep_num_max;         // Highest endpoint number the controller has
+    uint8_t in_ep_max;          // IN endpoints it can run at once, EP0 not counted
+    uint8_t string_count;       // String indices below this are served
+} usb_desc_limits_t;
+
+typedef struct {
+    uint8_t addr;
+    uint8_t attributes;         // Transfer type in bits 0..1
+    uint16_t max_packet;
+    uint8_t interval;
+} usb_desc_ep_t;
+
+typedef struct {
+    uint8_t cls;
+    uint8_t subclass;
+    uint8_t ep_count;
+    usb_desc_ep_t ep[USB_DESC_CHECK_EP_MAX];
+} usb_desc_alt_t;
+
+typedef struct {
+    uint8_t alt_count;
+    usb_desc_alt_t alt[USB_DESC_CHECK_ALT_MAX];
+} usb_desc_itf_t;
+
+typedef struct {
+    uint16_t total_len;
+    uint8_t itf_count;
+    usb_desc_itf_t itf[USB_DESC_CHECK_ITF_MAX];
+    uint8_t in_eps;             // Distinct endpoint addresses over all interfaces
+    uint8_t out_eps;
+    uint16_t periodic_bytes;    // Per frame, with every interface at its most demanding alt
+} usb_desc_layout_t;
+
+// Gets one line per problem found, without a trailing newline.
+typedef void (*usb_desc_report_fn_t)(void *ctx, const char *problem);
+
+// Each returns the number of problems found; `report` may be NULL.
+int usb_desc_check_device(const uint8_t *desc, const usb_desc_limits_t *limits, usb_desc_report_fn_t report, void *ctx);
+
+// `len` is the number of bytes available at `desc`, at least wTotalLength. On return
+// `layout` describes what could be parsed, even when problems were found.
+int usb_desc_check_config(const uint8_t *desc, size_t len, const usb_desc_limits_t *limits, usb_desc_layout_t *layout,
+                          usb_desc_report_fn_t report, void *ctx);
+
+// Checks that interface i can run alternate setting `alts[i]` while every other
+// interface runs its own. `periodic_bytes` (may be NULL) gets the frame bandwidth.
+int usb_desc_check_alts(const usb_desc_layout_t *layout, const uint8_t *alts, const usb_desc_limits_t *limits,
+                        uint16_t *periodic_bytes, usb_desc_report_fn_t report, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,355 @@
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "dlog.h"
+#include "wav_player.h"
+
+static const char *TAG = "wav_player";
+
+#define WAV_PLAYER_TASK_STACK   (CONFIG_TASK_PLAYER_STACK)
+#define WAV_PLAYER_TASK_PRIO    (CONFIG_TASK_PLAYER_PRIO)  // Below the audio writer, above the MSC worker
+#define WAV_PLAYER_TASK_CORE    (CONFIG_TASK_PLAYER_CORE)
+#define WAV_PLAYER_CMD_DEPTH    (4)
+#define WAV_PLAYER_STOP_POLL_MS (10)
+
+typedef enum {
+    WAV_IDLE = 0,       // No track; the blocks belong to the reader
+    WAV_PLAYING,        // Reader fills, writer drains
+    WAV_DRAINING,       // File fully read, writer plays what is left
+    WAV_STOPPING,       // Reader asked the writer to drop the track
+} wav_state_t;
+
+typedef enum {
+    WAV_CMD_PLAY,
+    WAV_CMD_QUEUE,
+    WAV_CMD_STOP,
+} wav_cmd_op_t;
+
+typedef struct {
+    wav_cmd_op_t op;
+    char path[WAV_PLAYER_PATH_MAX];
+} wav_cmd_t;
+
+// What the status shows of the current track
+typedef struct {
+    char path[WAV_PLAYER_PATH_MAX];
+    uint32_t sample_rate;
+    uint8_t bits_per_sample;
+    uint8_t channels;
+} wav_track_t;
+
+static TaskHandle_t s_task;
+static QueueHandle_t s_cmd_queue;
+static _Atomic int s_state;     // wav_state_t
+static _Atomic uint32_t s_output_rate;
+
+// The reader task owns the file side, the writer the block side; the format is
+// published by the reader before leaving WAV_IDLE and read-only until it is back
+static wav_stream_t s_stream;
+
+// Published with the format, also read by the status
+static wav_track_t s_track;
+static portMUX_TYPE s_track_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Reader task only
+static char s_queue[WAV_PLAYER_QUEUE_LEN][WAV_PLAYER_PATH_MAX];
+static int s_queue_head;
+static _Atomic uint32_t s_queue_count;
+
+// Writer task only
+static _Atomic uint32_t s_underruns;
+static _Atomic bool s_finished;   // Played to the end; the reader logs it once back in WAV_IDLE
+
+static inline int wav_state(void)
+{
+    return atomic_load_explicit(&s_state, memory_order_acquire);
+}
+
+static esp_err_t wav_err(wav_stream_err_t err)
+{
+    switch (err) {
+    case WAV_STREAM_OK:
+        return ESP_OK;
+    case WAV_STREAM_ERR_UNSUPPORTED:
+        return ESP_ERR_NOT_SUPPORTED;
+    case WAV_STREAM_ERR_IO:
+        return ESP_FAIL;
+    default:
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+}
+
+static void wav_log_rejected(const char *path, wav_stream_err_t err, const wav_stream_format_t *format)
+{
+    if (err == WAV_STREAM_ERR_UNSUPPORTED) {
+        ESP_LOGE(TAG, "Skipping %s: unsupported encoding %04x, %d ch, %d-bit, block %d", path, format->format_tag,
+                 format->channels, format->bits_per_sample, format->frame_bytes);
+    } else {
+        ESP_LOGE(TAG, "Skipping %s: %s", path, err == WAV_STREAM_ERR_IO ? "I/O error" : "not a RIFF/WAVE file");
+    }
+}
+
+esp_err_t wav_player_probe(int fd, wav_player_info_t *info)
+{
+    wav_stream_format_t format;
+    esp_err_t ret = wav_err(wav_stream_parse(fd, &format));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    info->sample_rate = format.sample_rate;
+    info->channels = format.channels;
+    info->bytes_per_sample = format.bytes_per_sample;
+    info->adpcm = format.adpcm;
+    info->data_pos = format.data_pos;
+    info->data_end = format.data_end;
+    return ESP_OK;
+}
+
+// Fills the released blocks; true once the file is done
+static bool wav_fill(void)
+{
+    bool done = wav_stream_fill(&s_stream);
+    if (s_stream.read_error) {
+        ESP_LOGE(TAG, "Read failed at %d in %s", s_stream.file_pos, s_track.path);
+        s_stream.read_error = false;
+    }
+    return done;
+}
+
+// Opens queued files until one starts playing or the queue is empty. WAV_IDLE only.
+static void wav_open_next(void)
+{
+    while (atomic_load(&s_queue_count) > 0) {
+        wav_track_t track = { 0 };
+        strlcpy(track.path, s_queue[s_queue_head], sizeof(track.path));
+        s_queue_head = (s_queue_head + 1) % WAV_PLAYER_QUEUE_LEN;
+        atomic_fetch_sub(&s_queue_count, 1);
+
+        int fd = open(track.path, O_RDONLY);
+        if (fd < 0) {
+            ESP_LOGE(TAG, "Cannot open %s", track.path);
+            continue;
+        }
+        wav_stream_err_t err = wav_stream_open(&s_stream, fd);
+        if (err != WAV_STREAM_OK) {
+            wav_log_rejected(track.path, err, &s_stream.format);
+            close(fd);
+            continue;
+        }
+        const wav_stream_format_t *format = &s_stream.format;
+        uint32_t rate = atomic_load(&s_output_rate);
+        if (format->sample_rate != rate) {
+            ESP_LOGE(TAG, "Skipping %s: %" PRIu32 " Hz, output runs at %" PRIu32 " Hz", track.path, format->sample_rate, rate);
+            wav_stream_close(&s_stream);
+            continue;
+        }
+
+        track.sample_rate = format->sample_rate;
+        track.bits_per_sample = format->bits_per_sample;
+        track.channels = format->channels;
+        taskENTER_CRITICAL(&s_track_lock);
+        s_track = track;
+        taskEXIT_CRITICAL(&s_track_lock);
+
+        // Both blocks are loaded before the writer sees the track, so it starts without
+        // an underrun
+        bool done = wav_fill();
+        atomic_store_explicit(&s_state, done ? WAV_DRAINING : WAV_PLAYING, memory_order_release);
+        ESP_LOGI(TAG, "Playing %s: %" PRIu32 " Hz, %d-bit, %d ch, %d bytes", track.path, format->sample_rate,
+                 format->bits_per_sample, format->channels, format->data_end - format->data_pos);
+        return;
+    }
+}
+
+// Takes the current track away from the writer and waits until it has let go.
+static void wav_halt(void)
+{
+    wav_stream_close(&s_stream);
+    int expected = wav_state();
+    while (expected != WAV_IDLE &&
+           !atomic_compare_exchange_weak(&s_state, &expected, WAV_STOPPING)) {
+    }
+    while (wav_state() != WAV_IDLE) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WAV_PLAYER_STOP_POLL_MS));
+    }
+}
+
+static void wav_enqueue_path(const char *path)
+{
+    uint32_t count = atomic_load(&s_queue_count);
+    if (count == WAV_PLAYER_QUEUE_LEN) {
+        ESP_LOGW(TAG, "Queue full, dropping %s", path);
+        return;
+    }
+    strlcpy(s_queue[(s_queue_head + count) % WAV_PLAYER_QUEUE_LEN], path, WAV_PLAYER_PATH_MAX);
+    atomic_fetch_add(&s_queue_count, 1);
+}
+
+static void wav_handle_cmd(const wav_cmd_t *cmd)
+{
+    switch (cmd->op) {
+    case WAV_CMD_PLAY:
+        wav_halt();
+        atomic_store(&s_queue_count, 0);
+        wav_enqueue_path(cmd->path);
+        break;
+    case WAV_CMD_QUEUE:
+        wav_enqueue_path(cmd->path);
+        break;
+    case WAV_CMD_STOP:
+        wav_halt();
+        atomic_store(&s_queue_count, 0);
+        break;
+    }
+}
+
+static void wav_player_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        wav_cmd_t cmd;
+        while (xQueueReceive(s_cmd_queue, &cmd, 0) == pdTRUE) {
+            wav_handle_cmd(&cmd);
+        }
+
+        if (s_stream.fd >= 0) {
+            if (wav_fill()) {
+                atomic_store_explicit(&s_state, WAV_DRAINING, memory_order_release);
+            }
+        } else if (wav_state() == WAV_IDLE) {
+            if (atomic_exchange(&s_finished, false)) {
+                ESP_LOGI(TAG, "Finished %s", s_track.path);
+            }
+            wav_open_next();
+        }
+    }
+}
+
+static esp_err_t wav_send(wav_cmd_op_t op, const char *path)
+{
+    ESP_RETURN_ON_FALSE(s_cmd_queue, ESP_ERR_INVALID_STATE, TAG, "Not initialized");
+    wav_cmd_t cmd = { .op = op };
+    if (path) {
+        ESP_RETURN_ON_FALSE(strlen(path) < sizeof(cmd.path), ESP_ERR_INVALID_ARG, TAG, "Path too long");
+        strlcpy(cmd.path, path, sizeof(cmd.path));
+    }
+    ESP_RETURN_ON_FALSE(xQueueSend(s_cmd_queue, &cmd, pdMS_TO_TICKS(100)) == pdTRUE, ESP_ERR_TIMEOUT, TAG, "Player busy");
+    xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+esp_err_t wav_player_play(const char *path)
+{
+    return wav_send(WAV_CMD_PLAY, path);
+}
+
+esp_err_t wav_player_enqueue(const char *path)
+{
+    return wav_send(WAV_CMD_QUEUE, path);
+}
+
+esp_err_t wav_player_stop(void)
+{
+    return wav_send(WAV_CMD_STOP, NULL);
+}
+
+void wav_player_set_output_rate(uint32_t sample_rate)
+{
+    atomic_store(&s_output_rate, sample_rate);
+}
+
+bool wav_player_active(void)
+{
+    return wav_state() != WAV_IDLE;
+}
+
+static void wav_notify_reader(void *ctx)
+{
+    xTaskNotifyGive(s_task);
+}
+
+// Hands the blocks back to the reader. Writer task only.
+static void wav_release(void)
+{
+    wav_stream_release(&s_stream);
+    atomic_store_explicit(&s_state, WAV_IDLE, memory_order_release);
+    xTaskNotifyGive(s_task);
+}
+
+size_t wav_player_read(uint8_t *out, size_t len, const usb_audio_format_t *format)
+{
+    int state = wav_state();
+    if (state == WAV_IDLE) {
+        return 0;
+    }
+    if (state == WAV_STOPPING) {
+        wav_release();
+        return 0;
+    }
+    if (format->sample_rate != s_stream.format.sample_rate) {
+        // Deferred: the path buffer is reused by the next track
+        DLOGW(TAG, "Output switched to %" PRIu32 " Hz, dropping the track", format->sample_rate);
+        wav_release();
+        return 0;
+    }
+
+    const size_t out_frame = format->channels * format->bytes_per_sample;
+    size_t done = wav_stream_read(&s_stream, out, len / out_frame, format->bytes_per_sample, format->channels);
+    if (done == 0) {
+        // Reload: the reader may have finished the file since the first look
+        if (wav_state() == WAV_DRAINING) {
+            atomic_store(&s_finished, true);
+            wav_release();
+        } else {
+            atomic_fetch_add_explicit(&s_underruns, 1, memory_order_relaxed);
+        }
+    }
+    return done * out_frame;
+}
+
+void wav_player_get_status(wav_player_status_t *status)
+{
+    memset(status, 0, sizeof(*status));
+    status->active = wav_player_active();
+    if (status->active) {
+        taskENTER_CRITICAL(&s_track_lock);
+        strlcpy(status->path, s_track.path, sizeof(status->path));
+        status->sample_rate = s_track.sample_rate;
+        status->bits_per_sample = s_track.bits_per_sample;
+        status->channels = s_track.channels;
+        taskEXIT_CRITICAL(&s_track_lock);
+        if (status->sample_rate) {
+            status->played_ms = (uint32_t)((uint64_t)wav_stream_played_frames(&s_stream) * 1000 / status->sample_rate);
+        }
+    }
+    status->queued = atomic_load(&s_queue_count);
+    status->underruns = atomic_load(&s_underruns);
+}
+
+esp_err_t wav_player_init(void)
+{
+    uint8_t *block[2];
+    for (int i = 0; i < 2; i++) {
+        block[i] = heap_caps_malloc(WAV_PLAYER_BLOCK_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        ESP_RETURN_ON_FALSE(block[i], ESP_ERR_NO_MEM, TAG, "No memory for read blocks");
+    }
+    wav_stream_init(&s_stream, block[0], block[1], wav_notify_reader, NULL);
+    s_cmd_queue = xQueueCreate(WAV_PLAYER_CMD_DEPTH, sizeof(wav_cmd_t));
+    ESP_RETURN_ON_FALSE(s_cmd_queue, ESP_ERR_NO_MEM, TAG, "No memory for command queue");
+    BaseType_t task_created = xTaskCreatePinnedToCore(wav_player_task, "wav_player", WAV_PLAYER_TASK_STACK, NULL,
+                                                      WAV_PLAYER_TASK_PRIO, &s_task, WAV_PLAYER_TASK_CORE);
+    ESP_RETURN_ON_FALSE(task_created == pdPASS, ESP_ERR_NO_MEM, TAG, "Failed to create reader task");
+
+    ESP_LOGI(TAG, "2 x %d byte read blocks, queue of %d", WAV_PLAYER_BLOCK_BYTES, WAV_PLAYER_QUEUE_LEN);
+    return ESP_OK;
+}
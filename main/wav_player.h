@@ -0,0 +1,80 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "usb_audio.h"
+#include "wav_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Streams PCM WAV files from the FAT partition into the playback path.
+//
+// A reader task fills two block buffers with file-offset-aligned reads of
+// WAV_PLAYER_BLOCK_BYTES (a multiple of the FAT cluster size), so a file is never held
+// in RAM and FatFs never has to split a cluster. The audio writer pulls converted
+// frames with wav_player_read() in place of the USB jitter buffer while a track is
+// active, which lets playback take over from and hand back to the USB stream without
+// touching the I2S channel. Files must be at the rate the channel is running at;
+// channel count and sample width are converted.
+// Both 16/24/32-bit PCM and IMA-ADPCM (4:1, see ima_adpcm.h) files are played; ADPCM
+// is decoded a block at a time from a single static block buffer. The parsing and the
+// block streaming are in wav_stream.h; this file adds the reader task, the queue and
+// the handover to and from the USB stream.
+
+#define WAV_PLAYER_BLOCK_BYTES (WAV_STREAM_BLOCK_BYTES)
+#define WAV_PLAYER_QUEUE_LEN   (8)
+#define WAV_PLAYER_PATH_MAX    (64)
+
+typedef struct {
+    bool active;
+    char path[WAV_PLAYER_PATH_MAX];
+    uint32_t sample_rate;
+    uint8_t bits_per_sample;
+    uint8_t channels;
+    uint32_t played_ms;
+    uint32_t queued;            // Tracks waiting after the current one
+    uint32_t underruns;         // Writer found both blocks empty mid-track
+} wav_player_status_t;
+
+typedef struct {
+    uint32_t sample_rate;
+    uint8_t channels;
+    uint8_t bytes_per_sample;   // Container size: 2, 3 or 4
+    bool adpcm;
+    size_t data_pos;            // PCM bytes are [data_pos, data_end) in the file
+    size_t data_end;
+} wav_player_info_t;
+
+esp_err_t wav_player_init(void);
+
+// Parses the header of the WAV file open as `fd` and leaves it positioned at the data.
+// Fails for layouts the player can't play.
+esp_err_t wav_player_probe(int fd, wav_player_info_t *info);
+
+// Stops whatever is playing, clears the queue and starts `path`.
+esp_err_t wav_player_play(const char *path);
+
+// Appends `path` to the queue; starts it right away if nothing is playing.
+esp_err_t wav_player_enqueue(const char *path);
+
+// Stops playback and clears the queue.
+esp_err_t wav_player_stop(void);
+
+// Rate the I2S channel runs at; files at other rates are skipped.
+void wav_player_set_output_rate(uint32_t sample_rate);
+
+// True while a track owns the playback path.
+bool wav_player_active(void);
+
+// Audio writer side. Fills `out` with up to `len` bytes converted to `format`, whole
+// frames only. Returns 0 when nothing is ready.
+size_t wav_player_read(uint8_t *out, size_t len, const usb_audio_format_t *format);
+
+void wav_player_get_status(wav_player_status_t *status);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,250 @@
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "audio_convert.h"
+#include "wav_stream.h"
+
+#define WAV_FORMAT_PCM        (0x0001)
+#define WAV_FORMAT_EXTENSIBLE (0xFFFE)
+
+static inline uint16_t wav_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static inline uint32_t wav_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+void wav_stream_init(wav_stream_t *s, uint8_t *block0, uint8_t *block1, void (*released)(void *ctx), void *ctx)
+{
+    memset(s, 0, sizeof(*s));
+    s->block[0].data = block0;
+    s->block[1].data = block1;
+    atomic_init(&s->block[0].full, false);
+    atomic_init(&s->block[1].full, false);
+    atomic_init(&s->played_frames, 0);
+    s->released = released;
+    s->ctx = ctx;
+    s->fd = -1;
+}
+
+// Only runs once per file, so the small unaligned reads here don't matter; streaming
+// starts from the block the data begins in.
+wav_stream_err_t wav_stream_parse(int fd, wav_stream_format_t *format)
+{
+    memset(format, 0, sizeof(*format));
+    uint8_t hdr[12];
+    if (read(fd, hdr, sizeof(hdr)) != sizeof(hdr) || memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "WAVE", 4) != 0) {
+        return WAV_STREAM_ERR_FORMAT;
+    }
+
+    bool have_fmt = false;
+    while (1) {
+        uint8_t chunk[8];
+        if (read(fd, chunk, sizeof(chunk)) != sizeof(chunk)) {
+            return WAV_STREAM_ERR_FORMAT;   // No data chunk
+        }
+        uint32_t size = wav_le32(chunk + 4);
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t fmt[40] = { 0 };
+            size_t n = MIN(size, sizeof(fmt));
+            if (size < 16 || read(fd, fmt, n) != (ssize_t)n) {
+                return WAV_STREAM_ERR_FORMAT;
+            }
+            uint16_t tag = wav_le16(fmt);
+            if (tag == WAV_FORMAT_EXTENSIBLE && size >= 26) {
+                tag = wav_le16(fmt + 24); // First two bytes of the sub-format GUID
+            }
+            format->format_tag = tag;
+            format->channels = wav_le16(fmt + 2);
+            format->sample_rate = wav_le32(fmt + 4);
+            format->frame_bytes = wav_le16(fmt + 12);
+            format->bits_per_sample = wav_le16(fmt + 14);
+            if (tag == IMA_ADPCM_FORMAT_TAG) {
+                // Consumed a whole block at a time and decoded to 16 bits
+                if (format->bits_per_sample != 4 || format->frame_bytes > WAV_STREAM_ADPCM_BLOCK_MAX ||
+                    !ima_adpcm_block_valid(format->frame_bytes, format->channels)) {
+                    return WAV_STREAM_ERR_UNSUPPORTED;
+                }
+                format->adpcm = true;
+                format->bytes_per_sample = 2;
+            } else {
+                format->bytes_per_sample = format->channels ? format->frame_bytes / format->channels : 0;
+                if (tag != WAV_FORMAT_PCM || (format->channels != 1 && format->channels != 2) ||
+                    format->bytes_per_sample < 2 || format->bytes_per_sample > 4 ||
+                    format->bytes_per_sample * format->channels != format->frame_bytes) {
+                    return WAV_STREAM_ERR_UNSUPPORTED;
+                }
+            }
+            lseek(fd, size - n + (size & 1), SEEK_CUR);
+            have_fmt = true;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            struct stat st;
+            if (!have_fmt) {
+                return WAV_STREAM_ERR_FORMAT;
+            }
+            if (fstat(fd, &st) != 0) {
+                return WAV_STREAM_ERR_IO;
+            }
+            format->data_pos = lseek(fd, 0, SEEK_CUR);
+            // Streaming writers often leave the size at 0 or 0xFFFFFFFF
+            format->data_end = MIN((size_t)st.st_size, format->data_pos + (size_t)size);
+            if (size == 0 || size == UINT32_MAX) {
+                format->data_end = st.st_size;
+            }
+            // Drops a trailing partial frame, or partial ADPCM block
+            format->data_end -= (format->data_end - format->data_pos) % format->frame_bytes;
+            return WAV_STREAM_OK;
+        } else if (memcmp(chunk, "fact", 4) == 0 && size >= 4) {
+            uint8_t fact[4];
+            if (read(fd, fact, sizeof(fact)) != sizeof(fact)) {
+                return WAV_STREAM_ERR_FORMAT;
+            }
+            format->total_frames = wav_le32(fact);
+            lseek(fd, size - sizeof(fact) + (size & 1), SEEK_CUR);
+        } else {
+            lseek(fd, size + (size & 1), SEEK_CUR);
+        }
+    }
+}
+
+wav_stream_err_t wav_stream_open(wav_stream_t *s, int fd)
+{
+    wav_stream_err_t err = wav_stream_parse(fd, &s->format);
+    if (err != WAV_STREAM_OK) {
+        return err;
+    }
+    s->fd = fd;
+    s->file_pos = s->format.data_pos & ~((size_t)WAV_STREAM_BLOCK_BYTES - 1);
+    lseek(fd, s->file_pos, SEEK_SET);
+    s->fill_idx = 0;
+    s->read_error = false;
+    atomic_store_explicit(&s->played_frames, 0, memory_order_relaxed);
+    return WAV_STREAM_OK;
+}
+
+void wav_stream_close(wav_stream_t *s)
+{
+    if (s->fd >= 0) {
+        close(s->fd);
+        s->fd = -1;
+    }
+}
+
+bool wav_stream_fill(wav_stream_t *s)
+{
+    while (s->fd >= 0) {
+        wav_stream_block_t *b = &s->block[s->fill_idx];
+        if (atomic_load_explicit(&b->full, memory_order_acquire)) {
+            return false;
+        }
+
+        ssize_t n = read(s->fd, b->data, WAV_STREAM_BLOCK_BYTES);
+        if (n < 0) {
+            s->read_error = true;
+            n = 0;
+        }
+        size_t block_pos = s->file_pos;
+        s->file_pos += n;
+
+        const size_t data_pos = s->format.data_pos;
+        const size_t data_end = s->format.data_end;
+        b->start = data_pos > block_pos ? MIN(data_pos - block_pos, (size_t)n) : 0;
+        b->end = s->file_pos > data_end ? (data_end > block_pos ? data_end - block_pos : 0) : (size_t)n;
+        if (b->end > b->start) {
+            atomic_store_explicit(&b->full, true, memory_order_release);
+            s->fill_idx ^= 1;
+        }
+        if (n < WAV_STREAM_BLOCK_BYTES || s->file_pos >= data_end) {
+            wav_stream_close(s);
+            return true;
+        }
+    }
+    return true;
+}
+
+void wav_stream_release(wav_stream_t *s)
+{
+    s->play_idx = 0;
+    s->play_pos = 0;
+    s->adpcm.frames = 0;
+    s->adpcm.pos = 0;
+    atomic_store_explicit(&s->block[0].full, false, memory_order_relaxed);
+    atomic_store_explicit(&s->block[1].full, false, memory_order_release);
+}
+
+// Copies up to `max_frames` whole frames out of the blocks. A frame may straddle the
+// two blocks, so only what is complete across both is taken.
+static size_t wav_gather(wav_stream_t *s, uint8_t *dst, size_t max_frames)
+{
+    const size_t frame_bytes = s->format.frame_bytes;
+    size_t avail = 0;
+    for (int i = 0; i < 2; i++) {
+        const wav_stream_block_t *b = &s->block[(s->play_idx + i) & 1];
+        if (!atomic_load_explicit(&b->full, memory_order_acquire)) {
+            break;
+        }
+        avail += b->end - (i == 0 ? MAX(s->play_pos, b->start) : b->start);
+    }
+
+    size_t frames = MIN(max_frames, avail / frame_bytes);
+    size_t want = frames * frame_bytes;
+    while (want > 0) {
+        wav_stream_block_t *b = &s->block[s->play_idx];
+        s->play_pos = MAX(s->play_pos, b->start);
+        size_t n = MIN(want, b->end - s->play_pos);
+        memcpy(dst, b->data + s->play_pos, n);
+        dst += n;
+        want -= n;
+        s->play_pos += n;
+        if (s->play_pos == b->end) {
+            s->play_pos = 0;
+            s->play_idx ^= 1;
+            atomic_store_explicit(&b->full, false, memory_order_release);
+            if (s->released) {
+                s->released(s->ctx);
+            }
+        }
+    }
+    return frames;
+}
+
+size_t wav_stream_read(wav_stream_t *s, uint8_t *out, size_t frames, int out_bytes, int out_channels)
+{
+    const wav_stream_format_t *f = &s->format;
+    // Any container width to the output's, mono duplicated, stereo averaged down to mono.
+    // Never NULL: the layout was checked on open.
+    audio_convert_fn_t convert = audio_convert_select(f->bytes_per_sample, f->channels, out_bytes, out_channels);
+    const size_t out_frame = (size_t)out_channels * out_bytes;
+    uint32_t played = atomic_load_explicit(&s->played_frames, memory_order_relaxed);
+    if (f->total_frames) {
+        frames = MIN(frames, f->total_frames - MIN(f->total_frames, played));
+    }
+
+    size_t done = 0;
+    while (done < frames) {
+        size_t n;
+        if (f->adpcm) {
+            if (ima_adpcm_block_done(&s->adpcm)) {
+                if (wav_gather(s, s->adpcm_block, 1) == 0) {
+                    break;
+                }
+                ima_adpcm_decoder_start(&s->adpcm, s->adpcm_block, f->frame_bytes, f->channels);
+            }
+            n = ima_adpcm_decode(&s->adpcm, (int16_t *)s->gather, MIN(frames - done, sizeof(s->gather) / (2 * f->channels)));
+        } else {
+            n = wav_gather(s, s->gather, MIN(frames - done, sizeof(s->gather) / f->frame_bytes));
+            if (n == 0) {
+                break;
+            }
+        }
+        convert(out + done * out_frame, s->gather, n);
+        done += n;
+    }
+    atomic_store_explicit(&s->played_frames, played + done, memory_order_relaxed);
+    return done;
+}
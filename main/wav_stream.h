@@ -0,0 +1,111 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ima_adpcm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Streaming half of the WAV player (wav_player.h): parses a file's header and moves its
+// PCM through two block buffers, from a reader that fills them with block-aligned reads
+// to a writer that drains them in whole frames, converted to the output layout.
+//
+// The reader calls wav_stream_fill() whenever it is told a block was released; the
+// writer calls wav_stream_read() and wav_stream_release(). Each side touches only its
+// own fields, and the blocks change hands through their `full` flags, so the two can
+// run in different tasks without a lock. wav_stream_open() may only be called while the
+// writer has let go of the stream.
+// tools/wav_player_test.c plays files through it into a simulated sink.
+
+#define WAV_STREAM_BLOCK_BYTES     (4096)   // A multiple of the FAT cluster size
+#define WAV_STREAM_GATHER_BYTES    (1536)   // One 2 ms writer chunk at 96 kHz, 32-bit stereo
+#define WAV_STREAM_ADPCM_BLOCK_MAX (2048)   // 1024 bytes per channel, 43 ms at 48 kHz
+
+typedef enum {
+    WAV_STREAM_OK = 0,
+    WAV_STREAM_ERR_FORMAT,          // Not RIFF/WAVE, or the chunks are malformed
+    WAV_STREAM_ERR_UNSUPPORTED,     // An encoding or layout that can't be played
+    WAV_STREAM_ERR_IO,
+} wav_stream_err_t;
+
+typedef struct {
+    uint16_t format_tag;
+    uint32_t sample_rate;
+    uint8_t bits_per_sample;
+    uint8_t channels;
+    uint8_t bytes_per_sample;       // Container size: 2, 3 or 4; decoded size for ADPCM
+    uint16_t frame_bytes;           // Unit the blocks are consumed in: a frame, or an ADPCM block
+    bool adpcm;
+    uint32_t total_frames;          // From the fact chunk, 0 if unknown
+    size_t data_pos;                // Encoded bytes are [data_pos, data_end) in the file
+    size_t data_end;
+} wav_stream_format_t;
+
+typedef struct {
+    uint8_t *data;                  // WAV_STREAM_BLOCK_BYTES
+    size_t start;                   // Valid bytes are [start, end)
+    size_t end;
+    _Atomic bool full;              // Set by the reader, cleared by the writer once drained
+} wav_stream_block_t;
+
+typedef struct {
+    wav_stream_format_t format;     // Written by wav_stream_open(), read-only after
+    wav_stream_block_t block[2];
+    void (*released)(void *ctx);    // The writer drained a block; the reader should fill
+    void *ctx;
+
+    // Reader side
+    int fd;                         // -1 once the file is fully read
+    size_t file_pos;                // Next read offset, always a multiple of WAV_STREAM_BLOCK_BYTES
+    int fill_idx;
+    bool read_error;
+
+    // Writer side
+    int play_idx;
+    size_t play_pos;
+    _Atomic uint32_t played_frames;
+    ima_adpcm_decoder_t adpcm;
+    uint8_t adpcm_block[WAV_STREAM_ADPCM_BLOCK_MAX];
+    uint8_t gather[WAV_STREAM_GATHER_BYTES] __attribute__((aligned(4)));
+} wav_stream_t;
+
+// `block0` and `block1` hold WAV_STREAM_BLOCK_BYTES each; `released` may be NULL.
+void wav_stream_init(wav_stream_t *s, uint8_t *block0, uint8_t *block1, void (*released)(void *ctx), void *ctx);
+
+// Walks the RIFF chunks of the file open as `fd` up to "data" and leaves it positioned
+// there. Fails for layouts the player can't play; `format` is filled in as far as the
+// header was read either way.
+wav_stream_err_t wav_stream_parse(int fd, wav_stream_format_t *format);
+
+// Parses `fd` and takes it over, positioned at the block the data starts in. On
+// failure the caller keeps the file.
+wav_stream_err_t wav_stream_open(wav_stream_t *s, int fd);
+
+// Closes the file, if still open. Reader side.
+void wav_stream_close(wav_stream_t *s);
+
+// Reads whole blocks into the buffers the writer has released. Every read starts at a
+// block-aligned file offset, so FatFs transfers whole clusters straight into the buffer
+// without going through its sector window. Closes the file and returns true once it is
+// fully read; a failed read ends it early and sets `read_error`.
+bool wav_stream_fill(wav_stream_t *s);
+
+// Converts up to `frames` frames to `out_bytes` per sample and `out_channels`, whole
+// frames only, and stops at the fact chunk's frame count. Returns the frames produced;
+// 0 when both blocks are empty. Writer side.
+size_t wav_stream_read(wav_stream_t *s, uint8_t *out, size_t frames, int out_bytes, int out_channels);
+
+// Hands both blocks back to the reader and forgets the writer's position. Writer side.
+void wav_stream_release(wav_stream_t *s);
+
+static inline uint32_t wav_stream_played_frames(wav_stream_t *s)
+{
+    return atomic_load_explicit(&s->played_frames, memory_order_relaxed);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,291 @@
+// Host tool: drives audio_ring with simulated USB packet timing and a simulated I2S sink,
+// then with a real producer and consumer thread. Every frame carries a counter, so any
+// byte the ring loses, duplicates or reorders shows up at the sink. Prints one JSON
+// object and exits 1 on a data error, or on an underrun with the target main.c uses.
+//
+//   cc -O2 -pthread -Imain -o audio_ring_test tools/audio_ring_test.c main/audio_ring.c
+//   ./audio_ring_test [--seconds N] [--jitter-us J] [--frames N] [--seed S]
+//
+// The sink takes one DMA buffer per on_sent event in 2 ms chunks, the way the writer
+// task refills the I2S DMA, so the fill swings by a whole buffer every period. The
+// cases compare the old fixed 10 ms target with the one sized from the DMA buffer
+// (EXAMPLE_AUDIO_RING_MARGIN_MS on top), at 48 kHz, 16-bit stereo, full speed.
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audio_ring.h"
+
+#define TEST_RATE          (48000)
+#define TEST_FRAME_BYTES   (4)      // A 32-bit frame counter in place of two 16-bit samples
+#define TEST_RING_SIZE     (16384)  // EXAMPLE_AUDIO_RING_SIZE
+#define TEST_CHUNK_MS      (2)      // EXAMPLE_AUDIO_WRITE_CHUNK_MS
+#define TEST_MARGIN_MS     (5)      // EXAMPLE_AUDIO_RING_MARGIN_MS
+#define TEST_DMA_FRAMES    (1023)   // i2s_dma_frames_for() at 48 kHz, 16-bit stereo
+#define TEST_USB_FPS       (1000)
+
+typedef struct {
+    const char *name;
+    size_t target_frames;
+    uint32_t stall_at_ms;           // The sink stops taking buffers for stall_ms from here
+    uint32_t stall_ms;
+    bool must_not_underrun;
+} ring_case_t;
+
+typedef struct {
+    uint64_t packets;
+    uint64_t frames_out;
+    uint32_t fill_min, fill_max;
+    uint32_t errors;
+} case_result_t;
+
+static uint32_t s_errors;
+
+static void check_frame(uint32_t got, uint32_t *expect, uint32_t *errors, const char *what)
+{
+    if (got != *expect) {
+        if (*errors < 5) {
+            fprintf(stderr, "%s: frame %u where %u was due\n", what, got, *expect);
+        }
+        (*errors)++;
+        *expect = got;
+    }
+    (*expect)++;
+}
+
+// Producer side as uac_device_rx_cb does it: reserve, fill in place around the wrap, commit
+static bool produce(audio_ring_t *ring, uint32_t *counter, uint32_t frames)
+{
+    size_t len = (size_t)frames * TEST_FRAME_BYTES;
+    if (!audio_ring_reserve(ring, len)) {
+        return false;
+    }
+    for (size_t done = 0; done < len;) {
+        size_t contig;
+        uint8_t *dst = audio_ring_write_ptr(ring, done, &contig);
+        size_t n = contig < len - done ? contig : len - done;
+        for (size_t i = 0; i < n; i += TEST_FRAME_BYTES) {
+            memcpy(dst + i, counter, TEST_FRAME_BYTES);
+            (*counter)++;
+        }
+        done += n;
+    }
+    audio_ring_commit(ring, len);
+    return true;
+}
+
+static case_result_t run_case(const ring_case_t *c, double seconds, double jitter_us)
+{
+    static uint8_t storage[TEST_RING_SIZE];
+    audio_ring_t ring;
+    case_result_t r = { .fill_min = UINT32_MAX };
+    if (!audio_ring_init(&ring, storage, sizeof(storage), TEST_FRAME_BYTES, c->target_frames * TEST_FRAME_BYTES)) {
+        fprintf(stderr, "%s: invalid ring configuration\n", c->name);
+        r.errors++;
+        return r;
+    }
+    const size_t chunk_bytes = audio_ring_bytes_for_ms(TEST_CHUNK_MS, TEST_RATE, TEST_FRAME_BYTES);
+    const double dma_period_us = TEST_DMA_FRAMES * 1e6 / TEST_RATE;
+    uint32_t produced = 0, expect = 0;
+    double next_packet = 0, next_sent = dma_period_us, host_acc = 0;
+    bool started = false;
+
+    const uint64_t end_us = (uint64_t)(seconds * 1e6);
+    for (uint64_t now = 0; now < end_us; now++) {
+        if (now >= next_packet) {
+            host_acc += (double)TEST_RATE / TEST_USB_FPS;
+            uint32_t frames = (uint32_t)host_acc;
+            host_acc -= frames;
+            if (produce(&ring, &produced, frames)) {
+                r.packets++;
+            }
+            next_packet += 1e6 / TEST_USB_FPS + (jitter_us > 0 ? jitter_us * (rand() / (double)RAND_MAX - 0.5) : 0);
+        }
+        if (now < next_sent) {
+            continue;
+        }
+        next_sent += dma_period_us;
+        uint32_t ms = (uint32_t)(now / 1000);
+        if (c->stall_ms && ms >= c->stall_at_ms && ms < c->stall_at_ms + c->stall_ms) {
+            continue;
+        }
+
+        // One freed DMA buffer: the writer peeks chunks until it is full or the ring is dry
+        size_t fill = audio_ring_fill(&ring) / TEST_FRAME_BYTES;
+        if (started && fill > r.fill_max) {
+            r.fill_max = (uint32_t)fill;
+        }
+        for (size_t want = TEST_DMA_FRAMES * TEST_FRAME_BYTES; want > 0;) {
+            uint8_t *data;
+            size_t len = audio_ring_peek(&ring, &data, want < chunk_bytes ? want : chunk_bytes);
+            if (len == 0) {
+                break;
+            }
+            started = true;
+            for (size_t i = 0; i < len; i += TEST_FRAME_BYTES) {
+                uint32_t frame;
+                memcpy(&frame, data + i, TEST_FRAME_BYTES);
+                check_frame(frame, &expect, &r.errors, c->name);
+            }
+            audio_ring_consume(&ring, len);
+            r.frames_out += len / TEST_FRAME_BYTES;
+            want -= len;
+        }
+        // The low point of the swing, right after the buffer was refilled
+        fill = audio_ring_fill(&ring) / TEST_FRAME_BYTES;
+        if (started && fill < r.fill_min) {
+            r.fill_min = (uint32_t)fill;
+        }
+    }
+
+    bool underran = c->must_not_underrun && atomic_load(&ring.underruns) != 0;
+    s_errors += r.errors + underran;
+    printf("\n    {\"name\": \"%s\", \"target_frames\": %zu, \"packets\": %llu, \"frames_out\": %llu, "
+           "\"overruns\": %u, \"underruns\": %u, \"fill_min\": %u, \"fill_max\": %u, \"high_water\": %zu, \"errors\": %u}",
+           c->name, c->target_frames, (unsigned long long)r.packets, (unsigned long long)r.frames_out,
+           (unsigned)atomic_load(&ring.overruns), (unsigned)atomic_load(&ring.underruns),
+           r.fill_min == UINT32_MAX ? 0 : r.fill_min, r.fill_max,
+           atomic_load(&ring.high_water) / TEST_FRAME_BYTES, r.errors);
+    return r;
+}
+
+// --- Threaded: a real producer and consumer on the same ring, random sizes ---
+
+typedef struct {
+    audio_ring_t ring;
+    uint32_t frames;
+    unsigned seed;
+    uint64_t full_spins;
+    uint32_t errors;
+    _Atomic bool done;
+} thread_test_t;
+
+static void *producer_thread(void *arg)
+{
+    thread_test_t *t = arg;
+    uint32_t counter = 0;
+    unsigned seed = t->seed;
+    while (counter < t->frames) {
+        uint32_t frames = 1 + rand_r(&seed) % 97;
+        if (frames > t->frames - counter) {
+            frames = t->frames - counter;
+        }
+        // A full ring drops the packet on the device; here the same packet is retried so
+        // the consumer can expect every frame
+        while (!produce(&t->ring, &counter, frames)) {
+            t->full_spins++;
+            sched_yield();
+        }
+    }
+    atomic_store(&t->done, true);
+    return NULL;
+}
+
+static void *consumer_thread(void *arg)
+{
+    thread_test_t *t = arg;
+    uint32_t expect = 0;
+    unsigned seed = t->seed ^ 0x5a5a5a5a;
+    uint8_t copy[512 * TEST_FRAME_BYTES];
+    while (expect < t->frames) {
+        size_t want = (1 + rand_r(&seed) % 512) * TEST_FRAME_BYTES;
+        size_t len;
+        const uint8_t *data;
+        uint8_t *peeked;
+        if (rand_r(&seed) & 1) {
+            len = audio_ring_read(&t->ring, copy, want);
+            data = copy;
+        } else {
+            len = audio_ring_peek(&t->ring, &peeked, want);
+            data = peeked;
+        }
+        if (len == 0 && atomic_load(&t->done) && audio_ring_fill(&t->ring) < t->ring.target) {
+            // The tail of the stream is below the priming level and never plays
+            break;
+        }
+        if (len == 0) {
+            sched_yield();
+        }
+        for (size_t i = 0; i < len; i += TEST_FRAME_BYTES) {
+            uint32_t frame;
+            memcpy(&frame, data + i, TEST_FRAME_BYTES);
+            check_frame(frame, &expect, &t->errors, "threaded");
+        }
+        if (data != copy && len) {
+            audio_ring_consume(&t->ring, len);
+        }
+    }
+    return NULL;
+}
+
+static void run_threaded(uint32_t frames, unsigned seed)
+{
+    static uint8_t storage[TEST_RING_SIZE];
+    static thread_test_t t;
+    t.frames = frames;
+    t.seed = seed;
+    atomic_init(&t.done, false);
+    audio_ring_init(&t.ring, storage, sizeof(storage), TEST_FRAME_BYTES,
+                    (TEST_DMA_FRAMES + TEST_RATE / 1000 * TEST_MARGIN_MS) * TEST_FRAME_BYTES);
+    pthread_t prod, cons;
+    pthread_create(&cons, NULL, consumer_thread, &t);
+    pthread_create(&prod, NULL, producer_thread, &t);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+    s_errors += t.errors;
+    printf("  \"threaded\": {\"frames\": %u, \"full_spins\": %llu, \"underruns\": %u, \"errors\": %u},\n",
+           frames, (unsigned long long)t.full_spins, (unsigned)atomic_load(&t.ring.underruns), t.errors);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 30, jitter_us = 500;
+    uint32_t frames = 10000000;
+    unsigned seed = 1;
+    static const struct option opts[] = {
+        { "seconds", required_argument, NULL, 's' },
+        { "jitter-us", required_argument, NULL, 'j' },
+        { "frames", required_argument, NULL, 'f' },
+        { "seed", required_argument, NULL, 'r' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 's': seconds = atof(optarg); break;
+        case 'j': jitter_us = atof(optarg); break;
+        case 'f': frames = strtoul(optarg, NULL, 0); break;
+        case 'r': seed = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s [--seconds N] [--jitter-us J] [--frames N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+    }
+    srand(seed);
+
+    const size_t sized = TEST_DMA_FRAMES + TEST_RATE / 1000 * TEST_MARGIN_MS;
+    const ring_case_t cases[] = {
+        { "fixed_10ms", TEST_RATE / 1000 * 10, 0, 0, false },
+        { "dma_sized", sized, 0, 0, true },
+        // The sink stalls past the ring's capacity: whole packets are dropped, never torn
+        { "dma_sized_stall", sized, 1000, 200, false },
+    };
+
+    printf("{\n  \"config\": {\"seconds\": %.1f, \"jitter_us\": %.0f, \"dma_frames\": %u, \"seed\": %u},\n",
+           seconds, jitter_us, TEST_DMA_FRAMES, seed);
+    run_threaded(frames, seed);
+    printf("  \"cases\": [");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (i) {
+            printf(",");
+        }
+        run_case(&cases[i], seconds, jitter_us);
+    }
+    printf("\n  ],\n  \"errors\": %u\n}\n", s_errors);
+    return s_errors ? 1 : 0;
+}
@@ -0,0 +1,459 @@
+// Host tool: runs the speaker path of main.c (jitter ring, feedback engine or
+// resampler, DSP) against a simulated USB host and I2S DMA in simulated time, so audio
+// path changes can be benchmarked without flashing. Prints one JSON object.
+//
+//   cc -O2 -Imain -o audio_sim tools/audio_sim.c main/audio_ring.c main/audio_feedback.c main/audio_resampler.c main/audio_dsp.c -lm
+//   ./audio_sim [options]
+//
+//   --seconds N         simulated time (30)
+//   --mode M            feedback: host follows the feedback endpoint (default),
+//                       resampler: host ignores it and the device resamples,
+//                       none: neither, the ring drifts
+//   --host-ppm P        host SOF clock against the device timer (0)
+//   --codec-ppm P       I2S clock against the device timer (0)
+//   --jitter-us J       packets arrive up to J us late (0)
+//   --burst-every MS    every MS milliseconds the host stalls ...
+//   --burst-len MS      ... for MS milliseconds and then sends everything at once
+//   --trace FILE        replay "<arrival_us> <frames>" lines instead of the host model
+//   --channels N        speaker channels, 1 or 2 (1, CONFIG_UAC_SPEAKER_CHANNEL_NUM)
+//   --settle N          seconds of start-up left out of the "settled" counts (5)
+//   --seed S
+//
+// The constants mirror main.c for 48 kHz, 16-bit on a full-speed bus. Latency is the
+// time a packet's first frame waits in the ring and the DMA queue. CPU time is host time
+// per stage, useful for comparing builds, not as a target figure.
+//
+// A stream start moves the primed ring straight into the free DMA buffers, so the ring
+// runs low, and may re-prime, until the drift loop has built it back up. Those start-up
+// underruns are part of the totals; the "settled" counts are the ones after --settle,
+// which is what a listener hears mid-stream.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "audio_ring.h"
+#include "audio_feedback.h"
+#include "audio_resampler.h"
+#include "audio_dsp.h"
+
+#define SIM_RATE           (48000)
+#define SIM_RING_SIZE      (16384)  // EXAMPLE_AUDIO_RING_SIZE
+#define SIM_RING_MARGIN_MS (5)    // EXAMPLE_AUDIO_RING_MARGIN_MS
+#define SIM_WRITE_CHUNK_MS (2)
+#define SIM_FB_PERIOD_MS   (10)
+#define SIM_DMA_DESC_NUM   (6)
+#define SIM_DMA_FRAME_NUM  (1248)
+#define SIM_DMA_BUF_MAX    (4092)
+#define SIM_USB_FPS        (1000)
+#define SIM_PKT_QUEUE      (4096)   // Packets in flight between host and device
+
+typedef enum { MODE_FEEDBACK, MODE_RESAMPLER, MODE_NONE } sim_mode_t;
+typedef enum { STAGE_USB_RX, STAGE_RING, STAGE_FEEDBACK, STAGE_RESAMPLER, STAGE_DSP, STAGE_COUNT } sim_stage_t;
+static const char *const s_stage_names[STAGE_COUNT] = { "usb_rx", "ring", "feedback", "resampler", "dsp" };
+
+typedef struct {
+    double *v;
+    size_t n, cap;
+} series_t;
+
+typedef struct {
+    uint64_t ns;
+    uint64_t calls;
+} stage_t;
+
+typedef struct {
+    double arrival_us;
+    uint32_t frames;
+} packet_t;
+
+static stage_t s_stage[STAGE_COUNT];
+
+static uint64_t cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+#define STAGE(id, ...) do {                     \
+        uint64_t t0_ = cpu_ns();                \
+        __VA_ARGS__;                            \
+        s_stage[id].ns += cpu_ns() - t0_;       \
+        s_stage[id].calls++;                    \
+    } while (0)
+
+static void series_add(series_t *s, double v)
+{
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 4096;
+        s->v = realloc(s->v, s->cap * sizeof(double));
+    }
+    s->v[s->n++] = v;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_series(const char *name, series_t *s, const char *tail)
+{
+    if (s->n == 0) {
+        printf("  \"%s\": null%s\n", name, tail);
+        return;
+    }
+    qsort(s->v, s->n, sizeof(double), cmp_double);
+    double sum = 0;
+    for (size_t i = 0; i < s->n; i++) {
+        sum += s->v[i];
+    }
+    printf("  \"%s\": {\"n\": %zu, \"min\": %.1f, \"mean\": %.1f, \"p1\": %.1f, \"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f}%s\n",
+           name, s->n, s->v[0], sum / s->n, s->v[s->n / 100], s->v[s->n / 2], s->v[s->n * 99 / 100], s->v[s->n - 1], tail);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 30, host_ppm = 0, codec_ppm = 0, jitter_us = 0, settle_s = 5;
+    int channels = 1;
+    uint32_t burst_every = 0, burst_len = 0;
+    unsigned seed = 1;
+    sim_mode_t mode = MODE_FEEDBACK;
+    const char *trace_path = NULL;
+
+    static const struct option opts[] = {
+        { "seconds", required_argument, NULL, 's' },
+        { "mode", required_argument, NULL, 'm' },
+        { "host-ppm", required_argument, NULL, 'h' },
+        { "codec-ppm", required_argument, NULL, 'c' },
+        { "jitter-us", required_argument, NULL, 'j' },
+        { "burst-every", required_argument, NULL, 'e' },
+        { "burst-len", required_argument, NULL, 'l' },
+        { "trace", required_argument, NULL, 't' },
+        { "channels", required_argument, NULL, 'n' },
+        { "settle", required_argument, NULL, 'S' },
+        { "seed", required_argument, NULL, 'r' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 's': seconds = atof(optarg); break;
+        case 'h': host_ppm = atof(optarg); break;
+        case 'c': codec_ppm = atof(optarg); break;
+        case 'j': jitter_us = atof(optarg); break;
+        case 'e': burst_every = strtoul(optarg, NULL, 0); break;
+        case 'l': burst_len = strtoul(optarg, NULL, 0); break;
+        case 't': trace_path = optarg; break;
+        case 'n': channels = atoi(optarg); break;
+        case 'S': settle_s = atof(optarg); break;
+        case 'r': seed = strtoul(optarg, NULL, 0); break;
+        case 'm':
+            if (strcmp(optarg, "feedback") == 0) {
+                mode = MODE_FEEDBACK;
+            } else if (strcmp(optarg, "resampler") == 0) {
+                mode = MODE_RESAMPLER;
+            } else if (strcmp(optarg, "none") == 0) {
+                mode = MODE_NONE;
+            } else {
+                fprintf(stderr, "unknown mode %s\n", optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [--seconds N] [--mode feedback|resampler|none] [--host-ppm P] [--codec-ppm P]\n"
+                    "       [--jitter-us J] [--burst-every MS --burst-len MS] [--trace FILE] [--channels N]\n"
+                    "       [--settle N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (channels < 1 || channels > AUDIO_RS_MAX_CH) {
+        fprintf(stderr, "--channels must be 1 or 2\n");
+        return 1;
+    }
+    const uint32_t frame_bytes = channels * 2;
+    srand(seed);
+
+    FILE *trace = NULL;
+    if (trace_path && (trace = fopen(trace_path, "r")) == NULL) {
+        perror(trace_path);
+        return 1;
+    }
+
+    // --- Device side, set up as audio_stream_setup() does ---
+    // i2s_dma_frames_for() at the default rate
+    uint32_t dma_frames = SIM_DMA_FRAME_NUM;
+    if (dma_frames > SIM_DMA_BUF_MAX / frame_bytes) {
+        dma_frames = SIM_DMA_BUF_MAX / frame_bytes;
+    }
+    const size_t target = dma_frames * frame_bytes + audio_ring_bytes_for_ms(SIM_RING_MARGIN_MS, SIM_RATE, frame_bytes);
+    static uint8_t ring_storage[SIM_RING_SIZE];
+    static audio_ring_t ring;
+    const size_t chunk_bytes = audio_ring_bytes_for_ms(SIM_WRITE_CHUNK_MS, SIM_RATE, frame_bytes);
+    if (!audio_ring_init(&ring, ring_storage, SIM_RING_SIZE, frame_bytes, target)) {
+        fprintf(stderr, "invalid ring configuration\n");
+        return 1;
+    }
+    static audio_fb_t fb;
+    audio_fb_init(&fb, SIM_RATE, SIM_USB_FPS, target / frame_bytes, SIM_FB_PERIOD_MS * 1000);
+    static audio_rs_t rs;
+    audio_rs_init(&rs, channels);
+    static audio_dsp_t dsp;
+    audio_dsp_params_t params;
+    audio_dsp_default_params(&params);
+    audio_dsp_init(&dsp, SIM_RATE, channels);
+    audio_dsp_configure(&dsp, &params);
+
+    const size_t resampled_bytes = chunk_bytes + 2 * frame_bytes;
+    int16_t *resampled = malloc(resampled_bytes);
+
+    // --- Simulation state ---
+    static packet_t pkts[SIM_PKT_QUEUE];
+    size_t pkt_head = 0, pkt_tail = 0;
+    double next_sof = 0, host_acc = 0, last_arrival = 0;
+    const double sof_period = 1e6 / SIM_USB_FPS / (1 + host_ppm * 1e-6);
+    uint32_t host_feedback_q16 = 0;     // Last value the host read; 0 until the device sends one
+    double sine_phase = 0;
+    bool trace_done = false;
+
+    // The I2S DMA plays a circle of SIM_DMA_DESC_NUM buffers without pause; buffer k of
+    // the play sequence starts at k * dma_period_us. A buffer is handed back to the
+    // writer when it has been sent, to be played a full circle later, so the writer's
+    // buffer `dma_w` is free once dma_w < sent + SIM_DMA_DESC_NUM. If the DMA reaches it
+    // first, that buffer plays (partly) cleared: an audible dropout.
+    const double codec_rate = SIM_RATE * (1 + codec_ppm * 1e-6);
+    const double dma_period_us = dma_frames * 1e6 / codec_rate;
+    uint64_t dma_sent = 0;
+    uint64_t dma_w = SIM_DMA_DESC_NUM;  // The first buffer after the first on_sent
+    uint32_t dma_off = 0;               // Frames already in buffer dma_w
+    bool dma_started = false;
+    uint64_t starved_frames = 0, starve_events = 0;
+
+    enum { W_WAIT, W_RUN, W_WRITE } wstate = W_RUN;
+    double wake_at = 0;
+    bool notified = false, streaming = false;
+    uint8_t *chunk = NULL;
+    size_t chunk_len = 0;
+    uint32_t write_left = 0, write_total = 0;
+    double write_start = 0;
+    double stream_written = 0;
+    uint32_t stream_starts = 0;         // Fade-ins: the stream's first chunk, or after the DMA ran dry
+
+    series_t latency = { 0 }, fill = { 0 }, block = { 0 }, feedback_ppm = { 0 }, resampler_ppm = { 0 };
+    uint64_t packets = 0;
+
+    const uint64_t end_us = (uint64_t)(seconds * 1e6);
+    const uint64_t settle_us = (uint64_t)(settle_s * 1e6);
+    uint32_t settle_underruns = 0, settle_overruns = 0;
+    uint64_t settle_starve_events = 0;
+    for (uint64_t now = 0; now < end_us; now++) {
+        if (now == settle_us) {
+            settle_underruns = atomic_load(&ring.underruns);
+            settle_overruns = atomic_load(&ring.overruns);
+            settle_starve_events = starve_events;
+        }
+        // Host: one packet per SOF, sized from the feedback value if it follows it
+        if (trace) {
+            while (!trace_done && pkt_head - pkt_tail < SIM_PKT_QUEUE && (pkt_head == pkt_tail || pkts[(pkt_head - 1) % SIM_PKT_QUEUE].arrival_us <= now)) {
+                double t;
+                unsigned frames;
+                if (fscanf(trace, "%lf %u", &t, &frames) != 2) {
+                    trace_done = true;
+                    break;
+                }
+                pkts[pkt_head++ % SIM_PKT_QUEUE] = (packet_t) { t, frames };
+            }
+        } else if (now >= next_sof) {
+            double per_frame = (double)SIM_RATE / SIM_USB_FPS;
+            if (mode == MODE_FEEDBACK && host_feedback_q16) {
+                per_frame = host_feedback_q16 / 65536.0;
+            }
+            host_acc += per_frame;
+            uint32_t frames = (uint32_t)host_acc;
+            host_acc -= frames;
+
+            double arrival = next_sof + (jitter_us > 0 ? jitter_us * rand() / RAND_MAX : 0);
+            if (burst_every && burst_len) {
+                uint64_t ms = (uint64_t)(next_sof / 1000);
+                if (ms % burst_every < burst_len) {
+                    arrival = (double)(ms - ms % burst_every + burst_len) * 1000;
+                }
+            }
+            last_arrival = arrival > last_arrival ? arrival : last_arrival;
+            if (pkt_head - pkt_tail < SIM_PKT_QUEUE) {
+                pkts[pkt_head++ % SIM_PKT_QUEUE] = (packet_t) { last_arrival, frames };
+            }
+            next_sof += sof_period;
+        }
+
+        // Device: uac_device_rx_cb for every packet that has arrived
+        while (pkt_tail != pkt_head && pkts[pkt_tail % SIM_PKT_QUEUE].arrival_us <= now) {
+            packet_t p = pkts[pkt_tail++ % SIM_PKT_QUEUE];
+            size_t len = p.frames * frame_bytes;
+            uint32_t ahead = (audio_ring_fill(&ring) - (chunk ? (write_total - write_left) * frame_bytes : 0)) / frame_bytes;
+            bool ok;
+            STAGE(STAGE_USB_RX, {
+                ok = audio_ring_reserve(&ring, len);
+                for (size_t done = 0; ok && done < len;) {
+                    size_t contig;
+                    int16_t *dst = (int16_t *)audio_ring_write_ptr(&ring, done, &contig);
+                    size_t n = contig < len - done ? contig : len - done;
+                    for (size_t i = 0; i < n / 2; i += channels) {
+                        for (int c = 0; c < channels; c++) {
+                            dst[i + c] = (int16_t)(16384 * sin(sine_phase));
+                        }
+                        sine_phase += 2 * M_PI * 1000 / SIM_RATE;
+                    }
+                    done += n;
+                }
+                if (ok) {
+                    audio_ring_commit(&ring, len);
+                }
+            });
+            if (ok) {
+                packets++;
+                double play_us = (dma_w * dma_frames + dma_off + ahead) * 1e6 / codec_rate;
+                series_add(&latency, play_us > now ? play_us - now : 0);
+                notified = true;
+            }
+        }
+
+        // I2S DMA: on_sent at the end of every buffer
+        while ((dma_sent + 1) * dma_period_us <= now) {
+            dma_sent++;
+            audio_fb_dma_done(&fb, dma_frames, (uint32_t)now);
+        }
+
+        // Writer task: one loop iteration of audio_writer_task per step
+        if (wstate == W_WAIT && (notified || now >= wake_at)) {
+            notified = false;
+            wstate = W_RUN;
+        }
+        if (wstate == W_RUN) {
+            STAGE(STAGE_RING, chunk_len = audio_ring_peek(&ring, &chunk, chunk_bytes));
+            size_t len = chunk_len;
+            if (mode == MODE_FEEDBACK) {
+                STAGE(STAGE_FEEDBACK, {
+                    if (!streaming) {
+                        audio_fb_reset(&fb);
+                    } else {
+                        uint32_t feedback;
+                        uint32_t fill_frames = (audio_ring_fill(&ring) - len) / frame_bytes;
+                        if (audio_fb_update(&fb, (uint32_t)now, fill_frames, &feedback)) {
+                            host_feedback_q16 = feedback;
+                            series_add(&feedback_ppm, (feedback / 65536.0 / (SIM_RATE / SIM_USB_FPS) - 1) * 1e6);
+                        }
+                    }
+                });
+            }
+            if (len == 0) {
+                // A re-prime keeps the stream, and the loop state, unless the DMA played out
+                if (now - stream_written >= SIM_DMA_DESC_NUM * dma_period_us) {
+                    streaming = false;
+                }
+                chunk = NULL;
+                wstate = W_WAIT;
+                wake_at = now + SIM_WRITE_CHUNK_MS * 1000;
+            } else {
+                int16_t *out = (int16_t *)chunk;
+                if (mode == MODE_RESAMPLER) {
+                    STAGE(STAGE_RESAMPLER, {
+                        if (!streaming) {
+                            audio_rs_reset(&rs);
+                        }
+                        uint32_t fill_frames = (audio_ring_fill(&ring) - len) / frame_bytes;
+                        audio_rs_track_fill(&rs, (uint32_t)now, fill_frames, target / frame_bytes);
+                        len = audio_rs_process(&rs, out, len / frame_bytes, resampled,
+                                               resampled_bytes / frame_bytes) * frame_bytes;
+                    });
+                    out = resampled;
+                }
+                STAGE(STAGE_DSP, audio_dsp_process_s16(&dsp, out, len / frame_bytes));
+                stream_starts += !streaming;
+                streaming = true;
+                write_total = write_left = len / frame_bytes;
+                write_start = now;
+                wstate = W_WRITE;
+            }
+        }
+        if (wstate == W_WRITE) {
+            // i2s_channel_write: copies into free buffers, blocks until the chunk is in
+            while (write_left > 0) {
+                if (dma_started && dma_w <= dma_sent) {
+                    // Already played: the writer resumes with the next buffer not yet started
+                    starve_events++;
+                    starved_frames += (dma_sent - dma_w + 1) * dma_frames - dma_off;
+                    dma_w = dma_sent + 1;
+                    dma_off = 0;
+                }
+                if (dma_w >= dma_sent + SIM_DMA_DESC_NUM) {
+                    break;
+                }
+                uint32_t n = dma_frames - dma_off < write_left ? dma_frames - dma_off : write_left;
+                dma_off += n;
+                write_left -= n;
+                dma_started = true;
+                if (dma_off == dma_frames) {
+                    dma_w++;
+                    dma_off = 0;
+                }
+            }
+            if (write_left == 0) {
+                series_add(&block, now - write_start);
+                STAGE(STAGE_RING, audio_ring_consume(&ring, chunk_len));
+                stream_written = now;
+                chunk = NULL;
+                wstate = W_RUN;
+            }
+        }
+
+        if (now % 1000 == 0 && dma_started) {
+            series_add(&fill, (double)audio_ring_fill(&ring) / frame_bytes);
+            if (mode == MODE_RESAMPLER) {
+                series_add(&resampler_ppm, rs.ppm);
+            }
+        }
+    }
+
+    printf("{\n");
+    printf("  \"config\": {\"seconds\": %.1f, \"mode\": \"%s\", \"host_ppm\": %.1f, \"codec_ppm\": %.1f, \"jitter_us\": %.0f, "
+           "\"channels\": %d, \"burst_every_ms\": %u, \"burst_len_ms\": %u, \"trace\": %s%s%s, \"seed\": %u},\n",
+           seconds, mode == MODE_FEEDBACK ? "feedback" : mode == MODE_RESAMPLER ? "resampler" : "none",
+           host_ppm, codec_ppm, jitter_us, channels, burst_every, burst_len,
+           trace_path ? "\"" : "", trace_path ? trace_path : "null", trace_path ? "\"" : "", seed);
+    printf("  \"packets\": %llu,\n", (unsigned long long)packets);
+    printf("  \"overruns\": %u,\n", (unsigned)atomic_load(&ring.overruns));
+    printf("  \"underruns\": %u,\n", (unsigned)atomic_load(&ring.underruns));
+    printf("  \"stream_starts\": %u,\n", stream_starts);
+    printf("  \"dma_starve_events\": %llu,\n", (unsigned long long)starve_events);
+    printf("  \"dma_starved_ms\": %.3f,\n", starved_frames * 1000.0 / SIM_RATE);
+    if (settle_us < end_us) {
+        printf("  \"settled\": {\"after_s\": %.1f, \"underruns\": %u, \"overruns\": %u, \"dma_starve_events\": %llu},\n",
+               settle_s, (unsigned)atomic_load(&ring.underruns) - settle_underruns,
+               (unsigned)atomic_load(&ring.overruns) - settle_overruns,
+               (unsigned long long)(starve_events - settle_starve_events));
+    } else {
+        printf("  \"settled\": null,\n");
+    }
+    print_series("latency_us", &latency, ",");
+    print_series("fill_frames", &fill, ",");
+    print_series("i2s_block_us", &block, ",");
+    print_series("feedback_ppm", &feedback_ppm, ",");
+    print_series("resampler_ppm", &resampler_ppm, ",");
+    printf("  \"cpu\": {");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        printf("%s\"%s\": {\"calls\": %llu, \"ns_per_call\": %.0f, \"pct_realtime\": %.4f}", i ? ", " : "",
+               s_stage_names[i], (unsigned long long)s_stage[i].calls,
+               s_stage[i].calls ? (double)s_stage[i].ns / s_stage[i].calls : 0.0, s_stage[i].ns / (seconds * 1e7));
+    }
+    printf("}\n}\n");
+
+    if (trace) {
+        fclose(trace);
+    }
+    free(resampled);
+    return 0;
+}
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""Host side of the CDC file transfer (main/cdc_xfer.h).
+
+  cdc_xfer.py PORT put LOCAL [REMOTE]      upload LOCAL to /data/REMOTE (default: its name)
+  cdc_xfer.py PORT bench [--size N] [--to REMOTE]
+                                           send N random bytes, discarded on the device unless
+                                           --to is given, and report the sustained rate
+
+Needs pyserial.
+"""
+
+import argparse
+import os
+import struct
+import sys
+import time
+import zlib
+
+MAGIC = 0xA5
+DATA, END, ABORT = 0x01, 0x02, 0x03
+ACK, NAK, DONE = 0x81, 0x82, 0x83
+STATUS = {0: "ok", 1: "size mismatch", 2: "crc mismatch", 3: "i/o error", 4: "aborted", 5: "timeout"}
+
+RESEND_TIMEOUT = 1.0   # No ACK for this long: resend the window
+NAK_SETTLE = 0.05      # After a NAK, let frames already in flight drain before going back
+
+
+def frame(ftype, seq, payload=b""):
+    body = struct.pack("<BHH", ftype, seq & 0xFFFF, len(payload)) + payload
+    return bytes([MAGIC]) + body + struct.pack("<I", zlib.crc32(body))
+
+
+class FrameParser:
+    def __init__(self):
+        self.buf = bytearray()
+
+    def feed(self, data):
+        self.buf += data
+        frames = []
+        while True:
+            start = self.buf.find(bytes([MAGIC]))
+            if start < 0:
+                self.buf.clear()
+                return frames
+            del self.buf[:start]
+            if len(self.buf) < 6:
+                return frames
+            ftype, seq, length = struct.unpack_from("<BHH", self.buf, 1)
+            if length > 64:
+                del self.buf[:1]  # Device frames are small; this was text
+                continue
+            if len(self.buf) < 6 + length + 4:
+                return frames
+            body = bytes(self.buf[1:6 + length])
+            (crc,) = struct.unpack_from("<I", self.buf, 6 + length)
+            if crc == zlib.crc32(body):
+                frames.append((ftype, seq, body[5:]))
+                del self.buf[:6 + length + 4]
+            else:
+                del self.buf[:1]
+
+
+class Link:
+    def __init__(self, port):
+        import serial
+        self.ser = serial.Serial(port, timeout=0.01)
+
+    def write(self, data):
+        self.ser.write(data)
+
+    def read(self):
+        return self.ser.read(self.ser.in_waiting or 1)
+
+
+def wait_ready(link, timeout=2.0):
+    text = bytearray()
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        text += link.read()
+        for line in text.decode(errors="replace").splitlines():
+            words = line.split()
+            if words[:2] == ["XFER", "READY"]:
+                return int(words[2]), int(words[3])
+            if words[:2] == ["XFER", "ERROR"]:
+                raise RuntimeError(line)
+    raise RuntimeError("device did not enter transfer mode: %r" % bytes(text))
+
+
+def send(link, data, remote):
+    """Go-back-N sender. Returns (seconds, resends)."""
+    link.write(("xfer put %s\n" % remote).encode())
+    window, max_payload = wait_ready(link)
+    chunks = [data[i:i + max_payload] for i in range(0, len(data), max_payload)]
+    n = len(chunks)
+    parser = FrameParser()
+    base = nxt = 0
+    resends = 0
+    settle_until = None
+    last_progress = start = time.monotonic()
+
+    def unwrap(seq):
+        return base + ((seq - base) & 0xFFFF)
+
+    while base < n:
+        now = time.monotonic()
+        if settle_until is not None and now >= settle_until:
+            settle_until = None
+            nxt = base
+        if settle_until is None:
+            while nxt < n and nxt - base < window:
+                link.write(frame(DATA, nxt, chunks[nxt]))
+                nxt += 1
+
+        for ftype, seq, payload in parser.feed(link.read()):
+            if ftype == ACK:
+                acked = unwrap(seq)
+                if base < acked <= n:
+                    base = acked
+                    nxt = max(nxt, base)
+                    last_progress = time.monotonic()
+            elif ftype == NAK and settle_until is None:
+                base = max(base, min(unwrap(seq), n))
+                settle_until = time.monotonic() + NAK_SETTLE
+                resends += 1
+            elif ftype == DONE:
+                status, _ = struct.unpack("<II", payload)
+                raise RuntimeError("device ended the transfer: %s" % STATUS.get(status, status))
+
+        if time.monotonic() - last_progress > RESEND_TIMEOUT:
+            nxt = base
+            resends += 1
+            last_progress = time.monotonic()
+
+    end = frame(END, n, struct.pack("<II", len(data), zlib.crc32(data)))
+    for _ in range(3):
+        link.write(end)
+        deadline = time.monotonic() + 10.0  # Covers the final flush and fsync
+        while time.monotonic() < deadline:
+            for ftype, seq, payload in parser.feed(link.read()):
+                if ftype == DONE:
+                    status, size = struct.unpack("<II", payload)
+                    if status != 0:
+                        raise RuntimeError("device rejected the file: %s" % STATUS.get(status, status))
+                    return time.monotonic() - start, resends
+                if ftype == NAK:
+                    break
+            else:
+                continue
+            break
+    raise RuntimeError("no DONE from device")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("port")
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    put = sub.add_parser("put")
+    put.add_argument("local")
+    put.add_argument("remote", nargs="?")
+    bench = sub.add_parser("bench")
+    bench.add_argument("--size", type=int, default=1 << 20)
+    bench.add_argument("--to", default="-")
+    args = ap.parse_args()
+
+    if args.cmd == "put":
+        with open(args.local, "rb") as f:
+            data = f.read()
+        remote = args.remote or os.path.basename(args.local)
+    else:
+        data = os.urandom(args.size)
+        remote = args.to
+
+    link = Link(args.port)
+    try:
+        secs, resends = send(link, data, remote)
+    except RuntimeError as e:
+        link.write(frame(ABORT, 0))
+        print(e, file=sys.stderr)
+        return 1
+    print("%d bytes in %.2f s, %.1f KB/s, %d resends" % (len(data), secs, len(data) / secs / 1000, resends))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,524 @@
+// Host tool: uploads data through the device's frame receiver (main/cdc_xfer_frame.c)
+// from a go-back-N sender that follows tools/cdc_xfer.py, over a simulated CDC link
+// that corrupts, drops and pads frames, in simulated time. Checks that every case ends
+// in DONE(OK) with the data intact, and that a corrupted END is not accepted. Transfers
+// that fail (a refused END, or a full disk mid-stream) must not let any frame still in
+// flight through to the command line: only the command typed afterwards may get there,
+// whether the host sends ABORT or just goes quiet. Prints one JSON object and exits 1
+// on any failure.
+//
+//   cc -O2 -Imain -o cdc_xfer_test tools/cdc_xfer_test.c main/cdc_xfer_frame.c
+//   ./cdc_xfer_test [--size BYTES] [--rate-kbs R] [--seed S]
+//
+// The link carries host data at --rate-kbs in 64-byte full-speed packets, 1 ms after it
+// was sent; the device's replies take 1 ms back. The device consumes what has arrived
+// at once, up to 256 bytes per read, as the console worker does. The sender's resend
+// timeout and NAK settle time are the script's; the window and payload size are the
+// device's. Rates are simulated link throughput, not a measurement of any host.
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cdc_xfer_frame.h"
+
+#define TEST_WINDOW         (7)         // CDC_XFER_WINDOW
+#define TEST_RX_READ        (256)       // The console worker's read size
+#define TEST_PACKET         (64)        // Full-speed bulk packet
+#define TEST_LATENCY_US     (1000)
+#define TEST_TICK_US        (10)
+#define TEST_HOST_POLL_US   (100)
+#define TEST_RESEND_US      (1000000)   // RESEND_TIMEOUT in cdc_xfer.py
+#define TEST_NAK_SETTLE_US  (50000)     // NAK_SETTLE
+#define TEST_END_WAIT_US    (10000000)
+#define TEST_END_TRIES      (3)
+#define TEST_TIMEOUT_US     (600000000ULL)
+#define TEST_DRAIN_QUIET_US (2000000)   // CDC_XFER_DRAIN_QUIET_MS
+#define TEST_LINE_BYTES     (256)
+
+typedef struct {
+    const char *name;
+    uint32_t corrupt_every;     // Every Nth DATA frame sent has a payload bit flipped
+    uint32_t drop_every;        // Every Nth DATA frame sent is lost
+    uint32_t noise_every;       // Every Nth frame sent is preceded by console text
+    uint32_t false_magic_every; // ... or by bytes that look like the start of a frame
+    uint32_t reply_loss_pct;    // Device frames lost on the way back
+    bool corrupt_end;           // The first END carries a wrong file CRC
+    uint32_t size;              // 0: --size
+    uint32_t fail_after;        // The device refuses data past this many bytes (disk full)
+    bool host_silent;           // After an error the host exits without sending ABORT
+} xfer_case_t;
+
+// What the host types once a failed transfer is over; the only thing that may reach
+// the command line
+static const char s_next_command[] = "stats\r\n";
+
+// One direction of the link: a byte queue that becomes readable as it is clocked out
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t head, tail;          // Written, consumed
+    double *ready_us;           // Time each TEST_PACKET-aligned block arrives, by block
+    double busy_until;
+    double bytes_per_us;
+} pipe_t;
+
+typedef struct {
+    const xfer_case_t *c;
+    const uint8_t *src;
+    uint32_t src_len;
+    uint8_t *dst;
+    uint32_t dst_len;
+    pipe_t up, down;
+    uint32_t reply_frames;
+    bool done;
+    uint32_t done_status;
+    unsigned seed;
+    enum { DEV_ACTIVE, DEV_FAILED, DEV_DRAIN, DEV_LINE } state;   // As in cdc_xfer.c
+    double last_rx_us;
+    uint8_t line[TEST_LINE_BYTES];  // What the console worker was given, as far as it fits
+    uint32_t line_len;
+} xfer_test_t;
+
+static uint32_t s_crc_table[256];
+
+static uint32_t crc32_zlib(uint32_t crc, const uint8_t *data, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc = s_crc_table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void crc32_table_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        s_crc_table[i] = c;
+    }
+}
+
+static void pipe_init(pipe_t *p, size_t cap, double bytes_per_us)
+{
+    p->buf = malloc(cap);
+    p->ready_us = malloc((cap / TEST_PACKET + 1) * sizeof(double));
+    p->cap = cap;
+    p->head = p->tail = 0;
+    p->busy_until = 0;
+    p->bytes_per_us = bytes_per_us;
+}
+
+static void pipe_free(pipe_t *p)
+{
+    free(p->buf);
+    free(p->ready_us);
+}
+
+// Queues bytes for the link at `now`; the queue is sized for the whole run
+static void pipe_write(pipe_t *p, double now, const uint8_t *data, size_t len)
+{
+    if (p->head + len > p->cap) {
+        fprintf(stderr, "link queue full\n");
+        exit(1);
+    }
+    memcpy(p->buf + p->head, data, len);
+    for (size_t end = p->head + len; p->head < end;) {
+        size_t block = p->head / TEST_PACKET;
+        size_t n = (block + 1) * TEST_PACKET - p->head;
+        n = n < end - p->head ? n : end - p->head;
+        p->busy_until = (p->busy_until > now ? p->busy_until : now) + n / p->bytes_per_us;
+        p->ready_us[block] = p->busy_until + TEST_LATENCY_US;
+        p->head += n;
+    }
+}
+
+// Bytes readable at `now`, from the consumed position on
+static size_t pipe_readable(const pipe_t *p, double now)
+{
+    size_t end = p->tail;
+    while (end < p->head && p->ready_us[end / TEST_PACKET] <= now) {
+        end = (end / TEST_PACKET + 1) * TEST_PACKET;
+    }
+    return (end < p->head ? end : p->head) - p->tail;
+}
+
+// --- Device side: the ops cdc_xfer.c plugs into the receiver ---
+
+static double s_now;
+
+static void dev_send(xfer_test_t *t, cdc_xfer_type_t type, uint16_t seq, const uint8_t *payload, uint16_t len)
+{
+    uint8_t f[CDC_XFER_HDR_BYTES + 8 + 4];
+    size_t n = cdc_xfer_frame_build(f, type, seq, payload, len, crc32_zlib);
+    t->reply_frames++;
+    if (t->c->reply_loss_pct && (uint32_t)rand_r(&t->seed) % 100 < t->c->reply_loss_pct) {
+        return;
+    }
+    pipe_write(&t->down, s_now, f, n);
+}
+
+static void dev_reply(void *ctx, cdc_xfer_type_t type, uint16_t seq)
+{
+    dev_send(ctx, type, seq, NULL, 0);
+}
+
+static cdc_xfer_rx_t s_rx;
+
+// xfer_finish(): DONE with the outcome
+static void dev_finish(xfer_test_t *t, uint32_t status)
+{
+    uint8_t done[8];
+    cdc_xfer_put_le32(done, status);
+    cdc_xfer_put_le32(done + 4, t->dst_len);
+    dev_send(t, CDC_XFER_DONE, s_rx.expected, done, sizeof(done));
+    t->done = true;
+    t->done_status = status;
+    t->state = status == 0 || status == 4 ? DEV_LINE : DEV_FAILED;
+}
+
+static bool dev_data(void *ctx, const uint8_t *payload, size_t len)
+{
+    xfer_test_t *t = ctx;
+    if (t->c->fail_after && t->dst_len + len > t->c->fail_after) {
+        dev_finish(t, 3);               // CDC_XFER_ERR_IO
+        return false;
+    }
+    if (t->dst_len + len > t->src_len) {
+        return false;
+    }
+    memcpy(t->dst + t->dst_len, payload, len);
+    t->dst_len += len;
+    return true;
+}
+
+// xfer_end(): status from the size and CRC the host sent
+static void dev_end(void *ctx, cdc_xfer_type_t type, const uint8_t *payload, size_t len)
+{
+    xfer_test_t *t = ctx;
+    uint32_t status = 4;                // CDC_XFER_ERR_ABORTED
+    if (type == CDC_XFER_END && len == 8) {
+        status = cdc_xfer_le32(payload) != t->dst_len ? 1 :
+                 cdc_xfer_le32(payload + 4) != crc32_zlib(0, t->dst, t->dst_len) ? 2 : 0;
+    }
+    dev_finish(t, status);
+}
+
+// --- Host side: send() of tools/cdc_xfer.py ---
+
+typedef struct {
+    uint8_t buf[CDC_XFER_FRAME_MAX * 4];
+    size_t len;
+} host_parser_t;
+
+// FrameParser.feed: calls `on_frame` for every intact device frame
+static void host_parse(host_parser_t *hp, const uint8_t *data, size_t n,
+                       void (*on_frame)(void *ctx, uint8_t type, uint16_t seq, const uint8_t *payload), void *ctx)
+{
+    memcpy(hp->buf + hp->len, data, n);
+    hp->len += n;
+    while (hp->len > 0) {
+        uint8_t *m = memchr(hp->buf, CDC_XFER_MAGIC, hp->len);
+        if (m == NULL) {
+            hp->len = 0;
+            return;
+        }
+        hp->len -= m - hp->buf;
+        memmove(hp->buf, m, hp->len);
+        if (hp->len < CDC_XFER_HDR_BYTES) {
+            return;
+        }
+        uint16_t len = cdc_xfer_le16(hp->buf + 4);
+        size_t skip = 1;
+        if (len <= 64) {
+            if (hp->len < CDC_XFER_HDR_BYTES + len + 4u) {
+                return;
+            }
+            if (crc32_zlib(0, hp->buf + 1, CDC_XFER_HDR_BYTES - 1 + len) == cdc_xfer_le32(hp->buf + CDC_XFER_HDR_BYTES + len)) {
+                on_frame(ctx, hp->buf[1], cdc_xfer_le16(hp->buf + 2), hp->buf + CDC_XFER_HDR_BYTES);
+                skip = CDC_XFER_HDR_BYTES + len + 4;
+            }
+        }
+        hp->len -= skip;
+        memmove(hp->buf, hp->buf + skip, hp->len);
+    }
+}
+
+typedef struct {
+    xfer_test_t *t;
+    uint32_t n, base, nxt;
+    uint32_t resends;
+    uint32_t data_sent;         // DATA frames written, resends included
+    uint32_t frames_sent;
+    double settle_until;        // < 0: not settling
+    double last_progress;
+    bool got_done, got_nak;
+    uint32_t done_status;
+} host_t;
+
+static void host_on_frame(void *ctx, uint8_t type, uint16_t seq, const uint8_t *payload)
+{
+    host_t *h = ctx;
+    uint32_t unwrapped = h->base + (uint16_t)(seq - h->base);
+    if (type == CDC_XFER_ACK) {
+        if (h->base < unwrapped && unwrapped <= h->n) {
+            h->base = unwrapped;
+            h->nxt = h->nxt > h->base ? h->nxt : h->base;
+            h->last_progress = s_now;
+        }
+    } else if (type == CDC_XFER_NAK) {
+        h->got_nak = true;
+        if (h->settle_until < 0 && h->base < h->n) {
+            uint32_t to = unwrapped < h->n ? unwrapped : h->n;
+            h->base = h->base > to ? h->base : to;
+            h->settle_until = s_now + TEST_NAK_SETTLE_US;
+            h->resends++;
+        }
+    } else if (type == CDC_XFER_DONE) {
+        h->got_done = true;
+        h->done_status = cdc_xfer_le32(payload);
+    }
+}
+
+static void host_write_frame(host_t *h, cdc_xfer_type_t type, uint16_t seq, const uint8_t *payload, uint16_t len)
+{
+    const xfer_case_t *c = h->t->c;
+    uint8_t f[CDC_XFER_FRAME_MAX];
+    size_t n = cdc_xfer_frame_build(f, type, seq, payload, len, crc32_zlib);
+    h->frames_sent++;
+    if (c->noise_every && h->frames_sent % c->noise_every == 0) {
+        static const uint8_t noise[] = "\r\nstats\r\n";
+        pipe_write(&h->t->up, s_now, noise, sizeof(noise) - 1);
+    }
+    if (c->false_magic_every && h->frames_sent % c->false_magic_every == 0) {
+        static const uint8_t magic[] = { CDC_XFER_MAGIC, CDC_XFER_DATA };
+        pipe_write(&h->t->up, s_now, magic, sizeof(magic));
+    }
+    if (type == CDC_XFER_DATA) {
+        h->data_sent++;
+        if (c->drop_every && h->data_sent % c->drop_every == 0) {
+            return;
+        }
+        if (c->corrupt_every && h->data_sent % c->corrupt_every == 0) {
+            f[CDC_XFER_HDR_BYTES + (h->data_sent * 7) % len] ^= 0x10;
+        }
+    }
+    pipe_write(&h->t->up, s_now, f, n);
+}
+
+// Runs the console worker and the link up to `now`: xfer_feed() while in raw mode, the
+// line assembler afterwards
+static void device_poll(xfer_test_t *t)
+{
+    size_t n;
+    while ((n = pipe_readable(&t->up, s_now)) > 0) {
+        n = n < TEST_RX_READ ? n : TEST_RX_READ;
+        const uint8_t *data = t->up.buf + t->up.tail;
+        t->last_rx_us = s_now;
+        if (t->state == DEV_LINE) {
+            size_t room = sizeof(t->line) - (t->line_len < sizeof(t->line) ? t->line_len : sizeof(t->line));
+            memcpy(t->line + sizeof(t->line) - room, data, n < room ? n : room);
+            t->line_len += n;
+            t->up.tail += n;
+            continue;
+        }
+        t->up.tail += cdc_xfer_rx_feed(&s_rx, data, n);
+        if (t->state == DEV_FAILED) {
+            cdc_xfer_rx_drain(&s_rx);
+            t->state = DEV_DRAIN;
+        } else if (t->state == DEV_DRAIN && s_rx.done) {
+            t->state = DEV_LINE;
+        }
+    }
+    if (t->state == DEV_DRAIN && s_now - t->last_rx_us > TEST_DRAIN_QUIET_US) {
+        t->state = DEV_LINE;
+    }
+}
+
+static void host_poll(host_t *h, host_parser_t *hp)
+{
+    pipe_t *down = &h->t->down;
+    size_t n = pipe_readable(down, s_now);
+    n = n < sizeof(hp->buf) - hp->len ? n : sizeof(hp->buf) - hp->len;
+    host_parse(hp, down->buf + down->tail, n, host_on_frame, h);
+    down->tail += n;
+}
+
+typedef struct {
+    bool ok;
+    double seconds;
+    uint32_t link_bytes;
+    uint32_t resends;
+    uint32_t data_sent;
+    uint32_t end_tries;
+} host_result_t;
+
+static host_result_t run_host(xfer_test_t *t)
+{
+    host_t h = { .t = t, .settle_until = -1 };
+    host_parser_t hp = { .len = 0 };
+    host_result_t r = { 0 };
+    h.n = (t->src_len + CDC_XFER_MAX_PAYLOAD - 1) / CDC_XFER_MAX_PAYLOAD;
+    double next_host = 0;
+    s_now = 0;
+
+    // The data phase
+    while (h.base < h.n && !h.got_done && s_now < TEST_TIMEOUT_US) {
+        device_poll(t);
+        if (s_now >= next_host) {
+            next_host += TEST_HOST_POLL_US;
+            if (h.settle_until >= 0 && s_now >= h.settle_until) {
+                h.settle_until = -1;
+                h.nxt = h.base;
+            }
+            if (h.settle_until < 0) {
+                while (h.nxt < h.n && h.nxt - h.base < TEST_WINDOW) {
+                    uint32_t off = h.nxt * CDC_XFER_MAX_PAYLOAD;
+                    uint32_t len = t->src_len - off < CDC_XFER_MAX_PAYLOAD ? t->src_len - off : CDC_XFER_MAX_PAYLOAD;
+                    host_write_frame(&h, CDC_XFER_DATA, (uint16_t)h.nxt, t->src + off, (uint16_t)len);
+                    h.nxt++;
+                }
+            }
+            host_poll(&h, &hp);
+            if (s_now - h.last_progress > TEST_RESEND_US) {
+                h.nxt = h.base;
+                h.resends++;
+                h.last_progress = s_now;
+            }
+        }
+        s_now += TEST_TICK_US;
+    }
+
+    // END, resent on a NAK or when nothing comes back
+    uint8_t end[8];
+    cdc_xfer_put_le32(end, t->src_len);
+    for (; r.end_tries < TEST_END_TRIES && !h.got_done; r.end_tries++) {
+        uint32_t crc = crc32_zlib(0, t->src, t->src_len);
+        cdc_xfer_put_le32(end + 4, t->c->corrupt_end && r.end_tries == 0 ? ~crc : crc);
+        host_write_frame(&h, CDC_XFER_END, (uint16_t)h.n, end, sizeof(end));
+        h.got_nak = false;
+        for (double deadline = s_now + TEST_END_WAIT_US; s_now < deadline && !h.got_done && !h.got_nak;
+                s_now += TEST_TICK_US) {
+            device_poll(t);
+            host_poll(&h, &hp);
+        }
+    }
+
+    // After an error the script sends ABORT and exits; then the user types a command
+    if (h.got_done && h.done_status != 0) {
+        if (!t->c->host_silent) {
+            host_write_frame(&h, CDC_XFER_ABORT, 0, NULL, 0);
+        } else {
+            for (double until = s_now + TEST_DRAIN_QUIET_US + 100000; s_now < until; s_now += TEST_TICK_US) {
+                device_poll(t);
+            }
+        }
+        pipe_write(&t->up, s_now, (const uint8_t *)s_next_command, sizeof(s_next_command) - 1);
+        for (double until = s_now + TEST_DRAIN_QUIET_US; s_now < until; s_now += TEST_TICK_US) {
+            device_poll(t);
+        }
+    }
+
+    r.ok = h.got_done && h.done_status == 0;
+    r.seconds = s_now / 1e6;
+    r.link_bytes = (uint32_t)t->up.head;
+    r.resends = h.resends;
+    r.data_sent = h.data_sent;
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t size = 1 << 20;
+    double rate_kbs = 800;
+    unsigned seed = 1;
+    static const struct option opts[] = {
+        { "size", required_argument, NULL, 'n' },
+        { "rate-kbs", required_argument, NULL, 'k' },
+        { "seed", required_argument, NULL, 'r' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'n': size = strtoul(optarg, NULL, 0); break;
+        case 'k': rate_kbs = atof(optarg); break;
+        case 'r': seed = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s [--size BYTES] [--rate-kbs R] [--seed S]\n", argv[0]);
+            return 1;
+        }
+    }
+    crc32_table_init();
+
+    const xfer_case_t cases[] = {
+        { "clean", 0, 0, 0, 0, 0, false, 0, 0, false },
+        { "crc_errors", 37, 0, 0, 0, 0, false, 0, 0, false },
+        { "gaps", 0, 53, 0, 0, 0, false, 0, 0, false },
+        { "line_noise", 0, 0, 11, 0, 0, false, 0, 0, false },
+        // The false header swallows the start of the real frame behind it
+        { "false_magic", 0, 0, 0, 101, 0, false, 0, 0, false },
+        { "reply_loss", 0, 0, 0, 0, 5, false, 0, 0, false },
+        { "all", 37, 53, 11, 101, 5, false, 0, 0, false },
+        { "bad_end_crc", 0, 0, 0, 0, 0, true, 0, 0, false },
+        // 16-bit sequence numbers wrap after 32 MB
+        { "seq_wrap", 401, 0, 0, 0, 0, false, 34u << 20, 0, false },
+        // The disk fills up with a window of frames still on the way
+        { "disk_full_abort", 0, 0, 0, 0, 0, false, 256u << 10, 100000, false },
+        { "disk_full_quiet", 0, 0, 0, 0, 0, false, 256u << 10, 100000, true },
+    };
+
+    int failures = 0;
+    printf("{\n  \"config\": {\"size\": %u, \"rate_kbs\": %.0f, \"window\": %d, \"payload\": %d, \"seed\": %u},\n"
+           "  \"cases\": [", size, rate_kbs, TEST_WINDOW, CDC_XFER_MAX_PAYLOAD, seed);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const xfer_case_t *c = &cases[i];
+        xfer_test_t t = { .c = c, .src_len = c->size ? c->size : size, .seed = seed };
+        uint8_t *src = malloc(t.src_len);
+        for (uint32_t k = 0; k < t.src_len; k++) {
+            src[k] = (uint8_t)rand_r(&t.seed);
+        }
+        t.src = src;
+        t.dst = malloc(t.src_len);
+        pipe_init(&t.up, (size_t)t.src_len * 3 + (1 << 20), rate_kbs * 1000 / 1e6);
+        pipe_init(&t.down, (size_t)t.src_len / 8 + (1 << 20), rate_kbs * 1000 / 1e6);
+        const cdc_xfer_frame_ops_t ops = {
+            .crc32 = crc32_zlib,
+            .reply = dev_reply,
+            .data = dev_data,
+            .end = dev_end,
+            .ctx = &t,
+        };
+        cdc_xfer_rx_init(&s_rx, &ops);
+
+        host_result_t r = run_host(&t);
+        bool intact = t.dst_len == t.src_len && memcmp(t.src, t.dst, t.src_len) == 0;
+        // A wrong END must be refused, and the file with it
+        bool pass = c->corrupt_end ? t.done && t.done_status == 2 : c->fail_after ? t.done && t.done_status == 3 :
+                    r.ok && intact;
+        if (c->corrupt_end || c->fail_after) {
+            pass = pass && t.state == DEV_LINE && t.line_len == sizeof(s_next_command) - 1 &&
+                   memcmp(t.line, s_next_command, t.line_len) == 0;
+        }
+        failures += !pass;
+        printf("%s\n    {\"name\": \"%s\", \"bytes\": %u, \"sim_s\": %.3f, \"kbs\": %.1f, \"link_efficiency\": %.3f, "
+               "\"data_frames_sent\": %u, \"host_resends\": %u, \"end_tries\": %u, \"frames\": %u, \"naks\": %u, "
+               "\"crc_errors\": %u, \"resync_bytes\": %u, \"drained_bytes\": %u, \"line_bytes\": %u, \"done_status\": %d, \"intact\": %s, "
+               "\"pass\": %s}",
+               i ? "," : "", c->name, t.src_len, r.seconds, t.src_len / r.seconds / 1000,
+               (double)t.src_len / r.link_bytes, r.data_sent, r.resends, r.end_tries, s_rx.frames, s_rx.naks,
+               s_rx.crc_errors, s_rx.resync_bytes, s_rx.drained_bytes, t.line_len, t.done ? (int)t.done_status : -1, intact ? "true" : "false",
+               pass ? "true" : "false");
+        pipe_free(&t.up);
+        pipe_free(&t.down);
+        free(src);
+        free(t.dst);
+    }
+    printf("\n  ],\n  \"failures\": %d\n}\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,163 @@
+// Host tool: checks every audio_convert kernel bit for bit against a plain reference
+// conversion and times it. The input is random samples plus the edge values (full scale,
+// -1, the smallest steps of every width). Output past the last frame must stay untouched.
+// Prints one JSON object and exits 1 on any mismatch.
+//
+//   cc -O2 -Imain -o convert_bench tools/convert_bench.c main/audio_convert.c
+//   ./convert_bench [--frames N] [--rounds N] [--seed S]
+//
+// Timing is host CPU time per frame, for comparing builds, not a target figure.
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "audio_convert.h"
+
+static const int s_widths[] = { 2, 3, 4 };
+
+static uint64_t cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// The reference works on bytes only, independent of the kernels' word accesses
+static int32_t ref_load(const uint8_t *p, int bytes)
+{
+    uint32_t v = 0;
+    for (int b = 0; b < bytes; b++) {
+        v |= (uint32_t)p[b] << (8 * (4 - bytes + b));
+    }
+    return (int32_t)v;
+}
+
+static void ref_store(uint8_t *p, int bytes, int32_t v)
+{
+    for (int b = 0; b < bytes; b++) {
+        p[b] = (uint8_t)((uint32_t)v >> (8 * (4 - bytes + b)));
+    }
+}
+
+// Each channel is halved, rounding down, before the sum
+static int64_t ref_half(int32_t v)
+{
+    return v >= 0 ? v / 2 : -((-(int64_t)v + 1) / 2);
+}
+
+static void ref_convert(uint8_t *out, const uint8_t *in, size_t frames, int ib, int ic, int ob, int oc)
+{
+    for (size_t i = 0; i < frames; i++) {
+        int32_t l = ref_load(in + i * ib * ic, ib);
+        int32_t r = ic == 2 ? ref_load(in + i * ib * ic + ib, ib) : l;
+        if (oc == 1) {
+            ref_store(out + i * ob, ob, ic == 2 ? (int32_t)(ref_half(l) + ref_half(r)) : l);
+        } else {
+            ref_store(out + i * ob * oc, ob, l);
+            ref_store(out + i * ob * oc + ob, ob, r);
+        }
+    }
+}
+
+static void fill_input(uint8_t *in, size_t bytes)
+{
+    static const uint32_t edges[] = {
+        0x00000000, 0xffffffff, 0x7fffffff, 0x80000000, 0x7fff0000, 0x80000000, 0x00010000,
+        0xffff0000, 0x00000100, 0xffffff00, 0x00000001, 0x7fffff00, 0x80000100,
+    };
+    for (size_t i = 0; i < bytes; i++) {
+        in[i] = (uint8_t)rand();
+    }
+    // The first frames carry the edge values in every lane
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]) && (i + 1) * 4 <= bytes; i++) {
+        memcpy(in + i * 4, &edges[i], 4);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t frames = 4096;
+    int rounds = 200;
+    unsigned seed = 1;
+
+    static const struct option opts[] = {
+        { "frames", required_argument, NULL, 'f' },
+        { "rounds", required_argument, NULL, 'r' },
+        { "seed", required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'f': frames = (size_t)atol(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [--frames N] [--rounds N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (frames == 0 || rounds <= 0) {
+        fprintf(stderr, "frames and rounds must be positive\n");
+        return 1;
+    }
+    srand(seed);
+
+    const size_t max_bytes = frames * 4 * 2;
+    uint8_t *in = aligned_alloc(16, max_bytes + 16);
+    uint8_t *out = aligned_alloc(16, max_bytes + 16);
+    uint8_t *want = malloc(max_bytes);
+    bool ok = true;
+
+    printf("{\n  \"frames\": %zu,\n  \"rounds\": %d,\n  \"kernels\": [\n", frames, rounds);
+    int n = 0;
+    for (int a = 0; a < 3; a++) {
+        for (int ic = 1; ic <= 2; ic++) {
+            for (int b = 0; b < 3; b++) {
+                for (int oc = 1; oc <= 2; oc++) {
+                    const int ib = s_widths[a], ob = s_widths[b];
+                    audio_convert_fn_t fn = audio_convert_select(ib, ic, ob, oc);
+                    uint64_t mismatches = 0;
+                    if (fn == NULL) {
+                        mismatches = frames;
+                    } else {
+                        fill_input(in, frames * ib * ic);
+                        ref_convert(want, in, frames, ib, ic, ob, oc);
+                        memset(out, 0xa5, max_bytes + 16);
+                        fn(out, in, frames);
+                        for (size_t i = 0; i < frames * ob * oc; i++) {
+                            mismatches += out[i] != want[i];
+                        }
+                        // Nothing past the end
+                        for (size_t i = frames * ob * oc; i < max_bytes + 16; i++) {
+                            mismatches += out[i] != 0xa5;
+                        }
+                    }
+
+                    uint64_t start = cpu_ns();
+                    for (int r = 0; fn && r < rounds; r++) {
+                        fn(out, in, frames);
+                        __asm__ volatile("" ::: "memory");
+                    }
+                    double ns = (double)(cpu_ns() - start) / ((double)rounds * frames);
+
+                    bool pass = mismatches == 0;
+                    ok &= pass;
+                    n++;
+                    printf("    { \"in\": \"s%d x%d\", \"out\": \"s%d x%d\", \"mismatched_bytes\": %llu, \"ns_per_frame\": %.3f, \"pass\": %s }%s\n",
+                           ib * 8, ic, ob * 8, oc, (unsigned long long)mismatches, ns, pass ? "true" : "false", n < 36 ? "," : "");
+                }
+            }
+        }
+    }
+    printf("  ],\n  \"pass\": %s\n}\n", ok ? "true" : "false");
+
+    free(in);
+    free(out);
+    free(want);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,438 @@
+// Host tool: checks the playback DSP chain (main/audio_dsp.c) against plain references
+// and measures each stage's cost per writer chunk. The checks cover a bit-exact unity
+// path through the limiter's delay line, the biquads against a double-precision cascade,
+// the limiter ceiling under bursts driven 12 dB past full scale, the gain ramp and the
+// stop fade. Prints one JSON object and exits 1 on any failed check.
+//
+//   cc -O2 -Imain -o dsp_bench tools/dsp_bench.c main/audio_dsp.c -lm
+//   ./dsp_bench [--chunk FRAMES] [--rounds N] [--seed S]
+//
+// The chunk defaults to 96 frames, one EXAMPLE_AUDIO_WRITE_CHUNK_MS chunk at 48 kHz.
+// Stages are timed on internal-format blocks, the chains through process_s16/s32 as the
+// writer calls them. Timing is host CPU time, for comparing builds, not a target figure.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "audio_dsp.h"
+
+#define BENCH_RATE      (48000)
+#define BENCH_FRAMES    (48000)     // One second per check and per timed round
+#define BENCH_SHIFT     (27 - 15)   // s16 to the internal format
+#define BENCH_EQ_TOL    (1)         // s16 LSBs allowed between the biquads and the reference
+
+static int16_t s_in16[BENCH_FRAMES * AUDIO_DSP_MAX_CH];
+static int16_t s_out16[BENCH_FRAMES * AUDIO_DSP_MAX_CH];
+static int32_t s_in32[BENCH_FRAMES * AUDIO_DSP_MAX_CH];
+static int32_t s_out32[BENCH_FRAMES * AUDIO_DSP_MAX_CH];
+static audio_dsp_t s_dsp;
+
+static uint64_t cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int32_t rand32(void)
+{
+    return (int32_t)((uint32_t)rand() << 16 ^ (uint32_t)rand());
+}
+
+// Uniform in [-amp, amp]
+static int32_t rand_amp(int32_t amp)
+{
+    return (int32_t)((int64_t)rand32() % (amp + 1));
+}
+
+static void run_s16(int16_t *buf, size_t frames, size_t chunk)
+{
+    for (size_t f = 0; f < frames; f += chunk) {
+        size_t n = frames - f < chunk ? frames - f : chunk;
+        audio_dsp_process_s16(&s_dsp, buf + f * s_dsp.channels, n);
+    }
+}
+
+static void run_s32(int32_t *buf, size_t frames, size_t chunk)
+{
+    for (size_t f = 0; f < frames; f += chunk) {
+        size_t n = frames - f < chunk ? frames - f : chunk;
+        audio_dsp_process_s32(&s_dsp, buf + f * s_dsp.channels, n);
+    }
+}
+
+// A stream that has been playing long enough for the gain ramp to finish, with silence
+// in the limiter's delay line
+static void start(int channels, const audio_dsp_params_t *params, size_t chunk)
+{
+    audio_dsp_init(&s_dsp, BENCH_RATE, channels);
+    audio_dsp_configure(&s_dsp, params);
+    memset(s_out16, 0, sizeof(s_out16));
+    run_s16(s_out16, BENCH_RATE / 10, chunk);
+}
+
+// Below the ceiling the chain is the identity, delayed by the limiter's look-ahead. s32
+// loses the 4 bits below the internal format.
+static uint64_t check_passthrough(int bytes, int channels, size_t chunk)
+{
+    audio_dsp_params_t params;
+    audio_dsp_default_params(&params);
+    start(channels, &params, chunk);
+
+    const size_t n = BENCH_FRAMES * channels;
+    const size_t delay = (size_t)s_dsp.lookahead * channels;
+    uint64_t bad = 0;
+    if (bytes == 2) {
+        for (size_t i = 0; i < n; i++) {
+            s_in16[i] = (int16_t)rand_amp(30000);
+            s_out16[i] = s_in16[i];
+        }
+        run_s16(s_out16, BENCH_FRAMES, chunk);
+        for (size_t i = 0; i < n; i++) {
+            bad += s_out16[i] != (i < delay ? 0 : s_in16[i - delay]);
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            s_in32[i] = (int32_t)((uint32_t)rand_amp(30000) << 16 | ((uint32_t)rand() & 0xffff));
+            s_out32[i] = s_in32[i];
+        }
+        run_s32(s_out32, BENCH_FRAMES, chunk);
+        for (size_t i = 0; i < n; i++) {
+            bad += s_out32[i] != (i < delay ? 0 : (int32_t)(s_in32[i - delay] & ~0xf));
+        }
+    }
+    return bad;
+}
+
+typedef struct {
+    double b0, b1, b2, a1, a2;
+    double x1[AUDIO_DSP_MAX_CH], x2[AUDIO_DSP_MAX_CH], y1[AUDIO_DSP_MAX_CH], y2[AUDIO_DSP_MAX_CH];
+} ref_biquad_t;
+
+// RBJ cookbook peak and high pass, in double
+static void ref_design(ref_biquad_t *bq, const audio_dsp_eq_t *eq)
+{
+    double a = pow(10.0, eq->gain_db / 40.0);
+    double w0 = 2.0 * M_PI * eq->freq_hz / BENCH_RATE;
+    double cw = cos(w0);
+    double alpha = sin(w0) / (2.0 * eq->q);
+    double b0, b1, b2, a0, a1, a2;
+    if (eq->type == AUDIO_DSP_EQ_PEAK) {
+        b0 = 1 + alpha * a;  b1 = -2 * cw;  b2 = 1 - alpha * a;
+        a0 = 1 + alpha / a;  a1 = -2 * cw;  a2 = 1 - alpha / a;
+    } else {
+        b0 = (1 + cw) / 2;  b1 = -(1 + cw); b2 = (1 + cw) / 2;
+        a0 = 1 + alpha;     a1 = -2 * cw;   a2 = 1 - alpha;
+    }
+    memset(bq, 0, sizeof(*bq));
+    bq->b0 = b0 / a0;
+    bq->b1 = b1 / a0;
+    bq->b2 = b2 / a0;
+    bq->a1 = a1 / a0;
+    bq->a2 = a2 / a0;
+}
+
+// A +6 dB peak and a 40 Hz high pass, limiter off, on noise at -12 dBFS. Returns the
+// samples further than BENCH_EQ_TOL from the reference; the largest error goes to `max_err`.
+static uint64_t check_eq(int channels, size_t chunk, double *max_err)
+{
+    audio_dsp_params_t params;
+    audio_dsp_default_params(&params);
+    params.limiter = false;
+    params.eq[0] = (audio_dsp_eq_t){ .type = AUDIO_DSP_EQ_PEAK, .freq_hz = 1000, .q = 1.0f, .gain_db = 6.0f };
+    params.eq[1] = (audio_dsp_eq_t){ .type = AUDIO_DSP_EQ_HIGHPASS, .freq_hz = 40, .q = 0.707f };
+    start(channels, &params, chunk);
+
+    ref_biquad_t ref[2];
+    for (int s = 0; s < 2; s++) {
+        ref_design(&ref[s], &params.eq[s]);
+    }
+    const size_t n = BENCH_FRAMES * channels;
+    for (size_t i = 0; i < n; i++) {
+        s_in16[i] = (int16_t)rand_amp(8192);
+        s_out16[i] = s_in16[i];
+    }
+    run_s16(s_out16, BENCH_FRAMES, chunk);
+
+    uint64_t bad = 0;
+    *max_err = 0;
+    for (size_t i = 0; i < n; i++) {
+        const int c = (int)(i % channels);
+        double x = s_in16[i];
+        for (int s = 0; s < 2; s++) {
+            ref_biquad_t *bq = &ref[s];
+            double y = bq->b0 * x + bq->b1 * bq->x1[c] + bq->b2 * bq->x2[c] - bq->a1 * bq->y1[c] - bq->a2 * bq->y2[c];
+            bq->x2[c] = bq->x1[c];
+            bq->x1[c] = x;
+            bq->y2[c] = bq->y1[c];
+            bq->y1[c] = y;
+            x = y;
+        }
+        double err = fabs(s_out16[i] - x);
+        *max_err = err > *max_err ? err : *max_err;
+        bad += err > BENCH_EQ_TOL;
+    }
+    return bad;
+}
+
+// 10 ms noise bursts of random level, up to clipped full scale, through +12 dB of volume,
+// with quiet gaps so every attack starts from a released limiter. Returns the samples over the
+// ceiling; the loudest output goes to `peak`.
+static uint64_t check_limiter(int bytes, int channels, size_t chunk, int32_t *peak)
+{
+    audio_dsp_params_t params;
+    audio_dsp_default_params(&params);
+    params.volume_db = 12.0f;
+    start(channels, &params, chunk);
+
+    // The ceiling in output units; s16 rounding can add half an LSB
+    const int32_t ceiling = bytes == 2 ? (s_dsp.limit + (1 << (BENCH_SHIFT - 1))) >> BENCH_SHIFT : s_dsp.limit << 4;
+    const size_t n = BENCH_FRAMES * channels;
+    int32_t amp = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (i % (BENCH_RATE / 100 * channels) == 0) {
+            amp = rand() % 3 == 0 ? 100 : rand() % 4 * INT16_MAX + 100;
+        }
+        int32_t v = rand_amp(amp);
+        s_out16[i] = (int16_t)(v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v));
+        s_out32[i] = (int32_t)s_out16[i] << 16;
+    }
+    if (bytes == 2) {
+        run_s16(s_out16, BENCH_FRAMES, chunk);
+    } else {
+        run_s32(s_out32, BENCH_FRAMES, chunk);
+    }
+
+    uint64_t bad = 0;
+    *peak = 0;
+    for (size_t i = 0; i < n; i++) {
+        int32_t v = bytes == 2 ? s_out16[i] : s_out32[i];
+        int32_t a = v < 0 ? (v == INT32_MIN ? INT32_MAX : -v) : v;
+        *peak = a > *peak ? a : *peak;
+        bad += a > ceiling;
+    }
+    return bad;
+}
+
+// From a fresh init the gain rises monotonically to unity within AUDIO_DSP_RAMP_MS
+static uint64_t check_ramp(int channels, size_t chunk)
+{
+    audio_dsp_params_t params;
+    audio_dsp_default_params(&params);
+    audio_dsp_init(&s_dsp, BENCH_RATE, channels);
+    audio_dsp_configure(&s_dsp, &params);
+
+    const int16_t level = 16000;
+    const size_t n = BENCH_FRAMES * channels;
+    for (size_t i = 0; i < n; i++) {
+        s_out16[i] = level;
+    }
+    run_s16(s_out16, BENCH_FRAMES, chunk);
+
+    const size_t done = ((size_t)BENCH_RATE * AUDIO_DSP_RAMP_MS / 1000 + s_dsp.lookahead) * channels;
+    uint64_t bad = 0;
+    for (size_t i = channels; i < n; i++) {
+        bad += s_out16[i] < s_out16[i - channels] || (i >= done && s_out16[i] != level);
+    }
+    return bad;
+}
+
+// A stop fade reaches silence in its length and holds it
+static uint64_t check_fade(int channels, size_t chunk)
+{
+    audio_dsp_params_t params;
+    audio_dsp_default_params(&params);
+    start(channels, &params, chunk);
+
+    const uint32_t fade_ms = 10;
+    audio_dsp_fade(&s_dsp, false, fade_ms);
+    const size_t n = BENCH_FRAMES * channels;
+    for (size_t i = 0; i < n; i++) {
+        s_out16[i] = (int16_t)rand_amp(30000);
+    }
+    run_s16(s_out16, BENCH_FRAMES, chunk);
+
+    const size_t silent = ((size_t)BENCH_RATE * fade_ms / 1000 + s_dsp.lookahead) * channels;
+    uint64_t bad = !audio_dsp_faded_out(&s_dsp);
+    for (size_t i = silent; i < n; i++) {
+        bad += s_out16[i] != 0;
+    }
+    return bad;
+}
+
+typedef enum {
+    STAGE_GAIN_UNITY,
+    STAGE_GAIN,
+    STAGE_GAIN_RAMP,
+    STAGE_FADE,
+    STAGE_BIQUAD,
+    STAGE_LIMITER,
+    STAGE_LIMITER_ACTIVE,
+    STAGE_CHAIN_S16,
+    STAGE_CHAIN_S32,
+} bench_stage_t;
+
+static const char *const s_stage_names[] = {
+    "gain_unity", "gain", "gain_ramp", "fade_ramp", "biquad", "limiter", "limiter_active", "chain_s16", "chain_s32",
+};
+
+static void bench_params(audio_dsp_params_t *params, int biquads)
+{
+    static const audio_dsp_eq_t eq[AUDIO_DSP_MAX_BIQUADS] = {
+        { AUDIO_DSP_EQ_HIGHPASS, 40, 0.707f, 0 },
+        { AUDIO_DSP_EQ_LOWSHELF, 120, 0.707f, 3.0f },
+        { AUDIO_DSP_EQ_PEAK, 2500, 1.5f, -4.0f },
+        { AUDIO_DSP_EQ_HIGHSHELF, 8000, 0.707f, 2.0f },
+    };
+    audio_dsp_default_params(params);
+    for (int i = 0; i < biquads; i++) {
+        params->eq[i] = eq[i];
+    }
+}
+
+// Nanoseconds per chunk of one stage, or of a whole chain with `biquads` bands
+static double bench(bench_stage_t stage, int channels, int biquads, size_t chunk, int rounds)
+{
+    audio_dsp_params_t params;
+    bench_params(&params, biquads);
+    if (stage == STAGE_GAIN) {
+        params.volume_db = -6.0f;
+    }
+    audio_dsp_init(&s_dsp, BENCH_RATE, channels);
+    audio_dsp_configure(&s_dsp, &params);
+    s_dsp.gain = s_dsp.gain_target;
+
+    // Hot input drives the limiter into gain reduction all the time; the rest stays under
+    const int shift = stage == STAGE_LIMITER_ACTIVE ? BENCH_SHIFT + 1 : BENCH_SHIFT - 1;
+    const size_t n = BENCH_FRAMES * channels;
+    uint64_t total = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < n; i++) {
+            s_in32[i] = (int32_t)rand_amp(INT16_MAX);
+            s_out16[i] = (int16_t)(s_in32[i] >> 1);
+            s_out32[i] = s_in32[i] << shift;
+        }
+        uint64_t t0 = cpu_ns();
+        for (size_t f = 0; f < BENCH_FRAMES; f += chunk) {
+            const size_t len = BENCH_FRAMES - f < chunk ? BENCH_FRAMES - f : chunk;
+            int32_t *x = s_out32 + f * channels;
+            switch (stage) {
+            case STAGE_GAIN_UNITY:
+            case STAGE_GAIN:
+                audio_dsp_gain_block(&s_dsp, x, len);
+                break;
+            case STAGE_GAIN_RAMP:
+                s_dsp.gain = 0;     // Every chunk is mid-ramp
+                audio_dsp_gain_block(&s_dsp, x, len);
+                break;
+            case STAGE_FADE:
+                s_dsp.fade = 0;
+                audio_dsp_fade_block(&s_dsp, x, len);
+                break;
+            case STAGE_BIQUAD:
+                audio_dsp_biquad_block(&s_dsp, x, len);
+                break;
+            case STAGE_LIMITER:
+            case STAGE_LIMITER_ACTIVE:
+                audio_dsp_limiter_block(&s_dsp, x, len);
+                break;
+            case STAGE_CHAIN_S16:
+                audio_dsp_process_s16(&s_dsp, s_out16 + f * channels, len);
+                break;
+            case STAGE_CHAIN_S32:
+                audio_dsp_process_s32(&s_dsp, x, len);
+                break;
+            }
+        }
+        total += cpu_ns() - t0;
+    }
+    const double chunks = (double)rounds * ((BENCH_FRAMES + chunk - 1) / chunk);
+    return total / chunks;
+}
+
+int main(int argc, char **argv)
+{
+    size_t chunk = 96;
+    int rounds = 20;
+    unsigned seed = 1;
+
+    static const struct option opts[] = {
+        { "chunk", required_argument, NULL, 'c' },
+        { "rounds", required_argument, NULL, 'r' },
+        { "seed", required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'c': chunk = (size_t)atol(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [--chunk FRAMES] [--rounds N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (chunk == 0 || rounds <= 0) {
+        fprintf(stderr, "chunk and rounds must be positive\n");
+        return 1;
+    }
+    srand(seed);
+
+    uint64_t failures = 0;
+    printf("{\"chunk\":%zu,\"rate\":%d,\"checks\":[", chunk, BENCH_RATE);
+    const char *sep = "";
+    for (int ch = 1; ch <= AUDIO_DSP_MAX_CH; ch++) {
+        for (int bytes = 2; bytes <= 4; bytes += 2) {
+            uint64_t bad = check_passthrough(bytes, ch, chunk);
+            failures += bad;
+            printf("%s{\"name\":\"passthrough\",\"bytes\":%d,\"channels\":%d,\"bad\":%llu}", sep, bytes, ch,
+                   (unsigned long long)bad);
+            sep = ",";
+
+            int32_t peak;
+            bad = check_limiter(bytes, ch, chunk, &peak);
+            failures += bad;
+            printf(",{\"name\":\"limiter_ceiling\",\"bytes\":%d,\"channels\":%d,\"limit\":%ld,\"peak\":%ld,"
+                   "\"bad\":%llu}", bytes, ch, bytes == 2 ? (long)(s_dsp.limit + (1 << (BENCH_SHIFT - 1))) >> BENCH_SHIFT
+                   : (long)s_dsp.limit << 4, (long)peak, (unsigned long long)bad);
+        }
+        double max_err;
+        uint64_t bad = check_eq(ch, chunk, &max_err);
+        failures += bad;
+        printf(",{\"name\":\"eq_reference\",\"channels\":%d,\"max_err_lsb\":%.3f,\"bad\":%llu}", ch, max_err,
+               (unsigned long long)bad);
+        bad = check_ramp(ch, chunk);
+        failures += bad;
+        printf(",{\"name\":\"gain_ramp\",\"channels\":%d,\"bad\":%llu}", ch, (unsigned long long)bad);
+        bad = check_fade(ch, chunk);
+        failures += bad;
+        printf(",{\"name\":\"fade_out\",\"channels\":%d,\"bad\":%llu}", ch, (unsigned long long)bad);
+    }
+
+    printf("],\"stages\":[");
+    sep = "";
+    for (int ch = 1; ch <= AUDIO_DSP_MAX_CH; ch++) {
+        for (bench_stage_t stage = STAGE_GAIN_UNITY; stage <= STAGE_CHAIN_S32; stage++) {
+            const int first = stage == STAGE_BIQUAD ? 1 : stage >= STAGE_CHAIN_S16 ? 0 : -1;
+            const int last = first < 0 ? -1 : AUDIO_DSP_MAX_BIQUADS;
+            for (int biquads = first; biquads <= last; biquads++) {
+                if (stage >= STAGE_CHAIN_S16 && biquads != 0 && biquads != AUDIO_DSP_MAX_BIQUADS) {
+                    continue;
+                }
+                printf("%s{\"stage\":\"%s\",\"channels\":%d,", sep, s_stage_names[stage], ch);
+                if (biquads >= 0) {
+                    printf("\"biquads\":%d,", biquads);
+                }
+                printf("\"ns_per_chunk\":%.0f}", bench(stage, ch, biquads < 0 ? 0 : biquads, chunk, rounds));
+                sep = ",";
+            }
+        }
+    }
+    printf("],\"failures\":%llu}\n", (unsigned long long)failures);
+    return failures ? 1 : 0;
+}
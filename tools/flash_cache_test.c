@@ -0,0 +1,344 @@
+// Host tool: runs the MSC sector cache (main/flash_cache.c) against an emulated SPI NOR
+// partition through flash_cache_ops_t. Checks random mixes of sector and whole-unit
+// writes against a reference image, read back through the cache and on flash after a
+// flush, that flash_cache_flush_unit() erases one unit per call oldest first, and that
+// failed erases and reads lose nothing. Reports the write amplification of typical
+// host patterns next to wear levelling's own for the same writes. Prints one JSON object
+// and exits 1 on any failure.
+//
+//   cc -O2 -Imain -o flash_cache_test tools/flash_cache_test.c main/flash_cache.c
+//   ./flash_cache_test [--ops N] [--seed S]
+//
+// The emulated chip behaves like the real one: erases cover whole 4 KB units and set
+// them to 0xFF, programs can only clear bits, and a program over bytes that weren't
+// erased is counted as an error. Without the cache, wear levelling erases and
+// reprograms the whole 4 KB unit around every partial write; that is the baseline.
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_cache.h"
+
+#define TEST_SECTOR         (512)   // WL sector size
+#define TEST_FLASH_BYTES    (1 << 20)
+#define TEST_UNITS          (TEST_FLASH_BYTES / FLASH_CACHE_UNIT_BYTES)
+#define TEST_MSC_BUF        (16384) // MSC_ENGINE_BUF_BYTES, the largest single write
+#define TEST_LOG            (64)
+
+typedef struct {
+    uint8_t mem[TEST_FLASH_BYTES];
+    uint32_t erases;                // Units
+    uint32_t misaligned;
+    uint32_t overprograms;
+    uint32_t out_of_range;
+    int fail_erase;                 // The erase this many erases from now fails, 0 for none
+    int fail_read;
+    size_t erase_log[TEST_LOG];     // Unit addresses, in order
+} nor_t;
+
+static nor_t s_nor;
+static uint8_t s_ref[TEST_FLASH_BYTES];
+static uint8_t s_cache_mem[FLASH_CACHE_UNITS * FLASH_CACHE_UNIT_BYTES];
+static int s_failures;
+
+static bool nor_range_ok(nor_t *n, size_t addr, size_t len)
+{
+    if (addr > TEST_FLASH_BYTES || len > TEST_FLASH_BYTES - addr) {
+        n->out_of_range++;
+        return false;
+    }
+    return true;
+}
+
+static int nor_read(void *ctx, size_t addr, void *dst, size_t len)
+{
+    nor_t *n = ctx;
+    if (!nor_range_ok(n, addr, len) || (n->fail_read && --n->fail_read == 0)) {
+        return -1;
+    }
+    memcpy(dst, n->mem + addr, len);
+    return 0;
+}
+
+static int nor_erase(void *ctx, size_t addr, size_t len)
+{
+    nor_t *n = ctx;
+    if ((addr | len) % FLASH_CACHE_UNIT_BYTES) {
+        n->misaligned++;
+        return -1;
+    }
+    if (!nor_range_ok(n, addr, len) || (n->fail_erase && --n->fail_erase == 0)) {
+        return -1;
+    }
+    for (size_t off = 0; off < len; off += FLASH_CACHE_UNIT_BYTES) {
+        if (n->erases < TEST_LOG) {
+            n->erase_log[n->erases] = addr + off;
+        }
+        n->erases++;
+    }
+    memset(n->mem + addr, 0xFF, len);
+    return 0;
+}
+
+static int nor_write(void *ctx, size_t addr, const void *src, size_t len)
+{
+    nor_t *n = ctx;
+    if (!nor_range_ok(n, addr, len)) {
+        return -1;
+    }
+    const uint8_t *p = src;
+    bool counted = false;
+    for (size_t i = 0; i < len; i++) {
+        if (n->mem[addr + i] != 0xFF && !counted) {
+            n->overprograms++;
+            counted = true;
+        }
+        n->mem[addr + i] &= p[i];
+    }
+    return 0;
+}
+
+static void cache_setup(flash_cache_t *cache)
+{
+    memset(&s_nor, 0, sizeof(s_nor));
+    memset(s_nor.mem, 0xFF, sizeof(s_nor.mem));
+    memset(s_ref, 0xFF, sizeof(s_ref));
+    const flash_cache_ops_t ops = { nor_read, nor_erase, nor_write, &s_nor };
+    flash_cache_init(cache, &ops, s_cache_mem);
+}
+
+static bool cache_write(flash_cache_t *cache, size_t addr, const uint8_t *src, size_t len)
+{
+    memcpy(s_ref + addr, src, len);
+    return flash_cache_write(cache, addr, src, len) == 0;
+}
+
+static void fill_random(uint8_t *dst, size_t len, unsigned *seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = (uint8_t)rand_r(seed);
+    }
+}
+
+// Returns 1, and says what went wrong, unless `ok`
+static int check(const char *name, bool ok, const char *what)
+{
+    if (!ok) {
+        fprintf(stderr, "%s: %s\n", name, what);
+    }
+    return !ok;
+}
+
+static int check_flash_rules(const char *name)
+{
+    return check(name, s_nor.misaligned == 0, "erase not on whole units") +
+           check(name, s_nor.overprograms == 0, "program over bytes that weren't erased") +
+           check(name, s_nor.out_of_range == 0, "access outside the partition");
+}
+
+static void report(const char *name, int failures, const char *extra)
+{
+    s_failures += failures;
+    printf("%s{\"name\":\"%s\",%s\"failures\":%d}", strcmp(name, "random") ? "," : "", name, extra, failures);
+}
+
+// The host's mix: mostly a few sectors anywhere, some whole buffers at unit boundaries
+static void case_random(uint32_t ops, unsigned seed)
+{
+    static flash_cache_t cache;
+    static uint8_t buf[TEST_MSC_BUF];
+    cache_setup(&cache);
+    int bad = 0;
+    uint32_t read_checks = 0;
+    for (uint32_t i = 0; i < ops && !bad; i++) {
+        size_t len, addr;
+        if (rand_r(&seed) % 8 == 0) {
+            len = (1 + rand_r(&seed) % (TEST_MSC_BUF / FLASH_CACHE_UNIT_BYTES)) * FLASH_CACHE_UNIT_BYTES;
+            addr = (size_t)(rand_r(&seed) % (TEST_UNITS - len / FLASH_CACHE_UNIT_BYTES + 1)) * FLASH_CACHE_UNIT_BYTES;
+        } else {
+            len = (1 + rand_r(&seed) % 16) * TEST_SECTOR;
+            addr = (size_t)(rand_r(&seed) % ((TEST_FLASH_BYTES - len) / TEST_SECTOR + 1)) * TEST_SECTOR;
+        }
+        fill_random(buf, len, &seed);
+        bad += check("random", cache_write(&cache, addr, buf, len), "write failed");
+        if (rand_r(&seed) % 4 == 0) {
+            // Anything, including ranges that straddle cached and uncached units
+            len = (1 + rand_r(&seed) % 32) * TEST_SECTOR;
+            addr = (size_t)(rand_r(&seed) % ((TEST_FLASH_BYTES - len) / TEST_SECTOR + 1)) * TEST_SECTOR;
+            bad += check("random", flash_cache_read(&cache, addr, buf, len) == 0 && memcmp(buf, s_ref + addr, len) == 0,
+                         "read through the cache differs");
+            read_checks++;
+        }
+        if (rand_r(&seed) % 64 == 0) {
+            bad += check("random", flash_cache_flush_unit(&cache) == 0, "flush_unit failed");
+        }
+    }
+    bad += check("random", flash_cache_flush(&cache) == 0 && !flash_cache_dirty(&cache), "flush failed");
+    bad += check("random", memcmp(s_nor.mem, s_ref, TEST_FLASH_BYTES) == 0, "flash differs after flush");
+    flash_cache_invalidate(&cache);
+    for (size_t addr = 0; addr < TEST_FLASH_BYTES && !bad; addr += sizeof(buf)) {
+        bad += check("random", flash_cache_read(&cache, addr, buf, sizeof(buf)) == 0 && memcmp(buf, s_ref + addr, sizeof(buf)) == 0,
+                     "read after invalidate differs");
+    }
+    bad += check_flash_rules("random");
+
+    char extra[96];
+    snprintf(extra, sizeof(extra), "\"ops\":%u,\"read_checks\":%u,\"erases\":%u,", ops, read_checks, s_nor.erases);
+    report("random", bad, extra);
+}
+
+// Every dirty unit takes exactly one call and one erase, least recently used first
+static void case_flush_unit(unsigned seed)
+{
+    static flash_cache_t cache;
+    uint8_t sector[TEST_SECTOR];
+    const size_t units[FLASH_CACHE_UNITS] = { 7, 2, 100, 31 };
+    cache_setup(&cache);
+    int bad = 0;
+    for (int i = 0; i < FLASH_CACHE_UNITS; i++) {
+        fill_random(sector, sizeof(sector), &seed);
+        bad += check("flush_unit", cache_write(&cache, units[i] * FLASH_CACHE_UNIT_BYTES + TEST_SECTOR, sector, sizeof(sector)),
+                     "write failed");
+    }
+    // Touching the first unit again makes it the most recently used
+    fill_random(sector, sizeof(sector), &seed);
+    bad += check("flush_unit", cache_write(&cache, units[0] * FLASH_CACHE_UNIT_BYTES, sector, sizeof(sector)), "write failed");
+    const size_t order[FLASH_CACHE_UNITS] = { units[1], units[2], units[3], units[0] };
+
+    bad += check("flush_unit", s_nor.erases == 0, "erased before any flush");
+    int calls = 0;
+    while (flash_cache_dirty(&cache) && calls < 2 * FLASH_CACHE_UNITS) {
+        uint32_t before = s_nor.erases;
+        bad += check("flush_unit", flash_cache_flush_unit(&cache) == 0, "flush_unit failed");
+        bad += check("flush_unit", s_nor.erases - before == 1, "not exactly one erase per call");
+        bad += check("flush_unit", s_nor.erase_log[calls] == order[calls] * FLASH_CACHE_UNIT_BYTES, "not least recently used first");
+        calls++;
+    }
+    bad += check("flush_unit", calls == FLASH_CACHE_UNITS, "dirty units and calls differ");
+    bad += check("flush_unit", flash_cache_flush_unit(&cache) == 0 && s_nor.erases == FLASH_CACHE_UNITS, "clean cache erased");
+    bad += check("flush_unit", memcmp(s_nor.mem, s_ref, TEST_FLASH_BYTES) == 0, "flash differs after flush");
+    bad += check_flash_rules("flush_unit");
+
+    char extra[64];
+    snprintf(extra, sizeof(extra), "\"calls\":%d,\"erases\":%u,", calls, s_nor.erases);
+    report("flush_unit", bad, extra);
+}
+
+// A failed erase leaves the unit dirty for the next flush; a failed read on a miss
+// leaves nothing half loaded behind
+static void case_errors(unsigned seed)
+{
+    static flash_cache_t cache;
+    uint8_t buf[2 * TEST_SECTOR];
+    cache_setup(&cache);
+    int bad = 0;
+
+    fill_random(buf, sizeof(buf), &seed);
+    bad += check("errors", cache_write(&cache, 3 * FLASH_CACHE_UNIT_BYTES, buf, sizeof(buf)), "write failed");
+    s_nor.fail_erase = 1;
+    bad += check("errors", flash_cache_flush_unit(&cache) != 0, "failed erase not reported");
+    bad += check("errors", flash_cache_dirty(&cache), "unit clean after a failed erase");
+    bad += check("errors", flash_cache_flush(&cache) == 0 && memcmp(s_nor.mem, s_ref, TEST_FLASH_BYTES) == 0,
+                 "retried flush lost data");
+
+    // Miss with the load failing
+    fill_random(buf, sizeof(buf), &seed);
+    s_nor.fail_read = 1;
+    bad += check("errors", flash_cache_write(&cache, 9 * FLASH_CACHE_UNIT_BYTES, buf, TEST_SECTOR) != 0, "failed load not reported");
+    bad += check("errors", flash_cache_read(&cache, 9 * FLASH_CACHE_UNIT_BYTES, buf, TEST_SECTOR) == 0 &&
+                           memcmp(buf, s_ref + 9 * FLASH_CACHE_UNIT_BYTES, TEST_SECTOR) == 0,
+                 "failed load left data behind");
+    bad += check("errors", !flash_cache_dirty(&cache), "failed load left a dirty unit");
+
+    // Evicting a dirty unit fails: the write reports it and the unit stays cached
+    for (int i = 0; i < FLASH_CACHE_UNITS; i++) {
+        fill_random(buf, TEST_SECTOR, &seed);
+        bad += check("errors", cache_write(&cache, (size_t)(20 + i) * FLASH_CACHE_UNIT_BYTES, buf, TEST_SECTOR), "write failed");
+    }
+    uint8_t extra_sector[TEST_SECTOR];
+    fill_random(extra_sector, sizeof(extra_sector), &seed);
+    s_nor.fail_erase = 1;
+    bad += check("errors", flash_cache_write(&cache, 40 * FLASH_CACHE_UNIT_BYTES, extra_sector, TEST_SECTOR) != 0,
+                 "failed eviction not reported");
+    bad += check("errors", cache_write(&cache, 40 * FLASH_CACHE_UNIT_BYTES, extra_sector, TEST_SECTOR), "write after a failed eviction");
+    bad += check("errors", flash_cache_flush(&cache) == 0 && memcmp(s_nor.mem, s_ref, TEST_FLASH_BYTES) == 0,
+                 "data lost after a failed eviction");
+    bad += check_flash_rules("errors");
+    report("errors", bad, "");
+}
+
+typedef struct {
+    const char *name;
+    size_t bytes;               // Per write
+    bool sequential;
+} pattern_t;
+
+// Flash bytes programmed per host byte for a write pattern, against WL without the cache
+static void case_amplification(const pattern_t *p, unsigned seed)
+{
+    static flash_cache_t cache;
+    static uint8_t buf[TEST_MSC_BUF];
+    cache_setup(&cache);
+    const size_t span = TEST_FLASH_BYTES / 4;
+    uint64_t uncached = 0;
+    int bad = 0;
+    for (size_t done = 0; done < span; done += p->bytes) {
+        size_t addr = p->sequential ? done : (size_t)(rand_r(&seed) % (TEST_FLASH_BYTES / p->bytes)) * p->bytes;
+        fill_random(buf, p->bytes, &seed);
+        bad += check(p->name, cache_write(&cache, addr, buf, p->bytes), "write failed");
+        // WL rewrites every unit the write touches in full
+        uncached += ((addr + p->bytes + FLASH_CACHE_UNIT_BYTES - 1) / FLASH_CACHE_UNIT_BYTES - addr / FLASH_CACHE_UNIT_BYTES) *
+                    FLASH_CACHE_UNIT_BYTES;
+    }
+    bad += check(p->name, flash_cache_flush(&cache) == 0 && memcmp(s_nor.mem, s_ref, TEST_FLASH_BYTES) == 0, "flash differs after flush");
+    bad += check_flash_rules(p->name);
+    uint32_t pct = flash_cache_write_amplification_pct(&cache);
+    uint32_t uncached_pct = (uint32_t)(uncached * 100 / cache.host_bytes);
+    // Never worse than without the cache, and sequential writes merge completely
+    bad += check(p->name, pct <= uncached_pct, "amplification above the uncached baseline");
+    bad += check(p->name, !p->sequential || pct == 100, "sequential writes not merged");
+
+    char extra[96];
+    snprintf(extra, sizeof(extra), "\"write_amplification_pct\":%u,\"uncached_pct\":%u,", pct, uncached_pct);
+    report(p->name, bad, extra);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t ops = 200000;
+    unsigned seed = 1;
+    static const struct option opts[] = {
+        { "ops", required_argument, NULL, 'o' },
+        { "seed", required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'o': ops = strtoul(optarg, NULL, 0); break;
+        case 's': seed = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s [--ops N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    const pattern_t patterns[] = {
+        { "sequential_sectors", TEST_SECTOR, true },        // A file copy the host splits up
+        { "sequential_buffers", TEST_MSC_BUF, true },
+        { "random_sectors", TEST_SECTOR, false },           // FAT and directory updates
+        { "random_2k", 4 * TEST_SECTOR, false },
+    };
+    printf("{\"cases\":[");
+    case_random(ops, seed);
+    case_flush_unit(seed);
+    case_errors(seed);
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+        case_amplification(&patterns[i], seed);
+    }
+    printf("],\"failures\":%d}\n", s_failures);
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,7 @@
+#pragma once
+// See freertos/FreeRTOS.h. The bench runs on one thread, which stands for one core.
+
+static inline int esp_cpu_get_core_id(void)
+{
+    return 0;
+}
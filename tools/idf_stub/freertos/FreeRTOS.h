@@ -0,0 +1,5 @@
+#pragma once
+// The ESP-IDF declarations main/telemetry.c uses, for building it on a host
+// (tools/telemetry_bench.c). Nothing here schedules anything.
+
+#define portNUM_PROCESSORS 2
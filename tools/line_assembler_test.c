@@ -0,0 +1,230 @@
+// Host tool: feeds console input through main/line_assembler.c the way the console
+// worker does (cdc_console_task), in every packet split, and checks the lines it
+// produces and the bytes it leaves for a raw-mode handler. Prints one JSON object and
+// exits 1 on any mismatch.
+//
+//   cc -O2 -Imain -o line_assembler_test tools/line_assembler_test.c main/line_assembler.c
+//   ./line_assembler_test [--rounds N]
+//
+// Every case is run with the input cut into two packets at every position, and in
+// packets of every size from 1 byte up to the whole input. Timing is host CPU time per
+// byte of a long stream of short commands, for comparing builds only.
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "line_assembler.h"
+
+#define TEST_LINE_MAX   (256)   // CDC_CONSOLE_LINE_MAX
+#define TEST_LINES_MAX  (8)
+#define TEST_RAW_MAX    (64)
+#define TEST_RAW_END    (0x04)  // The raw handler below removes itself after this byte
+
+typedef struct {
+    const char *name;
+    const char *input;
+    size_t input_len;           // 0: strlen(input)
+    const char *lines[TEST_LINES_MAX];
+    uint32_t overflows;
+    const char *raw_after;      // A line that switches to raw mode, NULL for none
+    const char *raw;            // Bytes the raw handler must see, up to TEST_RAW_END
+    size_t raw_len;             // 0: strlen(raw)
+} line_case_t;
+
+typedef struct {
+    char lines[TEST_LINES_MAX][TEST_LINE_MAX];
+    int line_count;
+    uint8_t raw[TEST_RAW_MAX];
+    size_t raw_len;
+    uint32_t overflows;
+} line_result_t;
+
+static uint64_t cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// The console worker's input loop for one packet: raw bytes go to the raw handler while
+// one is installed, the rest through the assembler one line at a time
+static void worker_packet(line_asm_t *la, bool *raw_mode, const line_case_t *c, line_result_t *r,
+                          const uint8_t *rx, size_t rx_len)
+{
+    size_t rx_off = 0;
+    while (rx_off < rx_len) {
+        if (*raw_mode) {
+            uint8_t b = rx[rx_off++];
+            if (r->raw_len < TEST_RAW_MAX) {
+                r->raw[r->raw_len++] = b;
+            }
+            *raw_mode = b != TEST_RAW_END;
+            continue;
+        }
+        const char *line;
+        rx_off += line_asm_feed(la, rx + rx_off, rx_len - rx_off, &line);
+        if (line == NULL) {
+            continue;
+        }
+        if (r->line_count < TEST_LINES_MAX) {
+            snprintf(r->lines[r->line_count], TEST_LINE_MAX, "%s", line);
+        }
+        r->line_count++;
+        // A command that installs a raw handler does so before the worker reads on
+        *raw_mode = c->raw_after && strcmp(line, c->raw_after) == 0;
+    }
+}
+
+static line_result_t run_split(const line_case_t *c, const uint8_t *in, size_t len, const size_t *cuts, int cut_count,
+                               size_t packet)
+{
+    static char buf[TEST_LINE_MAX];
+    line_asm_t la;
+    line_asm_init(&la, buf, sizeof(buf));
+    line_result_t r = { 0 };
+    bool raw_mode = false;
+    size_t start = 0;
+    for (int i = 0; i <= cut_count && start < len; i++) {
+        size_t end = i < cut_count ? cuts[i] : len;
+        while (start < end) {
+            size_t n = packet && end - start > packet ? packet : end - start;
+            worker_packet(&la, &raw_mode, c, &r, in + start, n);
+            start += n;
+        }
+    }
+    r.overflows = la.overflows;
+    return r;
+}
+
+static int check(const line_case_t *c, const line_result_t *r, const char *how)
+{
+    int expect_lines = 0;
+    while (expect_lines < TEST_LINES_MAX && c->lines[expect_lines]) {
+        expect_lines++;
+    }
+    size_t raw_len = c->raw_len ? c->raw_len : c->raw ? strlen(c->raw) : 0;
+    const char *why = NULL;
+    if (r->line_count != expect_lines) {
+        why = "line count";
+    } else if (r->overflows != c->overflows) {
+        why = "overflow count";
+    } else if (r->raw_len != raw_len || memcmp(r->raw, c->raw ? c->raw : "", raw_len) != 0) {
+        why = "raw bytes";
+    }
+    for (int i = 0; !why && i < expect_lines; i++) {
+        if (strcmp(r->lines[i], c->lines[i]) != 0) {
+            why = "line text";
+        }
+    }
+    if (why) {
+        fprintf(stderr, "%s, %s: %s differs (%d lines, %u overflows, %zu raw bytes)\n", c->name, how, why,
+                r->line_count, r->overflows, r->raw_len);
+        return 1;
+    }
+    return 0;
+}
+
+static char s_long[TEST_LINE_MAX + 1];
+static char s_fits[TEST_LINE_MAX];
+static const char s_raw_nul[] = "xfer put f\n\x00\xa5\x00\x04\n\nls\n";
+
+int main(int argc, char **argv)
+{
+    int rounds = 2000;
+    static const struct option opts[] = {
+        { "rounds", required_argument, NULL, 'n' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        if (opt == 'n') {
+            rounds = atoi(optarg);
+        } else {
+            fprintf(stderr, "usage: %s [--rounds N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // One line that just fits (cap - 1 characters) and one that does not
+    memset(s_fits, 'f', TEST_LINE_MAX - 1);
+    char fits_input[TEST_LINE_MAX + 8];
+    snprintf(fits_input, sizeof(fits_input), "%s\r\nok\n", s_fits);
+    memset(s_long, 'x', TEST_LINE_MAX);
+    char long_input[TEST_LINE_MAX + 32];
+    snprintf(long_input, sizeof(long_input), "%s\bstill\r\nnext\r\n", s_long);
+
+    const line_case_t cases[] = {
+        { "crlf", "help\r\nstats\r\n", 0, { "help", "stats" }, 0, NULL, NULL, 0 },
+        { "mixed_terminators", "a\rb\nc\r\n\r\n\n\rd\r\r\n", 0, { "a", "b", "c", "d" }, 0, NULL, NULL, 0 },
+        { "backspace", "ab\bc\x7f" "d\r\n\b\b\r\nx\x7f\r\n", 0, { "ad" }, 0, NULL, NULL, 0 },
+        { "longest_line", fits_input, 0, { s_fits, "ok" }, 0, NULL, NULL, 0 },
+        // Dropped up to its terminator, backspace or not; the next line is intact
+        { "overflow", long_input, 0, { "next" }, 1, NULL, NULL, 0 },
+        // "xfer put" switches to raw mode: the bytes behind the command line, in the same
+        // packet or not, are the handler's, and line mode resumes after it
+        { "raw_after_lf", "xfer put f\n\xa5\x01\r\n\x04stats\r\n", 0, { "xfer put f", "stats" }, 0, "xfer put f",
+          "\xa5\x01\r\n\x04", 0 },
+        // The line completes at CR, so the LF of a CRLF is the first raw byte; cdc_xfer
+        // skips it while hunting for its magic byte
+        { "raw_after_crlf", "xfer put f\r\n\xa5\x04\nstats\n", 0, { "xfer put f", "stats" }, 0, "xfer put f",
+          "\n\xa5\x04", 0 },
+        { "raw_nul", s_raw_nul, sizeof(s_raw_nul) - 1, { "xfer put f", "ls" }, 0, "xfer put f",
+          "\x00\xa5\x00\x04", 4 },
+    };
+
+    int failures = 0;
+    uint32_t splits = 0;
+    printf("{\n  \"cases\": [");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const line_case_t *c = &cases[i];
+        const uint8_t *in = (const uint8_t *)c->input;
+        size_t len = c->input_len ? c->input_len : strlen(c->input);
+        int case_failures = 0;
+        uint32_t case_splits = 0;
+        char how[64];
+        for (size_t cut = 0; cut <= len; cut++) {
+            line_result_t r = run_split(c, in, len, &cut, 1, 0);
+            snprintf(how, sizeof(how), "cut at %zu", cut);
+            case_failures += check(c, &r, how);
+            case_splits++;
+        }
+        for (size_t packet = 1; packet <= len; packet++) {
+            line_result_t r = run_split(c, in, len, NULL, 0, packet);
+            snprintf(how, sizeof(how), "%zu-byte packets", packet);
+            case_failures += check(c, &r, how);
+            case_splits++;
+        }
+        failures += case_failures;
+        splits += case_splits;
+        printf("%s\n    {\"name\": \"%s\", \"bytes\": %zu, \"splits\": %u, \"failures\": %d}", i ? "," : "",
+               c->name, len, case_splits, case_failures);
+    }
+
+    // Throughput: short commands in 64-byte packets, as a terminal paste arrives
+    static uint8_t stream[64 * 1024];
+    static const char cmd[] = "vol 50\r\nstats\r\nls /data\r\n";
+    for (size_t i = 0; i < sizeof(stream); i++) {
+        stream[i] = (uint8_t)cmd[i % (sizeof(cmd) - 1)];
+    }
+    static char buf[TEST_LINE_MAX];
+    line_asm_t la;
+    line_asm_init(&la, buf, sizeof(buf));
+    uint64_t t0 = cpu_ns();
+    for (int k = 0; k < rounds; k++) {
+        for (size_t off = 0; off < sizeof(stream); off += 64) {
+            for (size_t i = 0; i < 64;) {
+                const char *line;
+                i += line_asm_feed(&la, stream + off + i, 64 - i, &line);
+            }
+        }
+    }
+    double ns_per_byte = (double)(cpu_ns() - t0) / ((double)rounds * sizeof(stream));
+
+    printf("\n  ],\n  \"splits\": %u,\n  \"lines\": %u,\n  \"ns_per_byte\": %.2f,\n  \"failures\": %d\n}\n",
+           splits, la.lines, ns_per_byte, failures);
+    return failures ? 1 : 0;
+}
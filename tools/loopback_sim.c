@@ -0,0 +1,261 @@
+// Host tool: loops the full-duplex I2S path of main.c through a simulated codec. TX and
+// RX DMA run off one bit clock, as they do on a single I2S controller; the codec feeds
+// its DAC back into its ADC after a fixed delay. The writer plays a frame counter, the
+// capture side reads whole RX buffers and converts them with audio_capture_convert(),
+// and every captured frame is checked against what was played. Prints one JSON object
+// and exits 1 if any format shows a discontinuity or a latency that moves.
+//
+//   cc -O2 -Imain -o loopback_sim tools/loopback_sim.c main/audio_capture.c
+//   ./loopback_sim [options]
+//
+//   --seconds N         simulated time per format (5)
+//   --rate R            sample rate (48000)
+//   --codec-delay F     DAC to ADC delay in frames (24)
+//   --frame-num F       frames per DMA buffer (240, EXAMPLE_I2S_DMA_FRAME_NUM with a mic)
+//   --restart-every MS  rebuild both channels every MS milliseconds, as a format switch does (0)
+//
+// The offset is the number of bit-clock frames between a frame leaving TX and the same
+// frame landing in RX. With a shared clock it is the codec delay and must not move, not
+// even across restarts. Latency is from the writer handing a frame to the TX DMA to the
+// capture task reading it back, which depends on where the frame sits in its buffers.
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audio_capture.h"
+
+#define SIM_DMA_DESC_NUM (6)
+#define SIM_DMA_BUF_MAX  (4092)
+#define SIM_DELAY_MAX    (4096)
+
+typedef struct {
+    int in_bytes;               // Slot format, shared by TX and RX
+    int in_channels;
+    int mic_channels;
+} sim_format_t;
+
+static const sim_format_t s_formats[] = {
+    { 2, 2, 1 }, { 2, 2, 2 }, { 2, 1, 1 }, { 2, 1, 2 },
+    { 4, 2, 1 }, { 4, 2, 2 }, { 4, 1, 1 }, { 4, 1, 2 },
+};
+#define SIM_FORMAT_COUNT (sizeof(s_formats) / sizeof(s_formats[0]))
+
+typedef struct {
+    uint64_t frames;            // Captured and checked
+    uint64_t errors;            // Frames that don't match the played counter
+    uint32_t restarts;
+    int64_t offset_min;
+    int64_t offset_max;
+    int64_t latency_max;
+} sim_result_t;
+
+// One slot of the played pattern: the frame counter in the top 16 bits, the channel in
+// the bits below so a swapped slot shows. 32-bit slots get noise in their low half,
+// which the conversion must drop.
+static void sim_put_sample(uint8_t *buf, size_t i, int bytes, uint16_t counter, int ch)
+{
+    int16_t v = (int16_t)(counter & 0x7ffe) | (ch & 1);
+    if (bytes == 2) {
+        ((int16_t *)buf)[i] = v;
+    } else {
+        ((int32_t *)buf)[i] = (int32_t)((uint32_t)(uint16_t)v << 16) | (rand() & 0xffff);
+    }
+}
+
+static sim_result_t sim_run(const sim_format_t *fmt, uint32_t rate, double seconds,
+                            uint32_t codec_delay, uint32_t frame_num, uint32_t restart_ms)
+{
+    sim_result_t res = { .offset_min = INT64_MAX, .offset_max = INT64_MIN, .latency_max = INT64_MIN };
+    const size_t frame_bytes = fmt->in_bytes * fmt->in_channels;
+    const size_t buf_bytes = frame_num * frame_bytes;
+    uint8_t *tx = calloc(SIM_DMA_DESC_NUM, buf_bytes);
+    uint8_t *rx = calloc(SIM_DMA_DESC_NUM, buf_bytes);
+    uint8_t *line = calloc(SIM_DELAY_MAX, frame_bytes);   // Codec delay line
+    int16_t *out = malloc(frame_num * 2 * sizeof(int16_t));
+    // Which played frame each TX slot holds, -1 for silence
+    int64_t *tx_tag = malloc(SIM_DMA_DESC_NUM * frame_num * sizeof(int64_t));
+    int64_t *line_tag = malloc(SIM_DELAY_MAX * sizeof(int64_t));
+    int64_t *rx_tag = malloc(SIM_DMA_DESC_NUM * frame_num * sizeof(int64_t));
+    // When each frame was handed to the DMA and when it was clocked out, by frame number
+    const uint64_t total = (uint64_t)(seconds * rate);
+    const uint64_t restart_frames = restart_ms ? (uint64_t)restart_ms * rate / 1000 : UINT64_MAX;
+    // Every start prefills the TX ring, and a restart throws its contents away
+    const uint64_t frames_max = total + (total / restart_frames + 2) * (SIM_DMA_DESC_NUM + 1) * frame_num;
+    uint64_t *written_at = calloc(frames_max, sizeof(uint64_t));
+    uint64_t *sent_at = calloc(frames_max, sizeof(uint64_t));
+    uint64_t *rx_at = malloc(SIM_DMA_DESC_NUM * frame_num * sizeof(uint64_t));
+
+    uint64_t played = 0;        // Next frame the writer produces
+    uint64_t clock = 0;
+    uint64_t next_restart = restart_frames;
+    int64_t expected = -1;      // Next played frame the capture side should see
+    int64_t offset = -1;
+
+    while (clock < total) {
+        // Channel (re)start: both DMA rings and the codec start out silent, the writer
+        // refills TX completely before the clock runs (i2s_channel_write blocks until a
+        // descriptor frees, so it stays full).
+        memset(tx, 0, SIM_DMA_DESC_NUM * buf_bytes);
+        memset(line, 0, SIM_DELAY_MAX * frame_bytes);
+        for (size_t i = 0; i < SIM_DMA_DESC_NUM * frame_num; i++) {
+            tx_tag[i] = rx_tag[i] = -1;
+        }
+        for (size_t i = 0; i < SIM_DELAY_MAX; i++) {
+            line_tag[i] = -1;
+        }
+        uint32_t tx_desc = 0, rx_desc = 0;
+        expected = -1;
+
+        // The writer keeps every descriptor but the one playing filled
+        for (uint32_t d = 1; d < SIM_DMA_DESC_NUM; d++) {
+            for (uint32_t f = 0; f < frame_num; f++) {
+                size_t slot = d * frame_num + f;
+                for (int ch = 0; ch < fmt->in_channels; ch++) {
+                    sim_put_sample(tx, slot * fmt->in_channels + ch, fmt->in_bytes, (uint16_t)(played << 1), ch);
+                }
+                tx_tag[slot] = played;
+                written_at[played] = clock;
+                played++;
+            }
+        }
+
+        while (clock < total && clock < next_restart) {
+            // One buffer period: TX clocks a descriptor out, RX clocks one in, frame by frame
+            for (uint32_t f = 0; f < frame_num; f++, clock++) {
+                size_t tx_slot = tx_desc * frame_num + f;
+                size_t in_pos = clock % SIM_DELAY_MAX;
+                size_t out_pos = (clock + SIM_DELAY_MAX - codec_delay) % SIM_DELAY_MAX;
+                memcpy(line + in_pos * frame_bytes, tx + tx_slot * frame_bytes, frame_bytes);
+                line_tag[in_pos] = tx_tag[tx_slot];
+                if (tx_tag[tx_slot] >= 0) {
+                    sent_at[tx_tag[tx_slot]] = clock;
+                }
+                size_t rx_slot = rx_desc * frame_num + f;
+                memcpy(rx + rx_slot * frame_bytes, line + out_pos * frame_bytes, frame_bytes);
+                rx_tag[rx_slot] = line_tag[out_pos];
+                rx_at[rx_slot] = clock;
+            }
+
+            // on_sent: the writer refills the descriptor that just played
+            for (uint32_t f = 0; f < frame_num; f++) {
+                size_t slot = tx_desc * frame_num + f;
+                for (int ch = 0; ch < fmt->in_channels; ch++) {
+                    sim_put_sample(tx, slot * fmt->in_channels + ch, fmt->in_bytes, (uint16_t)(played << 1), ch);
+                }
+                tx_tag[slot] = played;
+                written_at[played] = clock;
+                played++;
+            }
+            tx_desc = (tx_desc + 1) % SIM_DMA_DESC_NUM;
+
+            // on_recv: the capture task reads the buffer that just filled
+            uint8_t *in = rx + rx_desc * buf_bytes;
+            size_t len = audio_capture_convert(in, frame_num, fmt->in_bytes, fmt->in_channels, out, fmt->mic_channels);
+            if (len != frame_num * fmt->mic_channels * sizeof(int16_t)) {
+                res.errors += frame_num;
+            }
+            for (uint32_t f = 0; f < frame_num; f++) {
+                int64_t tag = rx_tag[rx_desc * frame_num + f];
+                if (tag < 0) {
+                    continue;   // Silence from before the first played frame came round
+                }
+                for (int ch = 0; ch < fmt->mic_channels; ch++) {
+                    // Mono to stereo duplicates, stereo to mono keeps the left slot
+                    int src_ch = fmt->in_channels == 1 ? 0 : ch;
+                    int16_t want = (int16_t)((uint16_t)(tag << 1) & 0x7ffe) | (src_ch & 1);
+                    if (out[f * fmt->mic_channels + ch] != want) {
+                        res.errors++;
+                    }
+                }
+                if (expected >= 0 && tag != expected) {
+                    res.errors++;   // Dropped or repeated frame
+                }
+                expected = tag + 1;
+                int64_t o = (int64_t)(rx_at[rx_desc * frame_num + f] - sent_at[tag]);
+                if (offset >= 0 && o != offset) {
+                    res.errors++;
+                }
+                offset = o;
+                res.offset_min = o < res.offset_min ? o : res.offset_min;
+                res.offset_max = o > res.offset_max ? o : res.offset_max;
+                int64_t l = (int64_t)(clock - written_at[tag]);
+                res.latency_max = l > res.latency_max ? l : res.latency_max;
+                res.frames++;
+            }
+            rx_desc = (rx_desc + 1) % SIM_DMA_DESC_NUM;
+        }
+        if (clock >= next_restart) {
+            next_restart += restart_frames;
+            res.restarts++;
+        }
+    }
+
+    free(tx);
+    free(rx);
+    free(line);
+    free(out);
+    free(tx_tag);
+    free(line_tag);
+    free(rx_tag);
+    free(written_at);
+    free(sent_at);
+    free(rx_at);
+    return res;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 5;
+    uint32_t rate = 48000;
+    uint32_t codec_delay = 24;
+    uint32_t frame_num = 240;
+    uint32_t restart_ms = 0;
+
+    static const struct option opts[] = {
+        { "seconds", required_argument, NULL, 's' },
+        { "rate", required_argument, NULL, 'r' },
+        { "codec-delay", required_argument, NULL, 'd' },
+        { "frame-num", required_argument, NULL, 'f' },
+        { "restart-every", required_argument, NULL, 'R' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 's': seconds = atof(optarg); break;
+        case 'r': rate = (uint32_t)atoi(optarg); break;
+        case 'd': codec_delay = (uint32_t)atoi(optarg); break;
+        case 'f': frame_num = (uint32_t)atoi(optarg); break;
+        case 'R': restart_ms = (uint32_t)atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [--seconds N] [--rate R] [--codec-delay F] [--frame-num F] [--restart-every MS]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (codec_delay >= SIM_DELAY_MAX || frame_num == 0 || frame_num * 8 > SIM_DMA_BUF_MAX || rate == 0) {
+        fprintf(stderr, "codec delay must be below %d frames, DMA buffers at most %d bytes\n", SIM_DELAY_MAX, SIM_DMA_BUF_MAX);
+        return 1;
+    }
+    srand(1);
+
+    bool ok = true;
+    printf("{\n");
+    printf("  \"rate\": %u,\n  \"codec_delay_frames\": %u,\n  \"dma_frame_num\": %u,\n", rate, codec_delay, frame_num);
+    printf("  \"formats\": [\n");
+    for (size_t i = 0; i < SIM_FORMAT_COUNT; i++) {
+        const sim_format_t *fmt = &s_formats[i];
+        sim_result_t res = sim_run(fmt, rate, seconds, codec_delay, frame_num, restart_ms);
+        bool pass = res.errors == 0 && res.frames > 0;
+        ok &= pass;
+        printf("    { \"slot_bits\": %d, \"slot_channels\": %d, \"mic_channels\": %d, \"frames\": %llu, \"errors\": %llu, "
+               "\"restarts\": %u, \"offset_frames_min\": %lld, \"offset_frames_max\": %lld, \"latency_ms_max\": %.3f, \"pass\": %s }%s\n",
+               fmt->in_bytes * 8, fmt->in_channels, fmt->mic_channels, (unsigned long long)res.frames,
+               (unsigned long long)res.errors, res.restarts, (long long)res.offset_min, (long long)res.offset_max,
+               res.latency_max * 1000.0 / rate, pass ? "true" : "false", i + 1 < SIM_FORMAT_COUNT ? "," : "");
+    }
+    printf("  ],\n  \"pass\": %s\n}\n", ok ? "true" : "false");
+    return ok ? 0 : 1;
+}
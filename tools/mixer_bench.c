@@ -0,0 +1,221 @@
+// Host tool: checks the effect mixer against a plain per-sample reference and measures
+// its cost per writer chunk. Voices of random length, channel count and gain (up to
+// AUDIO_MIXER_GAIN_MAX) are mixed over a full-scale random stream so the clamp is
+// exercised, and most voices end mid-block. Prints one JSON object and exits 1 on any
+// mismatch.
+//
+//   cc -O2 -Imain -o mixer_bench tools/mixer_bench.c main/audio_mixer.c
+//   ./mixer_bench [--chunk FRAMES] [--rounds N] [--seed S]
+//
+// The chunk defaults to 96 frames, one EXAMPLE_AUDIO_WRITE_CHUNK_MS chunk at 48 kHz.
+// Timing is host CPU time, for comparing builds, not a target figure.
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "audio_mixer.h"
+
+#define BENCH_FRAMES (20000)    // Stream and longest voice, in frames
+
+static int16_t s_mono[BENCH_FRAMES];
+static int16_t s_stereo[BENCH_FRAMES * 2];
+static int32_t s_orig[BENCH_FRAMES * 2];
+static int32_t s_out32[BENCH_FRAMES * 2];
+static int16_t s_out16[BENCH_FRAMES * 2];
+static audio_mixer_t s_mixer;
+
+typedef struct {
+    const int16_t *pcm;
+    uint32_t frames;
+    int channels;
+    int32_t gain;
+} bench_voice_t;
+
+static uint64_t cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int32_t rand32(void)
+{
+    return (int32_t)((uint32_t)rand() << 16 ^ (uint32_t)rand());
+}
+
+static int64_t clamp64(int64_t v, int64_t lo, int64_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// What the voices add to channel `ch` of `frame`, in 16-bit units
+static int64_t ref_voices(const bench_voice_t *v, int count, size_t frame, int ch, int out_ch)
+{
+    int64_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        if (frame >= v[i].frames) {
+            continue;
+        }
+        const int16_t *s = v[i].pcm + frame * v[i].channels;
+        int32_t x;
+        if (v[i].channels == out_ch) {
+            x = s[ch];
+        } else if (v[i].channels == 1) {
+            x = s[0];
+        } else {
+            x = (s[0] + s[1]) >> 1;
+        }
+        sum += ((int64_t)x * v[i].gain) >> 15;
+    }
+    return sum;
+}
+
+static void start_voices(bench_voice_t *v, int count)
+{
+    audio_mixer_init(&s_mixer);
+    for (int i = 0; i < count; i++) {
+        v[i].channels = 1 + rand() % 2;
+        v[i].pcm = v[i].channels == 1 ? s_mono : s_stereo;
+        v[i].frames = 1 + rand() % BENCH_FRAMES;
+        v[i].gain = rand() % (AUDIO_MIXER_GAIN_MAX + 1);
+        audio_mixer_play(&s_mixer, v[i].pcm, v[i].frames, v[i].channels, v[i].gain);
+    }
+}
+
+static void mix(int bytes, int out_ch, size_t chunk)
+{
+    for (size_t f = 0; f < BENCH_FRAMES; f += chunk) {
+        size_t n = BENCH_FRAMES - f < chunk ? BENCH_FRAMES - f : chunk;
+        if (bytes == 2) {
+            audio_mixer_mix_s16(&s_mixer, s_out16 + f * out_ch, n, out_ch);
+        } else {
+            audio_mixer_mix_s32(&s_mixer, s_out32 + f * out_ch, n, out_ch);
+        }
+    }
+}
+
+static void fill_stream(int out_ch)
+{
+    for (size_t i = 0; i < BENCH_FRAMES * (size_t)out_ch; i++) {
+        s_orig[i] = rand32();
+        s_out32[i] = s_orig[i];
+        s_out16[i] = (int16_t)(s_orig[i] >> 16);
+    }
+}
+
+// Mixes `count` random voices over a random stream and compares every sample.
+static uint64_t check(int bytes, int out_ch, int count, size_t chunk)
+{
+    bench_voice_t v[AUDIO_MIXER_VOICES];
+    fill_stream(out_ch);
+    start_voices(v, count);
+    mix(bytes, out_ch, chunk);
+
+    uint64_t mismatches = 0;
+    for (size_t f = 0; f < BENCH_FRAMES; f++) {
+        for (int ch = 0; ch < out_ch; ch++) {
+            const size_t i = f * out_ch + ch;
+            const int64_t add = ref_voices(v, count, f, ch, out_ch);
+            if (bytes == 2) {
+                mismatches += s_out16[i] != clamp64((int16_t)(s_orig[i] >> 16) + add, INT16_MIN, INT16_MAX);
+            } else {
+                mismatches += s_out32[i] != clamp64(s_orig[i] + add * 65536, INT32_MIN, INT32_MAX);
+            }
+        }
+    }
+    if (audio_mixer_active(&s_mixer)) {
+        mismatches++;   // Every voice ends within the stream
+    }
+    return mismatches;
+}
+
+// Nanoseconds per chunk with `count` voices that all outlast the stream
+static double bench(int bytes, int out_ch, int count, size_t chunk, int rounds)
+{
+    uint64_t total = 0;
+    for (int r = 0; r < rounds; r++) {
+        audio_mixer_init(&s_mixer);
+        for (int i = 0; i < count; i++) {
+            int ch = 1 + (i & 1);
+            audio_mixer_play(&s_mixer, ch == 1 ? s_mono : s_stereo, BENCH_FRAMES, ch, AUDIO_MIXER_UNITY / 2);
+        }
+        uint64_t t0 = cpu_ns();
+        mix(bytes, out_ch, chunk);
+        total += cpu_ns() - t0;
+    }
+    const double chunks = (double)rounds * ((BENCH_FRAMES + chunk - 1) / chunk);
+    return total / chunks;
+}
+
+// Nanoseconds per voice start with every voice busy, the slow (stealing) path
+static double bench_play(int rounds)
+{
+    audio_mixer_init(&s_mixer);
+    for (int i = 0; i < AUDIO_MIXER_VOICES; i++) {
+        audio_mixer_play(&s_mixer, s_mono, BENCH_FRAMES, 1, AUDIO_MIXER_UNITY);
+    }
+    const int starts = rounds * 100;
+    uint64_t t0 = cpu_ns();
+    for (int i = 0; i < starts; i++) {
+        audio_mixer_play(&s_mixer, s_mono, BENCH_FRAMES, 1, AUDIO_MIXER_UNITY);
+    }
+    return (double)(cpu_ns() - t0) / starts;
+}
+
+int main(int argc, char **argv)
+{
+    size_t chunk = 96;
+    int rounds = 20;
+    unsigned seed = 1;
+
+    static const struct option opts[] = {
+        { "chunk", required_argument, NULL, 'c' },
+        { "rounds", required_argument, NULL, 'r' },
+        { "seed", required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'c': chunk = (size_t)atol(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [--chunk FRAMES] [--rounds N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (chunk == 0 || rounds <= 0) {
+        fprintf(stderr, "chunk and rounds must be positive\n");
+        return 1;
+    }
+
+    srand(seed);
+    for (size_t i = 0; i < BENCH_FRAMES; i++) {
+        s_mono[i] = (int16_t)rand32();
+        s_stereo[2 * i] = (int16_t)rand32();
+        s_stereo[2 * i + 1] = (int16_t)rand32();
+    }
+
+    static const int voice_counts[] = { 1, 2, 4, AUDIO_MIXER_VOICES };
+    uint64_t mismatches = 0;
+    printf("{\"chunk\":%zu,\"voices_max\":%d,\"results\":[", chunk, AUDIO_MIXER_VOICES);
+    const char *sep = "";
+    for (int bytes = 2; bytes <= 4; bytes += 2) {
+        for (int out_ch = 1; out_ch <= 2; out_ch++) {
+            for (size_t k = 0; k < sizeof(voice_counts) / sizeof(voice_counts[0]); k++) {
+                const int count = voice_counts[k];
+                uint64_t bad = check(bytes, out_ch, count, chunk);
+                mismatches += bad;
+                printf("%s{\"bytes\":%d,\"channels\":%d,\"voices\":%d,\"ns_per_chunk\":%.0f,\"mismatches\":%llu}",
+                       sep, bytes, out_ch, count, bench(bytes, out_ch, count, chunk, rounds), (unsigned long long)bad);
+                sep = ",";
+            }
+        }
+    }
+    printf("],\"ns_per_steal\":%.1f,\"mismatches\":%llu}\n", bench_play(rounds), (unsigned long long)mismatches);
+    return mismatches ? 1 : 0;
+}
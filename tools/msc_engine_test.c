@@ -0,0 +1,536 @@
+// Host tool: runs the USB mass-storage engine (main/msc_engine.c) and the sector cache
+// (main/flash_cache.c) against a file-backed stand-in for the `storage` partition, with
+// a worker thread in place of msc_io and the main thread calling the engine the way
+// TinyUSB's read10, write10 and SYNCHRONIZE CACHE callbacks do. Reports MB/s for
+// sequential writes and reads, then checks small random writes, read back before and
+// after a sync. Prints one JSON object and exits 1 on a data error, on a flash misuse or
+// if a TinyUSB-side call ever takes long enough to have waited on flash.
+//
+//   cc -O2 -pthread -Imain -o msc_engine_test tools/msc_engine_test.c main/msc_engine.c main/flash_cache.c
+//   ./msc_engine_test [--profile file|nor|all] [--file-kb N] [--nor-kb N] [--random N] [--seed S]
+//
+// The "file" profile runs flat out, which measures the engine and the cache on their
+// own. The "nor" profile paces the USB side at full speed and sleeps in the flash ops for
+// typical SPI NOR erase, program and read times, so its MB/s is what the host sees.
+// Erases must cover whole 4 KB units and programs must hit erased bytes, as on the chip.
+// The partition file must match what the host wrote once SYNCHRONIZE CACHE succeeds, and
+// a read issued during the write-back must not wait for more than about one erase unit.
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "flash_cache.h"
+#include "msc_engine.h"
+
+#define TEST_SECTOR         (512)
+#define TEST_EP_BYTES       (4096)  // CFG_TUD_MSC_EP_BUFSIZE, the most a callback is offered
+#define TEST_CMD_BYTES      (65536) // WRITE10/READ10 size of a sequential copy
+#define TEST_RANDOM_MAX     (16)    // Sectors per random write
+#define TEST_IDLE_MS        (200)   // MSC_CACHE_IDLE_MS
+#define TEST_RETRY_US       (50)    // TinyUSB calls a busy callback again on its next pass
+#define TEST_HOST_RETRY_US  (1000)  // Host delay before repeating a command that was NOT READY
+#define TEST_CALL_LIMIT_US  (10000) // Well below one sector erase; nothing on the USB side may wait for flash
+#define TEST_SLACK_US       (20000) // Host scheduling on top of a modelled flash time
+#define TEST_QUEUE          (8)
+
+typedef struct {
+    const char *name;
+    uint32_t usb_kbps;          // Bulk throughput, 0 for unpaced
+    uint32_t erase_us;          // Per 4 KB unit
+    uint32_t program_us;        // Per 4 KB
+    uint32_t read_us;           // Per 4 KB
+} profile_t;
+
+static const profile_t s_profiles[] = {
+    { "file", 0, 0, 0, 0 },
+    // Full speed USB, and a 104 MHz quad SPI NOR at its typical erase and page program times
+    { "nor", 1000, 45000, 8000, 100 },
+};
+
+typedef struct {
+    int fd;
+    const profile_t *profile;
+    uint32_t erases;            // 4 KB units
+    uint32_t misaligned;        // Erases not on whole units
+    uint32_t overprograms;      // Programs of bytes that weren't erased
+    uint32_t io_errors;
+} partition_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    msc_io_buf_t *queue[TEST_QUEUE];
+    unsigned head, tail;
+    bool stop;
+    msc_engine_t *engine;
+    flash_cache_t *cache;
+    uint64_t read_queued_ns[2];
+    uint64_t read_wait_max_ns;  // Longest a read spent with the worker
+    uint32_t idle_writebacks;
+} worker_t;
+
+typedef struct {
+    msc_engine_t engine;
+    flash_cache_t cache;
+    partition_t part;
+    worker_t worker;
+    size_t bytes;
+    uint8_t *image;             // What the host has written
+    uint64_t call_max_ns;       // Longest engine call on the USB side
+    uint32_t sync_retries;      // SYNCHRONIZE CACHE answered NOT READY
+    uint32_t mismatches;
+    uint32_t scsi_errors;
+} test_t;
+
+static uint64_t wall_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void sleep_us(uint64_t us)
+{
+    if (us == 0) {
+        return;
+    }
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+//--------------------------------------------------------------------+
+// Partition: a temporary file with NOR flash rules
+//--------------------------------------------------------------------+
+static int part_read(void *ctx, size_t addr, void *dst, size_t len)
+{
+    partition_t *p = ctx;
+    sleep_us((uint64_t)p->profile->read_us * len / 4096);
+    if (pread(p->fd, dst, len, addr) != (ssize_t)len) {
+        p->io_errors++;
+        return -1;
+    }
+    return 0;
+}
+
+static int part_erase(void *ctx, size_t addr, size_t len)
+{
+    partition_t *p = ctx;
+    if ((addr | len) % FLASH_CACHE_UNIT_BYTES) {
+        p->misaligned++;
+        return -1;
+    }
+    static uint8_t ff[FLASH_CACHE_UNIT_BYTES];
+    memset(ff, 0xFF, sizeof(ff));
+    for (size_t off = 0; off < len; off += sizeof(ff)) {
+        sleep_us(p->profile->erase_us);
+        if (pwrite(p->fd, ff, sizeof(ff), addr + off) != (ssize_t)sizeof(ff)) {
+            p->io_errors++;
+            return -1;
+        }
+        p->erases++;
+    }
+    return 0;
+}
+
+static int part_write(void *ctx, size_t addr, const void *src, size_t len)
+{
+    partition_t *p = ctx;
+    uint8_t *old = malloc(len);
+    if (old == NULL || pread(p->fd, old, len, addr) != (ssize_t)len) {
+        free(old);
+        p->io_errors++;
+        return -1;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (old[i] != 0xFF) {
+            p->overprograms++;
+            break;
+        }
+    }
+    free(old);
+    sleep_us((uint64_t)p->profile->program_us * len / 4096);
+    if (pwrite(p->fd, src, len, addr) != (ssize_t)len) {
+        p->io_errors++;
+        return -1;
+    }
+    return 0;
+}
+
+//--------------------------------------------------------------------+
+// Worker: msc_io_worker without the application view
+//--------------------------------------------------------------------+
+static void worker_submit(void *ctx, msc_io_buf_t *b)
+{
+    worker_t *w = ctx;
+    pthread_mutex_lock(&w->lock);
+    if (b->op == MSC_IO_READ) {
+        w->read_queued_ns[b == &w->engine->rbuf[1]] = wall_ns();
+    }
+    w->queue[w->head++ % TEST_QUEUE] = b;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// Called with the lock held, released around the flash work
+static void worker_handle(worker_t *w, msc_io_buf_t *b)
+{
+    pthread_mutex_unlock(&w->lock);
+    int err = b->op == MSC_IO_READ ? flash_cache_read(w->cache, b->addr, b->data, b->bytes)
+                                   : flash_cache_write(w->cache, b->addr, b->data, b->bytes);
+    pthread_mutex_lock(&w->lock);
+    if (b->op == MSC_IO_READ) {
+        uint64_t waited = wall_ns() - w->read_queued_ns[b == &w->engine->rbuf[1]];
+        if (waited > w->read_wait_max_ns) {
+            w->read_wait_max_ns = waited;
+        }
+    }
+    msc_engine_done(w->engine, b, err);
+}
+
+// Same scheduling as msc_io_worker: one erase unit per pass of a write-back, reads
+// served between units, writes held back by a flush and ending an idle write-back
+static void *worker_thread(void *arg)
+{
+    worker_t *w = arg;
+    msc_io_buf_t *flush = NULL;
+    bool writeback = false;
+    pthread_mutex_lock(&w->lock);
+    while (!w->stop) {
+        if (writeback) {
+            if (w->head != w->tail) {
+                msc_io_buf_t *b = w->queue[w->tail % TEST_QUEUE];
+                if (b->op == MSC_IO_WRITE && flush == NULL) {
+                    writeback = false;
+                    continue;
+                }
+                if (b->op != MSC_IO_WRITE) {
+                    w->tail++;
+                    if (b->op == MSC_IO_FLUSH) {
+                        flush = b;
+                    } else {
+                        worker_handle(w, b);
+                    }
+                }
+            }
+            pthread_mutex_unlock(&w->lock);
+            int err = flash_cache_flush_unit(w->cache);
+            bool done = err != 0 || !flash_cache_dirty(w->cache);
+            if (done && flush) {
+                flash_cache_invalidate(w->cache);
+                msc_engine_done(w->engine, flush, err);
+                flush = NULL;
+            } else if (done && err != 0) {
+                atomic_store(&w->engine->write_failed, true);
+            }
+            pthread_mutex_lock(&w->lock);
+            writeback = !done;
+            continue;
+        }
+        if (w->head == w->tail) {
+            if (!flash_cache_dirty(w->cache)) {
+                pthread_cond_wait(&w->cond, &w->lock);
+                continue;
+            }
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += TEST_IDLE_MS * 1000000L;
+            until.tv_sec += until.tv_nsec / 1000000000L;
+            until.tv_nsec %= 1000000000L;
+            if (pthread_cond_timedwait(&w->cond, &w->lock, &until) == ETIMEDOUT && w->head == w->tail) {
+                writeback = true;
+                w->idle_writebacks++;
+            }
+            continue;
+        }
+        msc_io_buf_t *b = w->queue[w->tail++ % TEST_QUEUE];
+        if (b->op == MSC_IO_FLUSH) {
+            flush = b;
+            writeback = true;
+        } else {
+            worker_handle(w, b);
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+//--------------------------------------------------------------------+
+// Host and TinyUSB side
+//--------------------------------------------------------------------+
+static void call_done(test_t *t, uint64_t start)
+{
+    uint64_t ns = wall_ns() - start;
+    if (ns > t->call_max_ns) {
+        t->call_max_ns = ns;
+    }
+}
+
+static void usb_transfer(const test_t *t, size_t bytes)
+{
+    if (t->part.profile->usb_kbps) {
+        sleep_us((uint64_t)bytes * 1000 / t->part.profile->usb_kbps);
+    }
+}
+
+// WRITE10: the data stage arrives one endpoint buffer at a time, and TinyUSB offers the
+// rest of a buffer again until the callback has taken all of it
+static void scsi_write(test_t *t, size_t addr, const uint8_t *src, size_t len)
+{
+    for (size_t done = 0; done < len;) {
+        size_t chunk = len - done < TEST_EP_BYTES ? len - done : TEST_EP_BYTES;
+        usb_transfer(t, chunk);
+        for (size_t off = 0; off < chunk;) {
+            uint64_t start = wall_ns();
+            int32_t n = msc_engine_write(&t->engine, addr + done + off, src + done + off, chunk - off);
+            call_done(t, start);
+            if (n < 0) {
+                t->scsi_errors++;
+                return;
+            }
+            if (n == 0) {
+                sleep_us(TEST_RETRY_US);
+            }
+            off += n;
+        }
+        done += chunk;
+    }
+    memcpy(t->image + addr, src, len);
+    uint64_t start = wall_ns();
+    msc_engine_write_complete(&t->engine);
+    call_done(t, start);
+}
+
+static void scsi_read(test_t *t, size_t addr, uint8_t *dst, size_t len)
+{
+    for (size_t done = 0; done < len;) {
+        size_t chunk = len - done < TEST_EP_BYTES ? len - done : TEST_EP_BYTES;
+        for (size_t off = 0; off < chunk;) {
+            uint64_t start = wall_ns();
+            int32_t n = msc_engine_read(&t->engine, addr + done + off, dst + done + off, chunk - off);
+            call_done(t, start);
+            if (n < 0) {
+                t->scsi_errors++;
+                return;
+            }
+            if (n == 0) {
+                sleep_us(TEST_RETRY_US);
+            }
+            off += n;
+        }
+        usb_transfer(t, chunk);
+        done += chunk;
+    }
+    if (memcmp(dst, t->image + addr, len) != 0) {
+        if (t->mismatches < 5) {
+            fprintf(stderr, "%s: read of %zu bytes at 0x%zx differs from what was written\n", t->part.profile->name, len, addr);
+        }
+        t->mismatches++;
+    }
+}
+
+// Repeated, as a host does, for as long as the device answers NOT READY
+static void scsi_sync(test_t *t)
+{
+    while (1) {
+        uint64_t start = wall_ns();
+        bool synced = msc_engine_sync(&t->engine);
+        call_done(t, start);
+        if (synced) {
+            break;
+        }
+        t->sync_retries++;
+        sleep_us(TEST_HOST_RETRY_US);
+    }
+    if (msc_engine_take_write_error(&t->engine)) {
+        t->scsi_errors++;
+    }
+}
+
+// After a sync, the partition itself holds exactly what the host wrote
+static void check_flash(test_t *t)
+{
+    uint8_t *flash = malloc(t->bytes);
+    if (flash == NULL || pread(t->part.fd, flash, t->bytes, 0) != (ssize_t)t->bytes || memcmp(flash, t->image, t->bytes) != 0) {
+        fprintf(stderr, "%s: partition differs from what the host wrote after SYNCHRONIZE CACHE\n", t->part.profile->name);
+        t->mismatches++;
+    }
+    free(flash);
+}
+
+static double mb_per_s(size_t bytes, uint64_t ns)
+{
+    return ns ? bytes / 1e6 / (ns / 1e9) : 0;
+}
+
+static int run_profile(const profile_t *profile, size_t bytes, uint32_t random_writes, unsigned seed)
+{
+    static uint8_t engine_mem[MSC_ENGINE_BUFS][MSC_ENGINE_BUF_BYTES];
+    static uint8_t cache_mem[FLASH_CACHE_UNITS * FLASH_CACHE_UNIT_BYTES];
+    static test_t t;
+    memset(&t, 0, sizeof(t));
+    t.bytes = bytes;
+    t.image = malloc(bytes);
+    uint8_t *data = malloc(bytes);
+    char path[] = "/tmp/msc_engine_test.XXXXXX";
+    t.part.fd = mkstemp(path);
+    t.part.profile = profile;
+    if (t.image == NULL || data == NULL || t.part.fd < 0) {
+        fprintf(stderr, "%s: setup failed\n", profile->name);
+        exit(1);
+    }
+    unlink(path);
+
+    // A fresh chip reads as erased
+    memset(t.image, 0xFF, bytes);
+    if (pwrite(t.part.fd, t.image, bytes, 0) != (ssize_t)bytes) {
+        fprintf(stderr, "%s: can't create the partition file\n", profile->name);
+        exit(1);
+    }
+
+    const flash_cache_ops_t cache_ops = { part_read, part_erase, part_write, &t.part };
+    flash_cache_init(&t.cache, &cache_ops, cache_mem);
+    pthread_mutex_init(&t.worker.lock, NULL);
+    pthread_cond_init(&t.worker.cond, NULL);
+    t.worker.engine = &t.engine;
+    t.worker.cache = &t.cache;
+    const msc_engine_ops_t engine_ops = { worker_submit, &t.worker };
+    uint8_t *const bufs[MSC_ENGINE_BUFS] = { engine_mem[0], engine_mem[1], engine_mem[2], engine_mem[3] };
+    msc_engine_init(&t.engine, &engine_ops, bytes, bufs);
+    pthread_t worker;
+    pthread_create(&worker, NULL, worker_thread, &t.worker);
+
+    // Sequential copy onto the volume, as far as the host is concerned done once it synced
+    for (size_t i = 0; i < bytes; i++) {
+        data[i] = (uint8_t)rand_r(&seed);
+    }
+    uint64_t start = wall_ns();
+    for (size_t addr = 0; addr < bytes; addr += TEST_CMD_BYTES) {
+        scsi_write(&t, addr, data + addr, bytes - addr < TEST_CMD_BYTES ? bytes - addr : TEST_CMD_BYTES);
+    }
+    scsi_sync(&t);
+    uint64_t write_ns = wall_ns() - start;
+    check_flash(&t);
+
+    start = wall_ns();
+    for (size_t addr = 0; addr < bytes; addr += TEST_CMD_BYTES) {
+        scsi_read(&t, addr, data + addr, bytes - addr < TEST_CMD_BYTES ? bytes - addr : TEST_CMD_BYTES);
+    }
+    uint64_t read_ns = wall_ns() - start;
+
+    // FAT and directory updates: a few sectors at a time, read back before they reach flash
+    uint64_t host_before = t.cache.host_bytes, flash_before = t.cache.flash_bytes;
+    for (uint32_t i = 0; i < random_writes; i++) {
+        size_t sectors = 1 + rand_r(&seed) % TEST_RANDOM_MAX;
+        size_t addr = (size_t)(rand_r(&seed) % (bytes / TEST_SECTOR - sectors + 1)) * TEST_SECTOR;
+        size_t len = sectors * TEST_SECTOR;
+        for (size_t k = 0; k < len; k++) {
+            data[k] = (uint8_t)rand_r(&seed);
+        }
+        scsi_write(&t, addr, data, len);
+        if (rand_r(&seed) % 4 == 0) {
+            scsi_read(&t, addr, data, len);
+        }
+        if (rand_r(&seed) % 8 == 0) {
+            // A SYNCHRONIZE CACHE the host doesn't wait out: reads go on during the write-back
+            uint64_t start = wall_ns();
+            msc_engine_sync(&t.engine);
+            call_done(&t, start);
+            addr = (size_t)(rand_r(&seed) % (bytes / TEST_SECTOR - TEST_RANDOM_MAX + 1)) * TEST_SECTOR;
+            scsi_read(&t, addr, data, TEST_RANDOM_MAX * TEST_SECTOR);
+        }
+    }
+    start = wall_ns();
+    scsi_sync(&t);
+    uint64_t sync_ns = wall_ns() - start;
+    check_flash(&t);
+    uint64_t random_host = t.cache.host_bytes - host_before, random_flash = t.cache.flash_bytes - flash_before;
+
+    pthread_mutex_lock(&t.worker.lock);
+    t.worker.stop = true;
+    pthread_cond_signal(&t.worker.cond);
+    pthread_mutex_unlock(&t.worker.lock);
+    pthread_join(worker, NULL);
+    close(t.part.fd);
+    free(data);
+    free(t.image);
+
+    uint32_t call_max_us = (uint32_t)(t.call_max_ns / 1000);
+    uint32_t read_wait_max_us = (uint32_t)(t.worker.read_wait_max_ns / 1000);
+    // A write-back goes out one unit at a time, so a read waits for one unit at most.
+    // Twice that plus scheduling slack still tells it from a whole cache's worth.
+    uint32_t read_wait_limit_us = 2 * (profile->erase_us + profile->program_us + profile->read_us) + TEST_SLACK_US;
+    int failures = (t.mismatches > 0) + (t.scsi_errors > 0) + (t.part.misaligned > 0) + (t.part.overprograms > 0) +
+                   (t.part.io_errors > 0) + (call_max_us > TEST_CALL_LIMIT_US) + (read_wait_max_us > read_wait_limit_us);
+    if (call_max_us > TEST_CALL_LIMIT_US) {
+        fprintf(stderr, "%s: a USB-side call took %u us\n", profile->name, call_max_us);
+    }
+    if (read_wait_max_us > read_wait_limit_us) {
+        fprintf(stderr, "%s: a read waited %u us for the worker\n", profile->name, read_wait_max_us);
+    }
+    printf("{\"profile\":\"%s\",\"bytes\":%zu,\"write_mb_s\":%.3f,\"read_mb_s\":%.3f,"
+           "\"random_writes\":%u,\"random_write_amplification_pct\":%u,\"final_sync_ms\":%.1f,"
+           "\"sync_retries\":%u,\"busy_retries\":%u,\"read_ahead_hits\":%u,\"call_max_us\":%u,\"read_wait_max_us\":%u,"
+           "\"erases\":%u,\"unit_flushes\":%u,\"idle_writebacks\":%u,"
+           "\"mismatches\":%u,\"scsi_errors\":%u,\"misaligned_erases\":%u,\"overprograms\":%u,\"failures\":%d}",
+           profile->name, bytes, mb_per_s(bytes, write_ns), mb_per_s(bytes, read_ns),
+           random_writes, random_host ? (uint32_t)(random_flash * 100 / random_host) : 0, sync_ns / 1e6,
+           t.sync_retries, t.engine.busy_retries, t.engine.read_ahead_hits, call_max_us, read_wait_max_us,
+           t.part.erases, t.cache.unit_flushes, t.worker.idle_writebacks,
+           t.mismatches, t.scsi_errors, t.part.misaligned, t.part.overprograms, failures);
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    const char *which = "all";
+    size_t file_kb = 4096, nor_kb = 256;
+    uint32_t random_writes = 0;
+    unsigned seed = 1;
+    static const struct option opts[] = {
+        { "profile", required_argument, NULL, 'p' },
+        { "file-kb", required_argument, NULL, 'f' },
+        { "nor-kb", required_argument, NULL, 'n' },
+        { "random", required_argument, NULL, 'r' },
+        { "seed", required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'p': which = optarg; break;
+        case 'f': file_kb = strtoul(optarg, NULL, 0); break;
+        case 'n': nor_kb = strtoul(optarg, NULL, 0); break;
+        case 'r': random_writes = strtoul(optarg, NULL, 0); break;
+        case 's': seed = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s [--profile file|nor|all] [--file-kb N] [--nor-kb N] [--random N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    int failures = 0, runs = 0;
+    printf("{\"runs\":[");
+    for (size_t i = 0; i < sizeof(s_profiles) / sizeof(s_profiles[0]); i++) {
+        const profile_t *p = &s_profiles[i];
+        if (strcmp(which, "all") != 0 && strcmp(which, p->name) != 0) {
+            continue;
+        }
+        bool nor = p->erase_us > 0;
+        size_t kb = nor ? nor_kb : file_kb;
+        // Whole erase units, at least two commands' worth
+        kb = kb < 2 * TEST_CMD_BYTES / 1024 ? 2 * TEST_CMD_BYTES / 1024 : kb & ~(size_t)3;
+        printf("%s", runs++ ? "," : "");
+        failures += run_profile(p, kb * 1024, random_writes ? random_writes : (nor ? 64 : 2000), seed);
+    }
+    printf("],\"failures\":%d}\n", failures);
+    return failures || runs == 0 ? 1 : 0;
+}
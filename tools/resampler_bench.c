@@ -0,0 +1,295 @@
+// Host tool: measures the resampler kernel's cost per frame and the THD+N of a sine
+// through it, at fixed ratios and with the fill-tracking loop steering the ratio the way
+// main.c does. Prints one JSON object and exits 1 if any THD+N is above the limit.
+//
+//   cc -O2 -Imain -o resampler_bench tools/resampler_bench.c main/audio_resampler.c -lm
+//   ./resampler_bench [--channels N] [--seconds N] [--tone HZ] [--limit-db DB]
+//
+// With the loop running, the host sends 1 ms packets 0 and +-500 ppm off the codec
+// clock, and the writer takes one I2S DMA buffer of output per period in 2 ms
+// chunks, as audio_writer_task does; the ring is reduced to its fill count. THD+N is
+// taken over the last 2^16 output frames of channel 0 (Blackman-Harris window, 20 Hz to
+// 20 kHz, everything outside the tone's main lobe counts). Ratio changes the loop makes
+// while that window is captured show up as noise, which is the point of measuring it
+// there. The ppm and fill ranges cover the second half of the run, after the loop has
+// settled. Cycles are the host's time-stamp counter, for comparing builds only.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "audio_resampler.h"
+
+#define BENCH_RATE          (48000)
+#define BENCH_CHUNK_FRAMES  (96)        // EXAMPLE_AUDIO_WRITE_CHUNK_MS
+#define BENCH_MARGIN_MS     (5)         // EXAMPLE_AUDIO_RING_MARGIN_MS
+#define BENCH_DMA_FRAME_NUM (1248)      // EXAMPLE_I2S_DMA_FRAME_NUM
+#define BENCH_DMA_BUF_MAX   (4092)      // EXAMPLE_I2S_DMA_BUF_MAX
+#define BENCH_FFT_BITS      (16)
+#define BENCH_FFT_N         (1 << BENCH_FFT_BITS)
+#define BENCH_LOBE_BINS     (5)         // Blackman-Harris main lobe half-width, bins
+
+static const int32_t s_fixed_ppm[] = { 0, 300, -300, 1000, -1000 };
+static const int32_t s_host_ppm[] = { 0, 500, -500 };
+
+typedef struct {
+    int channels;
+    double tone_hz;
+    double amplitude;
+    double phase;               // Of the next input frame, radians
+} tone_t;
+
+static void tone_fill(tone_t *t, int16_t *in, size_t frames)
+{
+    for (size_t i = 0; i < frames; i++) {
+        int16_t v = (int16_t)lrint(t->amplitude * sin(t->phase));
+        for (int ch = 0; ch < t->channels; ch++) {
+            in[i * t->channels + ch] = v;
+        }
+        t->phase = fmod(t->phase + 2 * M_PI * t->tone_hz / BENCH_RATE, 2 * M_PI);
+    }
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void fft(double *re, double *im, int bits)
+{
+    const size_t n = (size_t)1 << bits;
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j |= bit;
+        if (i < j) {
+            double t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+        double a = -2 * M_PI / len;
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t k = 0; k < len / 2; k++) {
+                double wr = cos(a * k), wi = sin(a * k);
+                double xr = re[i + k + len / 2] * wr - im[i + k + len / 2] * wi;
+                double xi = re[i + k + len / 2] * wi + im[i + k + len / 2] * wr;
+                re[i + k + len / 2] = re[i + k] - xr;
+                im[i + k + len / 2] = im[i + k] - xi;
+                re[i + k] += xr;
+                im[i + k] += xi;
+            }
+        }
+    }
+}
+
+// THD+N of channel 0 of the last BENCH_FFT_N frames in `out`, dB relative to the tone
+static double thdn_db(const int16_t *out, int channels)
+{
+    static double re[BENCH_FFT_N], im[BENCH_FFT_N];
+    for (size_t i = 0; i < BENCH_FFT_N; i++) {
+        double x = 2 * M_PI * i / (BENCH_FFT_N - 1);
+        double w = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x) - 0.01168 * cos(3 * x);
+        re[i] = out[i * channels] * w;
+        im[i] = 0;
+    }
+    fft(re, im, BENCH_FFT_BITS);
+
+    const size_t lo = (size_t)(20.0 * BENCH_FFT_N / BENCH_RATE) + 1;
+    const size_t hi = (size_t)(20000.0 * BENCH_FFT_N / BENCH_RATE);
+    size_t peak = lo;
+    for (size_t k = lo; k <= hi; k++) {
+        if (re[k] * re[k] + im[k] * im[k] > re[peak] * re[peak] + im[peak] * im[peak]) {
+            peak = k;
+        }
+    }
+    double tone = 0, rest = 0;
+    for (size_t k = lo; k <= hi; k++) {
+        double p = re[k] * re[k] + im[k] * im[k];
+        if (k + BENCH_LOBE_BINS >= peak && k <= peak + BENCH_LOBE_BINS) {
+            tone += p;
+        } else {
+            rest += p;
+        }
+    }
+    return 10 * log10(rest / tone);
+}
+
+// Resamples at a fixed ratio; returns the THD+N and the kernel cost in `ns`/`cyc` per frame
+static double run_fixed(int channels, double tone_hz, int32_t ppm, double *ns, double *cyc)
+{
+    static audio_rs_t rs;
+    tone_t tone = { channels, tone_hz, 32767 * pow(10, -1 / 20.0), 0 };
+    const size_t total = BENCH_FFT_N + 4 * BENCH_CHUNK_FRAMES;
+    int16_t *out = malloc((total + BENCH_CHUNK_FRAMES) * channels * sizeof(int16_t));
+    int16_t in[BENCH_CHUNK_FRAMES * AUDIO_RS_MAX_CH];
+    audio_rs_init(&rs, channels);
+    audio_rs_set_ppm(&rs, ppm);
+
+    size_t produced = 0;
+    uint64_t t_ns = 0, t_cyc = 0;
+    while (produced < total) {
+        tone_fill(&tone, in, BENCH_CHUNK_FRAMES);
+        uint64_t c0 = cycles(), n0 = now_ns();
+        produced += audio_rs_process(&rs, in, BENCH_CHUNK_FRAMES, out + produced * channels, BENCH_CHUNK_FRAMES + 2);
+        t_ns += now_ns() - n0;
+        t_cyc += cycles() - c0;
+    }
+    *ns = (double)t_ns / produced;
+    *cyc = (double)t_cyc / produced;
+    double db = thdn_db(out + (produced - BENCH_FFT_N) * channels, channels);
+    free(out);
+    return db;
+}
+
+typedef struct {
+    double thdn_db;
+    double ns_per_frame;
+    double cycles_per_frame;
+    int32_t ppm_min, ppm_max, ppm_end;
+    uint32_t underruns;
+    double fill_min, fill_max;
+} tracking_t;
+
+// Runs the loop for `seconds` against a host `host_ppm` off the codec clock
+static tracking_t run_tracking(int channels, double tone_hz, double seconds, int32_t host_ppm)
+{
+    static audio_rs_t rs;
+    tracking_t r = { .ppm_min = INT32_MAX, .ppm_max = INT32_MIN, .fill_min = 1e9 };
+    tone_t tone = { channels, tone_hz, 32767 * pow(10, -1 / 20.0), 0 };
+    audio_rs_init(&rs, channels);
+
+    // i2s_dma_frames_for() and the ring target at the default rate, as audio_stream_setup() does
+    const uint32_t frame_bytes = 2 * channels;
+    uint32_t dma_frames = BENCH_DMA_FRAME_NUM;
+    if (dma_frames > BENCH_DMA_BUF_MAX / frame_bytes) {
+        dma_frames = BENCH_DMA_BUF_MAX / frame_bytes;
+    }
+    const uint32_t target = dma_frames + BENCH_RATE / 1000 * BENCH_MARGIN_MS;
+    const double dma_period_us = dma_frames * 1e6 / BENCH_RATE;
+    const double packet_us = 1000 / (1 + host_ppm * 1e-6);
+
+    const size_t total = (size_t)(seconds * BENCH_RATE);
+    int16_t *out = malloc((total + 2 * dma_frames) * channels * sizeof(int16_t));
+    int16_t in[BENCH_CHUNK_FRAMES * AUDIO_RS_MAX_CH];
+    double fill = 0, next_packet = 0, next_sent = dma_period_us, host_acc = 0;
+    bool primed = false;
+    size_t produced = 0, due = 0;
+    uint64_t t_ns = 0, t_cyc = 0;
+
+    for (double now = 0; produced < total; now = next_packet < next_sent ? next_packet : next_sent) {
+        if (now >= next_packet) {
+            host_acc += BENCH_RATE / 1000.0;
+            fill += (uint32_t)host_acc;
+            host_acc -= (uint32_t)host_acc;
+            next_packet += packet_us;
+            primed |= fill >= target;
+        }
+        if (now < next_sent) {
+            continue;
+        }
+        next_sent += dma_period_us;
+        if (!primed) {
+            continue;
+        }
+        // One DMA buffer freed: the writer refills it chunk by chunk from the ring
+        due += dma_frames;
+        while (produced < due) {
+            uint32_t n = fill < BENCH_CHUNK_FRAMES ? (uint32_t)fill : BENCH_CHUNK_FRAMES;
+            if (n == 0) {
+                r.underruns++;
+                primed = false;
+                due = produced;
+                break;
+            }
+            tone_fill(&tone, in, n);
+            uint64_t c0 = cycles(), n0 = now_ns();
+            int32_t ppm = audio_rs_track_fill(&rs, (uint32_t)now, (uint32_t)fill - n, target);
+            produced += audio_rs_process(&rs, in, n, out + produced * channels, n + 2);
+            t_ns += now_ns() - n0;
+            t_cyc += cycles() - c0;
+            fill -= n;
+            if (now > seconds * 0.5e6) {
+                r.ppm_min = ppm < r.ppm_min ? ppm : r.ppm_min;
+                r.ppm_max = ppm > r.ppm_max ? ppm : r.ppm_max;
+                r.fill_min = fill < r.fill_min ? fill : r.fill_min;
+                r.fill_max = fill > r.fill_max ? fill : r.fill_max;
+            }
+        }
+    }
+    r.ppm_end = rs.ppm;
+    r.ns_per_frame = (double)t_ns / produced;
+    r.cycles_per_frame = (double)t_cyc / produced;
+    r.thdn_db = thdn_db(out + (produced - BENCH_FFT_N) * channels, channels);
+    free(out);
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    int channels = 1;
+    double seconds = 120, tone_hz = 997, limit_db = -70;
+    static const struct option opts[] = {
+        { "channels", required_argument, NULL, 'c' },
+        { "seconds", required_argument, NULL, 's' },
+        { "tone", required_argument, NULL, 't' },
+        { "limit-db", required_argument, NULL, 'l' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'c': channels = atoi(optarg); break;
+        case 's': seconds = atof(optarg); break;
+        case 't': tone_hz = atof(optarg); break;
+        case 'l': limit_db = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [--channels N] [--seconds N] [--tone HZ] [--limit-db DB]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (channels < 1 || channels > AUDIO_RS_MAX_CH || seconds * BENCH_RATE < 2 * BENCH_FFT_N) {
+        fprintf(stderr, "channels must be 1..%d and seconds at least %.1f\n", AUDIO_RS_MAX_CH, 2.0 * BENCH_FFT_N / BENCH_RATE);
+        return 1;
+    }
+
+    int failures = 0;
+    printf("{\n  \"config\": {\"channels\": %d, \"seconds\": %.1f, \"tone_hz\": %.1f, \"limit_db\": %.1f},\n",
+           channels, seconds, tone_hz, limit_db);
+    printf("  \"fixed\": [");
+    for (size_t i = 0; i < sizeof(s_fixed_ppm) / sizeof(s_fixed_ppm[0]); i++) {
+        double ns, cyc;
+        double db = run_fixed(channels, tone_hz, s_fixed_ppm[i], &ns, &cyc);
+        failures += db > limit_db;
+        printf("%s\n    {\"ppm\": %d, \"thdn_db\": %.1f, \"ns_per_frame\": %.1f, \"cycles_per_frame\": %.0f}",
+               i ? "," : "", s_fixed_ppm[i], db, ns, cyc);
+    }
+    printf("\n  ],\n  \"tracking\": [");
+    for (size_t i = 0; i < sizeof(s_host_ppm) / sizeof(s_host_ppm[0]); i++) {
+        tracking_t r = run_tracking(channels, tone_hz, seconds, s_host_ppm[i]);
+        failures += r.thdn_db > limit_db || r.underruns != 0;
+        printf("%s\n    {\"host_ppm\": %d, \"thdn_db\": %.1f, \"ns_per_frame\": %.1f, \"cycles_per_frame\": %.0f, "
+               "\"ppm_end\": %d, \"ppm_min\": %d, \"ppm_max\": %d, \"fill_min\": %.0f, \"fill_max\": %.0f, \"underruns\": %u}",
+               i ? "," : "", s_host_ppm[i], r.thdn_db, r.ns_per_frame, r.cycles_per_frame, r.ppm_end,
+               r.ppm_min, r.ppm_max, r.fill_min, r.fill_max, r.underruns);
+    }
+    printf("\n  ],\n  \"failures\": %d\n}\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+// Host tool: measures what the always-on telemetry (main/telemetry.c) costs the audio
+// and USB paths. Times telemetry_count() and telemetry_record() on log2 and linear
+// histograms, then multiplies by how often the firmware calls them while streaming
+// 48 kHz over full speed with the mass-storage volume busy. Prints one JSON object and
+// exits 1 if that comes to 1% of a core or more.
+//
+//   cc -O2 -Imain -Itools/idf_stub -o telemetry_bench tools/telemetry_bench.c main/telemetry.c
+//   ./telemetry_bench [--rounds N] [--msc-kbs K]
+//
+// Timing is host CPU time. The JSON also gives the cycle budget per call at the
+// ESP32-S3's 240 MHz that keeps the total under 1%: a record is a core-id read, a clz
+// or divide, two relaxed atomic adds and a max compare, a few dozen cycles on the device.
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "telemetry.h"
+
+// Calls per second, from the call sites in main.c and msc_storage.c
+#define BENCH_USB_PACKETS_S (1000)      // One audio OUT packet per full-speed frame
+#define BENCH_TUD_LOOPS_S   (2000)      // tud_task() loops: the packet plus one other event
+#define BENCH_I2S_WRITES_S  (500)       // One per EXAMPLE_AUDIO_WRITE_CHUNK_MS chunk
+#define BENCH_MSC_OP_BYTES  (4096)      // CFG_TUD_MSC_EP_BUFSIZE: one callback and one flash request
+#define BENCH_CPU_HZ        (240000000)
+#define BENCH_VALUES        (4096)
+
+static uint32_t s_values[BENCH_VALUES];
+
+static uint64_t cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// ns per call of one kind, spread over varying values so the buckets and the max
+// change as they do on the device
+static double bench_record(telemetry_hist_t hist, uint32_t rounds)
+{
+    uint64_t t0 = cpu_ns();
+    for (uint32_t i = 0; i < rounds; i++) {
+        telemetry_record(hist, s_values[i % BENCH_VALUES]);
+    }
+    return (double)(cpu_ns() - t0) / rounds;
+}
+
+static double bench_count(uint32_t rounds)
+{
+    uint64_t t0 = cpu_ns();
+    for (uint32_t i = 0; i < rounds; i++) {
+        telemetry_count(TELEM_USB_BYTES, s_values[i % BENCH_VALUES]);
+    }
+    return (double)(cpu_ns() - t0) / rounds;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t rounds = 20000000;
+    uint32_t msc_kbs = 1024;
+    static const struct option opts[] = {
+        { "rounds", required_argument, NULL, 'r' },
+        { "msc-kbs", required_argument, NULL, 'm' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 'r': rounds = strtoul(optarg, NULL, 0); break;
+        case 'm': msc_kbs = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s [--rounds N] [--msc-kbs K]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    unsigned seed = 1;
+    for (int i = 0; i < BENCH_VALUES; i++) {
+        // Mostly around a packet interval, with the odd outlier
+        s_values[i] = rand_r(&seed) % 16 ? 900 + rand_r(&seed) % 200 : rand_r(&seed) % 100000;
+    }
+    telemetry_reset();
+
+    const double log2_ns = bench_record(TELEM_USB_RX_INTERVAL_US, rounds);
+    const double linear_ns = bench_record(TELEM_RING_FILL_PCT, rounds);
+    const double count_ns = bench_count(rounds);
+    const double record_ns = log2_ns > linear_ns ? log2_ns : linear_ns;
+
+    // usb rx: interval and ring fill records, packet and byte counts per packet
+    const uint32_t msc_ops_s = msc_kbs * 1024 / BENCH_MSC_OP_BYTES;
+    const uint32_t records_s = BENCH_TUD_LOOPS_S + 2 * BENCH_USB_PACKETS_S + BENCH_I2S_WRITES_S + msc_ops_s;
+    const uint32_t counts_s = 2 * BENCH_USB_PACKETS_S + msc_ops_s;
+    const double pct = (records_s * record_ns + counts_s * count_ns) / 1e9 * 100;
+    const double budget_cycles = 0.01 * BENCH_CPU_HZ / (records_s + counts_s);
+
+    telemetry_snapshot_t snap;
+    telemetry_snapshot(&snap);
+    const bool pass = pct < 1.0 && snap.hist[TELEM_USB_RX_INTERVAL_US].count == rounds;
+    printf("{\"rounds\": %u, \"record_log2_ns\": %.2f, \"record_linear_ns\": %.2f, \"count_ns\": %.2f, "
+           "\"records_per_s\": %u, \"counts_per_s\": %u, \"msc_kbs\": %u, \"pct_core\": %.4f, "
+           "\"budget_cycles_per_call_240mhz\": %.0f, \"pass\": %s}\n",
+           rounds, log2_ns, linear_ns, count_ns, records_s, counts_s, msc_kbs, pct, budget_cycles,
+           pass ? "true" : "false");
+    return pass ? 0 : 1;
+}
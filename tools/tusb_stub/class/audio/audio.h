@@ -0,0 +1,43 @@
+#pragma once
+// The constants of TinyUSB's class/audio/audio.h that the descriptors use; see tusb.h.
+
+#define AUDIO_FUNCTION_SUBCLASS_UNDEFINED               0x00
+#define AUDIO_FUNC_PROTOCOL_CODE_V2                     0x20
+#define AUDIO_SUBCLASS_CONTROL                          0x01
+#define AUDIO_SUBCLASS_STREAMING                        0x02
+#define AUDIO_INT_PROTOCOL_CODE_V2                      0x20
+
+#define AUDIO_FUNC_DESKTOP_SPEAKER                      0x01
+#define AUDIO_FUNC_HEADSET                              0x04
+
+#define AUDIO_CS_AC_INTERFACE_HEADER                    0x01
+#define AUDIO_CS_AC_INTERFACE_INPUT_TERMINAL            0x02
+#define AUDIO_CS_AC_INTERFACE_OUTPUT_TERMINAL           0x03
+#define AUDIO_CS_AC_INTERFACE_FEATURE_UNIT              0x06
+#define AUDIO_CS_AC_INTERFACE_CLOCK_SOURCE              0x0A
+#define AUDIO_CS_AS_INTERFACE_AS_GENERAL                0x01
+#define AUDIO_CS_AS_INTERFACE_FORMAT_TYPE               0x02
+#define AUDIO_CS_EP_SUBTYPE_GENERAL                     0x01
+
+#define AUDIO_CS_AS_INTERFACE_CTRL_LATENCY_POS          0
+#define AUDIO_CLOCK_SOURCE_ATT_INT_PRO_CLK              0x03
+#define AUDIO_CLOCK_SOURCE_CTRL_CLK_FRQ_POS             0
+#define AUDIO_CLOCK_SOURCE_CTRL_CLK_VAL_POS             2
+#define AUDIO_FEATURE_UNIT_CTRL_MUTE_POS                0
+#define AUDIO_FEATURE_UNIT_CTRL_VOLUME_POS              2
+
+#define AUDIO_CTRL_NONE                                 0x00
+#define AUDIO_CTRL_R                                    0x01
+#define AUDIO_CTRL_RW                                   0x03
+
+#define AUDIO_TERM_TYPE_USB_STREAMING                   0x0101
+#define AUDIO_TERM_TYPE_IN_GENERIC_MIC                  0x0201
+#define AUDIO_TERM_TYPE_OUT_DESKTOP_SPEAKER             0x0302
+#define AUDIO_CHANNEL_CONFIG_NON_PREDEFINED             0x00000000
+
+#define AUDIO_FORMAT_TYPE_I                             0x01
+#define AUDIO_DATA_FORMAT_TYPE_I_PCM                    ((uint32_t)(1 << 0))
+
+#define AUDIO_CS_AS_ISO_DATA_EP_ATT_NON_MAX_PACKETS_OK  0x80
+#define AUDIO_CS_AS_ISO_DATA_EP_LOCK_DELAY_UNIT_UNDEFINED 0x00
+#define AUDIO_CS_AS_ISO_DATA_EP_LOCK_DELAY_UNIT_MILLISEC  0x01
@@ -0,0 +1,10 @@
+#pragma once
+// The Kconfig options main/tusb reads, at their defaults (main/Kconfig.projbuild).
+// Pass -D on the compiler line to check another build.
+
+#ifndef CONFIG_UAC_SPEAKER_CHANNEL_NUM
+#define CONFIG_UAC_SPEAKER_CHANNEL_NUM 1
+#endif
+#ifndef CONFIG_UAC_MIC_CHANNEL_NUM
+#define CONFIG_UAC_MIC_CHANNEL_NUM 0
+#endif
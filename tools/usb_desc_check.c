@@ -0,0 +1,323 @@
+// Host tool: checks the device's USB descriptors and replays host control requests
+// against them, so a descriptor change that would fail SET_CONFIGURATION or
+// SET_INTERFACE on a real host is caught without a board. main/tusb/usb_descriptors.c
+// is compiled in, against the TinyUSB descriptor macros in tools/tusb_stub; -d checks
+// the output of the `usb dump` console command from a device instead. Every profile is
+// checked with the same code the firmware runs at boot (main/usb_desc_check.c), then a
+// request sequence is replayed on it, checking every alternate-setting combination the
+// host selects. Prints one JSON object and exits 1 on any problem.
+//
+//   cc -O2 -Imain -Imain/tusb -Itools/tusb_stub -o usb_desc_check tools/usb_desc_check.c main/usb_desc_check.c main/tusb/usb_descriptors.c
+//   ./usb_desc_check [-r ROUNDS] [-d DUMP] [SEQUENCE]
+//
+// The build checks the default Kconfig; add -DCONFIG_UAC_MIC_CHANNEL_NUM=1 (or 2) and
+// -DCONFIG_UAC_SPEAKER_CHANNEL_NUM=2 to the cc line for the headset and stereo builds.
+//
+// A sequence has one request per line, as recorded from a host (e.g. usbmon), '#' starts
+// a comment:
+//   get device LEN | get config LEN | get string INDEX
+//   set config VALUE | set interface ITF ALT
+// Without one, the Linux enumeration is replayed, followed by every alternate setting of
+// every interface and back to 0. A string request beyond the string table is counted as
+// a stall, which is what TinyUSB answers; hosts probe for such strings (0xEE) on purpose.
+//
+// The limits are the ESP32-S3 OTG controller's, as in main.c. Timing is host CPU time
+// for checking one configuration descriptor, which is what the firmware adds to boot.
+
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "usb_desc_check.h"
+#include "usb_descriptors.h"
+
+#define DUMP_PROFILES_MAX   (8)
+#define DESC_BYTES_MAX      (1024)
+#define EP_NUM_MAX          (6)     // EXAMPLE_USB_EP_NUM_MAX
+#define IN_EP_MAX           (4)     // EXAMPLE_USB_IN_EP_MAX
+
+typedef struct {
+    char name[32];
+    uint8_t desc[DESC_BYTES_MAX];
+    size_t len;
+} dump_config_t;
+
+static uint8_t s_device[DESC_BYTES_MAX];
+static size_t s_device_len;
+static dump_config_t s_configs[DUMP_PROFILES_MAX];
+static int s_config_count;
+static usb_desc_limits_t s_limits = {
+    .ep_num_max = EP_NUM_MAX,
+    .in_ep_max = IN_EP_MAX,
+};
+
+static const char *const s_default_sequence[] = {
+    "get device 64", "get device 18", "get config 9", "get config 255",
+    "get string 0", "get string 2", "get string 1", "get string 3",
+    "set config 1",
+};
+
+typedef struct {
+    const char *profile;
+    int problems;
+    int requests;
+    int stalls;
+    int alt_switches;
+    uint16_t periodic_max;
+} replay_t;
+
+static int s_problems;
+
+static void report(void *ctx, const char *problem)
+{
+    fprintf(stderr, "%s: %s\n", (const char *)ctx, problem);
+}
+
+static size_t parse_hex(char *s, uint8_t *out)
+{
+    size_t n = 0;
+    for (char *tok = strtok(s, " \t\r\n"); tok && n < DESC_BYTES_MAX; tok = strtok(NULL, " \t\r\n")) {
+        out[n++] = (uint8_t)strtoul(tok, NULL, 16);
+    }
+    return n;
+}
+
+static int load_dump(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    static char line[8192];
+    while (fgets(line, sizeof(line), f)) {
+        char name[32];
+        int n = 0;
+        unsigned strings;
+        if (sscanf(line, "strings %u", &strings) == 1) {
+            s_limits.string_count = (uint8_t)strings;
+        } else if (strncmp(line, "device ", 7) == 0) {
+            s_device_len = parse_hex(line + 7, s_device);
+        } else if (sscanf(line, "config %31s %n", name, &n) == 1 && n > 0 && s_config_count < DUMP_PROFILES_MAX) {
+            dump_config_t *c = &s_configs[s_config_count++];
+            strcpy(c->name, name);
+            c->len = parse_hex(line + n, c->desc);
+        }
+    }
+    fclose(f);
+    if (s_device_len < 18 || s_config_count == 0 || s_limits.string_count == 0) {
+        fprintf(stderr, "%s: not a `usb dump` output\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// The descriptors main/tusb/usb_descriptors.c serves, one configuration per profile
+static void load_build(void)
+{
+    usb_descriptors_set_profile(USB_PROFILE_FULL);
+    s_device_len = sizeof(tusb_desc_device_t);
+    memcpy(s_device, usb_descriptors_device(), s_device_len);
+    s_limits.string_count = usb_descriptors_string_count();
+    for (int p = 0; p < USB_PROFILE_COUNT && s_config_count < DUMP_PROFILES_MAX; p++) {
+        const uint8_t *desc = usb_descriptors_config((usb_profile_t)p);
+        dump_config_t *c = &s_configs[s_config_count++];
+        snprintf(c->name, sizeof(c->name), "%s", usb_descriptors_profile_name((usb_profile_t)p));
+        c->len = (size_t)(desc[2] | desc[3] << 8);
+        c->len = c->len < DESC_BYTES_MAX ? c->len : DESC_BYTES_MAX;
+        memcpy(c->desc, desc, c->len);
+    }
+}
+
+static void replay_problem(replay_t *r, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "%s: ", r->profile);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    r->problems++;
+}
+
+// One request against the device state: the current configuration and alt settings
+static void replay_request(replay_t *r, const dump_config_t *c, const usb_desc_layout_t *layout, uint8_t *alts,
+                           bool *configured, const char *req)
+{
+    char what[16];
+    int a = -1, b = -1;
+    int fields = sscanf(req, "%*s %15s %i %i", what, &a, &b);
+    r->requests++;
+    if (strncmp(req, "get ", 4) == 0 && fields >= 2) {
+        if (strcmp(what, "device") == 0) {
+            if (a < 8) {
+                replay_problem(r, "%s: shorter than bMaxPacketSize0", req);
+            }
+        } else if (strcmp(what, "config") == 0) {
+            // A short read must still carry the real wTotalLength for the full read that follows
+            if (a >= 4 && (size_t)(c->desc[2] | (c->desc[3] << 8)) != c->len) {
+                replay_problem(r, "%s: wTotalLength disagrees with the descriptor", req);
+            }
+        } else if (strcmp(what, "string") == 0) {
+            if (a < 0 || a >= s_limits.string_count) {
+                r->stalls++;
+            }
+        } else {
+            replay_problem(r, "unknown request '%s'", req);
+        }
+        return;
+    }
+    if (strncmp(req, "set ", 4) == 0 && fields >= 2) {
+        if (strcmp(what, "config") == 0) {
+            if (a == 0) {
+                *configured = false;
+                return;
+            }
+            if (a != c->desc[5]) {
+                replay_problem(r, "%s: no configuration %d", req, a);
+                return;
+            }
+            *configured = true;
+            memset(alts, 0, USB_DESC_CHECK_ITF_MAX);
+        } else if (strcmp(what, "interface") == 0 && fields == 3) {
+            if (!*configured) {
+                replay_problem(r, "%s: not configured", req);
+                return;
+            }
+            if (a < 0 || a >= layout->itf_count || b < 0 || b >= layout->itf[a].alt_count) {
+                replay_problem(r, "%s: interface %d has no alt %d", req, a, b);
+                return;
+            }
+            alts[a] = (uint8_t)b;
+            r->alt_switches++;
+        } else {
+            replay_problem(r, "unknown request '%s'", req);
+            return;
+        }
+        uint16_t periodic;
+        r->problems += usb_desc_check_alts(layout, alts, &s_limits, &periodic, report, (void *)r->profile);
+        if (periodic > r->periodic_max) {
+            r->periodic_max = periodic;
+        }
+        return;
+    }
+    replay_problem(r, "unknown request '%s'", req);
+}
+
+static replay_t replay(const dump_config_t *c, const usb_desc_layout_t *layout, char **seq, int seq_len)
+{
+    replay_t r = { .profile = c->name };
+    uint8_t alts[USB_DESC_CHECK_ITF_MAX] = {0};
+    bool configured = false;
+    char req[64];
+    if (seq) {
+        for (int i = 0; i < seq_len; i++) {
+            replay_request(&r, c, layout, alts, &configured, seq[i]);
+        }
+        return r;
+    }
+    for (size_t i = 0; i < sizeof(s_default_sequence) / sizeof(s_default_sequence[0]); i++) {
+        replay_request(&r, c, layout, alts, &configured, s_default_sequence[i]);
+    }
+    for (int i = 0; i < layout->itf_count; i++) {
+        for (int a = 1; a <= layout->itf[i].alt_count; a++) {
+            snprintf(req, sizeof(req), "set interface %d %d", i, a % layout->itf[i].alt_count);
+            replay_request(&r, c, layout, alts, &configured, req);
+        }
+    }
+    return r;
+}
+
+static char **load_sequence(const char *path, int *count)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+    char **seq = NULL;
+    char line[128];
+    *count = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = '\0';
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strspn(line, " \t") == strlen(line)) {
+            continue;
+        }
+        seq = realloc(seq, (size_t)(*count + 1) * sizeof(*seq));
+        seq[(*count)++] = strdup(line + strspn(line, " \t"));
+    }
+    fclose(f);
+    return seq;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = 10000;
+    const char *dump = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:d:")) != -1) {
+        if (opt == 'r') {
+            rounds = atoi(optarg);
+        } else if (opt == 'd') {
+            dump = optarg;
+        } else {
+            rounds = 0;
+        }
+    }
+    if (rounds < 1 || argc - optind > 1) {
+        fprintf(stderr, "usage: %s [-r ROUNDS] [-d DUMP] [SEQUENCE]\n", argv[0]);
+        return 2;
+    }
+    if (dump == NULL) {
+        load_build();
+    } else if (load_dump(dump) != 0) {
+        return 2;
+    }
+    int seq_len = 0;
+    char **seq = NULL;
+    if (optind < argc && !(seq = load_sequence(argv[optind], &seq_len))) {
+        return 2;
+    }
+
+    s_problems = usb_desc_check_device(s_device, &s_limits, report, "device");
+    printf("{\"source\": \"%s\", \"speaker_channels\": %d, \"mic_channels\": %d, \"strings\": %u, "
+           "\"device_problems\": %d, \"profiles\": [", dump ? dump : "build", UAC_SPK_CHANNELS, UAC_MIC_CHANNELS,
+           s_limits.string_count, s_problems);
+    for (int i = 0; i < s_config_count; i++) {
+        const dump_config_t *c = &s_configs[i];
+        usb_desc_layout_t layout;
+        int problems = usb_desc_check_config(c->desc, c->len, &s_limits, &layout, report, (void *)c->name);
+
+        double t0 = now_ns();
+        for (int k = 0; k < rounds; k++) {
+            usb_desc_check_config(c->desc, c->len, &s_limits, &layout, NULL, NULL);
+        }
+        double check_ns = (now_ns() - t0) / rounds;
+
+        replay_t r = replay(c, &layout, seq, seq_len);
+        problems += r.problems;
+        s_problems += problems;
+        printf("%s\n  {\"profile\": \"%s\", \"total_len\": %u, \"interfaces\": %u, \"in_eps\": %u, \"out_eps\": %u, "
+               "\"periodic_bytes_max\": %u, \"requests\": %d, \"stalls\": %d, \"alt_switches\": %d, "
+               "\"check_ns\": %.0f, \"problems\": %d}",
+               i ? "," : "", c->name, layout.total_len, layout.itf_count, layout.in_eps, layout.out_eps,
+               layout.periodic_bytes > r.periodic_max ? layout.periodic_bytes : r.periodic_max, r.requests, r.stalls,
+               r.alt_switches, check_ns, problems);
+    }
+    printf("\n], \"problems\": %d}\n", s_problems);
+    return s_problems ? 1 : 0;
+}
@@ -0,0 +1,191 @@
+// Host tool: converts a 16-bit PCM WAV file to IMA-ADPCM for the storage partition,
+// using the codec the firmware plays it with. The result is decoded again to report
+// the SNR and the decoder throughput.
+//
+//   cc -O2 -Imain -o wav2adpcm tools/wav2adpcm.c main/ima_adpcm.c -lm
+//   ./wav2adpcm [-b block_bytes] in.wav out.wav
+//
+// block_bytes defaults to 512 per channel (1017 frames, 21 ms at 48 kHz); the player
+// accepts up to 2048.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "ima_adpcm.h"
+
+typedef struct {
+    uint16_t channels;
+    uint32_t sample_rate;
+    int16_t *samples;           // Interleaved
+    size_t frames;
+} pcm_t;
+
+static uint32_t le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put16(FILE *f, uint16_t v)
+{
+    fputc(v & 0xFF, f);
+    fputc(v >> 8, f);
+}
+
+static void put32(FILE *f, uint32_t v)
+{
+    put16(f, v & 0xFFFF);
+    put16(f, v >> 16);
+}
+
+static int read_pcm(const char *path, pcm_t *pcm)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    uint8_t hdr[12];
+    if (fread(hdr, 1, 12, f) != 12 || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) {
+        fprintf(stderr, "%s: not a WAV file\n", path);
+        fclose(f);
+        return -1;
+    }
+
+    uint16_t bits = 0;
+    uint8_t chunk[8];
+    while (fread(chunk, 1, 8, f) == 8) {
+        uint32_t size = le32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t fmt[16];
+            if (size < 16 || fread(fmt, 1, 16, f) != 16) {
+                break;
+            }
+            uint16_t tag = fmt[0] | fmt[1] << 8;
+            pcm->channels = fmt[2] | fmt[3] << 8;
+            pcm->sample_rate = le32(fmt + 4);
+            bits = fmt[14] | fmt[15] << 8;
+            if ((tag != 1 && tag != 0xFFFE) || bits != 16 || pcm->channels < 1 || pcm->channels > IMA_ADPCM_MAX_CH) {
+                fprintf(stderr, "%s: need 16-bit PCM, mono or stereo\n", path);
+                break;
+            }
+            fseek(f, size - 16 + (size & 1), SEEK_CUR);
+        } else if (memcmp(chunk, "data", 4) == 0 && bits == 16) {
+            pcm->frames = size / (2 * pcm->channels);
+            pcm->samples = malloc(pcm->frames * pcm->channels * sizeof(int16_t));
+            pcm->frames = fread(pcm->samples, 2 * pcm->channels, pcm->frames, f); // Little-endian host
+            fclose(f);
+            return 0;
+        } else {
+            fseek(f, size + (size & 1), SEEK_CUR);
+        }
+    }
+    fprintf(stderr, "%s: no usable fmt/data chunks\n", path);
+    fclose(f);
+    return -1;
+}
+
+int main(int argc, char **argv)
+{
+    size_t block_bytes = 0;
+    int arg = 1;
+    if (argc == 5 && strcmp(argv[1], "-b") == 0) {
+        block_bytes = strtoul(argv[2], NULL, 0);
+        arg = 3;
+    }
+    if (argc - arg != 2) {
+        fprintf(stderr, "usage: %s [-b block_bytes] in.wav out.wav\n", argv[0]);
+        return 2;
+    }
+
+    pcm_t pcm = { 0 };
+    if (read_pcm(argv[arg], &pcm) != 0) {
+        return 1;
+    }
+    const int ch = pcm.channels;
+    if (block_bytes == 0) {
+        block_bytes = 512 * ch;
+    }
+    if (!ima_adpcm_block_valid(block_bytes, ch) || block_bytes > 2048) {
+        fprintf(stderr, "block_bytes must be a multiple of %d, above %d and at most 2048\n", 4 * ch, 4 * ch);
+        return 2;
+    }
+
+    const uint32_t block_frames = ima_adpcm_frames_per_block(block_bytes, ch);
+    const size_t blocks = (pcm.frames + block_frames - 1) / block_frames;
+    uint8_t *adpcm = calloc(blocks ? blocks : 1, block_bytes);
+
+    ima_adpcm_encoder_t enc;
+    ima_adpcm_encoder_init(&enc, ch);
+    for (size_t b = 0; b < blocks; b++) {
+        size_t first = b * block_frames;
+        size_t n = pcm.frames - first < block_frames ? pcm.frames - first : block_frames;
+        ima_adpcm_encode_block(&enc, pcm.samples + first * ch, n, adpcm + b * block_bytes, block_bytes);
+    }
+
+    FILE *out = fopen(argv[arg + 1], "wb");
+    if (!out) {
+        perror(argv[arg + 1]);
+        return 1;
+    }
+    const uint32_t data_bytes = (uint32_t)(blocks * block_bytes);
+    fwrite("RIFF", 1, 4, out);
+    put32(out, 4 + (8 + 20) + (8 + 4) + (8 + data_bytes));
+    fwrite("WAVEfmt ", 1, 8, out);
+    put32(out, 20);
+    put16(out, IMA_ADPCM_FORMAT_TAG);
+    put16(out, ch);
+    put32(out, pcm.sample_rate);
+    put32(out, (uint32_t)((uint64_t)pcm.sample_rate * block_bytes / block_frames));
+    put16(out, block_bytes);
+    put16(out, 4);
+    put16(out, 2);              // cbSize
+    put16(out, block_frames);
+    fwrite("fact", 1, 4, out);
+    put32(out, 4);
+    put32(out, (uint32_t)pcm.frames); // Lets the player drop the padding of the last block
+    fwrite("data", 1, 4, out);
+    put32(out, data_bytes);
+    fwrite(adpcm, 1, data_bytes, out);
+    fclose(out);
+
+    // Decode it back the way the player does, a few frames per call
+    int16_t *decoded = malloc((blocks * block_frames + 1) * ch * sizeof(int16_t));
+    const int passes = 20;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int p = 0; p < passes; p++) {
+        int16_t *o = decoded;
+        for (size_t b = 0; b < blocks; b++) {
+            ima_adpcm_decoder_t dec;
+            ima_adpcm_decoder_start(&dec, adpcm + b * block_bytes, block_bytes, ch);
+            size_t n;
+            while ((n = ima_adpcm_decode(&dec, o, 96)) > 0) {
+                o += n * ch;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    double sig = 0, err = 0;
+    for (size_t i = 0; i < pcm.frames * ch; i++) {
+        double d = (double)pcm.samples[i] - decoded[i];
+        sig += (double)pcm.samples[i] * pcm.samples[i];
+        err += d * d;
+    }
+
+    printf("%zu frames, %d ch, %u Hz -> %zu blocks of %zu bytes (%u frames), %zu -> %u bytes\n",
+           pcm.frames, ch, pcm.sample_rate, blocks, block_bytes, block_frames, pcm.frames * ch * 2, data_bytes);
+    printf("SNR %.1f dB\n", err > 0 ? 10 * log10(sig / err) : INFINITY);
+    if (secs > 0) {
+        double sps = (double)passes * blocks * block_frames * ch / secs;
+        printf("decode %.1f Msamples/s on this host, %.3f%% of a core at %u Hz\n",
+               sps / 1e6, 100.0 * pcm.sample_rate * ch / sps, pcm.sample_rate);
+    }
+    free(decoded);
+    free(adpcm);
+    free(pcm.samples);
+    return 0;
+}
@@ -0,0 +1,442 @@
+// Host tool: plays WAV files through main/wav_stream.c, the reader and writer halves of
+// the player, into a simulated I2S sink and checks the output sample for sample. Files
+// of every container width and channel count are built with the header layouts found
+// in the wild (odd-sized extra chunks, WAVE_FORMAT_EXTENSIBLE, streaming writers' 0 and
+// 0xFFFFFFFF data sizes, trailing partial frames, ADPCM with a fact chunk), played at
+// the stream layouts the writer runs, with the reader keeping up, lagging behind and
+// scheduled at random. Prints one JSON object and exits 1 on any mismatch.
+//
+//   cc -O2 -Imain -o wav_player_test tools/wav_player_test.c main/wav_stream.c main/audio_convert.c main/ima_adpcm.c
+//   ./wav_player_test [--seconds N] [--seed S]
+//
+// The expected output is the file's samples run through audio_convert (checked on its
+// own by convert_bench) and, for ADPCM, decoded block by block with ima_adpcm. The sink
+// pulls one EXAMPLE_AUDIO_WRITE_CHUNK_MS chunk per writer step. Every read must start at
+// a block-aligned offset and none may go past the block the data ends in. Timing is host
+// CPU time per output frame of the long case, for comparing builds only.
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "audio_convert.h"
+#include "ima_adpcm.h"
+#include "wav_stream.h"
+
+#define TEST_RATE           (48000)
+#define TEST_CHUNK_FRAMES   (96)    // EXAMPLE_AUDIO_WRITE_CHUNK_MS at 48 kHz
+#define TEST_LAG_CHUNKS     (40)    // The lagging reader runs once per 80 ms
+#define TEST_ADPCM_BLOCK    (1024)  // Per file, both channels
+
+#define WAV_TAG_PCM         (0x0001)
+#define WAV_TAG_EXTENSIBLE  (0xFFFE)
+
+typedef enum {
+    DATA_EXACT,                 // The data chunk's size is right
+    DATA_ZERO,                  // 0, as a streaming writer leaves it
+    DATA_OPEN,                  // 0xFFFFFFFF
+} data_size_t;
+
+typedef enum {
+    SCHED_EAGER,                // The reader fills every block as soon as it is released
+    SCHED_LAG,                  // Only every TEST_LAG_CHUNKS writer steps
+    SCHED_RANDOM,               // Half the writer steps, at random
+    SCHED_COUNT,
+} sched_t;
+
+static const char *const s_sched_names[] = { "eager", "lag", "random" };
+
+typedef struct {
+    const char *name;
+    uint16_t tag;
+    int channels;
+    int bytes;                  // Container size; ignored for ADPCM
+    uint32_t frames;            // Frames encoded in the file
+    uint32_t extra;             // Size of an extra chunk ahead of the data, 0 for none
+    data_size_t data_size;
+    uint32_t trailing;          // Bytes after the data: a chunk for DATA_EXACT, junk otherwise
+    uint32_t fact_frames;       // ADPCM: frames to play, less than the blocks hold
+    int out_bytes;
+    int out_channels;
+} wav_case_t;
+
+typedef struct {
+    uint8_t *file;
+    size_t len;
+    uint8_t *expect;            // Output layout
+    size_t expect_frames;
+} wav_file_t;
+
+typedef struct {
+    size_t frames;
+    uint32_t underruns;
+    uint32_t mismatches;        // Frames
+    uint32_t misaligned_reads;
+    bool overread;
+    double ns_per_frame;
+} play_result_t;
+
+static bool s_notified;
+
+static uint64_t cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void put16(uint8_t **p, uint16_t v)
+{
+    *(*p)++ = v;
+    *(*p)++ = v >> 8;
+}
+
+static void put32(uint8_t **p, uint32_t v)
+{
+    put16(p, v);
+    put16(p, v >> 16);
+}
+
+static void put_tag(uint8_t **p, const char *tag, uint32_t size)
+{
+    memcpy(*p, tag, 4);
+    *p += 4;
+    put32(p, size);
+}
+
+// Builds the file for `c` and what the sink must receive from it
+static wav_file_t build_file(const wav_case_t *c)
+{
+    const bool adpcm = c->tag == IMA_ADPCM_FORMAT_TAG;
+    const int bytes = adpcm ? 2 : c->bytes;
+    const uint32_t per_block = ima_adpcm_frames_per_block(TEST_ADPCM_BLOCK, c->channels);
+    const size_t blocks = adpcm ? (c->frames + per_block - 1) / per_block : 0;
+    const size_t data_len = adpcm ? blocks * TEST_ADPCM_BLOCK : (size_t)c->frames * bytes * c->channels;
+
+    // The samples as the writer gets them before conversion
+    const size_t pcm_frames = adpcm ? blocks * per_block : c->frames;
+    uint8_t *pcm = malloc(pcm_frames * bytes * c->channels);
+    uint8_t *data = malloc(data_len);
+    if (adpcm) {
+        int16_t *src = malloc(pcm_frames * c->channels * sizeof(int16_t));
+        for (size_t i = 0; i < pcm_frames * c->channels; i++) {
+            src[i] = (int16_t)(rand() % 40000 - 20000);
+        }
+        ima_adpcm_encoder_t enc;
+        ima_adpcm_encoder_init(&enc, c->channels);
+        ima_adpcm_decoder_t dec;
+        for (size_t b = 0; b < blocks; b++) {
+            uint8_t *block = data + b * TEST_ADPCM_BLOCK;
+            ima_adpcm_encode_block(&enc, src + b * per_block * c->channels, per_block, block, TEST_ADPCM_BLOCK);
+            ima_adpcm_decoder_start(&dec, block, TEST_ADPCM_BLOCK, c->channels);
+            ima_adpcm_decode(&dec, (int16_t *)pcm + b * per_block * c->channels, per_block);
+        }
+        free(src);
+    } else {
+        for (size_t i = 0; i < data_len; i++) {
+            data[i] = (uint8_t)rand();
+            pcm[i] = data[i];
+        }
+    }
+
+    wav_file_t f = { 0 };
+    f.file = malloc(data_len + c->extra + c->trailing + 256);
+    uint8_t *p = f.file + 12;
+    const uint32_t fmt_size = c->tag == WAV_TAG_EXTENSIBLE ? 40 : adpcm ? 20 : 16;
+    put_tag(&p, "fmt ", fmt_size);
+    put16(&p, c->tag);
+    put16(&p, c->channels);
+    put32(&p, TEST_RATE);
+    if (adpcm) {
+        put32(&p, (uint32_t)((uint64_t)TEST_RATE * TEST_ADPCM_BLOCK / per_block));
+        put16(&p, TEST_ADPCM_BLOCK);
+        put16(&p, 4);
+        put16(&p, 2);
+        put16(&p, per_block);
+        put_tag(&p, "fact", 4);
+        put32(&p, c->fact_frames ? c->fact_frames : pcm_frames);
+    } else {
+        put32(&p, TEST_RATE * bytes * c->channels);
+        put16(&p, bytes * c->channels);
+        put16(&p, bytes * 8);
+        if (c->tag == WAV_TAG_EXTENSIBLE) {
+            put16(&p, 22);
+            put16(&p, bytes * 8);
+            put32(&p, c->channels == 1 ? 0x4 : 0x3);
+            put16(&p, WAV_TAG_PCM);
+            memcpy(p, "\x00\x00\x00\x00\x10\x00\x80\x00\x00\xAA\x00\x38\x9B\x71", 14);
+            p += 14;
+        }
+    }
+    if (c->extra) {
+        put_tag(&p, "LIST", c->extra);
+        memset(p, 'x', c->extra + (c->extra & 1));
+        p += c->extra + (c->extra & 1);
+    }
+    put_tag(&p, "data", c->data_size == DATA_EXACT ? data_len : c->data_size == DATA_ZERO ? 0 : UINT32_MAX);
+    memcpy(p, data, data_len);
+    p += data_len;
+    if (c->trailing) {
+        if (c->data_size == DATA_EXACT) {
+            put_tag(&p, "junk", c->trailing - 8);
+        }
+        memset(p, 0x7f, c->trailing - (c->data_size == DATA_EXACT ? 8 : 0));
+        p += c->trailing - (c->data_size == DATA_EXACT ? 8 : 0);
+    }
+    f.len = p - f.file;
+    p = f.file;
+    put_tag(&p, "RIFF", f.len - 8);
+    memcpy(p, "WAVE", 4);
+
+    f.expect_frames = adpcm && c->fact_frames ? c->fact_frames : pcm_frames;
+    f.expect = malloc(f.expect_frames * c->out_bytes * c->out_channels + 1);
+    audio_convert_select(bytes, c->channels, c->out_bytes, c->out_channels)(f.expect, pcm, f.expect_frames);
+    free(pcm);
+    free(data);
+    return f;
+}
+
+static int open_bytes(const uint8_t *data, size_t len)
+{
+    char path[] = "/tmp/wav_player_test.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(1);
+    }
+    unlink(path);
+    if (write(fd, data, len) != (ssize_t)len) {
+        perror("write");
+        exit(1);
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+// wav_player's task notification
+static void released(void *ctx)
+{
+    *(bool *)ctx = true;
+}
+
+// The reader task's turn: fill what the writer released. Returns true once the file is done.
+static bool reader_step(wav_stream_t *s, play_result_t *r)
+{
+    if (s->fd < 0) {
+        return true;
+    }
+    s_notified = false;
+    r->misaligned_reads += s->file_pos % WAV_STREAM_BLOCK_BYTES != 0;
+    bool done = wav_stream_fill(s);
+    // Reads stop at the block holding the last data byte
+    const size_t last = (s->format.data_end + WAV_STREAM_BLOCK_BYTES - 1) & ~((size_t)WAV_STREAM_BLOCK_BYTES - 1);
+    r->overread |= s->file_pos > last;
+    return done;
+}
+
+// Plays the open stream to its end the way wav_player_task and the audio writer do:
+// the writer pulls a chunk per step and the track ends when the reader has finished the
+// file and the blocks run dry. `stop_after` > 0 drops the track after that many frames.
+static play_result_t play(wav_stream_t *s, const wav_case_t *c, const wav_file_t *f, sched_t sched, size_t stop_after)
+{
+    static uint8_t out[TEST_CHUNK_FRAMES * 8];
+    const size_t out_frame = (size_t)c->out_bytes * c->out_channels;
+    play_result_t r = { 0 };
+    bool draining = reader_step(s, &r);     // Both blocks are loaded before the writer starts
+    uint64_t t0 = cpu_ns();
+    for (uint32_t step = 0;; step++) {
+        size_t n = wav_stream_read(s, out, TEST_CHUNK_FRAMES, c->out_bytes, c->out_channels);
+        for (size_t i = 0; i < n; i++) {
+            const size_t frame = r.frames + i;
+            r.mismatches += frame >= f->expect_frames ||
+                            memcmp(out + i * out_frame, f->expect + frame * out_frame, out_frame) != 0;
+        }
+        r.frames += n;
+        if (stop_after && r.frames >= stop_after) {
+            wav_stream_release(s);
+            wav_stream_close(s);
+            break;
+        }
+        if (n == 0) {
+            if (draining) {
+                wav_stream_release(s);
+                break;
+            }
+            r.underruns++;
+        }
+
+        bool run = sched == SCHED_EAGER ? s_notified : sched == SCHED_LAG ? step % TEST_LAG_CHUNKS == 0 : rand() & 1;
+        if (run || (n == 0 && sched == SCHED_EAGER)) {
+            draining = reader_step(s, &r);
+        }
+    }
+    const uint64_t ns = cpu_ns() - t0;
+    r.ns_per_frame = r.frames ? (double)ns / r.frames : 0;
+    return r;
+}
+
+static int check(const char *name, sched_t sched, const wav_file_t *f, const play_result_t *r)
+{
+    const char *why = r->frames != f->expect_frames ? "frame count" : r->mismatches ? "samples" :
+                      r->misaligned_reads ? "read alignment" : r->overread ? "read past the data" :
+                      sched == SCHED_EAGER && r->underruns ? "underruns" : NULL;
+    if (why) {
+        fprintf(stderr, "%s, %s reader: %s differs (%zu of %zu frames, %u mismatches, %u underruns)\n", name,
+                s_sched_names[sched], why, r->frames, f->expect_frames, r->mismatches, r->underruns);
+        return 1;
+    }
+    return 0;
+}
+
+typedef struct {
+    const char *name;
+    const uint8_t *data;
+    size_t len;
+    wav_stream_err_t expect;
+} reject_case_t;
+
+static const uint8_t s_rifx[] = "RIFX\x24\0\0\0WAVEfmt \x10\0\0\0\x01\0\x02\0\x80\xbb\0\0\0\xee\x02\0\x04\0\x10\0data\0\0\0\0";
+static const uint8_t s_8bit[] = "RIFF\x24\0\0\0WAVEfmt \x10\0\0\0\x01\0\x01\0\x80\xbb\0\0\x80\xbb\0\0\x01\0\x08\0data\0\0\0\0";
+static const uint8_t s_3ch[] = "RIFF\x24\0\0\0WAVEfmt \x10\0\0\0\x01\0\x03\0\x80\xbb\0\0\0\x65\x04\0\x06\0\x10\0data\0\0\0\0";
+static const uint8_t s_float[] = "RIFF\x24\0\0\0WAVEfmt \x10\0\0\0\x03\0\x02\0\x80\xbb\0\0\0\xdc\x05\0\x08\0\x20\0data\0\0\0\0";
+static const uint8_t s_adpcm_odd[] = "RIFF\x28\0\0\0WAVEfmt \x14\0\0\0\x11\0\x02\0\x80\xbb\0\0\0\0\0\0\x64\0\x04\0\x02\0\x5d\0data\0\0\0\0";
+static const uint8_t s_data_first[] = "RIFF\x24\0\0\0WAVEdata\0\0\0\0fmt \x10\0\0\0\x01\0\x02\0\x80\xbb\0\0\0\xee\x02\0\x04\0\x10\0";
+static const uint8_t s_no_data[] = "RIFF\x1c\0\0\0WAVEfmt \x10\0\0\0\x01\0\x02\0\x80\xbb\0\0\0\xee\x02\0\x04\0\x10\0";
+static const uint8_t s_short_fmt[] = "RIFF\x14\0\0\0WAVEfmt \x10\0\0\0\x01\0\x02\0";
+
+int main(int argc, char **argv)
+{
+    int seconds = 10;
+    unsigned seed = 1;
+    static const struct option opts[] = {
+        { "seconds", required_argument, NULL, 't' },
+        { "seed", required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1) {
+        switch (opt) {
+        case 't': seconds = atoi(optarg); break;
+        case 's': seed = (unsigned)atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [--seconds N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (seconds <= 0) {
+        fprintf(stderr, "seconds must be positive\n");
+        return 1;
+    }
+    srand(seed);
+
+    // Header before the data: 12 RIFF + 24 fmt + 8 data, plus 8 + `extra` for a LIST chunk
+    const wav_case_t cases[] = {
+        { "s16_stereo", WAV_TAG_PCM, 2, 2, 48000, 0, DATA_EXACT, 0, 0, 2, 2 },
+        { "s16_mono_to_stereo", WAV_TAG_PCM, 1, 2, 30011, 0, DATA_EXACT, 0, 0, 2, 2 },
+        { "s16_stereo_to_mono", WAV_TAG_PCM, 2, 2, 30011, 0, DATA_EXACT, 0, 0, 2, 1 },
+        // 3- and 6-byte frames straddle every block boundary
+        { "s24_mono_to_s32", WAV_TAG_PCM, 1, 3, 40009, 0, DATA_EXACT, 0, 0, 4, 1 },
+        { "s24_stereo_to_s32", WAV_TAG_PCM, 2, 3, 40009, 4097, DATA_EXACT, 0, 0, 4, 2 },
+        { "s32_stereo_to_s16_mono", WAV_TAG_PCM, 2, 4, 25013, 0, DATA_EXACT, 0, 0, 2, 1 },
+        { "extensible_s24", WAV_TAG_EXTENSIBLE, 2, 3, 20011, 0, DATA_EXACT, 0, 0, 4, 2 },
+        // The data starts exactly on the second block
+        { "data_block_aligned", WAV_TAG_PCM, 2, 2, 10007, 4096 - 52, DATA_EXACT, 0, 0, 2, 2 },
+        { "odd_list_chunk", WAV_TAG_PCM, 2, 2, 10007, 37, DATA_EXACT, 0, 0, 2, 2 },
+        { "trailing_chunk", WAV_TAG_PCM, 2, 2, 10007, 0, DATA_EXACT, 5000, 0, 2, 2 },
+        { "size_zero_partial_frame", WAV_TAG_PCM, 2, 3, 10007, 0, DATA_ZERO, 5, 0, 4, 2 },
+        { "size_open", WAV_TAG_PCM, 1, 2, 10007, 0, DATA_OPEN, 1, 0, 2, 1 },
+        { "shorter_than_chunk", WAV_TAG_PCM, 2, 2, 50, 0, DATA_EXACT, 0, 0, 2, 2 },
+        { "one_block", WAV_TAG_PCM, 2, 2, (4096 - 44) / 4, 0, DATA_EXACT, 0, 0, 2, 2 },
+        { "empty", WAV_TAG_PCM, 2, 2, 0, 0, DATA_EXACT, 0, 0, 2, 2 },
+        { "adpcm_stereo", IMA_ADPCM_FORMAT_TAG, 2, 0, 30000, 0, DATA_EXACT, 0, 0, 2, 2 },
+        { "adpcm_mono_fact", IMA_ADPCM_FORMAT_TAG, 1, 0, 30000, 0, DATA_EXACT, 0, 29000, 4, 2 },
+        { "long_s16_stereo", WAV_TAG_PCM, 2, 2, 0, 0, DATA_EXACT, 0, 0, 2, 2 },
+    };
+    const size_t case_count = sizeof(cases) / sizeof(cases[0]);
+
+    static uint8_t block0[WAV_STREAM_BLOCK_BYTES], block1[WAV_STREAM_BLOCK_BYTES];
+    static wav_stream_t s;
+    wav_stream_init(&s, block0, block1, released, &s_notified);
+
+    int failures = 0;
+    double long_ns_per_frame = 0;
+    printf("{\"chunk\":%d,\"block\":%d,\"cases\":[", TEST_CHUNK_FRAMES, WAV_STREAM_BLOCK_BYTES);
+    for (size_t i = 0; i < case_count; i++) {
+        wav_case_t c = cases[i];
+        if (i == case_count - 1) {
+            c.frames = (uint32_t)seconds * TEST_RATE;
+        }
+        wav_file_t f = build_file(&c);
+        printf("%s{\"name\":\"%s\",\"frames\":%zu,\"runs\":[", i ? "," : "", c.name, f.expect_frames);
+        for (sched_t sched = SCHED_EAGER; sched < SCHED_COUNT; sched++) {
+            wav_stream_err_t err = wav_stream_open(&s, open_bytes(f.file, f.len));
+            play_result_t r = { 0 };
+            if (err != WAV_STREAM_OK) {
+                fprintf(stderr, "%s: open failed (%d)\n", c.name, err);
+                failures++;
+            } else {
+                r = play(&s, &c, &f, sched, 0);
+                failures += check(c.name, sched, &f, &r);
+            }
+            if (sched == SCHED_EAGER && i == case_count - 1) {
+                long_ns_per_frame = r.ns_per_frame;
+            }
+            printf("%s{\"reader\":\"%s\",\"underruns\":%u,\"mismatches\":%u}", sched ? "," : "",
+                   s_sched_names[sched], r.underruns, r.mismatches);
+        }
+        printf("]}");
+        free(f.file);
+        free(f.expect);
+    }
+
+    // A track dropped mid-block leaves nothing behind for the next one
+    {
+        const wav_case_t a = cases[4], b = cases[0];
+        wav_file_t fa = build_file(&a), fb = build_file(&b);
+        play_result_t ra = { 0 }, rb = { 0 };
+        bool ok = wav_stream_open(&s, open_bytes(fa.file, fa.len)) == WAV_STREAM_OK;
+        if (ok) {
+            ra = play(&s, &a, &fa, SCHED_RANDOM, 3000);
+            ok = s.fd < 0 && wav_stream_open(&s, open_bytes(fb.file, fb.len)) == WAV_STREAM_OK;
+        }
+        if (ok) {
+            rb = play(&s, &b, &fb, SCHED_RANDOM, 0);
+        }
+        int bad = !ok || ra.mismatches || check("stop_restart", SCHED_RANDOM, &fb, &rb);
+        failures += bad;
+        printf(",{\"name\":\"stop_restart\",\"frames\":%zu,\"failures\":%d}", rb.frames, bad);
+        free(fa.file);
+        free(fa.expect);
+        free(fb.file);
+        free(fb.expect);
+    }
+
+    const reject_case_t rejects[] = {
+        { "not_riff", s_rifx, sizeof(s_rifx) - 1, WAV_STREAM_ERR_FORMAT },
+        { "pcm_8bit", s_8bit, sizeof(s_8bit) - 1, WAV_STREAM_ERR_UNSUPPORTED },
+        { "three_channels", s_3ch, sizeof(s_3ch) - 1, WAV_STREAM_ERR_UNSUPPORTED },
+        { "float", s_float, sizeof(s_float) - 1, WAV_STREAM_ERR_UNSUPPORTED },
+        { "adpcm_bad_block", s_adpcm_odd, sizeof(s_adpcm_odd) - 1, WAV_STREAM_ERR_UNSUPPORTED },
+        { "data_before_fmt", s_data_first, sizeof(s_data_first) - 1, WAV_STREAM_ERR_FORMAT },
+        { "no_data", s_no_data, sizeof(s_no_data) - 1, WAV_STREAM_ERR_FORMAT },
+        { "short_fmt", s_short_fmt, sizeof(s_short_fmt) - 1, WAV_STREAM_ERR_FORMAT },
+    };
+    printf("],\"rejects\":[");
+    for (size_t i = 0; i < sizeof(rejects) / sizeof(rejects[0]); i++) {
+        int fd = open_bytes(rejects[i].data, rejects[i].len);
+        wav_stream_err_t err = wav_stream_open(&s, fd);
+        close(fd);
+        int bad = err != rejects[i].expect || s.fd >= 0;
+        if (bad) {
+            fprintf(stderr, "%s: open returned %d, expected %d\n", rejects[i].name, err, rejects[i].expect);
+        }
+        failures += bad;
+        printf("%s{\"name\":\"%s\",\"error\":%d,\"failures\":%d}", i ? "," : "", rejects[i].name, err, bad);
+    }
+    printf("],\"ns_per_frame\":%.1f,\"failures\":%d}\n", long_ns_per_frame, failures);
+    return failures ? 1 : 0;
+}